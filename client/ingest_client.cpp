@@ -0,0 +1,163 @@
+//
+//  ingest_client.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "ingest_client.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace pushy
+{
+    namespace
+    {
+        const std::size_t initial_buffer = 16 * 1024;
+    }
+    
+    ingest_client::ingest_client(const std::string& host, const std::string& port)
+    : in_(initial_buffer)
+    , in_size_(0)
+    {
+        io::ip::tcp::resolver resolver(io_);
+        
+        tcp_socket_.reset(new io::ip::tcp::socket(io_));
+        io::connect(*tcp_socket_, resolver.resolve(io::ip::tcp::resolver::query(host, port)));
+        tcp_socket_->set_option(io::ip::tcp::no_delay(true));
+    }
+    
+    ingest_client::ingest_client(const std::string& unix_path)
+    : in_(initial_buffer)
+    , in_size_(0)
+    {
+        local_socket_.reset(new io::local::stream_protocol::socket(io_));
+        local_socket_->connect(io::local::stream_protocol::endpoint(unix_path));
+    }
+    
+    ingest::ack_frame ingest_client::send(const ingest::send_frame& frame)
+    {
+        out_.clear();
+        ingest::encode(frame, out_);
+        write(out_);
+        
+        ingest::ack_frame ack;
+        read_ack(ack);
+        
+        if(ack.id != frame.id)
+        {
+            throw std::runtime_error("ingest ack does not match the frame sent");
+        }
+        
+        return ack;
+    }
+    
+    void ingest_client::send(const std::vector<ingest::send_frame>& frames,
+                             std::vector<ingest::ack_frame>& acks,
+                             std::size_t window)
+    {
+        acks.clear();
+        acks.resize(frames.size());
+        
+        window = std::max<std::size_t>(window, 1);
+        
+        for(std::size_t first = 0; first < frames.size(); first += window)
+        {
+            std::size_t last = std::min(first + window, frames.size());
+            
+            out_.clear();
+            
+            for(std::size_t i = first; i < last; ++i)
+            {
+                ingest::encode(frames[i], out_);
+            }
+            
+            write(out_);
+            
+            for(std::size_t i = first; i < last; ++i)
+            {
+                read_ack(acks[i]);
+                
+                if(acks[i].id != frames[i].id)
+                {
+                    throw std::runtime_error("ingest ack does not match the frame sent");
+                }
+            }
+        }
+    }
+    
+    void ingest_client::close()
+    {
+        boost::system::error_code ignored;
+        
+        if(tcp_socket_)
+        {
+            tcp_socket_->close(ignored);
+        }
+        
+        if(local_socket_)
+        {
+            local_socket_->close(ignored);
+        }
+    }
+    
+    void ingest_client::write(const std::string& data)
+    {
+        if(tcp_socket_)
+        {
+            io::write(*tcp_socket_, io::buffer(data));
+        }
+        else
+        {
+            io::write(*local_socket_, io::buffer(data));
+        }
+    }
+    
+    std::size_t ingest_client::read_some(char* data, std::size_t size)
+    {
+        if(tcp_socket_)
+        {
+            return tcp_socket_->read_some(io::buffer(data, size));
+        }
+        
+        return local_socket_->read_some(io::buffer(data, size));
+    }
+    
+    void ingest_client::read_ack(ingest::ack_frame& ack)
+    {
+        for(;;)
+        {
+            std::size_t size = in_size_;
+            auto res = ingest::decode(in_.data(), size, ack);
+            
+            if(res == ingest::decoded)
+            {
+                // acks read ahead stay for the next call
+                std::memmove(&in_[0], &in_[size], in_size_ - size);
+                in_size_ -= size;
+                
+                return;
+            }
+            
+            if(res == ingest::malformed)
+            {
+                throw std::runtime_error("malformed ingest ack");
+            }
+            
+            if(size > in_.size())
+            {
+                in_.resize(size);
+            }
+            
+            if(in_size_ == in_.size())
+            {
+                in_.resize(in_.size() * 2);
+            }
+            
+            in_size_ += read_some(&in_[in_size_], in_.size() - in_size_);
+        }
+    }
+}
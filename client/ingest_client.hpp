@@ -0,0 +1,66 @@
+//
+//  ingest_client.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__ingest_client__
+#define __pushy__ingest_client__
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "ingest_protocol.hpp"
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * Blocking client of pushy's binary ingest listener for internal producers.
+     * Not thread safe; use one client per producer thread.
+     */
+    class ingest_client
+    {
+    public:
+        /// connects over tcp
+        ingest_client(const std::string& host, const std::string& port);
+        
+        /// connects to a unix domain socket
+        explicit ingest_client(const std::string& unix_path);
+        
+        /// sends one message and waits for its ack
+        ingest::ack_frame send(const ingest::send_frame& frame);
+        
+        /**
+         * Sends the frames pipelined, up to window of them before reading acks.
+         * acks receives one ack per frame in the same order. The window keeps the
+         * unread acks small enough for the socket buffers of both sides.
+         */
+        void send(const std::vector<ingest::send_frame>& frames,
+                  std::vector<ingest::ack_frame>& acks,
+                  std::size_t window = 512);
+        
+        void close();
+    
+    private:
+        void write(const std::string& data);
+        std::size_t read_some(char* data, std::size_t size);
+        
+        void read_ack(ingest::ack_frame& ack);
+        
+        io::io_service                                          io_;
+        boost::scoped_ptr<io::ip::tcp::socket>                  tcp_socket_;
+        boost::scoped_ptr<io::local::stream_protocol::socket>   local_socket_;
+        
+        std::string         out_;
+        std::vector<char>   in_;
+        std::size_t         in_size_;
+    };
+}
+
+#endif /* defined(__pushy__ingest_client__) */
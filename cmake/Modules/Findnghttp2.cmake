@@ -0,0 +1,26 @@
+#
+# This module is designed to find/handle the nghttp2 library
+#
+# The following variables will be defined for your use:
+#   - NGHTTP2_FOUND         : true if nghttp2 was found
+#   - NGHTTP2_INCLUDE_DIRS  : nghttp2 include directory
+#   - NGHTTP2_LIBRARIES     : nghttp2 libraries
+#
+
+find_path(
+    NGHTTP2_INCLUDE_DIRS
+    NAMES nghttp2/nghttp2.h
+)
+
+find_library(
+    NGHTTP2_LIBRARIES
+    NAMES nghttp2
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(nghttp2 DEFAULT_MSG NGHTTP2_LIBRARIES NGHTTP2_INCLUDE_DIRS)
+
+mark_as_advanced(
+    NGHTTP2_INCLUDE_DIRS
+    NGHTTP2_LIBRARIES
+)
@@ -15,6 +15,7 @@
 #define BOOST_NETWORK_PROTOCOL_HTTP_IMPL_RESPONSE_RESPONSE_IPP
 
 #include <boost/asio/buffer.hpp>
+#include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/network/protocol/http/tags.hpp>
 #include <boost/network/traits/string.hpp>
@@ -93,6 +94,12 @@ namespace boost { namespace network { namespace http {
         typedef string<tags::http_server>::type string_type;
         string_type content;
 
+        /// When set the body is produced piece by piece after the headers went
+        /// out, and sent with chunked transfer encoding instead of content.
+        /// Each call fills the next piece; false is returned with the last one.
+        typedef boost::function<bool (string_type &)> body_generator_type;
+        body_generator_type body_generator;
+
         /// Convert the reply into a vector of buffers. The buffers do not own the
         /// underlying memory blocks, therefore the reply object must remain valid and
         /// not be changed until the write operation has completed.
@@ -139,6 +146,7 @@ namespace boost { namespace network { namespace http {
             using std::swap;
             swap(headers, r.headers);
             swap(content, r.content);
+            swap(body_generator, r.body_generator);
         }
 
         private:
@@ -225,6 +233,11 @@ namespace boost { namespace network { namespace http {
               "<head><title>Bad Gateway</title></head>"
               "<body><h1>502 Bad Gateway</h1></body>"
               "</html>";
+            static const char too_many_requests[] =
+              "<html>"
+              "<head><title>Too Many Requests</title></head>"
+              "<body><h1>429 Too Many Requests</h1></body>"
+              "</html>";
             static const char service_unavailable[] =
               "<html>"
               "<head><title>Service Unavailable</title></head>"
@@ -288,6 +301,8 @@ namespace boost { namespace network { namespace http {
                 return not_implemented;
               case basic_response<tags::http_server>::bad_gateway:
                 return bad_gateway;
+              case basic_response<tags::http_server>::too_many_requests:
+                return too_many_requests;
               case basic_response<tags::http_server>::service_unavailable:
                 return service_unavailable;
               case basic_response<tags::http_server>::space_unavailable:
@@ -308,43 +323,45 @@ namespace boost { namespace network { namespace http {
         boost::asio::const_buffer to_buffer(status_type status) {
             using boost::asio::buffer;
             static const string_type ok =
-              "HTTP/1.0 200 OK\r\n";
+              "HTTP/1.1 200 OK\r\n";
             static const string_type created =
-              "HTTP/1.0 201 Created\r\n";
+              "HTTP/1.1 201 Created\r\n";
             static const string_type accepted =
-              "HTTP/1.0 202 Accepted\r\n";
+              "HTTP/1.1 202 Accepted\r\n";
             static const string_type no_content =
-              "HTTP/1.0 204 No Content\r\n";
+              "HTTP/1.1 204 No Content\r\n";
             static const string_type multiple_choices =
-              "HTTP/1.0 300 Multiple Choices\r\n";
+              "HTTP/1.1 300 Multiple Choices\r\n";
             static const string_type moved_permanently =
-              "HTTP/1.0 301 Moved Permanently\r\n";
+              "HTTP/1.1 301 Moved Permanently\r\n";
             static const string_type moved_temporarily =
-              "HTTP/1.0 302 Moved Temporarily\r\n";
+              "HTTP/1.1 302 Moved Temporarily\r\n";
             static const string_type not_modified =
-              "HTTP/1.0 304 Not Modified\r\n";
+              "HTTP/1.1 304 Not Modified\r\n";
             static const string_type bad_request =
-              "HTTP/1.0 400 Bad Request\r\n";
+              "HTTP/1.1 400 Bad Request\r\n";
             static const string_type unauthorized =
-              "HTTP/1.0 401 Unauthorized\r\n";
+              "HTTP/1.1 401 Unauthorized\r\n";
             static const string_type forbidden =
-              "HTTP/1.0 403 Forbidden\r\n";
+              "HTTP/1.1 403 Forbidden\r\n";
             static const string_type not_found =
-              "HTTP/1.0 404 Not Found\r\n";
+              "HTTP/1.1 404 Not Found\r\n";
             static const string_type not_supported =
-              "HTTP/1.0 405 Method Not Supported\r\n";
+              "HTTP/1.1 405 Method Not Supported\r\n";
             static const string_type not_acceptable =
-              "HTTP/1.0 406 Method Not Acceptable\r\n";
+              "HTTP/1.1 406 Method Not Acceptable\r\n";
             static const string_type internal_server_error =
-              "HTTP/1.0 500 Internal Server Error\r\n";
+              "HTTP/1.1 500 Internal Server Error\r\n";
             static const string_type not_implemented =
-              "HTTP/1.0 501 Not Implemented\r\n";
+              "HTTP/1.1 501 Not Implemented\r\n";
             static const string_type bad_gateway =
-              "HTTP/1.0 502 Bad Gateway\r\n";
+              "HTTP/1.1 502 Bad Gateway\r\n";
+            static const string_type too_many_requests =
+              "HTTP/1.1 429 Too Many Requests\r\n";
             static const string_type service_unavailable =
-              "HTTP/1.0 503 Service Unavailable\r\n";
+              "HTTP/1.1 503 Service Unavailable\r\n";
             static const string_type space_unavailable =
-              "HTTP/1.0 507 Insufficient Space to Store Resource\r\n";
+              "HTTP/1.1 507 Insufficient Space to Store Resource\r\n";
             static const string_type partial_content =
               "HTTP/1.1 206 Partial Content\r\n";
             static const string_type request_timeout =
@@ -389,6 +406,8 @@ namespace boost { namespace network { namespace http {
                     return buffer(not_implemented);
                 case basic_response<tags::http_server>::bad_gateway:
                     return buffer(bad_gateway);
+                case basic_response<tags::http_server>::too_many_requests:
+                    return buffer(too_many_requests);
                 case basic_response<tags::http_server>::service_unavailable:
                     return buffer(service_unavailable);
                 case basic_response<tags::http_server>::space_unavailable:
@@ -76,6 +76,7 @@ namespace boost { namespace network { namespace http {
             , request_timeout = 408
             , precondition_failed = 412
             , unsatisfiable_range = 416
+            , too_many_requests = 429
             , internal_server_error = 500
             , not_implemented = 501
             , bad_gateway = 502
@@ -107,6 +108,7 @@ namespace boost { namespace network { namespace http {
                 , internal_server_error_[]  = "Internal Server Error"
                 , not_implemented_[]        = "Not Implemented"
                 , bad_gateway_[]            = "Bad Gateway"
+                , too_many_requests_[]      = "Too Many Requests"
                 , service_unavailable_[]    = "Service Unavailable"
                 , unknown_[]                = "Unknown"
                 , partial_content_[]        = "Partial Content"
@@ -133,6 +135,7 @@ namespace boost { namespace network { namespace http {
                 case internal_server_error: return internal_server_error_;
                 case not_implemented:       return not_implemented_;
                 case bad_gateway:           return bad_gateway_;
+                case too_many_requests:     return too_many_requests_;
                 case service_unavailable:   return service_unavailable_;
                 case partial_content:       return partial_content_;
                 case request_timeout:       return request_timeout_;
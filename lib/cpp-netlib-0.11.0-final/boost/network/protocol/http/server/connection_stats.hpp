@@ -0,0 +1,36 @@
+#ifndef BOOST_NETWORK_PROTOCOL_HTTP_SERVER_CONNECTION_STATS_20261019
+#define BOOST_NETWORK_PROTOCOL_HTTP_SERVER_CONNECTION_STATS_20261019
+
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+namespace boost { namespace network { namespace http {
+
+// Connection reuse counters of the sync server, updated by every connection.
+struct connection_stats {
+  connection_stats()
+  : accepted(0)
+  , open(0)
+  , requests(0)
+  , reused(0)
+  , pipelined(0)
+  , idle_timeouts(0)
+  {}
+
+  boost::atomic<boost::uint64_t> accepted;      // connections accepted
+  boost::atomic<boost::uint64_t> open;          // connections open right now
+  boost::atomic<boost::uint64_t> requests;      // requests answered
+  boost::atomic<boost::uint64_t> reused;        // requests answered on a connection after its first
+  boost::atomic<boost::uint64_t> pipelined;     // requests already received when the one before was answered
+  boost::atomic<boost::uint64_t> idle_timeouts; // kept alive connections closed for idling
+};
+
+} /* http */
+} /* network */
+} /* boost */
+
+#endif /* BOOST_NETWORK_PROTOCOL_HTTP_SERVER_CONNECTION_STATS_20261019 */
@@ -11,6 +11,7 @@
 #include <boost/asio/socket_base.hpp>
 #include <boost/network/traits/string.hpp>
 #include <boost/network/utils/thread_pool.hpp>
+#include <boost/network/protocol/http/server/connection_stats.hpp>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -35,6 +36,9 @@ struct server_options {
   , receive_low_watermark_()
   , send_low_watermark_()
   , thread_pool_()
+  , keep_alive_timeout_(0)
+  , max_keep_alive_requests_(0)
+  , connection_stats_()
   {}
 
   server_options(const server_options &other)
@@ -52,6 +56,9 @@ struct server_options {
   , receive_low_watermark_(other.receive_low_watermark_)
   , send_low_watermark_(other.send_low_watermark_)
   , thread_pool_(other.thread_pool_)
+  , keep_alive_timeout_(other.keep_alive_timeout_)
+  , max_keep_alive_requests_(other.max_keep_alive_requests_)
+  , connection_stats_(other.connection_stats_)
   {}
 
   server_options &operator= (server_options other) {
@@ -74,6 +81,9 @@ struct server_options {
     swap(receive_low_watermark_, other.receive_low_watermark_);
     swap(send_low_watermark_, other.send_low_watermark_);
     swap(thread_pool_, other.thread_pool_);
+    swap(keep_alive_timeout_, other.keep_alive_timeout_);
+    swap(max_keep_alive_requests_, other.max_keep_alive_requests_);
+    swap(connection_stats_, other.connection_stats_);
   }
 
   server_options &io_service(boost::shared_ptr<boost::asio::io_service> v) { io_service_ = v; return *this; }
@@ -89,6 +99,9 @@ struct server_options {
   server_options &receive_low_watermark(boost::asio::socket_base::receive_low_watermark v) { receive_low_watermark_ = v; return *this; }
   server_options &send_low_watermark(boost::asio::socket_base::send_low_watermark v) { send_low_watermark_ = v; return *this; }
   server_options &thread_pool(boost::shared_ptr<utils::thread_pool> v) { thread_pool_ = v; return *this; }
+  server_options &keep_alive_timeout(size_t v) { keep_alive_timeout_ = v; return *this; }
+  server_options &max_keep_alive_requests(size_t v) { max_keep_alive_requests_ = v; return *this; }
+  server_options &connection_stats(boost::shared_ptr<http::connection_stats> v) { connection_stats_ = v; return *this; }
 
   boost::shared_ptr<boost::asio::io_service> io_service() const { return io_service_; }
   string_type address() const { return address_; }
@@ -104,6 +117,9 @@ struct server_options {
   boost::optional<boost::asio::socket_base::receive_low_watermark> receive_low_watermark() const { return receive_low_watermark_; }
   boost::optional<boost::asio::socket_base::send_low_watermark> send_low_watermark() const { return send_low_watermark_; }
   boost::shared_ptr<utils::thread_pool> thread_pool() const { return thread_pool_; } 
+  size_t keep_alive_timeout() const { return keep_alive_timeout_; }
+  size_t max_keep_alive_requests() const { return max_keep_alive_requests_; }
+  boost::shared_ptr<http::connection_stats> connection_stats() const { return connection_stats_; }
 
  private:
   boost::shared_ptr<boost::asio::io_service> io_service_;
@@ -120,6 +136,9 @@ struct server_options {
   boost::optional<boost::asio::socket_base::receive_low_watermark> receive_low_watermark_;
   boost::optional<boost::asio::socket_base::send_low_watermark> send_low_watermark_;
   boost::shared_ptr<utils::thread_pool> thread_pool_;
+  size_t keep_alive_timeout_;      // seconds a connection may idle between requests; 0 closes after each response
+  size_t max_keep_alive_requests_; // requests per connection; 0 for unlimited
+  boost::shared_ptr<http::connection_stats> connection_stats_;
 };
 
 template <class Tag, class Handler>
@@ -22,24 +22,45 @@
 #include <boost/asio/read.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/placeholders.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/network/protocol/http/server/connection_stats.hpp>
 #include <boost/array.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/bind.hpp>
+#include <sstream>
 
 namespace boost { namespace network { namespace http {
 
     template <class Tag, class Handler>
     struct sync_connection : boost::enable_shared_from_this<sync_connection<Tag,Handler> > {
 
-        sync_connection(boost::asio::io_service & service, Handler & handler)
+        // keep_alive_timeout: seconds to wait for the next request on a connection,
+        // 0 closes it after the first response. max_keep_alive_requests: requests
+        // answered per connection before it is closed, 0 for unlimited.
+        sync_connection(boost::asio::io_service & service, Handler & handler,
+                        size_t keep_alive_timeout = 0, size_t max_keep_alive_requests = 0,
+                        boost::shared_ptr<connection_stats> stats = boost::shared_ptr<connection_stats>())
         : service_(service)
         , handler_(handler)
         , socket_(service_)
         , wrapper_(service_)
+        , idle_timer_(service_)
+        , keep_alive_timeout_(keep_alive_timeout)
+        , max_keep_alive_requests_(max_keep_alive_requests)
+        , stats_(stats)
+        , started_(false)
+        , idle_(false)
+        , chunked_(false)
+        , served_(0)
+        , source_port_(0)
         {
         }
 
+        ~sync_connection() {
+            if (stats_ && started_) --stats_->open;
+        }
+
         boost::asio::ip::tcp::socket & socket() {
             return socket_;
         }
@@ -54,6 +75,41 @@ namespace boost { namespace network { namespace http {
             boost::system::error_code option_error;
             socket_.set_option(tcp::no_delay(true), option_error);
             if (option_error) handler_.log(boost::system::system_error(option_error).what());
+
+            tcp::endpoint remote = socket_.remote_endpoint(option_error);
+            if (!option_error) {
+                source_ = remote.address().to_string();
+                source_port_ = remote.port();
+            }
+
+            started_ = true;
+            if (stats_) {
+                ++stats_->accepted;
+                ++stats_->open;
+            }
+
+            read_headers();
+        }
+
+        private:
+
+        struct is_content_length {
+            template <class Header>
+            bool operator()(Header const & header) {
+                return boost::to_lower_copy(header.name) == "content-length";
+            }
+        };
+
+        struct is_connection {
+            template <class Header>
+            bool operator()(Header const & header) {
+                return boost::to_lower_copy(header.name) == "connection";
+            }
+        };
+
+        typedef boost::array<char,BOOST_NETWORK_HTTP_SERVER_CONNECTION_BUFFER_SIZE> buffer_type;
+
+        void read_headers() {
             socket_.async_read_some(
                 boost::asio::buffer(buffer_),
                 wrapper_.wrap(
@@ -67,198 +123,310 @@ namespace boost { namespace network { namespace http {
                 );
         }
 
-        private:
-
-        struct is_content_length {
-            template <class Header>
-            bool operator()(Header const & header) {
-                return boost::to_lower_copy(header.name) == "content-length";
+        void handle_read_headers(boost::system::error_code const &ec, size_t bytes_transferred) {
+            // the idle timer holds the connection; release it once the client spoke or left
+            if (idle_) {
+                idle_ = false;
+                idle_timer_.cancel();
             }
-        };
 
-        void handle_read_headers(boost::system::error_code const &ec, size_t bytes_transferred) {
             if (!ec) {
-                request_.source = socket_.remote_endpoint().address().to_string();
-                request_.source_port = socket_.remote_endpoint().port();
-                boost::tribool done;
-                buffer_type::iterator new_start;
-                tie(done,new_start) = parser_.parse_headers(request_, buffer_.data(), buffer_.data() + bytes_transferred);
-                if (done) {
-                    if (request_.method[0] == 'P') {
-                        // look for the content-length header
-                        typename std::vector<typename request_header<Tag>::type >::iterator it = 
-                            std::find_if(
-                                request_.headers.begin(), 
-                                request_.headers.end(),
-                                is_content_length()
-                                );
-                        if (it == request_.headers.end()) {
-                            response_= basic_response<Tag>::stock_reply(basic_response<Tag>::bad_request);
-                            boost::asio::async_write(
-                                socket_,
-                                response_.to_buffers(),
-                                wrapper_.wrap(
-                                    boost::bind(
-                                        &sync_connection<Tag,Handler>::handle_write,
-                                        sync_connection<Tag,Handler>::shared_from_this(),
-                                        boost::asio::placeholders::error
-                                        )
-                                    )
-                                );
-                            return;
-                        }
-
-                        size_t content_length = 0;
-
-                        try {
-                            content_length = boost::lexical_cast<size_t>(it->value);
-                        } catch (...) {
-                            response_= basic_response<Tag>::stock_reply(basic_response<Tag>::bad_request);
-                            boost::asio::async_write(
-                                socket_,
-                                response_.to_buffers(),
-                                wrapper_.wrap(
-                                    boost::bind(
-                                        &sync_connection<Tag,Handler>::handle_write,
-                                        sync_connection<Tag,Handler>::shared_from_this(),
-                                        boost::asio::placeholders::error
-                                        )
-                                    )
-                                );
-                            return;
-                        }
-
-                        if (content_length != 0) {
-                            if (new_start != (buffer_.begin() + bytes_transferred)) {
-                                request_.body.append(new_start, buffer_.begin() + bytes_transferred);
-                                content_length -= std::distance(new_start, buffer_.begin() + bytes_transferred);
-                            }
-                            if (content_length > 0) {
-                                socket_.async_read_some(
-                                    boost::asio::buffer(buffer_),
-                                    wrapper_.wrap(
-                                        boost::bind(
-                                            &sync_connection<Tag,Handler>::handle_read_body_contents,
-                                            sync_connection<Tag,Handler>::shared_from_this(),
-                                            boost::asio::placeholders::error,
-                                            content_length,
-                                            boost::asio::placeholders::bytes_transferred
-                                            )
-                                        )
-                                    );
-                                return;
-                            }
-                        }
-
-                        handler_(request_, response_);
-                        boost::asio::async_write(
-                            socket_,
-                            response_.to_buffers(),
-                            wrapper_.wrap(
-                                boost::bind(
-                                    &sync_connection<Tag,Handler>::handle_write,
-                                    sync_connection<Tag,Handler>::shared_from_this(),
-                                    boost::asio::placeholders::error
-                                    )
-                                )
-                            );
-                    } else {
-                        handler_(request_, response_);
-                        boost::asio::async_write(
-                            socket_,
-                            response_.to_buffers(),
-                            wrapper_.wrap(
-                                boost::bind(
-                                    &sync_connection<Tag,Handler>::handle_write,
-                                    sync_connection<Tag,Handler>::shared_from_this(),
-                                    boost::asio::placeholders::error
-                                    )
-                                )
+                parse_headers(buffer_.begin(), buffer_.begin() + bytes_transferred);
+            }
+            // TODO Log the error?
+        }
+
+        void parse_headers(typename buffer_type::iterator begin, typename buffer_type::iterator end) {
+            boost::tribool done;
+            typename buffer_type::iterator new_start;
+            tie(done,new_start) = parser_.parse_headers(request_, begin, end);
+            if (done) {
+                if (request_.method[0] == 'P') {
+                    // look for the content-length header
+                    typename std::vector<typename request_header<Tag>::type >::iterator it = 
+                        std::find_if(
+                            request_.headers.begin(), 
+                            request_.headers.end(),
+                            is_content_length()
                             );
+                    if (it == request_.headers.end()) {
+                        bad_request();
+                        return;
+                    }
+
+                    size_t content_length = 0;
+
+                    try {
+                        content_length = boost::lexical_cast<size_t>(it->value);
+                    } catch (...) {
+                        bad_request();
+                        return;
+                    }
+
+                    // the body may have come along with the headers, followed by
+                    // the next pipelined request
+                    size_t taken = (std::min)(content_length, static_cast<size_t>(std::distance(new_start, end)));
+                    request_.body.append(new_start, new_start + taken);
+                    new_start += taken;
+                    content_length -= taken;
+
+                    if (content_length > 0) {
+                        read_body(content_length);
+                        return;
                     }
-                } else if (!done) {
-                    response_= basic_response<Tag>::stock_reply(basic_response<Tag>::bad_request);
-                    boost::asio::async_write(
-                        socket_,
-                        response_.to_buffers(),
-                        wrapper_.wrap(
-                            boost::bind(
-                                &sync_connection<Tag,Handler>::handle_write,
-                                sync_connection<Tag,Handler>::shared_from_this(),
-                                boost::asio::placeholders::error
-                                )
-                            )
-                        );
-                } else {
-                    socket_.async_read_some(
-                        boost::asio::buffer(buffer_),
-                        wrapper_.wrap(
-                            boost::bind(
-                                &sync_connection<Tag,Handler>::handle_read_headers,
-                                sync_connection<Tag,Handler>::shared_from_this(),
-                                boost::asio::placeholders::error,
-                                boost::asio::placeholders::bytes_transferred
-                                )
-                            )
-                        );
                 }
+
+                pipelined_.assign(new_start, end);
+                respond();
+            } else if (!done) {
+                bad_request();
+            } else {
+                read_headers();
             }
-            // TODO Log the error?
+        }
+
+        void read_body(size_t bytes_to_read) {
+            socket_.async_read_some(
+                boost::asio::buffer(buffer_),
+                wrapper_.wrap(
+                    boost::bind(
+                        &sync_connection<Tag,Handler>::handle_read_body_contents,
+                        sync_connection<Tag,Handler>::shared_from_this(),
+                        boost::asio::placeholders::error,
+                        bytes_to_read,
+                        boost::asio::placeholders::bytes_transferred
+                        )
+                    )
+                );
         }
 
         void handle_read_body_contents(boost::system::error_code const & ec, size_t bytes_to_read, size_t bytes_transferred) {
             if (!ec) {
-                size_t difference = bytes_to_read - bytes_transferred;
-                buffer_type::iterator start = buffer_.begin(),
-                    past_end = start;
-                std::advance(past_end, (std::min)(bytes_to_read,bytes_transferred));
-                request_.body.append(buffer_.begin(), past_end);
-                if (difference == 0) {
-                    handler_(request_, response_);
-                    boost::asio::async_write(
-                        socket_,
-                        response_.to_buffers(),
-                        wrapper_.wrap(
-                            boost::bind(
-                                &sync_connection<Tag,Handler>::handle_write,
-                                sync_connection<Tag,Handler>::shared_from_this(),
-                                boost::asio::placeholders::error
-                                )
-                            )
-                        );
+                size_t taken = (std::min)(bytes_to_read, bytes_transferred);
+                request_.body.append(buffer_.begin(), buffer_.begin() + taken);
+                if (taken == bytes_to_read) {
+                    pipelined_.assign(buffer_.begin() + taken, buffer_.begin() + bytes_transferred);
+                    respond();
                 } else {
-                    socket_.async_read_some(
-                        boost::asio::buffer(buffer_),
-                        wrapper_.wrap(
-                            boost::bind(
-                                &sync_connection<Tag,Handler>::handle_read_body_contents,
-                                sync_connection<Tag,Handler>::shared_from_this(),
-                                boost::asio::placeholders::error,
-                                difference,
-                                boost::asio::placeholders::bytes_transferred
-                                )
-                            )
-                        );
+                    read_body(bytes_to_read - taken);
                 }
             }
             // TODO Log the error?
         }
 
-        void handle_write(boost::system::error_code const & ec) {
-            if (!ec) {
+        void respond() {
+            request_.source = source_;
+            request_.source_port = source_port_;
+
+            handler_(request_, response_);
+
+            ++served_;
+            if (stats_) {
+                ++stats_->requests;
+                if (served_ > 1) ++stats_->reused;
+            }
+
+            bool keep_alive = keep_alive_timeout_ > 0 && client_keeps_alive()
+                && (!max_keep_alive_requests_ || served_ < max_keep_alive_requests_);
+
+            if (response_.body_generator) {
+                // HTTP/1.0 clients get the body up to the end of the connection
+                chunked_ = request_.http_version_major > 1
+                    || (request_.http_version_major == 1 && request_.http_version_minor >= 1);
+                if (chunked_) {
+                    typename response_header<Tag>::type transfer_encoding;
+                    transfer_encoding.name = "Transfer-Encoding";
+                    transfer_encoding.value = "chunked";
+                    response_.headers.push_back(transfer_encoding);
+                } else {
+                    keep_alive = false;
+                }
+            }
+
+            typename response_header<Tag>::type connection;
+            connection.name = "Connection";
+            connection.value = keep_alive ? "keep-alive" : "close";
+            response_.headers.push_back(connection);
+
+            write(keep_alive);
+        }
+
+        void bad_request() {
+            response_= basic_response<Tag>::stock_reply(basic_response<Tag>::bad_request);
+            write(false);
+        }
+
+        void write(bool keep_alive) {
+            boost::asio::async_write(
+                socket_,
+                response_.to_buffers(),
+                wrapper_.wrap(
+                    boost::bind(
+                        &sync_connection<Tag,Handler>::handle_write_head,
+                        sync_connection<Tag,Handler>::shared_from_this(),
+                        boost::asio::placeholders::error,
+                        keep_alive
+                        )
+                    )
+                );
+        }
+
+        void handle_write_head(boost::system::error_code const & ec, bool keep_alive) {
+            if (!ec && response_.body_generator) {
+                write_chunk(keep_alive);
+                return;
+            }
+
+            handle_write(ec, keep_alive);
+        }
+
+        // pulls the next piece of a generated body and sends it as one chunk
+        void write_chunk(bool keep_alive) {
+            static const char crlf[] = { '\r', '\n' };
+            static const char last_chunk[] = { '0', '\r', '\n', '\r', '\n' };
+
+            bool more = false;
+            chunk_.clear();
+
+            try {
+                more = response_.body_generator(chunk_);
+            } catch (std::exception & e) {
+                // the status went out already; all that is left is to cut the body short
+                handler_.log(e.what());
+                boost::system::error_code ignored_ec;
+                socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
+                return;
+            }
+
+            std::vector<boost::asio::const_buffer> buffers;
+
+            if (!chunked_) {
+                buffers.push_back(boost::asio::buffer(chunk_));
+            } else {
+                // an empty chunk would end the body
+                if (!chunk_.empty()) {
+                    std::ostringstream size;
+                    size << std::hex << chunk_.size() << "\r\n";
+                    chunk_size_ = size.str();
+
+                    buffers.push_back(boost::asio::buffer(chunk_size_));
+                    buffers.push_back(boost::asio::buffer(chunk_));
+                    buffers.push_back(boost::asio::buffer(crlf));
+                }
+                if (!more) buffers.push_back(boost::asio::buffer(last_chunk));
+            }
+
+            boost::asio::async_write(
+                socket_,
+                buffers,
+                wrapper_.wrap(
+                    boost::bind(
+                        &sync_connection<Tag,Handler>::handle_write_chunk,
+                        sync_connection<Tag,Handler>::shared_from_this(),
+                        boost::asio::placeholders::error,
+                        keep_alive,
+                        more
+                        )
+                    )
+                );
+        }
+
+        void handle_write_chunk(boost::system::error_code const & ec, bool keep_alive, bool more) {
+            if (!ec && more) {
+                write_chunk(keep_alive);
+                return;
+            }
+
+            handle_write(ec, keep_alive);
+        }
+
+        // HTTP/1.1 keeps the connection unless asked to close, HTTP/1.0 only when asked to keep it
+        bool client_keeps_alive() const {
+            typename std::vector<typename request_header<Tag>::type >::const_iterator it = 
+                std::find_if(
+                    request_.headers.begin(), 
+                    request_.headers.end(),
+                    is_connection()
+                    );
+            if (it != request_.headers.end()) {
+                std::string value = boost::to_lower_copy(it->value);
+                if (value.find("close") != std::string::npos) return false;
+                if (value.find("keep-alive") != std::string::npos) return true;
+            }
+            return request_.http_version_major > 1
+                || (request_.http_version_major == 1 && request_.http_version_minor >= 1);
+        }
+
+        void handle_write(boost::system::error_code const & ec, bool keep_alive) {
+            if (ec) return;
+
+            if (!keep_alive) {
                 using boost::asio::ip::tcp;
                 boost::system::error_code ignored_ec;
                 socket_.shutdown(tcp::socket::shutdown_receive, ignored_ec);
+                return;
             }
+
+            request_ = basic_request<Tag>();
+            response_ = basic_response<Tag>();
+            parser_.reset();
+
+            // the client did not wait for the response before sending more
+            if (!pipelined_.empty()) {
+                if (stats_) ++stats_->pipelined;
+                size_t size = pipelined_.size();
+                std::copy(pipelined_.begin(), pipelined_.end(), buffer_.begin());
+                pipelined_.clear();
+                parse_headers(buffer_.begin(), buffer_.begin() + size);
+                return;
+            }
+
+            idle_ = true;
+            idle_timer_.expires_from_now(boost::posix_time::seconds(keep_alive_timeout_));
+            idle_timer_.async_wait(
+                wrapper_.wrap(
+                    boost::bind(
+                        &sync_connection<Tag,Handler>::handle_idle_timeout,
+                        sync_connection<Tag,Handler>::shared_from_this(),
+                        boost::asio::placeholders::error,
+                        served_
+                        )
+                    )
+                );
+            read_headers();
+        }
+
+        void handle_idle_timeout(boost::system::error_code const & ec, size_t served) {
+            // a stale expiry of an earlier idle period must not close the connection
+            if (ec || !idle_ || served != served_) return;
+
+            // the pending read then ends and releases the connection
+            if (stats_) ++stats_->idle_timeouts;
+            boost::system::error_code ignored_ec;
+            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
         }
 
         boost::asio::io_service & service_;
         Handler & handler_;
         boost::asio::ip::tcp::socket socket_;
         boost::asio::io_service::strand wrapper_;
+        boost::asio::deadline_timer idle_timer_;
+
+        size_t keep_alive_timeout_;
+        size_t max_keep_alive_requests_;
+        boost::shared_ptr<connection_stats> stats_;
+        bool started_;
+        bool idle_;
+        bool chunked_;      // the response in progress is sent in chunks
+        size_t served_;
+
+        typename string<Tag>::type source_;
+        boost::uint16_t source_port_;
 
-        typedef boost::array<char,BOOST_NETWORK_HTTP_SERVER_CONNECTION_BUFFER_SIZE> buffer_type;
         buffer_type buffer_;
+        std::string pipelined_; // bytes received past the request in progress
+        std::string chunk_;
+        std::string chunk_size_;
         typedef basic_request_parser<Tag> request_parser;
         request_parser parser_;
         basic_request<Tag> request_;
@@ -36,6 +36,9 @@ namespace boost { namespace network { namespace http {
         , handler_(options.handler())
         , address_(options.address())
         , port_(options.port())
+        , keep_alive_timeout_(options.keep_alive_timeout())
+        , max_keep_alive_requests_(options.max_keep_alive_requests())
+        , connection_stats_(options.connection_stats())
         , acceptor_(server_storage_base::service_)
         , new_connection()
         , listening_mutex_()
@@ -63,6 +66,8 @@ namespace boost { namespace network { namespace http {
 
         Handler & handler_;
         string_type address_, port_;
+        size_t keep_alive_timeout_, max_keep_alive_requests_;
+        boost::shared_ptr<connection_stats> connection_stats_;
         boost::asio::ip::tcp::acceptor acceptor_;
         boost::shared_ptr<sync_connection<Tag,Handler> > new_connection;
         boost::mutex listening_mutex_;
@@ -74,7 +79,8 @@ namespace boost { namespace network { namespace http {
           socket_options_base::socket_options(new_connection->socket());
           new_connection->start();
           new_connection.reset(
-              new sync_connection<Tag, Handler>(service_, handler_));
+              new sync_connection<Tag, Handler>(service_, handler_,
+                  keep_alive_timeout_, max_keep_alive_requests_, connection_stats_));
           acceptor_.async_accept(
               new_connection->socket(),
               boost::bind(&sync_server_base<Tag, Handler>::handle_accept,
@@ -109,7 +115,8 @@ namespace boost { namespace network { namespace http {
                 BOOST_NETWORK_MESSAGE("Error listening on socket: " << address_ << ':' << port_ << " -- reason: '" << error << '\'');
                 boost::throw_exception(std::runtime_error("Error listening on socket."));
             }
-            new_connection.reset(new sync_connection<Tag,Handler>(service_, handler_));
+            new_connection.reset(new sync_connection<Tag,Handler>(service_, handler_,
+                keep_alive_timeout_, max_keep_alive_requests_, connection_stats_));
             acceptor_.async_accept(new_connection->socket(),
                 boost::bind(&sync_server_base<Tag,Handler>::handle_accept,
                             this, boost::asio::placeholders::error));
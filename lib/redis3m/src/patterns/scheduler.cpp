@@ -11,7 +11,18 @@
 using namespace redis3m;
 using namespace redis3m::patterns;
 
-script_exec scheduler::find_expired_script(utils::datadir("/lua/scheduler.lua"), true);
+// KEYS[1]: the scheduler zset
+// ARGV[1]: now, ARGV[2]: time the job is locked until
+// returns the id of one fired job and pushes its time forward, so other
+// workers will only see it again if this one does not dequeue it in time.
+// embedded so the library does not depend on a data directory at runtime.
+script_exec scheduler::find_expired_script(
+    "local jobs = redis.call('ZRANGEBYSCORE', KEYS[1], '-inf', ARGV[1], 'LIMIT', 0, 1) "
+    "if #jobs == 0 then "
+    "  return false "
+    "end "
+    "redis.call('ZADD', KEYS[1], ARGV[2], jobs[1]) "
+    "return jobs[1]");
 
 scheduler::scheduler(const std::string &queue_name):
     _queue(queue_name)
@@ -0,0 +1,77 @@
+//
+//  admission.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "admission.hpp"
+
+namespace pushy
+{
+    inflight_limit::inflight_limit(const std::string& name, std::size_t limit, uint32_t retry_after)
+    : name_(name)
+    , limit_(limit)
+    , retry_after_(retry_after)
+    , current_(0)
+    , peak_(0)
+    , admitted_(0)
+    , rejected_(0)
+    {
+    }
+    
+    void inflight_limit::configure(std::size_t limit, uint32_t retry_after)
+    {
+        limit_ = limit;
+        retry_after_ = retry_after;
+    }
+    
+    bool inflight_limit::try_acquire()
+    {
+        auto cur = ++current_;
+        
+        if(limit_ && cur > limit_)
+        {
+            --current_;
+            ++rejected_;
+            return false;
+        }
+        
+        ++admitted_;
+        
+        auto peak = peak_.load();
+        while(cur > peak && !peak_.compare_exchange_weak(peak, cur))
+        {
+        }
+        
+        return true;
+    }
+    
+    void inflight_limit::release()
+    {
+        --current_;
+    }
+    
+    void inflight_limit::acquire()
+    {
+        if(!try_acquire())
+        {
+            throw overload_error(name_ + " is overloaded. try again later.",
+                                 overload_error::busy, retry_after_);
+        }
+    }
+    
+    json_spirit::Object inflight_limit::stats() const
+    {
+        json_spirit::Object obj;
+        
+        obj.push_back( json_spirit::Pair("in_flight", static_cast<uint64_t>(current_.load())) );
+        obj.push_back( json_spirit::Pair("limit", static_cast<uint64_t>(limit_)) );
+        obj.push_back( json_spirit::Pair("peak", static_cast<uint64_t>(peak_.load())) );
+        obj.push_back( json_spirit::Pair("admitted", admitted_.load()) );
+        obj.push_back( json_spirit::Pair("rejected", rejected_.load()) );
+        
+        return obj;
+    }
+}
@@ -0,0 +1,111 @@
+//
+//  admission.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__admission__
+#define __pushy__admission__
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    /**
+     * Thrown when a bounded resource is exhausted.
+     * The json api turns it into 429 or 503 with a Retry-After header.
+     */
+    class overload_error : public std::runtime_error
+    {
+    public:
+        enum reason_t
+        {
+            busy,       // too much work in progress right now (503)
+            throttled   // queues in front of providers are full (429)
+        };
+        
+        overload_error(const std::string& msg, const reason_t& reason, uint32_t retry_after)
+        : std::runtime_error(msg)
+        , reason_(reason)
+        , retry_after_(retry_after)
+        {
+        }
+        
+        reason_t reason() const
+        {
+            return reason_;
+        }
+        
+        uint32_t retry_after() const
+        {
+            return retry_after_;
+        }
+        
+    private:
+        reason_t    reason_;
+        uint32_t    retry_after_;
+    };
+    
+    /**
+     * Bounded in-flight counter. A limit of zero disables the bound.
+     */
+    class inflight_limit : boost::noncopyable
+    {
+    public:
+        inflight_limit(const std::string& name, std::size_t limit = 0, uint32_t retry_after = 1);
+        
+        void configure(std::size_t limit, uint32_t retry_after);
+        
+        bool try_acquire();
+        void release();
+        
+        /// acquires or throws overload_error(busy)
+        void acquire();
+        
+        std::size_t current() const
+        {
+            return current_.load();
+        }
+        
+        json_spirit::Object stats() const;
+        
+        /**
+         * Scoped slot of an inflight_limit
+         */
+        class guard : boost::noncopyable
+        {
+        public:
+            explicit guard(inflight_limit& lim)
+            : lim_(lim)
+            {
+                lim_.acquire();
+            }
+            
+            ~guard()
+            {
+                lim_.release();
+            }
+            
+        private:
+            inflight_limit& lim_;
+        };
+        
+    private:
+        std::string                 name_;
+        std::size_t                 limit_;
+        uint32_t                    retry_after_;
+        
+        std::atomic<std::size_t>    current_;
+        std::atomic<std::size_t>    peak_;
+        std::atomic<uint64_t>       admitted_;
+        std::atomic<uint64_t>       rejected_;
+    };
+}
+
+#endif /* defined(__pushy__admission__) */
@@ -8,15 +8,22 @@
 
 #include "api_service.hpp"
 
+#include <algorithm>
+#include <cstdio>
+
+#include <boost/make_shared.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/string_generator.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <json_spirit/json_spirit_writer_template.h>
-#include <json_spirit/json_spirit_reader_template.h>
 
 #include "pushy_service.hpp"
+#include "ingest_service.hpp"
+#include "json_reader.hpp"
+#include "json_writer.hpp"
 #include "logging.hpp"
 
 namespace pushy
@@ -24,356 +31,1089 @@ namespace pushy
     using namespace boost::network::http;
     using namespace pushy::database;
     
-    const std::string api_service::handler::error_json(const std::string& msg)
+    namespace
     {
-        json_spirit::Object obj;
+        // largest request body the async server accepts
+        const std::size_t max_body = 16 * 1024 * 1024;
         
-        obj.push_back( json_spirit::Pair("success", false) );
-        obj.push_back( json_spirit::Pair("message", msg) );
+        // rows of a streamed list read per SSCAN, and so sent per chunk
+        const std::size_t list_batch = 500;
         
-        return json_spirit::write_string( json_spirit::Value(obj), false );
-    }
-    
-    const std::string api_service::handler::reg_apns(const std::string& body)
-    {
-        auto uuid = dba::instance().register_apns_device(body);
-        json_spirit::Object obj;
+        /**
+         * A JSON array of the members of one or more redis sets, produced one SSCAN
+         * batch at a time so that a large set is never held in memory as a whole.
+         * Every piece but the last one carries at least one row.
+         */
+        class list_stream
+        {
+        public:
+            list_stream(const std::vector<dba::set_scan>& scans)
+            : scans_(scans)
+            , current_(0)
+            , started_(false)
+            , writer_(buffer_)
+            {
+            }
+            
+            virtual ~list_stream()
+            {
+            }
+            
+            bool next(std::string& piece)
+            {
+                buffer_.clear();
+                
+                if(!started_)
+                {
+                    writer_.begin_array();
+                    started_ = true;
+                }
+                
+                while(current_ < scans_.size())
+                {
+                    auto& scan = scans_[current_];
+                    bool written = write_batch(scan, writer_);
+                    
+                    if(scan.done)
+                    {
+                        ++current_;
+                    }
+                    
+                    if(written)
+                    {
+                        break;
+                    }
+                }
+                
+                bool more = current_ < scans_.size();
+                
+                if(!more)
+                {
+                    writer_.end_array();
+                }
+                
+                piece.swap(buffer_);
+                return more;
+            }
         
-        obj.push_back( json_spirit::Pair("success", true) );
-        obj.push_back( json_spirit::Pair("uuid", to_string(uuid)) );
+        protected:
+            /// writes the rows of the next batch; false if there were none
+            virtual bool write_batch(dba::set_scan& scan, json_writer& w) = 0;
         
-        return json_spirit::write_string( json_spirit::Value(obj), false );
-    }
-
-    const std::string api_service::handler::reg_gcm(const std::string& body)
-    {
-        auto uuid = dba::instance().register_gcm_device(body);
-        json_spirit::Object obj;
+        private:
+            std::vector<dba::set_scan>  scans_;
+            std::size_t                 current_;
+            bool                        started_;
+            
+            std::string                 buffer_;
+            json_writer                 writer_;    // keeps the comma state between pieces
+        };
         
-        obj.push_back( json_spirit::Pair("success", true) );
-        obj.push_back( json_spirit::Pair("uuid", to_string(uuid)) );
+        class failed_list_stream : public list_stream
+        {
+        public:
+            failed_list_stream(const std::vector<dba::set_scan>& scans)
+            : list_stream(scans)
+            {
+            }
         
-        return json_spirit::write_string( json_spirit::Value(obj), false );
-    }
-    
-    const std::string api_service::handler::send_push(const std::string& body)
-    {
-        json_spirit::Value input;
-        if (!json_spirit::read_string(body, input))
+        private:
+            bool write_batch(dba::set_scan& scan, json_writer& w)
+            {
+                auto batch = dba::instance().next_failed_messages(scan, list_batch);
+                
+                for(auto& entry : batch)
+                {
+                    w.begin_object()
+                        .member("uuid", entry.msg_uuid)
+                        .member("device", entry.dev_uuid)
+                        .member("msg", entry.reason)
+                        .end_object();
+                }
+                
+                return !batch.empty();
+            }
+        };
+        
+        class leavers_list_stream : public list_stream
+        {
+        public:
+            leavers_list_stream()
+            : list_stream(std::vector<dba::set_scan>(1, dba::dead_devices_scan()))
+            {
+            }
+        
+        private:
+            bool write_batch(dba::set_scan& scan, json_writer& w)
+            {
+                auto batch = dba::instance().next_dead_devices(scan, list_batch);
+                
+                for(auto& entry : batch)
+                {
+                    w.begin_object()
+                        .member("uuid", entry.dev_uuid)
+                        .member("timestamp", entry.ts)
+                        .end_object();
+                }
+                
+                return !batch.empty();
+            }
+        };
+        
+        /**
+         * A streamed reply outlives handle(). This one keeps the request's inflight
+         * slot until the last piece is produced and records the route latency then.
+         */
+        class held_stream
+        {
+        public:
+            held_stream(const api_service::reply::body_stream& stream,
+                        boost::shared_ptr<inflight_limit::guard> slot,
+                        latency_histogram& latency, const boost::posix_time::ptime& start)
+            : stream_(stream)
+            , slot_(slot)
+            , latency_(latency)
+            , start_(start)
+            {
+            }
+            
+            bool next(std::string& piece)
+            {
+                bool more = stream_(piece);
+                
+                if(!more)
+                {
+                    latency_.record(boost::posix_time::microsec_clock::universal_time() - start_);
+                    slot_.reset();
+                }
+                
+                return more;
+            }
+        
+        private:
+            api_service::reply::body_stream             stream_;
+            boost::shared_ptr<inflight_limit::guard>    slot_;      // released early if the client goes away
+            latency_histogram&                          latency_;
+            boost::posix_time::ptime                    start_;
+        };
+        
+        // frames a piece of a streamed body for chunked transfer encoding
+        void append_chunk(std::string& out, const std::string& piece)
         {
-            LOG_WARN << "Couldn't parse JSON input: '" << body << "'";
-            return error_json("Couldn't parse JSON input");
+            char size[20];
+            
+            out.append(size, std::snprintf(size, sizeof(size), "%zx\r\n", piece.size()));
+            out.append(piece);
+            out.append("\r\n");
         }
         
-        if(input.type() != json_spirit::obj_type)
+        // the canonical 8-4-4-4-12 form is decoded directly, anything else
+        // goes through string_generator which also throws on invalid input
+        boost::uuids::uuid parse_uuid(boost::string_ref str)
         {
-            LOG_WARN << "Passed JSON is not an Object: '" << body << "'";
-            return error_json("Not an Object");
+            boost::uuids::uuid uuid;
+            
+            if(parse_canonical_uuid(str, uuid))
+            {
+                return uuid;
+            }
+            
+            boost::uuids::string_generator str_gen;
+            return str_gen(str.begin(), str.end());
         }
         
-        auto input_obj = input.get_obj();
-
-        boost::uuids::string_generator str_gen;
-        boost::uuids::uuid dev_uuid;
-        std::string msg, tag;
+        // value of the key just read, which must be a string
+        boost::string_ref string_value(json_reader& reader, const char* key)
+        {
+            if(reader.next() != json_reader::token_string)
+            {
+                throw std::runtime_error(std::string("'") + key + "' must be a string");
+            }
+            
+            return reader.text();
+        }
         
-        for(auto entry : input_obj)
+        // seconds since epoch or an utc time such as "2026-10-19T12:00:00Z"
+        boost::posix_time::ptime read_send_at(json_reader& reader)
         {
-            LOG_TRACE << "parsing entry " << entry.name_;
+            if(reader.next() == json_reader::token_number)
+            {
+                return boost::posix_time::from_time_t(static_cast<std::time_t>(reader.get_int64()));
+            }
+            
+            if(reader.current() != json_reader::token_string)
+            {
+                throw std::runtime_error("send_at must be seconds since epoch or a time like '2026-10-19T12:00:00Z'");
+            }
+            
+            auto str = reader.text().to_string();
+            std::replace(str.begin(), str.end(), 'T', ' ');
             
-            if(entry.name_ == "uuid")
+            if(!str.empty() && str.back() == 'Z')
             {
-                dev_uuid = str_gen(entry.value_.get_str());
+                str.pop_back();
             }
-            else if(entry.name_ == "msg")
+            
+            try
             {
-                msg = entry.value_.get_str();
+                return boost::posix_time::time_from_string(str);
             }
-            else if(entry.name_ == "tag")
+            catch(std::exception&)
             {
-                tag = entry.value_.get_str();
+                throw std::runtime_error("send_at must be seconds since epoch or a time like '2026-10-19T12:00:00Z'");
             }
         }
         
-        LOG_TRACE << "parsed uuid = " << to_string(dev_uuid);
-        LOG_TRACE << "parsed msg = '" << msg << "', tag = '" << tag << "'";
+        // the fields of a /send body; unknown ones are skipped
+        void read_push_request(const std::string& body, push_request& req)
+        {
+            json_reader reader(body);
+            
+            if(reader.next() != json_reader::token_begin_object)
+            {
+                throw std::runtime_error("Not an Object");
+            }
+            
+            while(reader.next() == json_reader::token_key)
+            {
+                auto key = reader.text();
+                LOG_TRACE << "parsing entry " << key;
+                
+                if(key == "uuid")
+                {
+                    req.dev_uuid = parse_uuid(string_value(reader, "uuid"));
+                }
+                else if(key == "msg")
+                {
+                    req.msg = string_value(reader, "msg").to_string();
+                }
+                else if(key == "tag")
+                {
+                    req.tag = string_value(reader, "tag").to_string();
+                }
+                else if(key == "priority")
+                {
+                    req.priority = dba::str_to_priority(string_value(reader, "priority").to_string());
+                }
+                else if(key == "idempotency_key")
+                {
+                    req.idempotency_key = string_value(reader, "idempotency_key").to_string();
+                }
+                else if(key == "collapse_key")
+                {
+                    req.collapse_key = string_value(reader, "collapse_key").to_string();
+                }
+                else if(key == "send_at")
+                {
+                    req.send_at = read_send_at(reader);
+                }
+                else
+                {
+                    reader.skip();
+                }
+            }
+            
+            // nothing may follow the object
+            reader.next();
+        }
         
-        // push to pushy_service
-        auto msg_uuid = push_service_.push(dev_uuid, msg, tag);
+        // an array of uuid strings as taken by /redeliver and /device/remove
+        void read_uuid_array(const std::string& body, std::vector<boost::uuids::uuid>& uuids)
+        {
+            json_reader reader(body);
+            
+            if(reader.next() != json_reader::token_begin_array)
+            {
+                throw std::runtime_error("Not an Array");
+            }
+            
+            // a quoted uuid and a comma take 39 bytes
+            uuids.reserve(body.size() / 39);
+            
+            while(reader.next() != json_reader::token_end_array)
+            {
+                if(reader.current() != json_reader::token_string)
+                {
+                    throw std::runtime_error("Entry is not a String UUID");
+                }
+                
+                uuids.push_back( parse_uuid(reader.text()) );
+            }
+            
+            reader.next();
+        }
         
-        json_spirit::Object obj;
+        // an array of device tokens as taken by /devices/register
+        void read_string_array(const std::string& body, std::vector<std::string>& strings)
+        {
+            json_reader reader(body);
+            
+            if(reader.next() != json_reader::token_begin_array)
+            {
+                throw std::runtime_error("Not an Array");
+            }
+            
+            while(reader.next() != json_reader::token_end_array)
+            {
+                if(reader.current() != json_reader::token_string)
+                {
+                    throw std::runtime_error("Entry is not a String");
+                }
+                
+                strings.push_back( reader.text().to_string() );
+            }
+            
+            reader.next();
+        }
+    }
+    
+    api_service::handler::handler(pushy_service& ps, const std::string& base,
+                                  std::size_t max_inflight, uint32_t retry_after,
+                                  boost::shared_ptr<http::connection_stats> connections,
+                                  ingest_service* ingest)
+    : push_service_(ps)
+    , api_base_(base)
+    , inflight_("json api", max_inflight, retry_after)
+    , connections_(connections)
+    , ingest_(ingest)
+    {
+        // devices of other apps than the default one are registered
+        // at /device/register/<provider>/<app>
+        router_.add("GET", "/stats", route_stats);
+        router_.add("POST", "/device/register/apns", route_reg_apns);
+        router_.add("POST", "/device/register/apns/{app}", route_reg_apns);
+        router_.add("POST", "/device/register/gcm", route_reg_gcm);
+        router_.add("POST", "/device/register/gcm/{app}", route_reg_gcm);
+        router_.add("POST", "/device/remove", route_remove_device);
         
-        obj.push_back( json_spirit::Pair("success", true) );
-        obj.push_back( json_spirit::Pair("uuid", to_string(msg_uuid)) );
+        // bulk registration: a json array of tokens in, their uuids out in the same order
+        router_.add("POST", "/devices/register/apns", route_reg_apns_bulk);
+        router_.add("POST", "/devices/register/apns/{app}", route_reg_apns_bulk);
+        router_.add("POST", "/devices/register/gcm", route_reg_gcm_bulk);
+        router_.add("POST", "/devices/register/gcm/{app}", route_reg_gcm_bulk);
+        router_.add("POST", "/send", route_send);
+        router_.add("POST", "/redeliver", route_redeliver);
+        router_.add("GET", "/message/{uuid}", route_message);
+        router_.add("GET", "/list", route_list);
+        router_.add("GET", "/list_apns", route_list_apns);
+        router_.add("GET", "/list_gcm", route_list_gcm);
+        router_.add("GET", "/leavers", route_leavers);
+    }
+    
+    void api_service::handler::error_json(const std::string& msg, std::string& out)
+    {
+        json_writer w(out);
         
-        return json_spirit::write_string( json_spirit::Value(obj), false );
+        w.begin_object()
+            .member("success", false)
+            .member("message", msg)
+            .end_object();
     }
     
-    const std::string api_service::handler::redeliver(const std::string& body)
+    void api_service::handler::reg_apns(const std::string& body, const std::string& app, std::string& out)
     {
-        json_spirit::Value input;
-        if (!json_spirit::read_string(body, input))
+        if(!push_service_.serves(push_type_apns, app))
         {
-            LOG_WARN << "Couldn't parse JSON input: '" << body << "'";
-            return error_json("Couldn't parse JSON input");
+            error_json("APNS is not setup for app '" + app + "'", out);
+            return;
         }
         
-        if(input.type() != json_spirit::array_type)
+        auto uuid = dba::instance().register_apns_device(body, app);
+        json_writer w(out);
+        
+        w.begin_object()
+            .member("success", true)
+            .member("uuid", uuid)
+            .end_object();
+    }
+    
+    void api_service::handler::reg_gcm(const std::string& body, const std::string& app, std::string& out)
+    {
+        if(!push_service_.serves(push_type_gcm, app))
         {
-            LOG_WARN << "Passed JSON is not an Array: '" << body << "'";
-            return error_json("Not an Array");
+            error_json("GCM is not setup for app '" + app + "'", out);
+            return;
         }
         
-        auto input_arr = input.get_array();
+        auto uuid = dba::instance().register_gcm_device(body, app);
+        json_writer w(out);
         
-        boost::uuids::string_generator str_gen;
-        std::vector<boost::uuids::uuid> msg_uuids;
-        
-        for(auto entry : input_arr)
+        w.begin_object()
+            .member("success", true)
+            .member("uuid", uuid)
+            .end_object();
+    }
+    
+    void api_service::handler::reg_devices(const std::string& body, const push_type& type,
+                                           const std::string& app, std::string& out)
+    {
+        if(!push_service_.serves(type, app))
         {
-            if(entry.type() != json_spirit::str_type)
-            {
-                LOG_WARN << "Entry is not a string UUID";
-                return error_json("Entry is not a String UUID");
-            }
-            
-            msg_uuids.push_back( str_gen(entry.get_str()) );
+            error_json((type == push_type_apns ? "APNS" : "GCM")
+                + std::string(" is not setup for app '") + app + "'", out);
+            return;
         }
         
-        for(auto uuid : msg_uuids)
+        std::vector<std::string> tokens;
+        
+        try
         {
-            LOG_TRACE << "will try to redeliver " << to_string(uuid);
-
-            auto fm = dba::instance().get_message(uuid);
-            push_service_.redeliver(fm.msg_uuid, fm.dev_uuid, fm.provider_type);
+            read_string_array(body, tokens);
+        }
+        catch(json_error& e)
+        {
+            LOG_WARN << "Couldn't parse JSON input: '" << body << "': " << e.what();
+            error_json("Couldn't parse JSON input", out);
+            return;
         }
         
-        json_spirit::Object obj;
+        LOG_DEBUG << "Registering " << tokens.size() << " " << dba::type_to_str(type) << " devices";
+        
+        auto uuids = dba::instance().register_devices(tokens, type, app);
+        json_writer w(out);
+        
+        w.begin_object()
+            .member("success", true)
+            .key("uuids").begin_array();
         
-        obj.push_back( json_spirit::Pair("success", true) );
-        return json_spirit::write_string( json_spirit::Value(obj), false );
+        for(auto& uuid : uuids)
+        {
+            w.value(uuid);
+        }
+        
+        w.end_array().end_object();
     }
     
-    const std::string api_service::handler::list_leavers()
+    void api_service::handler::send_push(const std::string& body, std::string& out)
     {
-        json_spirit::Array arr;
+        push_request req;
         
-        for(auto entry : dba::instance().get_dead_devices())
+        try
         {
-            json_spirit::Object obj;
-            
-            obj.push_back( json_spirit::Pair("uuid", to_string(entry.dev_uuid)) );
-            obj.push_back( json_spirit::Pair("timestamp", to_string(entry.ts)) );
-            
-            arr.push_back(obj);
+            read_push_request(body, req);
+        }
+        catch(json_error& e)
+        {
+            LOG_WARN << "Couldn't parse JSON input: '" << body << "': " << e.what();
+            error_json("Couldn't parse JSON input", out);
+            return;
         }
         
-        return json_spirit::write_string( json_spirit::Value(arr), false );
+        LOG_TRACE << "parsed uuid = " << to_string(req.dev_uuid);
+        LOG_TRACE << "parsed msg = '" << req.msg << "', tag = '" << req.tag
+            << "', priority = " << dba::priority_to_str(req.priority);
+        
+        // push to pushy_service
+        auto msg_uuid = push_service_.push(req);
+        
+        json_writer w(out);
+        
+        w.begin_object()
+            .member("success", true)
+            .member("uuid", msg_uuid)
+            .end_object();
     }
     
-    const std::string api_service::handler::remove_device(const std::string& body)
+    void api_service::handler::redeliver(const std::string& body, std::string& out)
     {
-        json_spirit::Value input;
-        if(!json_spirit::read_string(body, input))
+        std::vector<boost::uuids::uuid> msg_uuids;
+        
+        try
         {
-            LOG_WARN << "Couldn't parse JSON input: '" << body << "'";
-            return error_json("Couldn't parse JSON input");
+            read_uuid_array(body, msg_uuids);
+        }
+        catch(json_error& e)
+        {
+            LOG_WARN << "Couldn't parse JSON input: '" << body << "': " << e.what();
+            error_json("Couldn't parse JSON input", out);
+            return;
         }
         
-        if(input.type() != json_spirit::array_type)
+        for(auto uuid : msg_uuids)
         {
-            LOG_WARN << "Passed JSON is not an Array: '" << body << "'";
-            return error_json("Not an Array");
+            LOG_TRACE << "will try to redeliver " << to_string(uuid);
+            
+            auto fm = dba::instance().get_message(uuid);
+            push_service_.redeliver(fm);
         }
         
-        auto input_arr = input.get_array();
+        json_writer w(out);
         
+        w.begin_object().member("success", true).end_object();
+    }
+    
+    void api_service::handler::get_message(const std::string& uuid, std::string& out)
+    {
         boost::uuids::string_generator str_gen;
+        auto msg_uuid = str_gen(uuid);
+        
+        auto entry = dba::instance().get_message(msg_uuid);
+        json_writer w(out);
+        
+        w.begin_object()
+            .member("success", true)
+            .member("uuid", entry.msg_uuid)
+            .member("device", entry.dev_uuid)
+            .member("provider", entry.provider_type == push_type_apns ? "apns" : "gcm")
+            .member("priority", dba::priority_to_str(entry.priority))
+            .member("attempts", static_cast<uint64_t>(entry.attempts))
+            .member("timestamp", entry.ts)
+            .member("tag", entry.tag)
+            .member("app", entry.app)
+            .end_object();
+    }
+    
+    api_service::reply::body_stream api_service::handler::list_leavers()
+    {
+        return boost::bind(&list_stream::next, boost::make_shared<leavers_list_stream>(), _1);
+    }
+    
+    void api_service::handler::remove_device(const std::string& body, std::string& out)
+    {
         std::vector<boost::uuids::uuid> dev_uuids;
         
-        for(auto entry : input_arr)
+        try
         {
-            if(entry.type() != json_spirit::str_type)
-            {
-                LOG_WARN << "Entry is not a string UUID";
-                return error_json("Entry is not a String UUID");
-            }
-            
-            dev_uuids.push_back( str_gen(entry.get_str()) );
+            read_uuid_array(body, dev_uuids);
         }
-
-        LOG_DEBUG << "Parsed " << dev_uuids.size() << " UUIDs of devices to remove";
-
-        json_spirit::Object obj;
-
-        // remove each device
-        for(auto uuid : dev_uuids)
+        catch(json_error& e)
         {
-            dba::instance().drop_device(uuid);
+            LOG_WARN << "Couldn't parse JSON input: '" << body << "': " << e.what();
+            error_json("Couldn't parse JSON input", out);
+            return;
         }
         
-        obj.push_back( json_spirit::Pair("success", true) );
-        return json_spirit::write_string( json_spirit::Value(obj), false );
+        LOG_DEBUG << "Parsed " << dev_uuids.size() << " UUIDs of devices to remove";
+        
+        // in pipelined batches rather than a round trip per device
+        dba::instance().drop_devices(dev_uuids);
+        
+        json_writer w(out);
+        
+        w.begin_object().member("success", true).end_object();
     }
     
-    const std::string api_service::handler::list_failed()
+    api_service::reply::body_stream api_service::handler::list_failed()
     {
-        json_spirit::Array arr;
+        std::vector<dba::set_scan> scans;
+        
+        scans.push_back(dba::failed_messages_scan(push_type_apns));
+        scans.push_back(dba::failed_messages_scan(push_type_gcm));
+        
+        return boost::bind(&list_stream::next, boost::make_shared<failed_list_stream>(scans), _1);
+    }
+    
+    api_service::reply::body_stream api_service::handler::list_failed_for(const push_type& type)
+    {
+        std::vector<dba::set_scan> scans(1, dba::failed_messages_scan(type));
+        return boost::bind(&list_stream::next, boost::make_shared<failed_list_stream>(scans), _1);
+    }
+    
+    void api_service::handler::stats(std::string& out)
+    {
+        auto obj = push_service_.stats();
+        json_spirit::Object adm;
+        
+        adm.push_back( json_spirit::Pair("api", inflight_.stats()) );
+        adm.push_back( json_spirit::Pair("redis_writes", dba::instance().write_stats()) );
         
-        for(auto entry : dba::instance().get_failed_messages())
+        obj.push_back( json_spirit::Pair("admission", adm) );
+        obj.push_back( json_spirit::Pair("routes", router_.stats()) );
+        
+        if(connections_)
         {
-            json_spirit::Object obj;
+            json_spirit::Object conn;
             
-            obj.push_back( json_spirit::Pair("uuid", to_string(entry.msg_uuid)) );
-            obj.push_back( json_spirit::Pair("device", to_string(entry.dev_uuid)) );
-            obj.push_back( json_spirit::Pair("msg", entry.reason) );
+            conn.push_back( json_spirit::Pair("accepted", connections_->accepted.load()) );
+            conn.push_back( json_spirit::Pair("open", connections_->open.load()) );
+            conn.push_back( json_spirit::Pair("requests", connections_->requests.load()) );
+            conn.push_back( json_spirit::Pair("reused", connections_->reused.load()) );
+            conn.push_back( json_spirit::Pair("pipelined", connections_->pipelined.load()) );
+            conn.push_back( json_spirit::Pair("idle_timeouts", connections_->idle_timeouts.load()) );
             
-            arr.push_back(obj);
+            obj.push_back( json_spirit::Pair("api_connections", conn) );
         }
         
-        return json_spirit::write_string( json_spirit::Value(arr), false );
+        if(ingest_)
+        {
+            obj.push_back( json_spirit::Pair("ingest", ingest_->stats()) );
+        }
+        
+        out = json_spirit::write_string( json_spirit::Value(obj), false );
     }
     
-    const std::string api_service::handler::list_failed_for(const push_type& type)
+    void api_service::handler::handle(const std::string& method, const std::string& destination,
+                                      const std::string& body, reply& rep)
     {
-        json_spirit::Array arr;
+        // destination must start with the api base specified by the client
+        if(!boost::starts_with(destination, api_base_))
+        {
+            rep.status = http_service::response::forbidden;
+            return;
+        }
         
-        for(auto entry : dba::instance().get_failed_messages(type))
+        router::route* route = nullptr;
+        router::params params;
+        
+        switch(router_.match(method, boost::string_ref(destination).substr(api_base_.size()), route, params))
         {
-            json_spirit::Object obj;
+            case router::not_found:
+                rep.status = http_service::response::not_found;
+                return;
             
-            obj.push_back( json_spirit::Pair("uuid", to_string(entry.msg_uuid)) );
-            obj.push_back( json_spirit::Pair("device", to_string(entry.dev_uuid)) );
-            obj.push_back( json_spirit::Pair("msg", entry.reason) );
+            case router::method_not_allowed:
+                rep.status = http_service::response::not_supported;
+                return;
             
-            arr.push_back(obj);
+            case router::matched:
+                break;
         }
         
-        return json_spirit::write_string( json_spirit::Value(arr), false );
+        auto start = boost::posix_time::microsec_clock::universal_time();
+        
+        try
+        {
+            // stats must stay reachable when the node is overloaded
+            if(route->id == route_stats)
+            {
+                stats(rep.body);
+            }
+            else
+            {
+                // bounded amount of requests in progress; throws overload_error
+                boost::shared_ptr<inflight_limit::guard> slot(new inflight_limit::guard(inflight_));
+                dispatch(*route, params, body, rep);
+                
+                // the list apis hand the slot and the latency sample to their stream
+                if(rep.stream)
+                {
+                    rep.stream = boost::bind(&held_stream::next,
+                        boost::make_shared<held_stream>(rep.stream, slot, boost::ref(route->latency), start), _1);
+                    return;
+                }
+            }
+        }
+        catch(overload_error& e)
+        {
+            LOG_WARN << "Rejecting JSON API request: " << e.what();
+            ++route->errors;
+            
+            rep.status = e.reason() == overload_error::throttled
+                ? http_service::response::too_many_requests
+                : http_service::response::service_unavailable;
+            rep.body.clear();
+            error_json(e.what(), rep.body);
+            rep.retry_after = e.retry_after();
+        }
+        catch(std::exception& e)
+        {
+            LOG_ERROR << "Exception in JSON API: " << e.what();
+            ++route->errors;
+            
+            rep.status = http_service::response::ok;
+            rep.body.clear();
+            error_json(e.what(), rep.body);
+        }
+        
+        route->latency.record(boost::posix_time::microsec_clock::universal_time() - start);
+    }
+    
+    void api_service::handler::dispatch(const router::route& route, const router::params& params,
+                                        const std::string& body, reply& rep)
+    {
+        switch(route.id)
+        {
+            case route_reg_apns:
+                reg_apns(body, params.str(0), rep.body);
+                break;
+            
+            case route_reg_gcm:
+                reg_gcm(body, params.str(0), rep.body);
+                break;
+            
+            case route_reg_apns_bulk:
+                reg_devices(body, push_type_apns, params.str(0), rep.body);
+                break;
+            
+            case route_reg_gcm_bulk:
+                reg_devices(body, push_type_gcm, params.str(0), rep.body);
+                break;
+            
+            case route_remove_device:
+                remove_device(body, rep.body);
+                break;
+            
+            case route_send:
+                send_push(body, rep.body);
+                break;
+            
+            case route_redeliver:
+                redeliver(body, rep.body);
+                break;
+            
+            case route_message:
+                get_message(params.str(0), rep.body);
+                break;
+            
+            case route_list:
+                rep.stream = list_failed();
+                break;
+            
+            case route_list_apns:
+                rep.stream = list_failed_for(push_type_apns);
+                break;
+            
+            case route_list_gcm:
+                rep.stream = list_failed_for(push_type_gcm);
+                break;
+            
+            case route_leavers:
+                rep.stream = list_leavers();
+                break;
+            
+            default:
+                rep.status = http_service::response::not_found;
+                break;
+        }
     }
     
     void api_service::handler::operator() (http_service::request const &request,
                                            http_service::response &response)
-    try
     {
-        std::string uri = request.destination;
-        std::string body = request.body;
+        reply rep;
+        handle(request.method, request.destination, request.body, rep);
         
-        // destination must start with the api base specified by the client
-        if(!boost::starts_with(uri, api_base_))
+        auto status = static_cast<http_service::response::status_type>(rep.status);
+        
+        if(rep.stream)
         {
-            response = http_service::response::stock_reply(http_service::response::forbidden);
+            // the connection pulls the body from the stream once the headers went out
+            response = http_service::response();
+            response.status = status;
+            response.headers.resize(1);
+            response.headers[0].name = "Content-Type";
+            response.headers[0].value = "text/html";
+            response.body_generator = rep.stream;
             return;
         }
         
-        // trim base from uri
-        uri = uri.substr(api_base_.size());
+        response = rep.body.empty()
+            ? http_service::response::stock_reply(status)
+            : http_service::response::stock_reply(status, rep.body);
         
-        // check what api we are trying to call
-        if(boost::starts_with(uri, "/device/register/apns"))
+        if(rep.status == http_service::response::too_many_requests
+           || rep.status == http_service::response::service_unavailable)
         {
-            std::string res = reg_apns(body);
-            
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
-            return;
+            http_service::response_header retry_after;
+            retry_after.name = "Retry-After";
+            retry_after.value = boost::lexical_cast<std::string>(rep.retry_after);
+            response.headers.push_back(retry_after);
         }
-
-        if(boost::starts_with(uri, "/device/register/gcm"))
+    }
+    
+    void api_service::handler::log(http_service::string_type const &info)
+    {
+        LOG_ERROR << info;
+    }
+    
+    struct api_service::async_handler::pending
+    {
+        pending()
+        : length(0)
+        , chunked(false)
         {
-            std::string res = reg_gcm(body);
-            
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
-            return;
         }
         
-        if(boost::starts_with(uri, "/device/remove"))
+        std::string     method;
+        std::string     destination;
+        std::string     body;
+        std::size_t     length;     // Content-Length of the request
+        bool            chunked;    // the client reads chunked replies
+    };
+    
+    struct api_service::async_handler::streaming
+    {
+        reply::body_stream  stream;
+        bool                chunked;    // or else the body ends with the connection
+        
+        std::string         piece;
+        std::string         chunk;
+    };
+    
+    void api_service::async_handler::operator() (async_http_service::request const &request,
+                                                 async_http_service::connection_ptr connection)
+    {
+        auto p = boost::make_shared<pending>();
+        p->method = request.method;
+        p->destination = request.destination;
+        p->chunked = request.http_version_major > 1
+            || (request.http_version_major == 1 && request.http_version_minor >= 1);
+        
+        for(auto& header : request.headers)
+        {
+            if(boost::iequals(header.name, "Content-Length"))
+            {
+                try
+                {
+                    p->length = boost::lexical_cast<std::size_t>(header.value);
+                }
+                catch(boost::bad_lexical_cast&)
+                {
+                    p->length = max_body + 1;
+                }
+            }
+        }
+        
+        if(p->length > max_body)
         {
-            std::string res = remove_device(body);
+            reply rep;
+            rep.status = async_http_service::connection::bad_request;
+            handler_.error_json("Request body missing a valid Content-Length or too large", rep.body);
             
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
+            respond(connection, rep, p->chunked);
             return;
         }
         
-        if(boost::starts_with(uri, "/send"))
+        if(!p->length)
         {
-            std::string res = send_push(body);
-            
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
+            dispatch(p, connection);
             return;
         }
         
-        if(boost::starts_with(uri, "/redeliver"))
+        p->body.reserve(p->length);
+        connection->read(boost::bind(&async_handler::on_read, this, p, _1, _2, _3, _4));
+    }
+    
+    void api_service::async_handler::on_read(boost::shared_ptr<pending> p,
+                                             async_http_service::connection::input_range input,
+                                             boost::system::error_code err, std::size_t bytes,
+                                             async_http_service::connection_ptr connection)
+    {
+        // the first read may hand over body bytes that came with the headers
+        bytes = std::min(bytes, static_cast<std::size_t>(boost::size(input)));
+        bytes = std::min(bytes, p->length - p->body.size());
+        p->body.append(boost::begin(input), boost::begin(input) + bytes);
+        
+        if(p->body.size() == p->length)
         {
-            std::string res = redeliver(body);
-            
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
+            dispatch(p, connection);
             return;
         }
         
-        if(boost::starts_with(uri, "/list_apns"))
+        if(err)
         {
-            std::string res = list_failed_for(push_type_apns);
-            
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
+            LOG_DEBUG << "JSON API client went away while sending the request body: " << err.message();
             return;
         }
-
-        if(boost::starts_with(uri, "/list_gcm"))
+        
+        connection->read(boost::bind(&async_handler::on_read, this, p, _1, _2, _3, _4));
+    }
+    
+    void api_service::async_handler::dispatch(boost::shared_ptr<pending> p,
+                                              async_http_service::connection_ptr connection)
+    {
+        reply rep;
+        handler_.handle(p->method, p->destination, p->body, rep);
+        
+        respond(connection, rep, p->chunked);
+    }
+    
+    void api_service::async_handler::respond(async_http_service::connection_ptr connection,
+                                             const reply& rep, bool chunked)
+    try
+    {
+        // same headers as the stock replies of the sync server
+        std::vector<async_http_service::response_header> headers;
+        async_http_service::response_header header;
+        
+        if(!rep.stream)
+        {
+            header.name = "Content-Length";
+            header.value = boost::lexical_cast<std::string>(rep.body.size());
+            headers.push_back(header);
+        }
+        
+        header.name = "Content-Type";
+        header.value = "text/html";
+        headers.push_back(header);
+        
+        // the async server closes the connection after every reply; http/1.1 clients
+        // would otherwise take it as persistent and send the next request into a reset
+        header.name = "Connection";
+        header.value = "close";
+        headers.push_back(header);
+        
+        if(rep.stream && chunked)
         {
-            std::string res = list_failed_for(push_type_gcm);
+            header.name = "Transfer-Encoding";
+            header.value = "chunked";
+            headers.push_back(header);
+        }
+        
+        if(rep.status == async_http_service::connection::too_many_requests
+           || rep.status == async_http_service::connection::service_unavailable)
+        {
+            async_http_service::response_header retry_after;
+            retry_after.name = "Retry-After";
+            retry_after.value = boost::lexical_cast<std::string>(rep.retry_after);
+            headers.push_back(retry_after);
+        }
+        
+        connection->set_status(static_cast<async_http_service::connection::status_t>(rep.status));
+        connection->set_headers(boost::make_iterator_range(headers.begin(), headers.end()));
+        
+        if(rep.stream)
+        {
+            auto s = boost::make_shared<streaming>();
+            s->stream = rep.stream;
+            s->chunked = chunked;
             
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
-            return;
+            write_chunk(s, connection);
         }
-
-        if(boost::starts_with(uri, "/list"))
+        else if(!rep.body.empty())
+        {
+            connection->write(rep.body);
+        }
+    }
+    catch(std::exception& e)
+    {
+        // the client is gone
+        LOG_DEBUG << "Couldn't write JSON API reply: " << e.what();
+    }
+    
+    void api_service::async_handler::write_chunk(boost::shared_ptr<streaming> s,
+                                                 async_http_service::connection_ptr connection)
+    try
+    {
+        s->piece.clear();
+        s->chunk.clear();
+        
+        bool more = s->stream(s->piece);
+        
+        if(!s->chunked)
+        {
+            s->chunk.swap(s->piece);
+        }
+        else
         {
-            std::string res = list_failed();
+            // an empty chunk would end the body
+            if(!s->piece.empty())
+            {
+                append_chunk(s->chunk, s->piece);
+            }
             
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
-            return;
+            if(!more)
+            {
+                s->chunk.append("0\r\n\r\n");
+            }
         }
         
-        if(boost::starts_with(uri, "/leavers"))
+        if(!more)
         {
-            std::string res = list_leavers();
+            if(!s->chunk.empty())
+            {
+                connection->write(s->chunk);
+            }
             
-            response = http_service::response::stock_reply(
-                http_service::response::ok, res);
             return;
         }
         
+        // nothing to send yet; empty writes never complete
+        if(s->chunk.empty())
+        {
+            write_chunk(s, connection);
+            return;
+        }
         
-        response = http_service::response::stock_reply(
-            http_service::response::not_found);
+        // the next piece is read on the worker pool once this one is out
+        connection->write(s->chunk, boost::bind(&async_handler::on_chunk_written, this, s, connection, _1));
     }
     catch(std::exception& e)
     {
-        LOG_ERROR << "Exception in JSON API: " << e.what();
-        response = http_service::response::stock_reply(
-            http_service::response::ok, error_json(e.what()));
+        // the status went out already; the body is cut short as the connection closes
+        LOG_ERROR << "Couldn't stream JSON API reply: " << e.what();
     }
+    
+    void api_service::async_handler::on_chunk_written(boost::shared_ptr<streaming> s,
+                                                      async_http_service::connection_ptr connection,
+                                                      boost::system::error_code err)
+    {
+        if(err)
+        {
+            LOG_DEBUG << "JSON API client went away during a streamed reply: " << err.message();
+            return;
+        }
+        
+        write_chunk(s, connection);
+    }
+    
+    api_service::api_service(pushy_service& ps,
+                             const std::string& addr, const std::string& port,
+                             const std::string& base, int workers,
+                             std::size_t max_inflight, uint32_t retry_after,
+                             std::size_t keep_alive, std::size_t keep_alive_requests,
+                             bool async, int io_threads, ingest_service* ingest)
+    : connections_(async ? boost::shared_ptr<http::connection_stats>()
+                         : boost::make_shared<http::connection_stats>())
+    , handler_(ps, base, max_inflight, retry_after, connections_, ingest)
+    , async_handler_(handler_)
+    , workers_(workers)
+    , io_threads_(io_threads)
+    {
+        if(async)
+        {
+            // the workers run the apis; the io threads all the connections
+            async_http_service::options options(async_handler_);
+            options.address(addr).port(port)
+                .thread_pool(boost::make_shared<boost::network::utils::thread_pool>(workers_));
             
-    void api_service::handler::log(http_service::string_type const &info)
+            async_service_.reset(new async_http_service(options));
+        }
+        else
+        {
+            // connections stay open for keep_alive seconds between requests
+            http_service::options options(handler_);
+            options.address(addr).port(port).keep_alive_timeout(keep_alive)
+                .max_keep_alive_requests(keep_alive_requests).connection_stats(connections_);
+            
+            service_.reset(new http_service(options));
+        }
+        
+        run();
+    }
+    
+    void api_service::stop()
     {
-        LOG_ERROR << info;
+        if(async_service_)
+        {
+            async_service_->stop();
+        }
+        else
+        {
+            service_->stop();
+        }
     }
     
     void api_service::run()
     {
+        if(async_service_)
+        {
+            for(int i = 0; i < io_threads_; ++i)
+            {
+                threads_.add_thread( new boost::thread(
+                    boost::bind(&async_http_service::run, async_service_.get()) ) );
+            }
+            
+            LOG_DEBUG << "JSON API running async on " << int(io_threads_) << " io threads and "
+                << int(workers_) << " workers.";
+            return;
+        }
+        
         for(int i = 0; i < workers_; ++i)
         {
             // thread_group takes ownership as per documentation
-            threads_.add_thread( new boost::thread( boost::bind(&http_service::run, &service_) ) );
+            threads_.add_thread( new boost::thread( boost::bind(&http_service::run, service_.get()) ) );
             LOG_DEBUG << "JSON API worker spawned.";
         }
     }
-}
\ No newline at end of file
+}
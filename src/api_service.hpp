@@ -10,70 +10,167 @@
 #define pushy_api_service_h
 
 #include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/network.hpp>
 #include <boost/network/protocol/http/server.hpp>
+#include <boost/network/protocol/http/server/async_server.hpp>
 
 #include "database.hpp"
+#include "admission.hpp"
+#include "router.hpp"
 
 namespace pushy
 {
     namespace http = boost::network::http;
     
     class pushy_service;
+    class ingest_service;
     
     /**
-     * API service
+     * API service. In sync mode every worker thread serves one connection at a time;
+     * in async mode a few io threads serve all connections and only run the apis on
+     * the workers once the request body arrived.
      */
     class api_service
     {
     public:
-        struct handler;
+        class handler;
+        class async_handler;
         typedef http::server<handler> http_service;
+        typedef http::async_server<async_handler> async_http_service;
         
-        class handler
+        /**
+         * Result of an api call, independent of the server mode
+         */
+        struct reply
         {
-        public:
-            handler(pushy_service& ps, const std::string& base)
-            : push_service_(ps)
-            , api_base_(base)
+            /// fills the next piece of a streamed body; false with the last one
+            typedef boost::function<bool (std::string&)> body_stream;
+            
+            reply()
+            : status(200)
+            , retry_after(0)
             {
             }
             
+            int             status;
+            std::string     body;
+            body_stream     stream;         // sent in chunks instead of body if set
+            uint32_t        retry_after;    // Retry-After header if set
+        };
+        
+        class handler
+        {
+        public:
+            handler(pushy_service& ps, const std::string& base,
+                    std::size_t max_inflight, uint32_t retry_after,
+                    boost::shared_ptr<http::connection_stats> connections,
+                    ingest_service* ingest);
+            
             void operator() (http_service::request const &request,
                              http_service::response &response);
             
             void log(http_service::string_type const &info);
-
+            
+            /// routes the request to its api
+            void handle(const std::string& method, const std::string& destination,
+                        const std::string& body, reply& rep);
+            
             // helpers
-            const std::string error_json(const std::string& msg);
+            void error_json(const std::string& msg, std::string& out);
             
-            // apis
-            const std::string reg_apns(const std::string& body);
-            const std::string reg_gcm(const std::string& body);
-            const std::string send_push(const std::string& body);
-            const std::string redeliver(const std::string& body);
-
-            const std::string list_leavers();
-            const std::string remove_device(const std::string& body);
-
-            const std::string list_failed();
-            const std::string list_failed_for(const database::push_type& type);
+            // apis; the reply is appended to out
+            void reg_apns(const std::string& body, const std::string& app, std::string& out);
+            void reg_gcm(const std::string& body, const std::string& app, std::string& out);
+            void reg_devices(const std::string& body, const database::push_type& type,
+                             const std::string& app, std::string& out);
+            void send_push(const std::string& body, std::string& out);
+            void redeliver(const std::string& body, std::string& out);
+            void get_message(const std::string& uuid, std::string& out);
+            
+            // lists are streamed as they are read from redis
+            reply::body_stream list_leavers();
+            void remove_device(const std::string& body, std::string& out);
+            
+            reply::body_stream list_failed();
+            reply::body_stream list_failed_for(const database::push_type& type);
             
+            void stats(std::string& out);
+        
         private:
+            enum route_id
+            {
+                route_stats,
+                route_reg_apns,
+                route_reg_gcm,
+                route_reg_apns_bulk,
+                route_reg_gcm_bulk,
+                route_remove_device,
+                route_send,
+                route_redeliver,
+                route_message,
+                route_list,
+                route_list_apns,
+                route_list_gcm,
+                route_leavers
+            };
+            
+            void dispatch(const router::route& route, const router::params& params,
+                          const std::string& body, reply& rep);
+            
             pushy_service&      push_service_;
             std::string         api_base_;
+            inflight_limit      inflight_;
+            router              router_;
+            
+            // connection reuse of the sync server; null in async mode
+            boost::shared_ptr<http::connection_stats>   connections_;
+            
+            // reported with /stats; null without a binary ingest listener
+            ingest_service*     ingest_;
+        };
+        
+        /**
+         * Reads the request body without holding a thread, then runs the api on
+         * the worker pool and writes the reply.
+         */
+        class async_handler
+        {
+        public:
+            async_handler(handler& h)
+            : handler_(h)
+            {
+            }
+            
+            void operator() (async_http_service::request const &request,
+                             async_http_service::connection_ptr connection);
+        
+        private:
+            struct pending;
+            struct streaming;
+            
+            void on_read(boost::shared_ptr<pending> p,
+                         async_http_service::connection::input_range input,
+                         boost::system::error_code err, std::size_t bytes,
+                         async_http_service::connection_ptr connection);
+            
+            void dispatch(boost::shared_ptr<pending> p, async_http_service::connection_ptr connection);
+            void respond(async_http_service::connection_ptr connection, const reply& rep, bool chunked);
+            
+            void write_chunk(boost::shared_ptr<streaming> s, async_http_service::connection_ptr connection);
+            void on_chunk_written(boost::shared_ptr<streaming> s, async_http_service::connection_ptr connection,
+                                  boost::system::error_code err);
+            
+            handler&    handler_;
         };
         
         api_service(pushy_service& ps,
                     const std::string& addr, const std::string& port,
-                    const std::string& base, int workers)
-        : handler_(ps, base)
-        , options_(handler_)
-        , service_(options_.address(addr).port(port))
-        , workers_(workers)
-        {
-            run();
-        }
+                    const std::string& base, int workers,
+                    std::size_t max_inflight, uint32_t retry_after,
+                    std::size_t keep_alive, std::size_t keep_alive_requests,
+                    bool async, int io_threads, ingest_service* ingest = nullptr);
         
         ~api_service()
         {
@@ -83,19 +180,19 @@ namespace pushy
         /**
          * Request service halt
          */
-        void stop()
-        {
-            service_.stop();
-        }
-        
+        void stop();
+    
     private:
         void run();
         
-        handler                 handler_;
-        http_service::options   options_;
-        http_service            service_;
+        boost::shared_ptr<http::connection_stats>   connections_;
+        handler                                 handler_;
+        async_handler                           async_handler_;
+        boost::scoped_ptr<http_service>         service_;
+        boost::scoped_ptr<async_http_service>   async_service_;
         
         uint8_t                 workers_;
+        uint8_t                 io_threads_;
         boost::thread_group     threads_;
     };
 }
@@ -0,0 +1,700 @@
+//
+//  apns_binary.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "apns_binary.hpp"
+#include "logging.hpp"
+#include "p12.hpp"
+
+#include <deque>
+#include <vector>
+#include <stdexcept>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/ssl.hpp>
+
+namespace pushy
+{
+    namespace apns_error
+    {
+        namespace
+        {
+            class category_impl : public boost::system::error_category
+            {
+            public:
+                const char* name() const BOOST_SYSTEM_NOEXCEPT
+                {
+                    return "apns_binary";
+                }
+                
+                std::string message(int ev) const
+                {
+                    switch(ev)
+                    {
+                        case processing_error:
+                            return "processing error";
+                        case missing_device_token:
+                            return "missing device token";
+                        case missing_topic:
+                            return "missing topic";
+                        case missing_payload:
+                            return "missing payload";
+                        case invalid_token_size:
+                            return "invalid token size";
+                        case invalid_topic_size:
+                            return "invalid topic size";
+                        case invalid_payload_size:
+                            return "invalid payload size";
+                        case invalid_token:
+                            return "invalid token";
+                        case shutdown:
+                            return "apns is shutting the connection down";
+                        case connection_lost:
+                            return "connection lost before apns confirmed";
+                        default:
+                            return "unknown apns error";
+                    }
+                }
+            };
+        }
+        
+        const boost::system::error_category& category()
+        {
+            static category_impl instance;
+            return instance;
+        }
+        
+        boost::system::error_code make_error_code(code c)
+        {
+            return boost::system::error_code(static_cast<int>(c), category());
+        }
+        
+        bool device_gone(const boost::system::error_code& err)
+        {
+            return err.category() == category() && err.value() == invalid_token;
+        }
+    }
+    
+    namespace
+    {
+        typedef io::ssl::stream<io::ip::tcp::socket> ssl_socket;
+        
+        const uint32_t min_retry_ms = 500;
+        const uint32_t max_retry_ms = 30000;
+        
+        void put32(std::string& out, uint32_t v)
+        {
+            out.push_back(static_cast<char>((v >> 24) & 0xff));
+            out.push_back(static_cast<char>((v >> 16) & 0xff));
+            out.push_back(static_cast<char>((v >> 8) & 0xff));
+            out.push_back(static_cast<char>(v & 0xff));
+        }
+        
+        void put_item(std::string& out, uint8_t id, const std::string& data)
+        {
+            out.push_back(static_cast<char>(id));
+            out.push_back(static_cast<char>((data.size() >> 8) & 0xff));
+            out.push_back(static_cast<char>(data.size() & 0xff));
+            out += data;
+        }
+        
+        // command 2 notification frame
+        std::string make_frame(const std::string& token, const std::string& payload,
+                               uint32_t ident, uint32_t expiry)
+        {
+            std::string items, ident_bytes, expiry_bytes;
+            
+            put32(ident_bytes, ident);
+            put32(expiry_bytes, expiry);
+            
+            put_item(items, 1, token);
+            put_item(items, 2, payload);
+            put_item(items, 3, ident_bytes);
+            put_item(items, 4, expiry_bytes);
+            put_item(items, 5, std::string(1, 10)); // priority: send immediately
+            
+            std::string frame(1, 2);
+            put32(frame, static_cast<uint32_t>(items.size()));
+            
+            return frame + items;
+        }
+    }
+    
+    /**
+     * The connection and the frames. Lives on the io service thread only;
+     * apns_binary posts everything over.
+     */
+    class apns_binary::connection
+    : public boost::enable_shared_from_this<apns_binary::connection>
+    {
+    public:
+        connection(io::io_service& io, const config& cfg)
+        : io_(io)
+        , config_(cfg)
+        , ctx_(io::ssl::context::sslv23_client)
+        , resolver_(io)
+        , delay_timer_(io)
+        , confirm_timer_(io)
+        , retry_timer_(io)
+        , linger_timer_(io)
+        , queued_bytes_(0)
+        , connecting_(false)
+        , connected_(false)
+        , writing_(false)
+        , broken_(false)
+        , delay_armed_(false)
+        , confirm_armed_(false)
+        , retrying_(false)
+        , closed_(false)
+        , retry_ms_(min_retry_ms)
+        , generation_(0)
+        {
+            ctx_.set_options(io::ssl::context::default_workarounds
+                | io::ssl::context::no_sslv2 | io::ssl::context::no_sslv3);
+            
+            if(config_.verify)
+            {
+                ctx_.set_default_verify_paths();
+                ctx_.set_verify_mode(io::ssl::verify_peer);
+                ctx_.set_verify_callback(io::ssl::rfc2818_verification(config_.host));
+            }
+            
+            use_p12(ctx_.native_handle(), config_.p12, config_.p12_pass);
+        }
+        
+        void submit(const std::string& token, const std::string& payload, uint32_t expiry, uint32_t ident)
+        {
+            frame f;
+            
+            f.ident = ident;
+            f.bytes = make_frame(token, payload, ident, expiry);
+            
+            queued_bytes_ += f.bytes.size();
+            queue_.push_back(f);
+            
+            if(connected_)
+            {
+                schedule_write();
+            }
+            else
+            {
+                connect();
+            }
+        }
+        
+        void connect()
+        {
+            if(closed_ || connecting_ || connected_ || retrying_)
+            {
+                return;
+            }
+            
+            LOG_DEBUG << "apns connecting to " << config_.host << ":" << config_.port;
+            
+            connecting_ = true;
+            link_.reset(new link(io_, ctx_));
+            
+            resolver_.async_resolve(io::ip::tcp::resolver::query(config_.host, config_.port),
+                boost::bind(&connection::on_resolve, shared_from_this(), generation_,
+                    io::placeholders::error, io::placeholders::iterator) );
+        }
+        
+        void close()
+        {
+            closed_ = true;
+            
+            delay_timer_.cancel();
+            confirm_timer_.cancel();
+            retry_timer_.cancel();
+            linger_timer_.cancel();
+            
+            teardown();
+            
+            // the pool only closes connections without unacknowledged messages
+            lose_sent();
+            
+            while(!queue_.empty())
+            {
+                config_.callback(apns_error::make_error_code(apns_error::connection_lost), queue_.front().ident);
+                queue_.pop_front();
+            }
+        }
+    
+    private:
+        struct frame
+        {
+            frame()
+            : written(false)
+            {
+            }
+            
+            uint32_t    ident;
+            std::string bytes;
+            bool        written;    // reported to config_.written already; stays so when resent
+        };
+        
+        struct sent_frame
+        {
+            frame                       f;
+            boost::posix_time::ptime    at; // not_a_date_time while its write is in progress
+        };
+        
+        /**
+         * The stream and buffers of one connection attempt. Every handler holds on to
+         * its link, so a stream torn down with a write or read still pending is only
+         * destroyed once their aborted handlers ran.
+         */
+        struct link
+        {
+            link(io::io_service& io, io::ssl::context& ctx)
+            : socket(io, ctx)
+            {
+            }
+            
+            ssl_socket                  socket;
+            std::string                 write_buf;
+            boost::array<uint8_t, 6>    read_buf;
+        };
+        
+        typedef boost::shared_ptr<link> link_ptr;
+        
+        void on_resolve(uint64_t gen, const boost::system::error_code& err,
+                        io::ip::tcp::resolver::iterator it)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("resolve", err);
+                return;
+            }
+            
+            io::async_connect(link_->socket.lowest_layer(), it,
+                boost::bind(&connection::on_connect, shared_from_this(), link_, gen, io::placeholders::error) );
+        }
+        
+        void on_connect(link_ptr l, uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("connect", err);
+                return;
+            }
+            
+            boost::system::error_code ignored;
+            l->socket.lowest_layer().set_option(io::ip::tcp::no_delay(true), ignored);
+            l->socket.async_handshake(ssl_socket::client,
+                boost::bind(&connection::on_handshake, shared_from_this(), l, gen, io::placeholders::error) );
+        }
+        
+        void on_handshake(link_ptr l, uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("tls handshake", err);
+                return;
+            }
+            
+            LOG_INFO << "apns connected to " << config_.host << ":" << config_.port;
+            
+            connecting_ = false;
+            connected_ = true;
+            retry_ms_ = min_retry_ms;
+            
+            read();
+            
+            if(!queue_.empty())
+            {
+                write();
+            }
+        }
+        
+        // writes right away once a full batch is queued, otherwise waits a little for more
+        void schedule_write()
+        {
+            if(!connected_ || writing_ || queue_.empty())
+            {
+                return;
+            }
+            
+            if(broken_)
+            {
+                return;
+            }
+            
+            if(queued_bytes_ >= config_.batch_bytes || !config_.batch_delay)
+            {
+                write();
+                return;
+            }
+            
+            if(!delay_armed_)
+            {
+                delay_armed_ = true;
+                
+                delay_timer_.expires_from_now(boost::posix_time::microseconds(config_.batch_delay));
+                delay_timer_.async_wait(
+                    boost::bind(&connection::on_delay, shared_from_this(), io::placeholders::error) );
+            }
+        }
+        
+        void on_delay(const boost::system::error_code& err)
+        {
+            delay_armed_ = false;
+            
+            if(!err && connected_ && !writing_ && !broken_ && !queue_.empty())
+            {
+                write();
+            }
+        }
+        
+        // hands as many queued frames as fit into batch_bytes to a single write
+        void write()
+        {
+            auto& buf = link_->write_buf;
+            buf.clear();
+            
+            while(!queue_.empty()
+                  && (buf.empty() || buf.size() + queue_.front().bytes.size() <= config_.batch_bytes))
+            {
+                sent_frame s;
+                s.f = queue_.front();
+                
+                buf += s.f.bytes;
+                queued_bytes_ -= s.f.bytes.size();
+                
+                sent_.push_back(s);
+                queue_.pop_front();
+            }
+            
+            writing_ = true;
+            io::async_write(link_->socket, io::buffer(buf),
+                boost::bind(&connection::on_write, shared_from_this(), link_, generation_, io::placeholders::error) );
+        }
+        
+        void on_write(link_ptr l, uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            writing_ = false;
+            
+            if(err)
+            {
+                // apns closes the connection after an error response. give the read a
+                // moment to pick it up before giving up on the frames written meanwhile
+                broken_ = true;
+                
+                linger_timer_.expires_from_now(boost::posix_time::seconds(1));
+                linger_timer_.async_wait(
+                    boost::bind(&connection::on_linger, shared_from_this(), gen, err, io::placeholders::error) );
+                return;
+            }
+            
+            auto now = boost::posix_time::microsec_clock::universal_time();
+            std::vector<uint32_t> written;
+            
+            for(auto it = sent_.rbegin(); it != sent_.rend() && it->at.is_not_a_date_time(); ++it)
+            {
+                it->at = now;
+                
+                if(!it->f.written)
+                {
+                    it->f.written = true;
+                    written.push_back(it->f.ident);
+                }
+            }
+            
+            if(config_.written)
+            {
+                for(auto ident : written)
+                {
+                    config_.written(ident);
+                }
+            }
+            
+            arm_confirm();
+            
+            // whatever queued up meanwhile goes out right away
+            if(!queue_.empty() && !broken_)
+            {
+                write();
+            }
+        }
+        
+        void on_linger(uint64_t gen, const boost::system::error_code& write_err,
+                       const boost::system::error_code& err)
+        {
+            if(!err && gen == generation_)
+            {
+                fail("write", write_err);
+            }
+        }
+        
+        void arm_confirm()
+        {
+            if(confirm_armed_ || sent_.empty())
+            {
+                return;
+            }
+            
+            confirm_armed_ = true;
+            
+            confirm_timer_.expires_from_now(boost::posix_time::milliseconds(std::max(config_.confirm / 4, 10u)));
+            confirm_timer_.async_wait(
+                boost::bind(&connection::on_confirm, shared_from_this(), io::placeholders::error) );
+        }
+        
+        // frames written long enough ago without an error response went through
+        void on_confirm(const boost::system::error_code& err)
+        {
+            confirm_armed_ = false;
+            
+            if(err)
+            {
+                return;
+            }
+            
+            auto deadline = boost::posix_time::microsec_clock::universal_time()
+                - boost::posix_time::milliseconds(config_.confirm);
+            
+            while(!sent_.empty() && !sent_.front().at.is_not_a_date_time() && sent_.front().at <= deadline)
+            {
+                auto ident = sent_.front().f.ident;
+                sent_.pop_front();
+                
+                config_.callback(boost::system::error_code(), ident);
+            }
+            
+            arm_confirm();
+        }
+        
+        void read()
+        {
+            io::async_read(link_->socket, io::buffer(link_->read_buf),
+                boost::bind(&connection::on_read, shared_from_this(), link_, generation_, io::placeholders::error) );
+        }
+        
+        // apns writes an error response and closes the connection
+        void on_read(link_ptr l, uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("read", err);
+                return;
+            }
+            
+            auto& buf = l->read_buf;
+            auto status = buf[1];
+            uint32_t ident = (uint32_t(buf[2]) << 24) | (uint32_t(buf[3]) << 16)
+                | (uint32_t(buf[4]) << 8) | uint32_t(buf[5]);
+            
+            LOG_DEBUG << "apns error response " << static_cast<int>(status) << " for ident " << ident;
+            
+            // frames up to the failed one went through, the ones after it were dropped by apns.
+            // if it was confirmed already everything still waiting came after it
+            auto failed = sent_.end();
+            for(auto it = sent_.begin(); it != sent_.end(); ++it)
+            {
+                if(it->f.ident == ident)
+                {
+                    failed = it;
+                    break;
+                }
+            }
+            
+            std::deque<sent_frame> done;
+            std::deque<sent_frame> resend(sent_.begin(), sent_.end());
+            
+            if(failed != sent_.end())
+            {
+                done.assign(sent_.begin(), failed);
+                resend.assign(failed + 1, sent_.end());
+                
+                if(status == apns_error::shutdown)
+                {
+                    // the ident of a shutdown is the last one processed
+                    done.push_back(*failed);
+                }
+                else
+                {
+                    config_.callback(apns_error::make_error_code(static_cast<apns_error::code>(status)), ident);
+                }
+            }
+            
+            sent_.clear();
+            
+            for(auto it = resend.rbegin(); it != resend.rend(); ++it)
+            {
+                queued_bytes_ += it->f.bytes.size();
+                queue_.push_front(it->f);
+            }
+            
+            teardown();
+            
+            for(auto& s : done)
+            {
+                config_.callback(boost::system::error_code(), s.f.ident);
+            }
+            
+            if(!queue_.empty())
+            {
+                connect();
+            }
+        }
+        
+        // drops the connection and reconnects later. frames without a verdict are reported lost
+        void fail(const std::string& what, const boost::system::error_code& err)
+        {
+            LOG_WARN << "apns " << config_.host << ":" << config_.port << " " << what
+                << " failed: " << err.message();
+            
+            teardown();
+            lose_sent();
+            
+            if(closed_ || queue_.empty())
+            {
+                return;
+            }
+            
+            retrying_ = true;
+            
+            retry_timer_.expires_from_now(boost::posix_time::milliseconds(retry_ms_));
+            retry_timer_.async_wait(
+                boost::bind(&connection::on_retry, shared_from_this(), io::placeholders::error) );
+            
+            retry_ms_ = std::min(retry_ms_ * 2, max_retry_ms);
+        }
+        
+        void on_retry(const boost::system::error_code& err)
+        {
+            retrying_ = false;
+            
+            if(!err)
+            {
+                connect();
+            }
+        }
+        
+        void teardown()
+        {
+            // handlers of the old socket are ignored from now on
+            ++generation_;
+            
+            connecting_ = false;
+            connected_ = false;
+            writing_ = false;
+            broken_ = false;
+            
+            resolver_.cancel();
+            
+            // the link itself lives on in the handlers still pending on it
+            if(link_)
+            {
+                boost::system::error_code ignored;
+                link_->socket.lowest_layer().close(ignored);
+                link_.reset();
+            }
+        }
+        
+        void lose_sent()
+        {
+            auto lost = sent_;
+            sent_.clear();
+            
+            for(auto& s : lost)
+            {
+                config_.callback(apns_error::make_error_code(apns_error::connection_lost), s.f.ident);
+            }
+        }
+        
+        io::io_service&                 io_;
+        config                          config_;
+        io::ssl::context                ctx_;
+        io::ip::tcp::resolver           resolver_;
+        link_ptr                        link_;  // a new one per connection attempt
+        io::deadline_timer              delay_timer_;
+        io::deadline_timer              confirm_timer_;
+        io::deadline_timer              retry_timer_;
+        io::deadline_timer              linger_timer_;
+        
+        std::deque<frame>               queue_;
+        std::size_t                     queued_bytes_;
+        std::deque<sent_frame>          sent_;      // written, waiting for confirmation
+        
+        bool        connecting_;
+        bool        connected_;
+        bool        writing_;
+        bool        broken_;    // a write failed; waiting for the error response
+        bool        delay_armed_;
+        bool        confirm_armed_;
+        bool        retrying_;
+        bool        closed_;
+        uint32_t    retry_ms_;
+        uint64_t    generation_;
+    };
+    
+    apns_binary::config apns_binary::config::sandbox(const std::string& p12_file)
+    {
+        config cfg;
+        
+        cfg.host = "gateway.sandbox.push.apple.com";
+        cfg.p12 = p12_file;
+        
+        return cfg;
+    }
+    
+    apns_binary::config apns_binary::config::production(const std::string& p12_file)
+    {
+        config cfg;
+        
+        cfg.host = "gateway.push.apple.com";
+        cfg.p12 = p12_file;
+        
+        return cfg;
+    }
+    
+    apns_binary::apns_binary(io::io_service& io, const config& cfg)
+    : io_(io)
+    , conn_(new connection(io, cfg))
+    {
+        io_.post(boost::bind(&connection::connect, conn_));
+    }
+    
+    apns_binary::~apns_binary()
+    {
+        io_.post(boost::bind(&connection::close, conn_));
+    }
+    
+    void apns_binary::post(const push::device& dev, const std::string& payload, uint32_t expiry, uint32_t ident)
+    {
+        io_.post(boost::bind(&connection::submit, conn_, dev.token, payload, expiry, ident));
+    }
+}
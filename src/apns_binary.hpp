@@ -0,0 +1,126 @@
+//
+//  apns_binary.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__apns_binary__
+#define __pushy__apns_binary__
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <push_service.hpp>
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * Status codes of the error response of the binary APNS protocol, plus failures
+     * of the connection.
+     */
+    namespace apns_error
+    {
+        enum code
+        {
+            processing_error = 1,
+            missing_device_token = 2,
+            missing_topic = 3,
+            missing_payload = 4,
+            invalid_token_size = 5,
+            invalid_topic_size = 6,
+            invalid_payload_size = 7,
+            invalid_token = 8,
+            shutdown = 10,
+            unknown = 255,
+            connection_lost = 256   // no verdict before the connection went away
+        };
+        
+        const boost::system::error_category& category();
+        boost::system::error_code make_error_code(code c);
+        
+        /// true if APNS will never accept this device token again
+        bool device_gone(const boost::system::error_code& err);
+    }
+}
+
+namespace boost
+{
+    namespace system
+    {
+        template<>
+        struct is_error_code_enum<pushy::apns_error::code>
+        {
+            static const bool value = true;
+        };
+    }
+}
+
+namespace pushy
+{
+    /**
+     * Binary protocol APNS sender which coalesces queued notification frames into
+     * large TLS writes. A write carries up to 'batch_bytes'; when the connection is
+     * idle the first frame waits up to 'batch_delay' microseconds for company.
+     *
+     * The protocol only reports failures. A frame is reported sent once 'confirm'
+     * milliseconds passed after its write without an error response. On an error
+     * response the failed frame is reported, the ones written after it are sent
+     * again on a new connection.
+     *
+     * 'written' is told about every frame once its first write completed, so that
+     * callers bounding the frames in flight need not wait for the confirmation.
+     */
+    class apns_binary
+    {
+    public:
+        typedef boost::function<void(const boost::system::error_code&, const uint32_t&)> callback_type;
+        typedef boost::function<void(const uint32_t&)> written_type;
+        
+        struct config
+        {
+            config()
+            : port("2195")
+            , batch_bytes(64 * 1024)
+            , batch_delay(200)
+            , confirm(1000)
+            , verify(true)
+            {
+            }
+            
+            static config sandbox(const std::string& p12_file);
+            static config production(const std::string& p12_file);
+            
+            std::string     host;
+            std::string     port;
+            std::string     p12;
+            std::string     p12_pass;
+            std::size_t     batch_bytes;    // max bytes per tls write
+            uint32_t        batch_delay;    // microseconds
+            uint32_t        confirm;        // milliseconds
+            bool            verify;         // verify the server certificate
+            callback_type   callback;
+            written_type    written;        // optional
+        };
+        
+        apns_binary(io::io_service& io, const config& cfg);
+        ~apns_binary();
+        
+        /// same signature as the plugin's post; the token is the binary device token
+        void post(const push::device& dev, const std::string& payload, uint32_t expiry, uint32_t ident);
+    
+    private:
+        class connection;
+        
+        io::io_service&                 io_;
+        boost::shared_ptr<connection>   conn_;
+    };
+}
+
+#endif /* defined(__pushy__apns_binary__) */
@@ -0,0 +1,225 @@
+//
+//  apns_feedback_poller.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "apns_feedback_poller.hpp"
+#include "logging.hpp"
+#include "p12.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/ssl.hpp>
+
+namespace pushy
+{
+    namespace
+    {
+        typedef io::ssl::stream<io::ip::tcp::socket> ssl_socket;
+        
+        // 4 bytes time, 2 bytes token length, the token
+        const std::size_t tuple_header = 6;
+    }
+    
+    /**
+     * One poll at a time on the io service thread.
+     */
+    class apns_feedback_poller::session
+    : public boost::enable_shared_from_this<apns_feedback_poller::session>
+    {
+    public:
+        session(io::io_service& io, const config& cfg)
+        : io_(io)
+        , config_(cfg)
+        , ctx_(io::ssl::context::sslv23_client)
+        , resolver_(io)
+        , timer_(io)
+        , tokens_(0)
+        , closed_(false)
+        {
+            ctx_.set_options(io::ssl::context::default_workarounds
+                | io::ssl::context::no_sslv2 | io::ssl::context::no_sslv3);
+            
+            if(config_.verify)
+            {
+                ctx_.set_default_verify_paths();
+                ctx_.set_verify_mode(io::ssl::verify_peer);
+                ctx_.set_verify_callback(io::ssl::rfc2818_verification(config_.host));
+            }
+            
+            use_p12(ctx_.native_handle(), config_.p12, config_.p12_pass);
+        }
+        
+        void poll()
+        {
+            if(closed_)
+            {
+                return;
+            }
+            
+            LOG_DEBUG << "apns feedback polling " << config_.host << ":" << config_.port;
+            
+            tokens_ = 0;
+            buf_.consume(buf_.size());
+            socket_.reset(new ssl_socket(io_, ctx_));
+            
+            resolver_.async_resolve(io::ip::tcp::resolver::query(config_.host, config_.port),
+                boost::bind(&session::on_resolve, shared_from_this(),
+                    io::placeholders::error, io::placeholders::iterator) );
+        }
+        
+        void close()
+        {
+            closed_ = true;
+            
+            timer_.cancel();
+            resolver_.cancel();
+            
+            if(socket_)
+            {
+                boost::system::error_code ignored;
+                socket_->lowest_layer().close(ignored);
+            }
+        }
+    
+    private:
+        void on_resolve(const boost::system::error_code& err, io::ip::tcp::resolver::iterator it)
+        {
+            if(err)
+            {
+                done("resolve", err);
+                return;
+            }
+            
+            io::async_connect(socket_->lowest_layer(), it,
+                boost::bind(&session::on_connect, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_connect(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                done("connect", err);
+                return;
+            }
+            
+            socket_->async_handshake(ssl_socket::client,
+                boost::bind(&session::on_handshake, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_handshake(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                done("tls handshake", err);
+                return;
+            }
+            
+            read();
+        }
+        
+        void read()
+        {
+            io::async_read(*socket_, buf_, io::transfer_at_least(1),
+                boost::bind(&session::on_read, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_read(const boost::system::error_code& err)
+        {
+            // report every complete tuple, keep a partial one for the next read
+            while(buf_.size() >= tuple_header)
+            {
+                auto data = io::buffer_cast<const uint8_t*>(buf_.data());
+                
+                uint32_t secs = (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16)
+                    | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+                std::size_t length = (std::size_t(data[4]) << 8) | data[5];
+                
+                if(buf_.size() < tuple_header + length)
+                {
+                    break;
+                }
+                
+                std::string token(reinterpret_cast<const char*>(data + tuple_header), length);
+                buf_.consume(tuple_header + length);
+                
+                ++tokens_;
+                config_.callback(boost::system::error_code(), token, boost::posix_time::from_time_t(secs));
+            }
+            
+            if(err)
+            {
+                // the server closes the connection once it sent everything
+                done("read", err == io::error::eof || err == io::ssl::error::stream_truncated
+                    ? boost::system::error_code() : err);
+                return;
+            }
+            
+            read();
+        }
+        
+        void done(const std::string& what, const boost::system::error_code& err)
+        {
+            if(closed_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                LOG_WARN << "apns feedback " << config_.host << ":" << config_.port << " " << what
+                    << " failed: " << err.message();
+            }
+            else
+            {
+                LOG_DEBUG << "apns feedback reported " << tokens_ << " tokens";
+            }
+            
+            boost::system::error_code ignored;
+            socket_->lowest_layer().close(ignored);
+            
+            timer_.expires_from_now(boost::posix_time::seconds(config_.interval));
+            timer_.async_wait(
+                boost::bind(&session::on_timer, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_timer(const boost::system::error_code& err)
+        {
+            if(!err)
+            {
+                poll();
+            }
+        }
+        
+        io::io_service&                 io_;
+        config                          config_;
+        io::ssl::context                ctx_;
+        io::ip::tcp::resolver           resolver_;
+        boost::scoped_ptr<ssl_socket>   socket_;
+        io::deadline_timer              timer_;
+        io::streambuf                   buf_;
+        
+        uint32_t    tokens_;
+        bool        closed_;
+    };
+    
+    apns_feedback_poller::apns_feedback_poller(io::io_service& io, const config& cfg)
+    : io_(io)
+    , session_(new session(io, cfg))
+    {
+    }
+    
+    apns_feedback_poller::~apns_feedback_poller()
+    {
+        io_.post(boost::bind(&session::close, session_));
+    }
+    
+    void apns_feedback_poller::start()
+    {
+        io_.post(boost::bind(&session::poll, session_));
+    }
+}
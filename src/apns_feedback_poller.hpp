@@ -0,0 +1,65 @@
+//
+//  apns_feedback_poller.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__apns_feedback_poller__
+#define __pushy__apns_feedback_poller__
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * Client of the APNS feedback service for any host, e.g. a local mock. Connects
+     * every 'interval' seconds, reads the (time, token) tuples until the server closes
+     * the connection and reports each token to the callback.
+     */
+    class apns_feedback_poller
+    {
+    public:
+        typedef boost::function<void(const boost::system::error_code&, const std::string&,
+                                     const boost::posix_time::ptime&)> callback_type;
+        
+        struct config
+        {
+            config()
+            : port("2196")
+            , interval(3600)
+            , verify(true)
+            {
+            }
+            
+            std::string     host;
+            std::string     port;
+            std::string     p12;
+            std::string     p12_pass;
+            uint32_t        interval;   // seconds between polls
+            bool            verify;     // verify the server certificate
+            callback_type   callback;
+        };
+        
+        apns_feedback_poller(io::io_service& io, const config& cfg);
+        ~apns_feedback_poller();
+        
+        /// polls right away and then every interval
+        void start();
+    
+    private:
+        class session;
+        
+        io::io_service&             io_;
+        boost::shared_ptr<session>  session_;
+    };
+}
+
+#endif /* defined(__pushy__apns_feedback_poller__) */
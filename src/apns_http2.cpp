@@ -0,0 +1,767 @@
+//
+//  apns_http2.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "apns_http2.hpp"
+
+#ifdef PUSHY_WITH_HTTP2
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <openssl/ssl.h>
+#include <nghttp2/nghttp2.h>
+#include <json_spirit/json_spirit_reader_template.h>
+
+#include "logging.hpp"
+#include "p12.hpp"
+
+#endif /* PUSHY_WITH_HTTP2 */
+
+namespace pushy
+{
+    namespace http2_error
+    {
+        namespace
+        {
+            class category_impl : public boost::system::error_category
+            {
+            public:
+                const char* name() const BOOST_SYSTEM_NOEXCEPT
+                {
+                    return "apns_http2";
+                }
+                
+                std::string message(int ev) const
+                {
+                    switch(ev)
+                    {
+                        case bad_request:
+                            return "bad request";
+                        case bad_device_token:
+                            return "bad device token";
+                        case forbidden:
+                            return "certificate or topic rejected";
+                        case method_not_allowed:
+                            return "method not allowed";
+                        case unregistered:
+                            return "device token is no longer active";
+                        case payload_too_large:
+                            return "payload too large";
+                        case throttled:
+                            return "too many requests for the device token";
+                        case server_error:
+                            return "apns internal server error";
+                        case unavailable:
+                            return "apns unavailable";
+                        case connection_lost:
+                            return "connection lost before apns replied";
+                        case protocol_error:
+                            return "http/2 protocol error";
+                        default:
+                            return "unknown apns http/2 error";
+                    }
+                }
+            };
+        }
+        
+        const boost::system::error_category& category()
+        {
+            static category_impl instance;
+            return instance;
+        }
+        
+        boost::system::error_code make_error_code(code c)
+        {
+            return boost::system::error_code(static_cast<int>(c), category());
+        }
+        
+        boost::system::error_code from_reply(int status, const std::string& reason)
+        {
+            switch(status)
+            {
+                case 200:
+                    return boost::system::error_code();
+                case 400:
+                    if(reason == "BadDeviceToken" || reason == "DeviceTokenNotForTopic")
+                    {
+                        return make_error_code(bad_device_token);
+                    }
+                    
+                    return make_error_code(bad_request);
+                case 403:
+                    return make_error_code(forbidden);
+                case 405:
+                    return make_error_code(method_not_allowed);
+                case 410:
+                    return make_error_code(unregistered);
+                case 413:
+                    return make_error_code(payload_too_large);
+                case 429:
+                    return make_error_code(throttled);
+                case 500:
+                    return make_error_code(server_error);
+                case 503:
+                    return make_error_code(unavailable);
+                default:
+                    return make_error_code(status >= 500 ? server_error : bad_request);
+            }
+        }
+        
+        bool device_gone(const boost::system::error_code& err)
+        {
+            return err.category() == category()
+                && (err.value() == unregistered || err.value() == bad_device_token);
+        }
+    }
+
+#ifdef PUSHY_WITH_HTTP2
+    
+    namespace
+    {
+        typedef io::ssl::stream<io::ip::tcp::socket> ssl_socket;
+        
+        const uint32_t      min_retry_ms = 500;
+        const uint32_t      max_retry_ms = 30000;
+        const std::size_t   max_write = 64 * 1024; // bytes handed to one tls write
+        
+        std::string to_hex(const std::string& token)
+        {
+            static const char digits[] = "0123456789abcdef";
+            
+            std::string res;
+            res.reserve(token.size() * 2);
+            
+            for(unsigned char c : token)
+            {
+                res.push_back(digits[c >> 4]);
+                res.push_back(digits[c & 0x0f]);
+            }
+            
+            return res;
+        }
+        
+        nghttp2_nv make_nv(const std::string& name, const std::string& value)
+        {
+            nghttp2_nv nv;
+            
+            nv.name = (uint8_t*)name.data();
+            nv.namelen = name.size();
+            nv.value = (uint8_t*)value.data();
+            nv.valuelen = value.size();
+            nv.flags = NGHTTP2_NV_FLAG_NONE;
+            
+            return nv;
+        }
+        
+        // the reason from a {"reason":"..."} reply body
+        std::string reason_of(const std::string& body)
+        {
+            json_spirit::Value v;
+            if(body.empty() || !json_spirit::read_string(body, v) || v.type() != json_spirit::obj_type)
+            {
+                return std::string();
+            }
+            
+            for(auto& entry : v.get_obj())
+            {
+                if(entry.name_ == "reason" && entry.value_.type() == json_spirit::str_type)
+                {
+                    return entry.value_.get_str();
+                }
+            }
+            
+            return std::string();
+        }
+    }
+    
+    /**
+     * The connection and its http/2 session. Lives on the io service thread only;
+     * apns_http2 posts everything over.
+     */
+    class apns_http2::connection
+    : public boost::enable_shared_from_this<apns_http2::connection>
+    {
+    public:
+        connection(io::io_service& io, const config& cfg)
+        : io_(io)
+        , config_(cfg)
+        , ctx_(io::ssl::context::sslv23_client)
+        , resolver_(io)
+        , timer_(io)
+        , session_(NULL)
+        , connecting_(false)
+        , connected_(false)
+        , writing_(false)
+        , closed_(false)
+        , retry_ms_(min_retry_ms)
+        , generation_(0)
+        {
+            ctx_.set_options(io::ssl::context::default_workarounds
+                | io::ssl::context::no_sslv2 | io::ssl::context::no_sslv3);
+            
+            if(config_.verify)
+            {
+                ctx_.set_default_verify_paths();
+                ctx_.set_verify_mode(io::ssl::verify_peer);
+                ctx_.set_verify_callback(io::ssl::rfc2818_verification(config_.host));
+            }
+            
+            use_p12(ctx_.native_handle(), config_.p12, config_.p12_pass);
+            
+            // apns only talks http/2 if it was negotiated with alpn
+            static const unsigned char alpn[] = { 2, 'h', '2' };
+            SSL_CTX_set_alpn_protos(ctx_.native_handle(), alpn, sizeof(alpn));
+        }
+        
+        ~connection()
+        {
+            if(session_)
+            {
+                nghttp2_session_del(session_);
+            }
+        }
+        
+        void submit(const std::string& token, const std::string& payload, uint32_t expiry, uint32_t ident)
+        {
+            request req;
+            
+            req.path = "/3/device/" + to_hex(token);
+            req.payload = payload;
+            req.expiry = expiry;
+            req.ident = ident;
+            
+            pending_.push_back(req);
+            
+            if(connected_)
+            {
+                start_streams();
+                flush();
+            }
+            else
+            {
+                connect();
+            }
+        }
+        
+        void connect()
+        {
+            if(closed_ || connecting_ || connected_)
+            {
+                return;
+            }
+            
+            LOG_DEBUG << "apns http2 connecting to " << config_.host << ":" << config_.port;
+            
+            connecting_ = true;
+            socket_.reset(new ssl_socket(io_, ctx_));
+            SSL_set_tlsext_host_name(socket_->native_handle(), config_.host.c_str());
+            
+            resolver_.async_resolve(io::ip::tcp::resolver::query(config_.host, config_.port),
+                boost::bind(&connection::on_resolve, shared_from_this(), generation_,
+                    io::placeholders::error, io::placeholders::iterator) );
+        }
+        
+        void close()
+        {
+            closed_ = true;
+            timer_.cancel();
+            
+            teardown();
+            
+            // the pool only closes connections without unacknowledged messages
+            lose_pending();
+        }
+    
+    private:
+        struct request
+        {
+            std::string path;
+            std::string payload;
+            uint32_t    expiry;
+            uint32_t    ident;
+        };
+        
+        struct stream
+        {
+            stream()
+            : offset(0)
+            , status(0)
+            {
+            }
+            
+            request     req;
+            std::size_t offset;
+            int         status;
+            std::string body;
+        };
+        
+        typedef boost::shared_ptr<stream> stream_ptr;
+        
+        void on_resolve(uint64_t gen, const boost::system::error_code& err,
+                        io::ip::tcp::resolver::iterator it)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("resolve", err);
+                return;
+            }
+            
+            io::async_connect(socket_->lowest_layer(), it,
+                boost::bind(&connection::on_connect, shared_from_this(), gen, io::placeholders::error) );
+        }
+        
+        void on_connect(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("connect", err);
+                return;
+            }
+            
+            socket_->lowest_layer().set_option(io::ip::tcp::no_delay(true));
+            socket_->async_handshake(ssl_socket::client,
+                boost::bind(&connection::on_handshake, shared_from_this(), gen, io::placeholders::error) );
+        }
+        
+        void on_handshake(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("tls handshake", err);
+                return;
+            }
+            
+            const unsigned char* proto = NULL;
+            unsigned int len = 0;
+            SSL_get0_alpn_selected(socket_->native_handle(), &proto, &len);
+            
+            if(len != 2 || std::memcmp(proto, "h2", 2) != 0)
+            {
+                fail("alpn", http2_error::make_error_code(http2_error::protocol_error));
+                return;
+            }
+            
+            nghttp2_session_callbacks* callbacks;
+            nghttp2_session_callbacks_new(&callbacks);
+            nghttp2_session_callbacks_set_on_header_callback(callbacks, &connection::on_header);
+            nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &connection::on_data_chunk);
+            nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &connection::on_stream_close);
+            
+            nghttp2_session_client_new(&session_, callbacks, this);
+            nghttp2_session_callbacks_del(callbacks);
+            
+            nghttp2_settings_entry settings[] = {
+                { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 },
+                { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, config_.streams }
+            };
+            nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, settings, 2);
+            
+            LOG_INFO << "apns http2 connected to " << config_.host << ":" << config_.port;
+            
+            connecting_ = false;
+            connected_ = true;
+            retry_ms_ = min_retry_ms;
+            
+            read();
+            start_streams();
+            flush();
+        }
+        
+        // opens streams for pending messages as long as the server allows more
+        void start_streams()
+        {
+            auto limit = std::min<std::size_t>(config_.streams,
+                nghttp2_session_get_remote_settings(session_, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS));
+            
+            while(!pending_.empty() && streams_.size() < std::max<std::size_t>(limit, 1))
+            {
+                stream_ptr s(new stream);
+                s->req = pending_.front();
+                pending_.pop_front();
+                
+                static const std::string method(":method"), post("POST");
+                static const std::string scheme(":scheme"), https("https");
+                static const std::string path(":path"), authority(":authority");
+                static const std::string topic("apns-topic"), expiration("apns-expiration");
+                
+                auto expiry = boost::lexical_cast<std::string>(s->req.expiry);
+                
+                std::vector<nghttp2_nv> headers;
+                headers.push_back(make_nv(method, post));
+                headers.push_back(make_nv(scheme, https));
+                headers.push_back(make_nv(path, s->req.path));
+                headers.push_back(make_nv(authority, config_.host));
+                
+                if(!config_.topic.empty())
+                {
+                    headers.push_back(make_nv(topic, config_.topic));
+                }
+                
+                if(s->req.expiry)
+                {
+                    headers.push_back(make_nv(expiration, expiry));
+                }
+                
+                nghttp2_data_provider body;
+                body.source.ptr = s.get();
+                body.read_callback = &connection::read_body;
+                
+                auto id = nghttp2_submit_request(session_, NULL, &headers[0], headers.size(), &body, NULL);
+                if(id < 0)
+                {
+                    LOG_ERROR << "apns http2 failed to submit request: " << nghttp2_strerror(id);
+                    config_.callback(http2_error::make_error_code(http2_error::protocol_error), s->req.ident);
+                    continue;
+                }
+                
+                streams_[id] = s;
+            }
+        }
+        
+        void read()
+        {
+            socket_->async_read_some(io::buffer(read_buf_),
+                boost::bind(&connection::on_read, shared_from_this(), generation_,
+                    io::placeholders::error, io::placeholders::bytes_transferred) );
+        }
+        
+        void on_read(uint64_t gen, const boost::system::error_code& err, std::size_t bytes)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("read", err);
+                return;
+            }
+            
+            auto rv = nghttp2_session_mem_recv(session_, read_buf_.data(), bytes);
+            if(rv < 0)
+            {
+                LOG_WARN << "apns http2 session error: " << nghttp2_strerror(rv);
+                fail("session", http2_error::make_error_code(http2_error::protocol_error));
+                return;
+            }
+            
+            // replies free streams for pending messages
+            start_streams();
+            flush();
+            
+            if(!nghttp2_session_want_read(session_) && !nghttp2_session_want_write(session_))
+            {
+                // goaway from apns
+                fail("session closed by server", http2_error::make_error_code(http2_error::connection_lost));
+                return;
+            }
+            
+            read();
+        }
+        
+        // writes everything the session has to send, one write at a time
+        void flush()
+        {
+            if(!connected_ || writing_)
+            {
+                return;
+            }
+            
+            write_buf_.clear();
+            
+            while(write_buf_.size() < max_write)
+            {
+                const uint8_t* data = NULL;
+                auto len = nghttp2_session_mem_send(session_, &data);
+                
+                if(len < 0)
+                {
+                    LOG_WARN << "apns http2 session error: " << nghttp2_strerror(len);
+                    fail("session", http2_error::make_error_code(http2_error::protocol_error));
+                    return;
+                }
+                
+                if(len == 0)
+                {
+                    break;
+                }
+                
+                write_buf_.insert(write_buf_.end(), data, data + len);
+            }
+            
+            if(write_buf_.empty())
+            {
+                return;
+            }
+            
+            writing_ = true;
+            io::async_write(*socket_, io::buffer(write_buf_),
+                boost::bind(&connection::on_write, shared_from_this(), generation_,
+                    io::placeholders::error) );
+        }
+        
+        void on_write(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            writing_ = false;
+            
+            if(err)
+            {
+                fail("write", err);
+                return;
+            }
+            
+            flush();
+        }
+        
+        // drops the connection and reconnects later. messages without a reply are reported lost
+        void fail(const std::string& what, const boost::system::error_code& err)
+        {
+            LOG_WARN << "apns http2 " << config_.host << ":" << config_.port << " " << what
+                << " failed: " << err.message() << ". reconnecting in " << retry_ms_ << "ms";
+            
+            teardown();
+            
+            if(closed_)
+            {
+                return;
+            }
+            
+            timer_.expires_from_now(boost::posix_time::milliseconds(retry_ms_));
+            timer_.async_wait(
+                boost::bind(&connection::on_retry, shared_from_this(), io::placeholders::error) );
+            
+            retry_ms_ = std::min(retry_ms_ * 2, max_retry_ms);
+        }
+        
+        void on_retry(const boost::system::error_code& err)
+        {
+            if(!err)
+            {
+                connect();
+            }
+        }
+        
+        void teardown()
+        {
+            // handlers of the old socket are ignored from now on
+            ++generation_;
+            
+            connecting_ = false;
+            connected_ = false;
+            writing_ = false;
+            
+            resolver_.cancel();
+            
+            if(socket_)
+            {
+                boost::system::error_code ignored;
+                socket_->lowest_layer().close(ignored);
+            }
+            
+            auto lost = streams_;
+            streams_.clear();
+            
+            if(session_)
+            {
+                nghttp2_session_del(session_);
+                session_ = NULL;
+            }
+            
+            for(auto& entry : lost)
+            {
+                config_.callback(http2_error::make_error_code(http2_error::connection_lost),
+                                 entry.second->req.ident);
+            }
+        }
+        
+        void lose_pending()
+        {
+            while(!pending_.empty())
+            {
+                auto ident = pending_.front().ident;
+                pending_.pop_front();
+                
+                config_.callback(http2_error::make_error_code(http2_error::connection_lost), ident);
+            }
+        }
+        
+        /*
+         * nghttp2 callbacks
+         */
+        static ssize_t read_body(nghttp2_session*, int32_t, uint8_t* buf, size_t length,
+                                 uint32_t* data_flags, nghttp2_data_source* source, void*)
+        {
+            auto s = static_cast<stream*>(source->ptr);
+            auto len = std::min(length, s->req.payload.size() - s->offset);
+            
+            std::memcpy(buf, s->req.payload.data() + s->offset, len);
+            s->offset += len;
+            
+            if(s->offset == s->req.payload.size())
+            {
+                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+            }
+            
+            return len;
+        }
+        
+        static int on_header(nghttp2_session*, const nghttp2_frame* frame,
+                             const uint8_t* name, size_t namelen,
+                             const uint8_t* value, size_t valuelen, uint8_t, void* user_data)
+        {
+            if(frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_RESPONSE)
+            {
+                return 0;
+            }
+            
+            auto self = static_cast<connection*>(user_data);
+            auto it = self->streams_.find(frame->hd.stream_id);
+            
+            if(it != self->streams_.end() && namelen == 7 && std::memcmp(name, ":status", 7) == 0)
+            {
+                it->second->status = std::atoi(std::string((const char*)value, valuelen).c_str());
+            }
+            
+            return 0;
+        }
+        
+        static int on_data_chunk(nghttp2_session*, uint8_t, int32_t stream_id,
+                                 const uint8_t* data, size_t len, void* user_data)
+        {
+            auto self = static_cast<connection*>(user_data);
+            auto it = self->streams_.find(stream_id);
+            
+            if(it != self->streams_.end())
+            {
+                it->second->body.append((const char*)data, len);
+            }
+            
+            return 0;
+        }
+        
+        static int on_stream_close(nghttp2_session*, int32_t stream_id, uint32_t error_code, void* user_data)
+        {
+            auto self = static_cast<connection*>(user_data);
+            auto it = self->streams_.find(stream_id);
+            
+            if(it == self->streams_.end())
+            {
+                return 0;
+            }
+            
+            auto s = it->second;
+            self->streams_.erase(it);
+            
+            boost::system::error_code err;
+            if(!s->status)
+            {
+                // reset or refused by the server before it replied
+                err = http2_error::make_error_code(error_code
+                    ? http2_error::protocol_error : http2_error::connection_lost);
+            }
+            else
+            {
+                err = http2_error::from_reply(s->status, reason_of(s->body));
+            }
+            
+            self->config_.callback(err, s->req.ident);
+            return 0;
+        }
+        
+        io::io_service&                 io_;
+        config                          config_;
+        io::ssl::context                ctx_;
+        io::ip::tcp::resolver           resolver_;
+        boost::scoped_ptr<ssl_socket>   socket_; // a new one per connection attempt
+        io::deadline_timer              timer_;
+        nghttp2_session*                session_;
+        
+        std::deque<request>             pending_;
+        std::map<int32_t, stream_ptr>   streams_;
+        
+        std::vector<uint8_t>            write_buf_;
+        boost::array<uint8_t, 16384>    read_buf_;
+        
+        bool        connecting_;
+        bool        connected_;
+        bool        writing_;
+        bool        closed_;
+        uint32_t    retry_ms_;
+        uint64_t    generation_;
+    };
+    
+    apns_http2::config apns_http2::config::sandbox(const std::string& p12_file)
+    {
+        config cfg;
+        
+        cfg.host = "api.sandbox.push.apple.com";
+        cfg.p12 = p12_file;
+        
+        return cfg;
+    }
+    
+    apns_http2::config apns_http2::config::production(const std::string& p12_file)
+    {
+        config cfg;
+        
+        cfg.host = "api.push.apple.com";
+        cfg.p12 = p12_file;
+        
+        return cfg;
+    }
+    
+    apns_http2::apns_http2(io::io_service& io, const config& cfg)
+    : io_(io)
+    , conn_(new connection(io, cfg))
+    {
+        io_.post(boost::bind(&connection::connect, conn_));
+    }
+    
+    apns_http2::~apns_http2()
+    {
+        io_.post(boost::bind(&connection::close, conn_));
+    }
+    
+    void apns_http2::post(const push::device& dev, const std::string& payload, uint32_t expiry, uint32_t ident)
+    {
+        io_.post(boost::bind(&connection::submit, conn_, dev.token, payload, expiry, ident));
+    }
+
+#endif /* PUSHY_WITH_HTTP2 */
+}
@@ -0,0 +1,123 @@
+//
+//  apns_http2.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__apns_http2__
+#define __pushy__apns_http2__
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <push_service.hpp>
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * Errors reported per message by the HTTP/2 APNS provider api. Apple answers every
+     * request with a status code and, on failure, a reason; both map to one of these.
+     */
+    namespace http2_error
+    {
+        enum code
+        {
+            bad_request = 1,        // 400
+            bad_device_token,       // 400 BadDeviceToken, DeviceTokenNotForTopic
+            forbidden,              // 403
+            method_not_allowed,     // 405
+            unregistered,           // 410
+            payload_too_large,      // 413
+            throttled,              // 429
+            server_error,           // 500
+            unavailable,            // 503
+            connection_lost,        // no reply before the connection went away
+            protocol_error          // http/2 framing or tls failure
+        };
+        
+        const boost::system::error_category& category();
+        boost::system::error_code make_error_code(code c);
+        
+        /// maps the :status and the reason of an APNS reply; success for 200
+        boost::system::error_code from_reply(int status, const std::string& reason);
+        
+        /// true if APNS will never accept this device token again
+        bool device_gone(const boost::system::error_code& err);
+    }
+}
+
+namespace boost
+{
+    namespace system
+    {
+        template<>
+        struct is_error_code_enum<pushy::http2_error::code>
+        {
+            static const bool value = true;
+        };
+    }
+}
+
+#ifdef PUSHY_WITH_HTTP2
+
+namespace pushy
+{
+    /**
+     * APNS provider api client (HTTP/2 over TLS) with a single connection which
+     * multiplexes up to 'streams' messages at once. Every message gets its own reply
+     * which is reported to the callback with the ident given to post().
+     *
+     * Messages posted while disconnected are held and sent once the connection is back.
+     * Messages in flight when the connection is lost are reported as connection_lost.
+     */
+    class apns_http2
+    {
+    public:
+        typedef boost::function<void(const boost::system::error_code&, const uint32_t&)> callback_type;
+        
+        struct config
+        {
+            config()
+            : port("443")
+            , streams(1000)
+            , verify(true)
+            {
+            }
+            
+            static config sandbox(const std::string& p12_file);
+            static config production(const std::string& p12_file);
+            
+            std::string     host;
+            std::string     port;
+            std::string     p12;
+            std::string     p12_pass;
+            std::string     topic;      // apns-topic header, the bundle id; optional for single topic certs
+            uint32_t        streams;    // max concurrent streams; lowered if the server says so
+            bool            verify;     // verify the server certificate
+            callback_type   callback;
+        };
+        
+        apns_http2(io::io_service& io, const config& cfg);
+        ~apns_http2();
+        
+        /// same signature as the binary plugin's post; expiry 0 means no apns-expiration
+        void post(const push::device& dev, const std::string& payload, uint32_t expiry, uint32_t ident);
+    
+    private:
+        class connection;
+        
+        io::io_service&                 io_;
+        boost::shared_ptr<connection>   conn_;
+    };
+}
+
+#endif /* PUSHY_WITH_HTTP2 */
+
+#endif /* defined(__pushy__apns_http2__) */
@@ -0,0 +1,137 @@
+//
+//  app_config.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "app_config.hpp"
+
+#include <stdexcept>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace pushy
+{
+    std::map<std::string, app_config> app_config::parse(const boost::program_options::parsed_options& opts)
+    {
+        std::map<std::string, app_config> res;
+        
+        for(auto& opt : opts.options)
+        {
+            if(!opt.unregistered || !boost::starts_with(opt.string_key, "app."))
+            {
+                continue;
+            }
+            
+            // app.<id>.<key>
+            auto rest = opt.string_key.substr(4);
+            auto pos = rest.find('.');
+            
+            if(pos == std::string::npos || pos == 0)
+            {
+                throw std::runtime_error("invalid app option '" + opt.string_key + "'");
+            }
+            
+            auto& app = res[rest.substr(0, pos)];
+            auto key = rest.substr(pos + 1);
+            auto value = opt.value.empty() ? std::string() : opt.value.front();
+            
+            if(key == "apns.p12")
+            {
+                app.apns_p12 = value;
+            }
+            else if(key == "apns.password")
+            {
+                app.apns_password = value;
+            }
+            else if(key == "apns.mode")
+            {
+                app.apns_mode = value;
+            }
+            else if(key == "apns.pool")
+            {
+                app.apns_pool = boost::lexical_cast<int>(value);
+            }
+            else if(key == "apns.pool_max")
+            {
+                app.apns_pool_max = boost::lexical_cast<int>(value);
+            }
+            else if(key == "apns.protocol")
+            {
+                app.apns_protocol = value;
+            }
+            else if(key == "apns.topic")
+            {
+                app.apns_topic = value;
+            }
+            else if(key == "apns.host")
+            {
+                app.apns_host = value;
+            }
+            else if(key == "apns.verify")
+            {
+                app.apns_verify = value == "true" || value == "1" || value == "yes" || value == "on";
+            }
+            else if(key == "apns.streams")
+            {
+                app.apns_streams = boost::lexical_cast<uint32_t>(value);
+            }
+            else if(key == "apns.batch_bytes")
+            {
+                app.apns_batch_bytes = boost::lexical_cast<std::size_t>(value);
+            }
+            else if(key == "apns.batch_delay")
+            {
+                app.apns_batch_delay = boost::lexical_cast<uint32_t>(value);
+            }
+            else if(key == "apns.feedback_host")
+            {
+                app.apns_feedback_host = value;
+            }
+            else if(key == "apns.feedback_interval")
+            {
+                app.apns_feedback_interval = boost::lexical_cast<uint32_t>(value);
+            }
+            else if(key == "gcm.project")
+            {
+                app.gcm_project = value;
+            }
+            else if(key == "gcm.key")
+            {
+                app.gcm_key = value;
+            }
+            else if(key == "gcm.pool")
+            {
+                app.gcm_pool = boost::lexical_cast<int>(value);
+            }
+            else if(key == "gcm.pool_max")
+            {
+                app.gcm_pool_max = boost::lexical_cast<int>(value);
+            }
+            else if(key == "gcm.multicast")
+            {
+                app.gcm_multicast = value == "true" || value == "1" || value == "yes" || value == "on";
+            }
+            else if(key == "gcm.url")
+            {
+                app.gcm_url = value;
+            }
+            else if(key == "gcm.batch_size")
+            {
+                app.gcm_batch_size = boost::lexical_cast<uint32_t>(value);
+            }
+            else if(key == "gcm.batch_window")
+            {
+                app.gcm_batch_window = boost::lexical_cast<uint32_t>(value);
+            }
+            else
+            {
+                throw std::runtime_error("unknown app option '" + opt.string_key + "'");
+            }
+        }
+        
+        return res;
+    }
+}
@@ -0,0 +1,92 @@
+//
+//  app_config.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__app_config__
+#define __pushy__app_config__
+
+#include <map>
+#include <string>
+#include <boost/program_options.hpp>
+
+namespace pushy
+{
+    /**
+     * Provider credentials of one app. Apps are configured in their own config file
+     * section, e.g.
+     *
+     *   [app.myapp]
+     *   apns.p12 = myapp.p12
+     *   gcm.project = ...
+     *   gcm.key = ...
+     *
+     * Keys are the same as for the default app: apns.p12, apns.password, apns.mode,
+     * apns.pool, apns.pool_max, apns.protocol, apns.topic, apns.host, apns.verify,
+     * apns.streams, apns.batch_bytes, apns.batch_delay, apns.feedback_host, apns.feedback_interval,
+     * gcm.project, gcm.key, gcm.pool, gcm.pool_max, gcm.multicast, gcm.url,
+     * gcm.batch_size and gcm.batch_window.
+     */
+    struct app_config
+    {
+        app_config()
+        : apns_mode("sandbox")
+        , apns_pool(1)
+        , apns_pool_max(0)
+        , apns_protocol("binary")
+        , apns_verify(true)
+        , apns_streams(1000)
+        , apns_batch_bytes(0)
+        , apns_batch_delay(200)
+        , apns_feedback_interval(3600)
+        , gcm_pool(1)
+        , gcm_pool_max(0)
+        , gcm_multicast(false)
+        , gcm_batch_size(1000)
+        , gcm_batch_window(5)
+        {
+        }
+        
+        bool has_apns() const
+        {
+            return !apns_p12.empty();
+        }
+        
+        bool has_gcm() const
+        {
+            return !gcm_project.empty() || !gcm_key.empty();
+        }
+        
+        /// collects the app sections from options left unregistered by the parser
+        static std::map<std::string, app_config> parse(const boost::program_options::parsed_options& opts);
+        
+        std::string apns_p12;
+        std::string apns_password;
+        std::string apns_mode;
+        int         apns_pool;
+        int         apns_pool_max;
+        std::string apns_protocol;  // 'binary' or 'http2'
+        std::string apns_topic;     // http2 only
+        std::string apns_host;      // host[:port] replacing apple's server
+        bool        apns_verify;    // verify the server certificates of apns_host and apns_feedback_host
+        uint32_t    apns_streams;   // http2 only; concurrent streams per connection
+        std::size_t apns_batch_bytes;   // binary only; 0 for the push_service plugin unless apns_host is set
+        uint32_t    apns_batch_delay;   // binary only; microseconds
+        std::string apns_feedback_host;     // host[:port] replacing apple's feedback service
+        uint32_t    apns_feedback_interval; // seconds between polls of apns_feedback_host
+        
+        std::string gcm_project;
+        std::string gcm_key;
+        int         gcm_pool;
+        int         gcm_pool_max;
+        bool        gcm_multicast;      // batch identical payloads into multicast requests
+        std::string gcm_url;            // multicast only; empty for google's endpoint
+        uint32_t    gcm_batch_size;     // multicast only
+        uint32_t    gcm_batch_window;   // multicast only; milliseconds
+    };
+}
+
+#endif /* defined(__pushy__app_config__) */
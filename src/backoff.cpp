@@ -0,0 +1,51 @@
+//
+//  backoff.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "backoff.hpp"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+using namespace boost::posix_time;
+
+namespace pushy
+{
+    backoff::backoff(const time_duration& base, const time_duration& cap)
+    : base_(base)
+    , cap_(cap)
+    {
+        if(base_.total_milliseconds() <= 0 || cap_ < base_)
+        {
+            throw std::runtime_error("backoff base must be positive and not greater than the cap");
+        }
+    }
+    
+    time_duration backoff::delay(uint32_t attempts) const
+    {
+        static thread_local std::mt19937_64 rng(std::random_device{}());
+        
+        int64_t base_ms = base_.total_milliseconds();
+        int64_t cap_ms  = cap_.total_milliseconds();
+        
+        // base * 2^(attempts-1) without overflowing for large attempt counts
+        int64_t delay_ms = base_ms;
+        for(uint32_t i = 1; i < attempts && delay_ms < cap_ms; ++i)
+        {
+            delay_ms *= 2;
+        }
+        
+        delay_ms = std::min(delay_ms, cap_ms);
+        
+        // spread retries of messages which failed together, also once capped
+        std::uniform_int_distribution<int64_t> jitter(0, delay_ms / 4);
+        delay_ms += jitter(rng);
+        
+        return milliseconds(delay_ms);
+    }
+}
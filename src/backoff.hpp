@@ -0,0 +1,41 @@
+//
+//  backoff.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__backoff__
+#define __pushy__backoff__
+
+#include <cstdint>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace pushy
+{
+    /**
+     * Exponential backoff with jitter for message redelivery.
+     * The n-th retry is due after base * 2^(n-1), capped, plus up to 25% random jitter.
+     */
+    class backoff
+    {
+    public:
+        backoff(const boost::posix_time::time_duration& base,
+                const boost::posix_time::time_duration& cap);
+        
+        /// delay before the next attempt given the amount of failed attempts so far
+        boost::posix_time::time_duration delay(uint32_t attempts) const;
+        
+        const boost::posix_time::time_duration& base() const
+        {
+            return base_;
+        }
+        
+    private:
+        boost::posix_time::time_duration base_;
+        boost::posix_time::time_duration cap_;
+    };
+}
+
+#endif /* defined(__pushy__backoff__) */
@@ -14,9 +14,11 @@
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/string_generator.hpp>
 
+#include <boost/lexical_cast.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <redis3m/patterns/scheduler.h>
+#include <redis3m/utils/datetime.h>
 
 namespace pushy {
 namespace database {
@@ -26,6 +28,186 @@ namespace database {
     
     dba dba::inst;
     
+    namespace
+    {
+        // messages written before priorities existed have no such field. anything
+        // which is not a known priority falls back to normal as well so that it can
+        // never select a lane that does not exist.
+        push_priority parse_priority(const std::string& priority_str)
+        {
+            int priority = -1;
+            
+            if(!boost::conversion::try_lexical_convert(priority_str, priority)
+               || priority < 0 || priority >= push_priority_count)
+            {
+                return push_priority_normal;
+            }
+            
+            return static_cast<push_priority>(priority);
+        }
+        
+        push_priority read_priority(connection::ptr_t conn, const std::string& field)
+        {
+            return parse_priority(conn->run(command("HGET") << field << "priority").str());
+        }
+        
+        // redelivery schedule scores are milliseconds since epoch
+        int64_t to_score(const ptime& time)
+        {
+            return (time - ptime(boost::gregorian::date(1970, 1, 1))).total_milliseconds();
+        }
+        
+        // messages with a send_at wait here until they are due
+        patterns::scheduler send_schedule(const push_type& type)
+        {
+            return patterns::scheduler("scheduled." + dba::type_to_str(type));
+        }
+        
+        // writes a message record and, in the same step, claims its idempotency key, puts it on
+        // the send schedule and points its collapse key at it. the message the collapse key
+        // pointed at before is removed from everywhere it could still be picked up for delivery.
+        // KEYS: message record, idempotency key or '', scheduled zset, collapse key or '',
+        //       failed set, redelivery zset, record of the message the collapse key points at or ''
+        // ARGV: message uuid, idempotency ttl, schedule score or '', uuid the collapse key
+        //       points at or '', record fields and values..
+        // returns the uuid owning the idempotency key and the uuid of the superseded message or '',
+        // or nil without writing anything if the collapse key was moved since it was read
+        patterns::script_exec write_script(
+            "if KEYS[4] ~= '' and (redis.call('GET', KEYS[4]) or '') ~= ARGV[4] then "
+            "  return false "
+            "end "
+            "if KEYS[2] ~= '' and not redis.call('SET', KEYS[2], ARGV[1], 'EX', ARGV[2], 'NX') then "
+            "  return { redis.call('GET', KEYS[2]), '' } "
+            "end "
+            "redis.call('HMSET', KEYS[1], unpack(ARGV, 5)) "
+            "if ARGV[3] ~= '' then "
+            "  redis.call('ZADD', KEYS[3], ARGV[3], ARGV[1]) "
+            "end "
+            "if KEYS[4] == '' then "
+            "  return { ARGV[1], '' } "
+            "end "
+            "redis.call('SET', KEYS[4], ARGV[1]) "
+            "if ARGV[4] ~= '' then "
+            "  redis.call('SREM', KEYS[5], ARGV[4]) "
+            "  redis.call('ZREM', KEYS[6], ARGV[4]) "
+            "  redis.call('ZREM', KEYS[3], ARGV[4]) "
+            "  redis.call('DEL', KEYS[7]) "
+            "end "
+            "return { ARGV[1], ARGV[4] }");
+        
+        // a collapse key moved by another writer between reading it and the write_script call
+        const int write_retries = 10;
+        
+        // runs write_script with the record the collapse key (keys[3]) points at right now.
+        // args start with the uuid, ttl and score and carry the record fields after those
+        reply exec_write_script(connection::ptr_t& conn, std::vector<std::string> keys, std::vector<std::string> args)
+        {
+            std::string prev = keys[3].empty() ? std::string() : conn->run(command("GET") << keys[3]).str();
+            
+            keys.push_back(prev.empty() ? std::string() : "message." + prev);
+            args.insert(args.begin() + 3, prev);
+            
+            return write_script.exec(conn, keys, args);
+        }
+        
+        // records a delivery failure unless the message is gone, e.g. because it was superseded.
+        // KEYS: message record, apns failed set, gcm failed set. ARGV: message uuid, reason
+        // returns the attempts so far, or 0 if the record does not exist
+        patterns::script_exec fail_script(
+            "local t = redis.call('HGET', KEYS[1], 'type') "
+            "if not t then "
+            "  return 0 "
+            "end "
+            "local set = KEYS[2 + tonumber(t)] "
+            "if not set then "
+            "  return redis.error_reply('unknown message type ' .. t) "
+            "end "
+            "redis.call('HSET', KEYS[1], 'reason', ARGV[2]) "
+            "redis.call('SADD', set, ARGV[1]) "
+            "return redis.call('HINCRBY', KEYS[1], 'attempts', 1)");
+        
+        // drops a message record and its collapse key unless that was taken over already.
+        // KEYS: message record. ARGV: message uuid
+        patterns::script_exec drop_script(
+            "local ck = redis.call('HGET', KEYS[1], 'collapse') "
+            "if ck and redis.call('GET', ck) == ARGV[1] then "
+            "  redis.call('DEL', ck) "
+            "end "
+            "return redis.call('DEL', KEYS[1])");
+        
+        // claims up to ARGV[3] due messages of a send schedule at once. every claimed id is
+        // pushed forward to ARGV[2] so other nodes only see it again if it is not dequeued by then.
+        // KEYS: scheduled zset. ARGV: now, locked until, limit. returns the claimed ids
+        patterns::script_exec claim_script(
+            "local ids = redis.call('ZRANGEBYSCORE', KEYS[1], '-inf', ARGV[1], 'LIMIT', 0, ARGV[3]) "
+            "for _, id in ipairs(ids) do "
+            "  redis.call('ZADD', KEYS[1], ARGV[2], id) "
+            "end "
+            "return ids");
+        
+        // set members fetched per SSCAN when a whole set is listed
+        const std::size_t scan_batch = 1000;
+        
+        // devices written or dropped per pipelined round trip
+        const std::size_t write_batch = 1000;
+        
+        // one SSCAN step; marks the scan done once redis hands the cursor back as 0
+        std::vector<std::string> sscan(connection::ptr_t conn, dba::set_scan& scan, std::size_t count)
+        {
+            std::vector<std::string> members;
+            
+            if(scan.done)
+            {
+                return members;
+            }
+            
+            auto rep = conn->run(command("SSCAN") << scan.key << scan.cursor << "COUNT" << count);
+            
+            scan.cursor = rep.elements()[0].str();
+            scan.done = scan.cursor == "0";
+            
+            for(auto& element : rep.elements()[1].elements())
+            {
+                members.push_back(element.str());
+            }
+            
+            return members;
+        }
+        
+        // fields read into a redelivery_entry, see read_entry
+        command& entry_fields(command& cmd)
+        {
+            return cmd << "device" << "priority" << "tag" << "payload" << "timestamp" << "attempts" << "app"
+                << "collapse";
+        }
+        
+        // parses the reply to HMGET message.<uuid> with entry_fields
+        bool read_entry(const std::string& msg_uuid, const push_type& type, const reply& rep,
+                        dba::redelivery_entry& entry)
+        {
+            auto& fields = rep.elements();
+            if(fields.size() != 8 || fields[0].str().empty())
+            {
+                return false;
+            }
+            
+            boost::uuids::string_generator str_gen;
+            
+            entry.msg_uuid = str_gen(msg_uuid);
+            entry.dev_uuid = str_gen(fields[0].str());
+            entry.provider_type = type;
+            entry.priority = parse_priority(fields[1].str());
+            entry.tag      = fields[2].str();
+            entry.payload  = fields[3].str();
+            entry.ts       = time_from_string(fields[4].str());
+            entry.attempts = fields[5].str().empty() ? 1 : boost::lexical_cast<uint32_t>(fields[5].str());
+            entry.app      = fields[6].str();
+            entry.collapse = fields[7].str();
+            
+            return true;
+        }
+    }
+    
     std::string dba::type_to_str(const push_type& type)
     {
         switch(type)
@@ -40,6 +222,34 @@ namespace database {
         }
     }
     
+    std::string dba::priority_to_str(const push_priority& priority)
+    {
+        switch(priority)
+        {
+            case push_priority_high:
+                return "high";
+            case push_priority_normal:
+                return "normal";
+            default:
+                throw std::runtime_error("priority_to_str failed for priority "
+                    + boost::lexical_cast<std::string>(priority) );
+        }
+    }
+    
+    push_priority dba::str_to_priority(const std::string& name)
+    {
+        if(name.empty() || name == "normal")
+        {
+            return push_priority_normal;
+        }
+        
+        if(name == "high")
+        {
+            return push_priority_high;
+        }
+        
+        throw std::runtime_error("unknown priority '" + name + "'. must be 'high' or 'normal'");
+    }
     
     void dba::init_pool(const std::string& host, int port)
     {
@@ -58,36 +268,74 @@ namespace database {
         LOG_INFO << "connection to redis established.";
     }
     
-    boost::uuids::uuid dba::register_apns_device(const std::string& token)
+    void dba::limit_writes(std::size_t max_inflight, uint32_t retry_after)
+    {
+        writes_.configure(max_inflight, retry_after);
+    }
+    
+    json_spirit::Object dba::write_stats() const
+    {
+        return writes_.stats();
+    }
+    
+    boost::uuids::uuid dba::register_apns_device(const std::string& token, const std::string& app)
     {
         LOG_DEBUG << "registering apns device..";
-        return register_device(token, push_type_apns);
+        return register_device(token, push_type_apns, app);
     }
     
-    boost::uuids::uuid dba::register_gcm_device(const std::string& token)
+    boost::uuids::uuid dba::register_gcm_device(const std::string& token, const std::string& app)
     {
         LOG_DEBUG << "registering gcm device..";
-        return register_device(token, push_type_gcm);
+        return register_device(token, push_type_gcm, app);
     }
     
     void dba::drop_device(boost::uuids::uuid& uuid)
     {
         LOG_INFO << "dropping device " << to_string(uuid);
+        drop_devices(std::vector<boost::uuids::uuid>(1, uuid));
+    }
+    
+    void dba::drop_devices(const std::vector<boost::uuids::uuid>& uuids)
+    {
+        LOG_DEBUG << "dropping " << uuids.size() << " devices";
         
-        std::string field = "device." + to_string(uuid);
-        LOG_TRACE << "trying field = " << field;
-
         connection::ptr_t conn = pool_->get();
-        auto token = conn->run(command("HGET") << field << "token").str();
-        
-        patterns::script_exec scr_mapping("return redis.call('del', unpack(redis.call('keys', 'device_token."
-            + util::base64::encode(token.c_str(), token.size()) + "')))");
-        
-        patterns::script_exec scr_dev("return redis.call('del', unpack(redis.call('keys', 'device."
-            + to_string(uuid) + "')))");
         
-        scr_mapping.exec(conn);
-        scr_dev.exec(conn);
+        for(std::size_t first = 0; first < uuids.size(); first += write_batch)
+        {
+            std::size_t last = std::min(first + write_batch, uuids.size());
+            
+            for(std::size_t i = first; i < last; ++i)
+            {
+                conn->append(command("HGET") << "device." + to_string(uuids[i]) << "token");
+            }
+            
+            auto tokens = conn->get_replies(static_cast<unsigned int>(last - first));
+            
+            for(std::size_t i = first; i < last; ++i)
+            {
+                conn->append(command("GET") << "device_token." + tokens[i - first].str());
+            }
+            
+            auto owners = conn->get_replies(static_cast<unsigned int>(last - first));
+            
+            for(std::size_t i = first; i < last; ++i)
+            {
+                command del = command("DEL") << "device." + to_string(uuids[i]);
+                auto& token = tokens[i - first].str();
+                
+                // the token may have been registered again for a newer device since
+                if(!token.empty() && owners[i - first].str() == to_string(uuids[i]))
+                {
+                    del << "device_token." + token;
+                }
+                
+                conn->append(del);
+            }
+            
+            conn->get_replies(static_cast<unsigned int>(last - first));
+        }
     }
     
     void dba::mark_device_dead(boost::uuids::uuid& uuid, const ptime& time)
@@ -104,23 +352,54 @@ namespace database {
     }
     
     std::vector<dba::dead_device_entry> dba::get_dead_devices()
+    {
+        std::vector<dba::dead_device_entry> res;
+        auto scan = dead_devices_scan();
+        
+        LOG_TRACE << "listing dead devices from 'dead_devices'";
+        
+        while(!scan.done)
+        {
+            auto batch = next_dead_devices(scan, scan_batch);
+            res.insert(res.end(), batch.begin(), batch.end());
+        }
+        
+        return res;
+    }
+    
+    dba::set_scan dba::dead_devices_scan()
+    {
+        return set_scan("dead_devices");
+    }
+    
+    std::vector<dba::dead_device_entry> dba::next_dead_devices(set_scan& scan, std::size_t count)
     {
         std::vector<dba::dead_device_entry> res;
         boost::uuids::string_generator str_gen;
         
         connection::ptr_t conn = pool_->get();
-        LOG_TRACE << "listing dead devices from 'dead_devices'";
+        auto members = sscan(conn, scan, count);
         
-        auto rep = conn->run(command("SMEMBERS") << "dead_devices");
-        for(auto element : rep.elements())
+        for(auto& member : members)
+        {
+            conn->append(command("HGET") << "device." + member << "death_time");
+        }
+        
+        auto replies = conn->get_replies(static_cast<unsigned int>(members.size()));
+        res.reserve(members.size());
+        
+        for(std::size_t i = 0; i < members.size(); ++i)
         {
-            auto item_field = "device." + element.str();
-            LOG_TRACE << "item field = " << item_field;
+            // the device was removed since the scan saw it
+            if(replies[i].str().empty())
+            {
+                continue;
+            }
             
             dba::dead_device_entry entry;
             
-            entry.dev_uuid = str_gen(element.str());
-            entry.ts = time_from_string(conn->run(command("HGET") << item_field << "death_time").str());
+            entry.dev_uuid = str_gen(members[i]);
+            entry.ts = time_from_string(replies[i].str());
             
             res.push_back(entry);
         }
@@ -128,27 +407,78 @@ namespace database {
         return res;
     }
     
+    std::vector<boost::uuids::uuid> dba::get_dead_device_uuids()
+    {
+        std::vector<boost::uuids::uuid> res;
+        boost::uuids::string_generator str_gen;
+        
+        connection::ptr_t conn = pool_->get();
+        auto scan = dead_devices_scan();
+        
+        while(!scan.done)
+        {
+            for(auto& member : sscan(conn, scan, scan_batch))
+            {
+                res.push_back(str_gen(member));
+            }
+        }
+        
+        return res;
+    }
+    
+    bool dba::is_device_dead(const boost::uuids::uuid& uuid)
+    {
+        connection::ptr_t conn = pool_->get();
+        return conn->run(command("SISMEMBER") << "dead_devices" << to_string(uuid)).integer() != 0;
+    }
+    
     push_type dba::get_device_type(boost::uuids::uuid& dev_uuid)
     {
         LOG_DEBUG << "getting device type for device " << dev_uuid;
-
+        
         connection::ptr_t conn = pool_->get();
         
         std::string field = "device." + to_string(dev_uuid);
         LOG_TRACE << "trying field = " << field;
-
+        
         // first check if this device exists at all
         if(conn->run(command("EXISTS") << field).integer() == 0)
         {
             return push_type_invalid;
         }
-
+        
         // FIXME: this is a bit unsafe if db got a value not supported by push_type
         return static_cast<push_type>(
             boost::lexical_cast<int>(
                 conn->run(command("HGET") << field << "type").str() ) );
     }
     
+    dba::device_entry dba::get_device(boost::uuids::uuid& dev_uuid)
+    {
+        LOG_DEBUG << "getting device " << dev_uuid;
+        
+        std::string field = "device." + to_string(dev_uuid);
+        LOG_TRACE << "trying field = " << field;
+        
+        connection::ptr_t conn = pool_->get();
+        auto fields = conn->run(command("HMGET") << field << "type" << "app" << "token").elements();
+        
+        device_entry entry;
+        entry.type = push_type_invalid;
+        
+        if(fields.size() != 3 || fields[0].str().empty())
+        {
+            return entry;
+        }
+        
+        // FIXME: this is a bit unsafe if db got a value not supported by push_type
+        entry.type  = static_cast<push_type>( boost::lexical_cast<int>(fields[0].str()) );
+        entry.app   = fields[1].str();
+        entry.token = fields[2].str();
+        
+        return entry;
+    }
+    
     dba::msg_entry dba::get_message(boost::uuids::uuid& uuid) const
     {
         LOG_TRACE << "getting push message details " << to_string(uuid);
@@ -158,12 +488,14 @@ namespace database {
         
         std::string field = "message." + to_string(uuid);
         LOG_TRACE << "trying field = " << field;
-
+        
         msg_entry entry;
         
         entry.msg_uuid = uuid;
         entry.dev_uuid = str_gen(conn->run(command("HGET") << field << "device").str());
         entry.tag = conn->run(command("HGET") << field << "tag").str();
+        entry.app = conn->run(command("HGET") << field << "app").str();
+        entry.collapse = conn->run(command("HGET") << field << "collapse").str();
         
         // FIXME: this is a bit unsafe if db got a value not supported by push_type
         entry.provider_type = static_cast<push_type>(
@@ -171,6 +503,7 @@ namespace database {
                 conn->run(command("HGET") << field << "type").str() ) );
         
         entry.ts = time_from_string(conn->run(command("HGET") << field << "timestamp").str());
+        entry.priority = read_priority(conn, field);
         
         auto attempts_str = conn->run(command("HGET") << field << "attempts").str();
         entry.attempts = 1;
@@ -185,11 +518,11 @@ namespace database {
         
         return entry;
     }
-
+    
     std::vector<dba::failed_msg_entry> dba::get_failed_messages()
     {
         std::vector<dba::failed_msg_entry> res;
-
+        
         auto apns_msgs = get_failed_messages(push_type_apns);
         auto gcm_msgs  = get_failed_messages(push_type_gcm);
         
@@ -200,28 +533,61 @@ namespace database {
     }
     
     std::vector<dba::failed_msg_entry> dba::get_failed_messages(const push_type& type)
+    {
+        std::vector<dba::failed_msg_entry> res;
+        auto scan = failed_messages_scan(type);
+        
+        LOG_TRACE << "listing failed messages from '" << scan.key << "' set";
+        
+        while(!scan.done)
+        {
+            auto batch = next_failed_messages(scan, scan_batch);
+            res.insert(res.end(), batch.begin(), batch.end());
+        }
+        
+        return res;
+    }
+    
+    dba::set_scan dba::failed_messages_scan(const push_type& type)
+    {
+        return set_scan("failed_messages." + type_to_str(type));
+    }
+    
+    std::vector<dba::failed_msg_entry> dba::next_failed_messages(set_scan& scan, std::size_t count)
     {
         std::vector<dba::failed_msg_entry> res;
         boost::uuids::string_generator str_gen;
         
         connection::ptr_t conn = pool_->get();
-
-        auto type_str = type_to_str(type);
-        LOG_TRACE << "listing failed messages from 'failed_messages." << type_str << "' set";
-
-        auto rep = conn->run(command("SMEMBERS") << "failed_messages." + type_str);
-        for(auto element : rep.elements())
+        auto members = sscan(conn, scan, count);
+        
+        for(auto& member : members)
         {
-            auto item_field = "message." + element.str();
-            LOG_TRACE << "item field = " << item_field;
+            conn->append(command("HMGET") << "message." + member
+                         << "device" << "reason" << "attempts" << "priority" << "tag");
+        }
+        
+        auto replies = conn->get_replies(static_cast<unsigned int>(members.size()));
+        res.reserve(members.size());
+        
+        for(std::size_t i = 0; i < members.size(); ++i)
+        {
+            auto& fields = replies[i].elements();
+            
+            // redelivered or dropped since the scan saw it
+            if(fields.size() != 5 || fields[0].str().empty())
+            {
+                continue;
+            }
             
             dba::failed_msg_entry entry;
             
-            entry.msg_uuid = str_gen(element.str());
-            entry.dev_uuid = str_gen(conn->run(command("HGET") << item_field << "device").str());
-            entry.reason   = conn->run(command("HGET") << item_field << "reason").str();
-            entry.attempts = boost::lexical_cast<uint32_t>(
-                conn->run(command("HGET") << item_field << "attempts").str() );
+            entry.msg_uuid = str_gen(members[i]);
+            entry.dev_uuid = str_gen(fields[0].str());
+            entry.reason   = fields[1].str();
+            entry.attempts = fields[2].str().empty() ? 1 : boost::lexical_cast<uint32_t>(fields[2].str());
+            entry.priority = parse_priority(fields[3].str());
+            entry.tag      = fields[4].str();
             
             res.push_back(entry);
         }
@@ -229,26 +595,196 @@ namespace database {
         return res;
     }
     
-    push::device dba::get_apns_device(boost::uuids::uuid& dev_uuid)
+    std::vector<dba::redelivery_entry> dba::claim_due_messages(const push_type& type, const ptime& now, std::size_t limit)
     {
-        return push::device(push::apns::key, util::base64::decode( get_device_token(dev_uuid) ) );
+        std::vector<dba::redelivery_entry> res;
+        connection::ptr_t conn = pool_->get();
+        
+        auto type_str = type_to_str(type);
+        auto key = "redelivery." + type_str;
+        
+        auto due = conn->run(command("ZRANGEBYSCORE") << key << "-inf" << to_score(now)
+                             << "LIMIT" << 0 << limit).elements();
+        if(due.empty())
+        {
+            return res;
+        }
+        
+        // claim and load in one go. SREM tells us whether we won the message
+        for(auto& element : due)
+        {
+            conn->append(command("SREM") << "failed_messages." + type_str << element.str());
+            conn->append(command("ZREM") << key << element.str());
+            command hmget = command("HMGET") << "message." + element.str();
+            conn->append(entry_fields(hmget));
+        }
+        
+        auto replies = conn->get_replies(static_cast<unsigned int>(due.size() * 3));
+        
+        for(std::size_t i = 0; i < due.size(); ++i)
+        {
+            if(!replies[i * 3].integer())
+            {
+                LOG_TRACE << "message " << due[i].str() << " was already taken"
+                    << " for redelivery by another node.";
+                continue;
+            }
+            
+            redelivery_entry entry;
+            if(!read_entry(due[i].str(), type, replies[i * 3 + 2], entry))
+            {
+                LOG_WARN << "message " << due[i].str() << " scheduled for redelivery does not exist anymore.";
+                continue;
+            }
+            
+            res.push_back(entry);
+        }
+        
+        read_tokens(conn, res);
+        return res;
     }
-
-    push::device dba::get_gcm_device(boost::uuids::uuid& dev_uuid)
+    
+    std::vector<dba::redelivery_entry> dba::claim_scheduled_messages(const push_type& type, std::size_t limit,
+                                                                     const time_duration& lock_for)
     {
-        return push::device(push::gcm::key, get_device_token(dev_uuid));
+        std::vector<dba::redelivery_entry> res;
+        std::vector<std::string> fired;
+        
+        if(!limit)
+        {
+            return res;
+        }
+        
+        connection::ptr_t conn = pool_->get();
+        auto schedule = send_schedule(type);
+        auto now = datetime::now();
+        
+        // claimed and locked in one step so concurrent nodes never fire the same message
+        auto r = claim_script.exec(conn,
+            { "scheduled." + type_to_str(type) },
+            { boost::lexical_cast<std::string>(datetime::ptime_in_seconds(now)),
+              boost::lexical_cast<std::string>(datetime::ptime_in_seconds(now + lock_for)),
+              boost::lexical_cast<std::string>(limit) });
+        
+        if(r.type() != reply::ARRAY)
+        {
+            throw std::runtime_error("failed to claim scheduled messages: " + r.str());
+        }
+        
+        for(auto& id : r.elements())
+        {
+            fired.push_back(id.str());
+        }
+        
+        if(fired.empty())
+        {
+            return res;
+        }
+        
+        for(auto& id : fired)
+        {
+            command hmget = command("HMGET") << "message." + id;
+            conn->append(entry_fields(hmget));
+        }
+        
+        auto replies = conn->get_replies(static_cast<unsigned int>(fired.size()));
+        
+        for(std::size_t i = 0; i < fired.size(); ++i)
+        {
+            redelivery_entry entry;
+            if(!read_entry(fired[i], type, replies[i], entry))
+            {
+                LOG_WARN << "scheduled message " << fired[i] << " does not exist anymore.";
+                schedule.dequeue(conn, fired[i]);
+                continue;
+            }
+            
+            res.push_back(entry);
+        }
+        
+        read_tokens(conn, res);
+        return res;
     }
     
-    boost::uuids::uuid dba::write_apns_push(boost::uuids::uuid& dev_uuid, const std::string& payload, const std::string& tag)
+    void dba::dequeue_scheduled(const push_type& type, const std::vector<boost::uuids::uuid>& uuids)
     {
-        return write_push(dev_uuid, push_type_apns, payload, tag);
+        if(uuids.empty())
+        {
+            return;
+        }
+        
+        connection::ptr_t conn = pool_->get();
+        auto schedule = send_schedule(type);
+        
+        for(auto& uuid : uuids)
+        {
+            schedule.append_dequeue(conn, to_string(uuid));
+        }
+        
+        conn->get_replies(static_cast<unsigned int>(uuids.size()));
     }
-
-    boost::uuids::uuid dba::write_gcm_push(boost::uuids::uuid& dev_uuid, const std::string& payload, const std::string& tag)
+    
+    uint64_t dba::get_scheduled_count(const push_type& type)
     {
-        return write_push(dev_uuid, push_type_gcm, payload, tag);
+        connection::ptr_t conn = pool_->get();
+        return static_cast<uint64_t>(conn->run(command("ZCARD") << "scheduled." + type_to_str(type)).integer());
     }
-
+    
+    void dba::read_tokens(connection::ptr_t conn, std::vector<redelivery_entry>& entries)
+    {
+        for(auto& entry : entries)
+        {
+            conn->append(command("HGET") << "device." + to_string(entry.dev_uuid) << "token");
+        }
+        
+        auto tokens = conn->get_replies(static_cast<unsigned int>(entries.size()));
+        for(std::size_t i = 0; i < entries.size(); ++i)
+        {
+            entries[i].token = tokens[i].str();
+        }
+    }
+    
+    dba::redelivery_backlog dba::get_redelivery_backlog(const push_type& type, const ptime& now)
+    {
+        connection::ptr_t conn = pool_->get();
+        auto key = "redelivery." + type_to_str(type);
+        
+        conn->append(command("ZCARD") << key);
+        conn->append(command("ZCOUNT") << key << "-inf" << to_score(now));
+        
+        auto replies = conn->get_replies(2);
+        
+        redelivery_backlog res;
+        res.scheduled = static_cast<uint64_t>(replies[0].integer());
+        res.due = static_cast<uint64_t>(replies[1].integer());
+        
+        return res;
+    }
+    
+    push::device dba::get_apns_device(boost::uuids::uuid& dev_uuid)
+    {
+        return make_device(push_type_apns, get_device_token(dev_uuid));
+    }
+    
+    push::device dba::get_gcm_device(boost::uuids::uuid& dev_uuid)
+    {
+        return make_device(push_type_gcm, get_device_token(dev_uuid));
+    }
+    
+    push::device dba::make_device(const push_type& type, const std::string& token)
+    {
+        switch(type)
+        {
+            case push_type_apns:
+                return push::device(push::apns::key, util::base64::decode(token));
+            case push_type_gcm:
+                return push::device(push::gcm::key, token);
+            default:
+                throw std::runtime_error("make_device failed for type "
+                    + boost::lexical_cast<std::string>(type) );
+        }
+    }
+    
     uint32_t dba::mark_push_record_failed(boost::uuids::uuid& uuid, const std::string& msg)
     {
         LOG_DEBUG << "marking push message as failed " << uuid;
@@ -256,21 +792,26 @@ namespace database {
         std::string field = "message." + to_string(uuid);
         LOG_TRACE << "field = " << field;
         
+        // one script so that a message superseded meanwhile is not brought back as a partial record
         connection::ptr_t conn = pool_->get();
-        auto msg_type = conn->run(command("HGET") << field << "type").str();
+        auto r = fail_script.exec(conn,
+            { field, "failed_messages." + type_to_str(push_type_apns), "failed_messages." + type_to_str(push_type_gcm) },
+            { to_string(uuid), msg });
         
-        // get string type to determine which set to use
-        // FIXME: this is a bit unsafe if db got a value not supported by push_type
-        auto msg_type_str = type_to_str( static_cast<push_type>( boost::lexical_cast<int>(msg_type) ) );
+        if(r.type() != reply::INTEGER)
+        {
+            throw std::runtime_error("failed to mark push message as failed: " + r.str());
+        }
         
-        conn->run(command("HSET") << field << "reason" << msg);
-        conn->run(command("SADD") << "failed_messages." + msg_type_str << to_string(uuid) );
-
-        // by default will set to 0 and inc by 1
-        return static_cast<uint32_t>(conn->run(command("HINCRBY") << field << "attempts" << 1).integer());
+        if(!r.integer())
+        {
+            LOG_DEBUG << "push message " << uuid << " is gone. not marking it failed.";
+        }
+        
+        return static_cast<uint32_t>(r.integer());
     }
     
-    boost::uuids::uuid dba::find_device_by_token64(const std::string& token) const
+    bool dba::find_device_by_token64(const std::string& token, boost::uuids::uuid& uuid) const
     {
         LOG_DEBUG << "looking up device by token (base64): " << token;
         
@@ -278,10 +819,25 @@ namespace database {
         LOG_TRACE << "field = " << field;
         
         connection::ptr_t conn = pool_->get();
-        auto uuid_str = conn->run(command("GET") << field).str();
-
-        boost::uuids::string_generator str_gen;
-        return str_gen(uuid_str);
+        auto r = conn->run(command("GET") << field);
+        
+        if(r.type() != reply::STRING)
+        {
+            return false;
+        }
+        
+        try
+        {
+            boost::uuids::string_generator str_gen;
+            uuid = str_gen(r.str());
+        }
+        catch(std::exception& e)
+        {
+            LOG_WARN << "device_token." << token << " does not hold a device uuid: '" << r.str() << "'";
+            return false;
+        }
+        
+        return true;
     }
     
     bool dba::remove_from_failed_messages(boost::uuids::uuid& uuid)
@@ -297,17 +853,70 @@ namespace database {
         // get string type to determine which set to use
         // FIXME: this is a bit unsafe if db got a value not supported by push_type
         auto msg_type_str = type_to_str( static_cast<push_type>( boost::lexical_cast<int>(msg_type) ) );
-        return conn->run(command("SREM") << "failed_messages." + msg_type_str << to_string(uuid)).integer();
+        
+        conn->append(command("SREM") << "failed_messages." + msg_type_str << to_string(uuid));
+        conn->append(command("ZREM") << "redelivery." + msg_type_str << to_string(uuid));
+        
+        return conn->get_replies(2).front().integer();
+    }
+    
+    void dba::schedule_redelivery(boost::uuids::uuid& uuid, const push_type& type, const ptime& due)
+    {
+        LOG_DEBUG << "scheduling redelivery of " << uuid << " at " << due;
+        
+        connection::ptr_t conn = pool_->get();
+        conn->run(command("ZADD") << "redelivery." + type_to_str(type) << to_score(due) << to_string(uuid));
+    }
+    
+    void dba::requeue_for_redelivery(const std::vector<msg_entry>& messages)
+    {
+        if(messages.empty())
+        {
+            return;
+        }
+        
+        connection::ptr_t conn = pool_->get();
+        auto score = to_score(microsec_clock::universal_time());
+        
+        for(auto& m : messages)
+        {
+            auto type_str = type_to_str(m.provider_type);
+            
+            conn->append(command("SADD") << "failed_messages." + type_str << to_string(m.msg_uuid));
+            conn->append(command("ZADD") << "redelivery." + type_str << score << to_string(m.msg_uuid));
+        }
+        
+        conn->get_replies(static_cast<unsigned int>(messages.size() * 2));
+    }
+    
+    std::size_t dba::schedule_unscheduled_failures(const push_type& type)
+    {
+        connection::ptr_t conn = pool_->get();
+        
+        auto type_str = type_to_str(type);
+        auto score = to_score(microsec_clock::universal_time());
+        
+        auto rep = conn->run(command("SMEMBERS") << "failed_messages." + type_str);
+        for(auto element : rep.elements())
+        {
+            conn->append(command("ZADD") << "redelivery." + type_str << "NX" << score << element.str());
+        }
+        
+        std::size_t added = 0;
+        for(auto r : conn->get_replies(static_cast<unsigned int>(rep.elements().size())))
+        {
+            added += static_cast<std::size_t>(r.integer());
+        }
+        
+        return added;
     }
     
     void dba::drop_push_record(boost::uuids::uuid& uuid)
     {
         LOG_DEBUG << "dropping push message record " << uuid;
         
-        patterns::script_exec scr("return redis.call('del', unpack(redis.call('keys', 'message." + to_string(uuid) + "')))");
-        
         connection::ptr_t conn = pool_->get();
-        scr.exec(conn);
+        drop_script.exec(conn, { "message." + to_string(uuid) }, { to_string(uuid) });
     }
     
     std::string dba::get_message_payload(boost::uuids::uuid& uuid) const
@@ -320,25 +929,43 @@ namespace database {
         connection::ptr_t conn = pool_->get();
         return conn->run(command("HGET") << field << "payload").str();
     }
-
-    boost::uuids::uuid dba::register_device(const std::string& token, const push_type& type)
+    
+    boost::uuids::uuid dba::register_device(const std::string& token, const push_type& type, const std::string& app)
     {
-        boost::uuids::random_generator gen;
-        boost::uuids::uuid uuid = gen();
+        return register_devices(std::vector<std::string>(1, token), type, app).front();
+    }
+    
+    std::vector<boost::uuids::uuid> dba::register_devices(const std::vector<std::string>& tokens,
+                                                          const push_type& type, const std::string& app)
+    {
+        inflight_limit::guard slot(writes_);
         
-        std::string field = "device." + to_string(uuid);
-        LOG_TRACE << "field = " << field;
+        boost::uuids::random_generator gen;
+        std::vector<boost::uuids::uuid> uuids;
+        uuids.reserve(tokens.size());
         
         connection::ptr_t conn = pool_->get();
-        conn->run(command("HMSET") << field << "type" << type << "token" << token);
-
-        // register token:device mapping
-        field = "device_token." + token;
-        LOG_TRACE << "token:device mapping field = " << field;
         
-        conn->run(command("SET") << field << util::base64::encode(token.c_str(), token.size()));
+        for(std::size_t first = 0; first < tokens.size(); first += write_batch)
+        {
+            std::size_t last = std::min(first + write_batch, tokens.size());
+            
+            for(std::size_t i = first; i < last; ++i)
+            {
+                auto& token = tokens[i];
+                uuids.push_back(gen());
+                
+                conn->append(command("HMSET") << "device." + to_string(uuids.back())
+                    << "type" << type << "token" << token << "app" << app);
+                
+                // register token:device mapping, read back when feedback reports the token
+                conn->append(command("SET") << "device_token." + token << to_string(uuids.back()));
+            }
+            
+            conn->get_replies(static_cast<unsigned int>((last - first) * 2));
+        }
         
-        return uuid;
+        return uuids;
     }
     
     std::string dba::get_device_token(boost::uuids::uuid& dev_uuid)
@@ -354,11 +981,11 @@ namespace database {
         
         return token;
     }
-
-    boost::uuids::uuid dba::write_push(boost::uuids::uuid& dev_uuid, const push_type& type,
-                                       const std::string& payload, const std::string& tag)
+    
+    boost::uuids::uuid dba::write_push(boost::uuids::uuid& dev_uuid, const push_record& rec, bool& created)
     {
         LOG_TRACE << "writing new push message record";
+        inflight_limit::guard slot(writes_);
         
         boost::uuids::random_generator gen;
         boost::uuids::uuid uuid = gen();
@@ -366,14 +993,86 @@ namespace database {
         std::string field = "message." + to_string(uuid);
         LOG_TRACE << "field = " << field;
         
+        bool scheduled = !rec.send_at.is_special();
+        auto type_str = type_to_str(rec.type);
+        auto collapse = rec.collapse_key.empty() ? std::string() : collapse_key(dev_uuid, rec.collapse_key);
+        
+        command fields = command("payload") << rec.payload
+            << "type" << rec.type << "device" << to_string(dev_uuid)
+            << "timestamp" << rec.timestamp
+            << "tag" << rec.tag << "priority" << rec.priority << "app" << rec.app;
+        
+        if(scheduled)
+        {
+            fields << "send_at" << rec.send_at;
+        }
+        
+        if(!collapse.empty())
+        {
+            fields << "collapse" << collapse;
+        }
+        
+        std::vector<std::string> args = command(to_string(uuid)) << std::max<uint32_t>(rec.idempotency_ttl, 1)
+            << (scheduled ? boost::lexical_cast<std::string>(datetime::ptime_in_seconds(rec.send_at)) : std::string());
+        const std::vector<std::string>& field_args = fields;
+        args.insert(args.end(), field_args.begin(), field_args.end());
+        
+        std::vector<std::string> keys {
+            field, rec.idempotency_key.empty() ? std::string() : "idempotency." + rec.idempotency_key,
+            "scheduled." + type_str, collapse, "failed_messages." + type_str, "redelivery." + type_str };
+        
+        // one script so that a crash can never leave a superseded message live next to its successor.
+        // the record it supersedes is declared to the script, so a collapse key moved meanwhile means another go
         connection::ptr_t conn = pool_->get();
-        conn->run(command("HMSET") << field << "payload" << payload
-                  << "type" << type << "device" << to_string(dev_uuid)
-                  << "timestamp" << microsec_clock::universal_time()
-                  << "tag" << tag);
+        auto r = exec_write_script(conn, keys, args);
+        
+        for(int attempt = 1; r.type() == reply::NIL && attempt < write_retries; ++attempt)
+        {
+            r = exec_write_script(conn, keys, args);
+        }
         
-        return uuid;
+        if(r.type() != reply::ARRAY || r.elements().size() != 2)
+        {
+            throw std::runtime_error("failed to write push message record: " + r.str());
+        }
+        
+        auto& owner = r.elements()[0].str();
+        auto& superseded = r.elements()[1].str();
+        
+        if(!superseded.empty())
+        {
+            LOG_DEBUG << "message " << superseded << " superseded by " << uuid
+                << " (collapse key '" << rec.collapse_key << "')";
+        }
+        
+        created = owner == to_string(uuid);
+        
+        if(created)
+        {
+            return uuid;
+        }
+        
+        LOG_DEBUG << "idempotency key '" << rec.idempotency_key << "' was used already";
+        
+        boost::uuids::string_generator str_gen;
+        return str_gen(owner);
+    }
+    
+    std::string dba::collapse_key(const boost::uuids::uuid& dev_uuid, const std::string& key)
+    {
+        return "collapse." + to_string(dev_uuid) + "." + key;
     }
     
+    bool dba::is_superseded(const msg_entry& m)
+    {
+        if(m.collapse.empty())
+        {
+            return false;
+        }
+        
+        connection::ptr_t conn = pool_->get();
+        return conn->run(command("GET") << m.collapse).str() != to_string(m.msg_uuid);
+    }
+
 } // database
 } // pushy
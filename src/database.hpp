@@ -11,8 +11,12 @@
 
 #include <string>
 #include <boost/uuid/uuid.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <push_service.hpp>
 #include <redis3m/redis3m.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+#include "admission.hpp"
 
 namespace pushy {
 namespace database {
@@ -24,16 +28,55 @@ namespace database {
         push_type_invalid = 127
     };
     
+    enum push_priority
+    {
+        push_priority_high   = 0,
+        push_priority_normal = 1,
+        push_priority_count  = 2
+    };
+    
     class dba
     {
     public:
         
+        /// a new push message as it gets written to redis
+        struct push_record
+        {
+            push_record()
+            : type(push_type_invalid)
+            , priority(push_priority_normal)
+            , idempotency_ttl(0)
+            , timestamp(boost::posix_time::microsec_clock::universal_time())
+            {
+            }
+            
+            push_type       type;
+            std::string     app;
+            std::string     payload;
+            std::string     tag;
+            push_priority   priority;
+            
+            /// optional; a second write with the same key within the ttl returns the first message
+            std::string     idempotency_key;
+            uint32_t        idempotency_ttl; // seconds
+            
+            /// optional; the message is put on the schedule instead of being sent right away
+            boost::posix_time::ptime    send_at;
+            
+            /// optional; supersedes a not yet delivered message to the same device with the same key
+            std::string     collapse_key;
+            
+            boost::posix_time::ptime    timestamp;
+        };
+        
         struct failed_msg_entry
         {
             boost::uuids::uuid msg_uuid;
             boost::uuids::uuid dev_uuid;
             std::string        reason;
             uint32_t           attempts;
+            push_priority      priority;
+            std::string        tag;
         };
         
         struct msg_entry
@@ -43,7 +86,30 @@ namespace database {
             uint32_t                    attempts;
             boost::posix_time::ptime    ts;
             push_type                   provider_type;
+            push_priority               priority;
             std::string                 tag;
+            std::string                 app;
+            std::string                 collapse;   // collapse key the message holds, empty if none
+        };
+        
+        struct device_entry
+        {
+            push_type                   type;   // push_type_invalid if there is no such device
+            std::string                 app;
+            std::string                 token;
+        };
+        
+        /// a message claimed for (re)delivery with everything needed to post it
+        struct redelivery_entry : msg_entry
+        {
+            std::string                 payload;
+            std::string                 token;
+        };
+        
+        struct redelivery_backlog
+        {
+            uint64_t    scheduled;
+            uint64_t    due;
         };
         
         struct dead_device_entry
@@ -52,33 +118,90 @@ namespace database {
             boost::posix_time::ptime    ts;
         };
         
+        /// position of a batched walk over a redis set, see next_failed_messages
+        struct set_scan
+        {
+            explicit set_scan(const std::string& k)
+            : key(k)
+            , cursor("0")
+            , done(false)
+            {
+            }
+            
+            std::string key;
+            std::string cursor;
+            bool        done;
+        };
+        
         static dba& instance()
         {
             return inst;
         }
         
         static std::string type_to_str(const push_type& type);
+        static std::string priority_to_str(const push_priority& priority);
+        static push_priority str_to_priority(const std::string& name);
         
         void init_pool(const std::string& host, int port);
         
-        boost::uuids::uuid register_apns_device(const std::string& token);
-        boost::uuids::uuid register_gcm_device(const std::string& token);
-
+        /// bounds the amount of concurrent producer-facing writes (0 for unbounded)
+        void limit_writes(std::size_t max_inflight, uint32_t retry_after);
+        json_spirit::Object write_stats() const;
+        
+        /// devices of the default app are registered with an empty app id
+        boost::uuids::uuid register_apns_device(const std::string& token, const std::string& app = std::string());
+        boost::uuids::uuid register_gcm_device(const std::string& token, const std::string& app = std::string());
+        
+        /// registers many devices in pipelined batches; the uuids are in the order of the tokens
+        std::vector<boost::uuids::uuid> register_devices(const std::vector<std::string>& tokens,
+                                                         const push_type& type,
+                                                         const std::string& app = std::string());
+        
+        /// type, app and token of a device in one round trip
+        device_entry get_device(boost::uuids::uuid& dev_uuid);
+        
         push_type get_device_type(boost::uuids::uuid& dev_uuid);
         push::device get_apns_device(boost::uuids::uuid& dev_uuid);
         push::device get_gcm_device(boost::uuids::uuid& dev_uuid);
+        static push::device make_device(const push_type& type, const std::string& token);
         std::string get_device_token(boost::uuids::uuid& dev_uuid);
         
-        boost::uuids::uuid write_apns_push(boost::uuids::uuid& dev_uuid, const std::string& payload, const std::string& tag);
-        boost::uuids::uuid write_gcm_push(boost::uuids::uuid& dev_uuid, const std::string& payload, const std::string& tag);
+        /**
+         * Writes a new push message record. If the record carries an idempotency key which
+         * was already used within its ttl nothing is written, the uuid of the original
+         * message is returned and 'created' is set to false.
+         */
+        boost::uuids::uuid write_push(boost::uuids::uuid& dev_uuid, const push_record& rec, bool& created);
+        /// returns the attempts made so far, or 0 if the record is gone (e.g. superseded by a collapse key)
         uint32_t mark_push_record_failed(boost::uuids::uuid& uuid, const std::string& msg);
         bool remove_from_failed_messages(boost::uuids::uuid& uuid);
         
+        /// makes a failed message eligible for automatic redelivery at the given time
+        void schedule_redelivery(boost::uuids::uuid& uuid, const push_type& type,
+                                 const boost::posix_time::ptime& due);
+        
+        /// hands messages which were never acknowledged over to redelivery, in one pipeline
+        void requeue_for_redelivery(const std::vector<msg_entry>& messages);
+        
+        /// schedules failed messages which have no redelivery time yet (written by older versions)
+        std::size_t schedule_unscheduled_failures(const push_type& type);
+        
         void drop_push_record(boost::uuids::uuid& uuid);
+        
+        /// redis key of a device's collapse key, see push_record::collapse_key
+        static std::string collapse_key(const boost::uuids::uuid& dev_uuid, const std::string& key);
+        
+        /// true if a newer message took over the collapse key of this one
+        bool is_superseded(const msg_entry& m);
+        
         std::string get_message_payload(boost::uuids::uuid& uuid) const;
         
-        boost::uuids::uuid find_device_by_token64(const std::string& token) const;
+        /// false if no device is registered with the token
+        bool find_device_by_token64(const std::string& token, boost::uuids::uuid& uuid) const;
         void drop_device(boost::uuids::uuid& uuid);
+        
+        /// drops many devices and their token mappings in pipelined batches
+        void drop_devices(const std::vector<boost::uuids::uuid>& uuids);
         void mark_device_dead(boost::uuids::uuid& uuid, const boost::posix_time::ptime& time);
         
         /// returns a list of uuids of failed messages
@@ -87,22 +210,62 @@ namespace database {
         /// returns a list of uuids of failed messages for a given provider type
         std::vector<dba::failed_msg_entry> get_failed_messages(const push_type& type);
         
+        /**
+         * The next batch of failed messages of a scan started with failed_messages_scan.
+         * One SSCAN and one pipelined round trip for the message records; a batch may be
+         * empty while the scan is not done. Messages changed during the scan may be
+         * missed or listed twice, as SSCAN guarantees no more.
+         */
+        static set_scan failed_messages_scan(const push_type& type);
+        std::vector<dba::failed_msg_entry> next_failed_messages(set_scan& scan, std::size_t count);
+        
+        /**
+         * Atomically takes up to 'limit' due messages off the failed set and the schedule
+         * and loads their payload and device token. Uses three pipelined round trips in total.
+         * Messages claimed concurrently by another node are skipped.
+         */
+        std::vector<dba::redelivery_entry> claim_due_messages(const push_type& type,
+                                                              const boost::posix_time::ptime& now,
+                                                              std::size_t limit);
+        
+        redelivery_backlog get_redelivery_backlog(const push_type& type, const boost::posix_time::ptime& now);
+        
+        /**
+         * Takes up to 'limit' scheduled messages whose send_at has passed. Each one stays
+         * locked for 'lock_for' and fires again on any node unless dequeue_scheduled is called.
+         */
+        std::vector<dba::redelivery_entry> claim_scheduled_messages(const push_type& type, std::size_t limit,
+                                                                    const boost::posix_time::time_duration& lock_for);
+        void dequeue_scheduled(const push_type& type, const std::vector<boost::uuids::uuid>& uuids);
+        uint64_t get_scheduled_count(const push_type& type);
+        
         /// returns a list of dead devices
         std::vector<dba::dead_device_entry> get_dead_devices();
         
-        msg_entry get_message(boost::uuids::uuid& uuid) const;
+        /// batched walk over the dead devices, same as next_failed_messages
+        static set_scan dead_devices_scan();
+        std::vector<dba::dead_device_entry> next_dead_devices(set_scan& scan, std::size_t count);
+        
+        /// uuids of all dead devices, fetched with SSCAN so redis isn't blocked by a large set
+        std::vector<boost::uuids::uuid> get_dead_device_uuids();
+        bool is_device_dead(const boost::uuids::uuid& uuid);
         
+        msg_entry get_message(boost::uuids::uuid& uuid) const;
+    
     private:
-        boost::uuids::uuid write_push(boost::uuids::uuid& dev_uuid, const push_type& type, const std::string& payload, const std::string& tag);
-        boost::uuids::uuid register_device(const std::string& token, const push_type& type);
+        void read_tokens(redis3m::connection::ptr_t conn, std::vector<redelivery_entry>& entries);
+        
+        boost::uuids::uuid register_device(const std::string& token, const push_type& type, const std::string& app);
         
         dba()
+        : writes_("redis")
         {}
         
         redis3m::simple_pool::ptr_t pool_;
+        inflight_limit              writes_;
         static dba inst;
     };
-    
+
 } // database
 } // pushy
 
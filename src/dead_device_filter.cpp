@@ -0,0 +1,145 @@
+//
+//  dead_device_filter.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "dead_device_filter.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace pushy
+{
+    namespace
+    {
+        // splitmix64 finalizer; device uuids are random but don't rely on it
+        uint64_t mix(uint64_t x)
+        {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            
+            return x;
+        }
+        
+        // two independent hashes of the uuid; the k probes are h1 + i * h2
+        void hash(const boost::uuids::uuid& uuid, uint64_t& h1, uint64_t& h2)
+        {
+            uint64_t lo, hi;
+            
+            std::memcpy(&lo, uuid.data, sizeof(lo));
+            std::memcpy(&hi, uuid.data + sizeof(lo), sizeof(hi));
+            
+            h1 = mix(lo ^ mix(hi));
+            h2 = mix(hi + 0x9e3779b97f4a7c15ULL) | 1;
+        }
+    }
+    
+    dead_device_filter::dead_device_filter(std::size_t capacity, double fp_rate)
+    : capacity_(capacity)
+    , words_(0)
+    , hashes_(0)
+    , entries_(0)
+    , lookups_(0)
+    , hits_(0)
+    {
+        if(!capacity_)
+        {
+            return;
+        }
+        
+        if(fp_rate <= 0 || fp_rate >= 1)
+        {
+            throw std::runtime_error("auto.dead_filter_fp must be between 0 and 1");
+        }
+        
+        // optimal size and probe count for the capacity and false positive rate
+        double bits = -static_cast<double>(capacity_) * std::log(fp_rate) / (std::log(2.0) * std::log(2.0));
+        
+        words_ = static_cast<std::size_t>(std::ceil(bits / 64));
+        hashes_ = std::max(1u, static_cast<uint32_t>(std::round(bits / capacity_ * std::log(2.0))));
+        
+        bits_.reset(new std::atomic<uint64_t>[words_]);
+        clear();
+    }
+    
+    void dead_device_filter::insert(const boost::uuids::uuid& uuid)
+    {
+        if(!words_)
+        {
+            return;
+        }
+        
+        uint64_t h1, h2;
+        hash(uuid, h1, h2);
+        
+        uint64_t total = words_ * 64;
+        
+        for(uint32_t i = 0; i < hashes_; ++i)
+        {
+            auto bit = (h1 + i * h2) % total;
+            bits_[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_relaxed);
+        }
+        
+        ++entries_;
+    }
+    
+    bool dead_device_filter::maybe_contains(const boost::uuids::uuid& uuid) const
+    {
+        if(!words_)
+        {
+            return false;
+        }
+        
+        ++lookups_;
+        
+        uint64_t h1, h2;
+        hash(uuid, h1, h2);
+        
+        uint64_t total = words_ * 64;
+        
+        for(uint32_t i = 0; i < hashes_; ++i)
+        {
+            auto bit = (h1 + i * h2) % total;
+            
+            if(!(bits_[bit / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (bit % 64))))
+            {
+                return false;
+            }
+        }
+        
+        ++hits_;
+        return true;
+    }
+    
+    void dead_device_filter::clear()
+    {
+        for(std::size_t i = 0; i < words_; ++i)
+        {
+            bits_[i].store(0, std::memory_order_relaxed);
+        }
+        
+        entries_ = 0;
+    }
+    
+    json_spirit::Object dead_device_filter::stats() const
+    {
+        json_spirit::Object obj;
+        
+        obj.push_back( json_spirit::Pair("capacity", static_cast<uint64_t>(capacity_)) );
+        obj.push_back( json_spirit::Pair("bytes", static_cast<uint64_t>(words_ * sizeof(uint64_t))) );
+        obj.push_back( json_spirit::Pair("hashes", static_cast<uint64_t>(hashes_)) );
+        obj.push_back( json_spirit::Pair("entries", entries_.load()) );
+        obj.push_back( json_spirit::Pair("lookups", lookups_.load()) );
+        obj.push_back( json_spirit::Pair("hits", hits_.load()) );
+        
+        return obj;
+    }
+}
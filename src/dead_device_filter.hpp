@@ -0,0 +1,56 @@
+//
+//  dead_device_filter.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__dead_device_filter__
+#define __pushy__dead_device_filter__
+
+#include <atomic>
+#include <memory>
+#include <boost/uuid/uuid.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    /**
+     * Bloom filter of the uuids of devices known to be dead. Sized for 'capacity'
+     * devices at a false positive rate of 'fp_rate'. A miss means the device is not
+     * known dead; a hit has to be confirmed against redis. Lock free; inserts and
+     * lookups may come from any thread.
+     */
+    class dead_device_filter
+    {
+    public:
+        /// a capacity of 0 disables the filter; it then never hits
+        dead_device_filter(std::size_t capacity, double fp_rate);
+        
+        void insert(const boost::uuids::uuid& uuid);
+        bool maybe_contains(const boost::uuids::uuid& uuid) const;
+        
+        bool enabled() const
+        {
+            return words_ > 0;
+        }
+        
+        /// empties the filter before a rebuild
+        void clear();
+        
+        json_spirit::Object stats() const;
+    
+    private:
+        std::size_t     capacity_;
+        std::size_t     words_;     // 64 bit words
+        uint32_t        hashes_;
+        
+        std::unique_ptr<std::atomic<uint64_t>[]>    bits_;
+        std::atomic<uint64_t>                       entries_;
+        mutable std::atomic<uint64_t>               lookups_;
+        mutable std::atomic<uint64_t>               hits_;
+    };
+}
+
+#endif /* defined(__pushy__dead_device_filter__) */
@@ -0,0 +1,537 @@
+//
+//  dispatcher.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "dispatcher.hpp"
+#include "logging.hpp"
+
+#include <boost/bind.hpp>
+
+using namespace pushy::database;
+using namespace boost::posix_time;
+
+namespace pushy
+{
+    void dispatcher::config::add_tag_limit(const std::string& spec)
+    {
+        auto pos = spec.find('=');
+        if(pos == std::string::npos || pos == 0)
+        {
+            throw std::runtime_error("invalid tag limit '" + spec + "'. expected tag=rate[:burst]");
+        }
+        
+        tag_limits[spec.substr(0, pos)] = token_bucket::from_spec(spec.substr(pos + 1));
+    }
+    
+    dispatcher::dispatcher(io::io_service& io, const config& cfg, const sink_type& sink)
+    : io_(io)
+    , config_(cfg)
+    , sink_(sink)
+    , pump_scheduled_(false)
+    , closed_(false)
+    , tag_limiters_(cfg.tag_limits)
+    , refill_timer_(io)
+    , refill_armed_(false)
+    {
+        if(!config_.window)
+        {
+            throw std::runtime_error("dispatch.window must be greater than zero");
+        }
+        
+        for(std::size_t i = 0; i < push_priority_count; ++i)
+        {
+            if(!config_.weights[i])
+            {
+                throw std::runtime_error("dispatch weights must be greater than zero");
+            }
+        }
+        
+        for(std::size_t t = 0; t < 2; ++t)
+        {
+            limiters_[t] = config_.limits[t];
+        }
+    }
+    
+    void dispatcher::enqueue(const job& j, const push_priority& priority)
+    {
+        if(j.type != push_type_apns && j.type != push_type_gcm)
+        {
+            throw std::runtime_error("can't dispatch job for unknown provider type");
+        }
+        
+        if(priority < 0 || priority >= push_priority_count)
+        {
+            throw std::runtime_error("can't dispatch job with unknown priority");
+        }
+        
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        auto& l = app_provider(j.type, j.app).lanes[priority];
+        l.queue.push_back(j);
+        l.queue.back().priority = priority;
+        ++l.enqueued;
+        
+        schedule_pump();
+    }
+    
+    void dispatcher::complete(const push_type& type, const std::string& app)
+    {
+        if(type != push_type_apns && type != push_type_gcm)
+        {
+            return;
+        }
+        
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        auto it = providers_[type].find(app);
+        if(it != providers_[type].end() && it->second.in_flight)
+        {
+            --it->second.in_flight;
+        }
+        
+        schedule_pump();
+    }
+    
+    std::size_t dispatcher::depth() const
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return depth_unlocked();
+    }
+    
+    std::size_t dispatcher::queued(const push_type& type, const std::string& app) const
+    {
+        if(type != push_type_apns && type != push_type_gcm)
+        {
+            return 0;
+        }
+        
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        auto it = providers_[type].find(app);
+        if(it == providers_[type].end())
+        {
+            return 0;
+        }
+        
+        std::size_t res = it->second.parked_count;
+        
+        for(auto& l : it->second.lanes)
+        {
+            res += l.queue.size();
+        }
+        
+        return res;
+    }
+    
+    bool dispatcher::has_capacity() const
+    {
+        return !config_.queue_limit || depth() < config_.queue_limit;
+    }
+    
+    void dispatcher::admit() const
+    {
+        if(!has_capacity())
+        {
+            throw overload_error("dispatch queue is full. try again later.",
+                                 overload_error::throttled, config_.retry_after);
+        }
+    }
+    
+    std::vector<dispatcher::job> dispatcher::close()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        closed_ = true;
+        refill_timer_.cancel();
+        
+        std::vector<job> res;
+        
+        for(auto& apps : providers_)
+        {
+            for(auto& entry : apps)
+            {
+                auto& p = entry.second;
+                
+                for(auto& l : p.lanes)
+                {
+                    res.insert(res.end(), l.queue.begin(), l.queue.end());
+                    l.queue.clear();
+                }
+                
+                for(auto& parked : p.parked)
+                {
+                    res.insert(res.end(), parked.second.begin(), parked.second.end());
+                }
+                
+                p.parked.clear();
+                p.parked_count = 0;
+            }
+        }
+        
+        return res;
+    }
+    
+    std::size_t dispatcher::depth_unlocked() const
+    {
+        std::size_t res = 0;
+        
+        for(auto& apps : providers_)
+        {
+            for(auto& entry : apps)
+            {
+                for(auto& l : entry.second.lanes)
+                {
+                    res += l.queue.size();
+                }
+                
+                res += entry.second.parked_count;
+            }
+        }
+        
+        return res;
+    }
+    
+    // must be called with mutex_ held
+    dispatcher::provider& dispatcher::app_provider(const push_type& type, const std::string& app)
+    {
+        auto it = providers_[type].find(app);
+        if(it != providers_[type].end())
+        {
+            return it->second;
+        }
+        
+        auto& p = providers_[type][app];
+        
+        for(std::size_t i = 0; i < push_priority_count; ++i)
+        {
+            p.lanes[i].credits = config_.weights[i];
+        }
+        
+        return p;
+    }
+    
+    // must be called with mutex_ held
+    void dispatcher::schedule_pump()
+    {
+        if(!pump_scheduled_)
+        {
+            pump_scheduled_ = true;
+            io_.post(boost::bind(&dispatcher::pump, this));
+        }
+    }
+    
+    // must be called with mutex_ held
+    void dispatcher::arm_refill(const time_duration& wait)
+    {
+        if(refill_armed_)
+        {
+            return;
+        }
+        
+        refill_armed_ = true;
+        refill_timer_.expires_from_now(wait);
+        refill_timer_.async_wait(
+            boost::bind(&dispatcher::on_refill, this, boost::asio::placeholders::error) );
+    }
+    
+    void dispatcher::on_refill(const boost::system::error_code& err)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            refill_armed_ = false;
+        }
+        
+        if(err != boost::asio::error::operation_aborted)
+        {
+            pump();
+        }
+    }
+    
+    dispatcher::lane* dispatcher::next_lane(provider& p)
+    {
+        // weighted round robin: a lane may dispatch 'weight' jobs in a row
+        // before yielding to the next non-empty lane. credits are refilled
+        // once every non-empty lane has used up its share.
+        for(int round = 0; round < 2; ++round)
+        {
+            for(std::size_t i = 0; i < push_priority_count; ++i)
+            {
+                std::size_t idx = (p.current + i) % push_priority_count;
+                auto& l = p.lanes[idx];
+                
+                if(!l.queue.empty() && l.credits)
+                {
+                    p.current = idx;
+                    return &l;
+                }
+            }
+            
+            for(std::size_t i = 0; i < push_priority_count; ++i)
+            {
+                p.lanes[i].credits = config_.weights[i];
+            }
+        }
+        
+        return nullptr;
+    }
+    
+    dispatcher::admission dispatcher::admit(const push_type& type, const std::string& tag,
+                                            const ptime& now, time_duration& wait,
+                                            bool count_throttle)
+    {
+        token_bucket* tag_limiter = nullptr;
+        
+        if(!tag.empty() && !tag_limiters_.empty())
+        {
+            auto it = tag_limiters_.find(tag);
+            if(it != tag_limiters_.end())
+            {
+                tag_limiter = &it->second;
+                
+                auto tag_wait = tag_limiter->wait_time(now);
+                if(tag_wait.total_microseconds() > 0)
+                {
+                    // a job which is parked already was counted when it got parked
+                    if(count_throttle)
+                    {
+                        tag_limiter->throttle();
+                    }
+                    
+                    wait = tag_wait;
+                    return admit_tag_limited;
+                }
+            }
+        }
+        
+        auto& limiter = limiters_[type];
+        
+        if(!limiter.try_take(now))
+        {
+            wait = limiter.wait_time(now);
+            return admit_provider_limited;
+        }
+        
+        if(tag_limiter)
+        {
+            tag_limiter->try_take(now);
+        }
+        
+        return admit_ok;
+    }
+    
+    // moves at most one job of the app to ready or to its parked jobs
+    dispatcher::step_result dispatcher::step(const push_type& type, provider& p,
+                                             const ptime& now, std::vector<job>& ready,
+                                             time_duration& min_wait, bool& throttled)
+    {
+        if(p.in_flight >= config_.window)
+        {
+            return step_idle;
+        }
+        
+        time_duration wait;
+        
+        // jobs parked by their tag limiter go first once the tag has tokens again
+        for(auto it = p.parked.begin(); it != p.parked.end(); ++it)
+        {
+            auto res = admit(type, it->first, now, wait, false);
+            if(res == admit_ok)
+            {
+                auto& j = it->second.front();
+                auto& l = p.lanes[j.priority];
+                
+                ++p.in_flight;
+                --p.parked_count;
+                ++l.dispatched;
+                l.wait.record(now - j.enqueued);
+                
+                ready.push_back(j);
+                it->second.pop_front();
+                
+                if(it->second.empty())
+                {
+                    p.parked.erase(it);
+                }
+                
+                return step_done;
+            }
+            
+            throttled = true;
+            min_wait = std::min(min_wait, wait);
+            
+            if(res == admit_provider_limited)
+            {
+                return step_blocked;
+            }
+        }
+        
+        lane* l = next_lane(p);
+        if(!l)
+        {
+            return step_idle;
+        }
+        
+        auto res = admit(type, l->queue.front().tag, now, wait, true);
+        if(res == admit_provider_limited)
+        {
+            throttled = true;
+            min_wait = std::min(min_wait, wait);
+            return step_blocked;
+        }
+        
+        --l->credits;
+        
+        if(res == admit_tag_limited)
+        {
+            // keep it in memory until the tag's bucket refills
+            throttled = true;
+            min_wait = std::min(min_wait, wait);
+            
+            auto& j = l->queue.front();
+            p.parked[j.tag].push_back(j);
+            ++p.parked_count;
+        }
+        else
+        {
+            ++p.in_flight;
+            ++l->dispatched;
+            l->wait.record(now - l->queue.front().enqueued);
+            
+            ready.push_back(l->queue.front());
+        }
+        
+        l->queue.pop_front();
+        return step_done;
+    }
+    
+    void dispatcher::pump()
+    {
+        std::vector<job> ready;
+        
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            pump_scheduled_ = false;
+            
+            if(closed_)
+            {
+                return;
+            }
+            
+            auto now = microsec_clock::universal_time();
+            bool throttled = false;
+            time_duration min_wait = pos_infin;
+            
+            for(std::size_t t = 0; t < 2; ++t)
+            {
+                auto type = static_cast<push_type>(t);
+                bool progress = true;
+                bool blocked = false;
+                
+                // one job per app and round so the apps share the provider's limiter
+                while(progress && !blocked)
+                {
+                    progress = false;
+                    
+                    for(auto& entry : providers_[t])
+                    {
+                        auto res = step(type, entry.second, now, ready, min_wait, throttled);
+                        if(res == step_blocked)
+                        {
+                            blocked = true;
+                            break;
+                        }
+                        
+                        progress = progress || res == step_done;
+                    }
+                }
+            }
+            
+            if(throttled)
+            {
+                arm_refill(min_wait.is_pos_infinity() ? milliseconds(1) : min_wait);
+            }
+        }
+        
+        // hand over to the plugins outside of the lock
+        for(auto& j : ready)
+        {
+            try
+            {
+                sink_(j);
+            }
+            catch(std::exception& e)
+            {
+                LOG_ERROR << "failed to hand message over to provider: " << e.what();
+                complete(j.type, j.app);
+            }
+        }
+    }
+    
+    json_spirit::Object dispatcher::stats() const
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        auto now = microsec_clock::universal_time();
+        json_spirit::Object obj, tags;
+        
+        obj.push_back( json_spirit::Pair("depth", static_cast<uint64_t>(depth_unlocked())) );
+        obj.push_back( json_spirit::Pair("queue_limit", static_cast<uint64_t>(config_.queue_limit)) );
+        obj.push_back( json_spirit::Pair("closed", closed_) );
+        
+        for(std::size_t t = 0; t < 2; ++t)
+        {
+            json_spirit::Object prov, apps;
+            uint64_t in_flight = 0;
+            uint64_t parked = 0;
+            
+            for(auto& entry : providers_[t])
+            {
+                auto& p = entry.second;
+                json_spirit::Object app, lanes;
+            
+                in_flight += p.in_flight;
+                parked += p.parked_count;
+                
+                app.push_back( json_spirit::Pair("in_flight", static_cast<uint64_t>(p.in_flight)) );
+                app.push_back( json_spirit::Pair("parked", static_cast<uint64_t>(p.parked_count)) );
+                
+                for(std::size_t i = 0; i < push_priority_count; ++i)
+                {
+                    auto& l = p.lanes[i];
+                    json_spirit::Object lane_obj;
+                    
+                    lane_obj.push_back( json_spirit::Pair("weight", static_cast<uint64_t>(config_.weights[i])) );
+                    lane_obj.push_back( json_spirit::Pair("depth", static_cast<uint64_t>(l.queue.size())) );
+                    lane_obj.push_back( json_spirit::Pair("enqueued", l.enqueued) );
+                    lane_obj.push_back( json_spirit::Pair("dispatched", l.dispatched) );
+                    lane_obj.push_back( json_spirit::Pair("wait", l.wait.to_json()) );
+                    
+                    lanes.push_back( json_spirit::Pair(dba::priority_to_str(static_cast<push_priority>(i)), lane_obj) );
+                }
+                
+                app.push_back( json_spirit::Pair("lanes", lanes) );
+                apps.push_back( json_spirit::Pair(entry.first.empty() ? "default" : entry.first, app) );
+            }
+            
+            prov.push_back( json_spirit::Pair("in_flight", in_flight) );
+            prov.push_back( json_spirit::Pair("window", static_cast<uint64_t>(config_.window)) );
+            prov.push_back( json_spirit::Pair("parked", parked) );
+            prov.push_back( json_spirit::Pair("limiter", limiters_[t].stats(now)) );
+            prov.push_back( json_spirit::Pair("apps", apps) );
+            
+            obj.push_back( json_spirit::Pair(dba::type_to_str(static_cast<push_type>(t)), prov) );
+        }
+        
+        for(auto& entry : tag_limiters_)
+        {
+            tags.push_back( json_spirit::Pair(entry.first, entry.second.stats(now)) );
+        }
+        
+        obj.push_back( json_spirit::Pair("tags", tags) );
+        
+        return obj;
+    }
+}
@@ -0,0 +1,209 @@
+//
+//  dispatcher.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__dispatcher__
+#define __pushy__dispatcher__
+
+#include <deque>
+#include <vector>
+#include <map>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <push_service.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+#include "database.hpp"
+#include "metrics.hpp"
+#include "rate_limiter.hpp"
+#include "admission.hpp"
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * Priority lanes in front of the provider plugins.
+     * Each app of a provider gets its own set of lanes which are drained using
+     * weighted round robin. At most 'window' messages per provider and app are
+     * handed to the plugin at any time so that bulk traffic can't fill up the
+     * plugin queues, and an app whose provider stalls never holds up the others.
+     *
+     * Dispatching is additionally shaped by token buckets per provider, shared
+     * by its apps in turn, and optionally per tag. Jobs which are over the limit
+     * stay queued in memory.
+     */
+    class dispatcher
+    {
+    public:
+        struct config
+        {
+            config()
+            : window(512)
+            , queue_limit(100000)
+            , retry_after(1)
+            {
+                weights[database::push_priority_high]   = 8;
+                weights[database::push_priority_normal] = 1;
+            }
+            
+            /// parses and adds a "tag=rate[:burst]" limit
+            void add_tag_limit(const std::string& spec);
+            
+            uint32_t    window;
+            uint32_t    weights[database::push_priority_count];
+            
+            std::size_t                             queue_limit; // 0 means unbounded
+            uint32_t                                retry_after; // hint for rejected producers, seconds
+            token_bucket                            limits[2];   // indexed by push_type
+            std::map<std::string, token_bucket>     tag_limits;
+        };
+        
+        struct job
+        {
+            job(const database::push_type& t, const push::device& d,
+                const std::string& p, uint32_t i, const std::string& tg,
+                const std::string& a = std::string())
+            : type(t)
+            , dev(d)
+            , payload(p)
+            , ident(i)
+            , tag(tg)
+            , app(a)
+            , priority(database::push_priority_normal)
+            , enqueued(boost::posix_time::microsec_clock::universal_time())
+            {
+            }
+            
+            database::push_type         type;
+            push::device                dev;
+            std::string                 payload;
+            uint32_t                    ident;
+            std::string                 tag;
+            std::string                 app;
+            database::push_priority     priority;   // the lane it was queued on
+            boost::posix_time::ptime    enqueued;
+        };
+        
+        typedef boost::function<void(const job&)> sink_type;
+        
+        dispatcher(io::io_service& io, const config& cfg, const sink_type& sink);
+        
+        /// queue a job on the given lane. thread-safe.
+        void enqueue(const job& j, const database::push_priority& priority);
+        
+        /// a previously dispatched job of this provider and app got its callback. thread-safe.
+        void complete(const database::push_type& type, const std::string& app);
+        
+        /// total amount of queued (not yet dispatched) jobs for all providers
+        std::size_t depth() const;
+        
+        /// queued (not yet dispatched) jobs of one app of a provider
+        std::size_t queued(const database::push_type& type, const std::string& app) const;
+        
+        /// false if the in-memory queue bound is reached
+        bool has_capacity() const;
+        
+        /// throws overload_error(throttled) if the in-memory queue bound is reached
+        void admit() const;
+        
+        /**
+         * Stops handing jobs to the plugins and returns all jobs which are still queued.
+         * Jobs enqueued after this are held until the next call. thread-safe.
+         */
+        std::vector<job> close();
+        
+        json_spirit::Object stats() const;
+        
+    private:
+        struct lane
+        {
+            lane()
+            : credits(0)
+            , enqueued(0)
+            , dispatched(0)
+            {
+            }
+            
+            std::deque<job>     queue;
+            uint32_t            credits;
+            uint64_t            enqueued;
+            uint64_t            dispatched;
+            latency_histogram   wait;
+        };
+        
+        /// the lanes of one app of a provider
+        struct provider
+        {
+            provider()
+            : in_flight(0)
+            , current(0)
+            , parked_count(0)
+            {
+            }
+            
+            lane            lanes[database::push_priority_count];
+            uint32_t        in_flight;
+            std::size_t     current;
+            
+            // jobs held back by their tag's limiter
+            std::map<std::string, std::deque<job> >  parked;
+            std::size_t                              parked_count;
+        };
+        
+        typedef std::map<std::string, provider> app_providers;
+        
+        enum admission
+        {
+            admit_ok,
+            admit_tag_limited,
+            admit_provider_limited
+        };
+        
+        enum step_result
+        {
+            step_done,      // a job was dispatched or parked
+            step_idle,      // nothing to do or the app's window is full
+            step_blocked    // the provider's limiter is empty
+        };
+        
+        void schedule_pump();
+        void pump();
+        void on_refill(const boost::system::error_code& err);
+        
+        provider& app_provider(const database::push_type& type, const std::string& app);
+        step_result step(const database::push_type& type, provider& p,
+                         const boost::posix_time::ptime& now, std::vector<job>& ready,
+                         boost::posix_time::time_duration& min_wait, bool& throttled);
+        
+        lane* next_lane(provider& p);
+        admission admit(const database::push_type& type, const std::string& tag,
+                        const boost::posix_time::ptime& now,
+                        boost::posix_time::time_duration& wait, bool count_throttle);
+        void arm_refill(const boost::posix_time::time_duration& wait);
+        std::size_t depth_unlocked() const;
+        
+        io::io_service&     io_;
+        config              config_;
+        sink_type           sink_;
+        
+        mutable boost::mutex    mutex_;
+        app_providers           providers_[2]; // indexed by push_type (apns, gcm), then app
+        token_bucket            limiters_[2];  // per provider, shared by its apps
+        bool                    pump_scheduled_;
+        bool                    closed_;
+        
+        std::map<std::string, token_bucket>     tag_limiters_;
+        io::deadline_timer                      refill_timer_;
+        bool                                    refill_armed_;
+    };
+}
+
+#endif /* defined(__pushy__dispatcher__) */
@@ -0,0 +1,876 @@
+//
+//  gcm_multicast.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "gcm_multicast.hpp"
+#include "logging.hpp"
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <limits>
+#include <cstdlib>
+#include <istream>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <json_spirit/json_spirit_reader_template.h>
+#include <json_spirit/json_spirit_writer_template.h>
+
+namespace pushy
+{
+    namespace gcm_error
+    {
+        namespace
+        {
+            class category_impl : public boost::system::error_category
+            {
+            public:
+                const char* name() const BOOST_SYSTEM_NOEXCEPT
+                {
+                    return "gcm_multicast";
+                }
+                
+                std::string message(int ev) const
+                {
+                    switch(ev)
+                    {
+                        case not_registered:
+                            return "registration id is not registered";
+                        case invalid_registration:
+                            return "invalid registration id";
+                        case mismatch_sender_id:
+                            return "registration id belongs to another sender";
+                        case missing_registration:
+                            return "missing registration id";
+                        case message_too_big:
+                            return "message too big";
+                        case invalid_data_key:
+                            return "invalid data key";
+                        case invalid_ttl:
+                            return "invalid time to live";
+                        case invalid_package_name:
+                            return "invalid package name";
+                        case rate_exceeded:
+                            return "device message rate exceeded";
+                        case unavailable:
+                            return "gcm unavailable";
+                        case internal_server_error:
+                            return "gcm internal server error";
+                        case unauthorized:
+                            return "gcm rejected the api key";
+                        case bad_request:
+                            return "gcm could not parse the request";
+                        case invalid_payload:
+                            return "payload is not a json object";
+                        case connection_lost:
+                            return "connection lost before gcm replied";
+                        case protocol_error:
+                            return "unexpected reply from gcm";
+                        default:
+                            return "unknown gcm error";
+                    }
+                }
+            };
+        }
+        
+        const boost::system::error_category& category()
+        {
+            static category_impl instance;
+            return instance;
+        }
+        
+        boost::system::error_code make_error_code(code c)
+        {
+            return boost::system::error_code(static_cast<int>(c), category());
+        }
+        
+        boost::system::error_code from_result(const std::string& error)
+        {
+            static const std::map<std::string, code> codes = {
+                { "NotRegistered", not_registered },
+                { "InvalidRegistration", invalid_registration },
+                { "MismatchSenderId", mismatch_sender_id },
+                { "MissingRegistration", missing_registration },
+                { "MessageTooBig", message_too_big },
+                { "InvalidDataKey", invalid_data_key },
+                { "InvalidTtl", invalid_ttl },
+                { "InvalidPackageName", invalid_package_name },
+                { "DeviceMessageRateExceeded", rate_exceeded },
+                { "Unavailable", unavailable },
+                { "InternalServerError", internal_server_error }
+            };
+            
+            auto it = codes.find(error);
+            return make_error_code(it == codes.end() ? unknown : it->second);
+        }
+        
+        bool device_gone(const boost::system::error_code& err)
+        {
+            return err.category() == category()
+                && (err.value() == not_registered
+                    || err.value() == invalid_registration
+                    || err.value() == mismatch_sender_id);
+        }
+    }
+    
+    namespace
+    {
+        typedef io::ssl::stream<io::ip::tcp::socket> ssl_socket;
+        
+        const uint32_t min_retry_ms = 500;
+        const uint32_t max_retry_ms = 30000;
+        
+        struct url_parts
+        {
+            bool        tls;
+            std::string host;
+            std::string port;
+            std::string path;
+        };
+        
+        url_parts parse_url(const std::string& url)
+        {
+            url_parts res;
+            std::string rest;
+            
+            if(boost::starts_with(url, "https://"))
+            {
+                res.tls = true;
+                rest = url.substr(8);
+            }
+            else if(boost::starts_with(url, "http://"))
+            {
+                res.tls = false;
+                rest = url.substr(7);
+            }
+            else
+            {
+                throw std::runtime_error("gcm url '" + url + "' must start with http:// or https://");
+            }
+            
+            auto slash = rest.find('/');
+            auto host = rest.substr(0, slash);
+            auto colon = host.rfind(':');
+            
+            res.path = slash == std::string::npos ? "/" : rest.substr(slash);
+            res.host = host.substr(0, colon);
+            res.port = colon == std::string::npos ? (res.tls ? "443" : "80") : host.substr(colon + 1);
+            
+            return res;
+        }
+    }
+    
+    /**
+     * Batches and the connection. Lives on the io service thread only;
+     * gcm_multicast posts everything over.
+     */
+    class gcm_multicast::sender
+    : public boost::enable_shared_from_this<gcm_multicast::sender>
+    {
+    public:
+        sender(io::io_service& io, const config& cfg)
+        : io_(io)
+        , config_(cfg)
+        , url_(parse_url(cfg.url))
+        , ctx_(io::ssl::context::sslv23_client)
+        , resolver_(io)
+        , window_timer_(io)
+        , retry_timer_(io)
+        , status_(0)
+        , content_length_(0)
+        , chunked_(false)
+        , window_armed_(false)
+        , connecting_(false)
+        , connected_(false)
+        , retrying_(false)
+        , busy_(false)
+        , reused_(false)
+        , closed_(false)
+        , keep_alive_(true)
+        , retry_ms_(min_retry_ms)
+        , generation_(0)
+        {
+            if(config_.batch_size < 1 || config_.batch_size > 1000)
+            {
+                throw std::runtime_error("gcm.batch_size must be between 1 and 1000");
+            }
+            
+            if(url_.tls)
+            {
+                ctx_.set_options(io::ssl::context::default_workarounds
+                    | io::ssl::context::no_sslv2 | io::ssl::context::no_sslv3);
+                
+                if(config_.verify)
+                {
+                    ctx_.set_default_verify_paths();
+                    ctx_.set_verify_mode(io::ssl::verify_peer);
+                    ctx_.set_verify_callback(io::ssl::rfc2818_verification(url_.host));
+                }
+            }
+        }
+        
+        void add(const std::string& token, const std::string& payload, uint32_t ident)
+        {
+            json_spirit::Value v;
+            if(!json_spirit::read_string(payload, v) || v.type() != json_spirit::obj_type)
+            {
+                config_.callback(gcm_error::make_error_code(gcm_error::invalid_payload), ident);
+                return;
+            }
+            
+            // messages are batched by everything but their registration ids
+            json_spirit::Object data;
+            for(auto& entry : v.get_obj())
+            {
+                if(entry.name_ != "registration_ids" && entry.name_ != "to")
+                {
+                    data.push_back(entry);
+                }
+            }
+            
+            auto key = json_spirit::write_string(json_spirit::Value(data), false);
+            auto& b = open_[key];
+            
+            if(b.idents.empty())
+            {
+                b.data = data;
+            }
+            
+            b.tokens.push_back(json_spirit::Value(token));
+            b.idents.push_back(ident);
+            
+            if(b.idents.size() >= config_.batch_size)
+            {
+                ready_.push_back(b);
+                open_.erase(key);
+                
+                send_next();
+            }
+            else if(!window_armed_)
+            {
+                window_armed_ = true;
+                
+                window_timer_.expires_from_now(boost::posix_time::milliseconds(config_.window));
+                window_timer_.async_wait(
+                    boost::bind(&sender::on_window, shared_from_this(), io::placeholders::error) );
+            }
+        }
+        
+        void close()
+        {
+            closed_ = true;
+            
+            window_timer_.cancel();
+            retry_timer_.cancel();
+            
+            teardown();
+            
+            // the pool only closes connections without unacknowledged messages
+            for(auto& entry : open_)
+            {
+                ready_.push_back(entry.second);
+            }
+            
+            open_.clear();
+            
+            while(!ready_.empty())
+            {
+                report_all(ready_.front(), gcm_error::make_error_code(gcm_error::connection_lost));
+                ready_.pop_front();
+            }
+        }
+    
+    private:
+        struct batch
+        {
+            batch()
+            : retried(false)
+            {
+            }
+            
+            json_spirit::Object     data;
+            json_spirit::Array      tokens;
+            std::vector<uint32_t>   idents;
+            bool                    retried;
+        };
+        
+        void on_window(const boost::system::error_code& err)
+        {
+            window_armed_ = false;
+            
+            if(err)
+            {
+                return;
+            }
+            
+            for(auto& entry : open_)
+            {
+                ready_.push_back(entry.second);
+            }
+            
+            open_.clear();
+            send_next();
+        }
+        
+        // one request at a time over the connection
+        void send_next()
+        {
+            if(busy_ || ready_.empty() || closed_)
+            {
+                return;
+            }
+            
+            if(!connected_)
+            {
+                connect();
+                return;
+            }
+            
+            busy_ = true;
+            inflight_ = ready_.front();
+            ready_.pop_front();
+            
+            json_spirit::Object body = inflight_.data;
+            body.push_back( json_spirit::Pair("registration_ids", inflight_.tokens) );
+            
+            auto content = json_spirit::write_string(json_spirit::Value(body), false);
+            
+            request_ = "POST " + url_.path + " HTTP/1.1\r\n"
+                "Host: " + url_.host + "\r\n"
+                "Authorization: key=" + config_.api_key + "\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: " + boost::lexical_cast<std::string>(content.size()) + "\r\n"
+                "\r\n" + content;
+            
+            LOG_TRACE << "gcm multicast request for " << inflight_.idents.size() << " registration ids";
+            
+            write(io::buffer(request_),
+                boost::bind(&sender::on_write, shared_from_this(), generation_, io::placeholders::error) );
+        }
+        
+        void connect()
+        {
+            if(closed_ || connecting_ || connected_ || retrying_)
+            {
+                return;
+            }
+            
+            LOG_DEBUG << "gcm multicast connecting to " << url_.host << ":" << url_.port;
+            
+            connecting_ = true;
+            socket_.reset(new ssl_socket(io_, ctx_));
+            
+            if(url_.tls)
+            {
+                SSL_set_tlsext_host_name(socket_->native_handle(), url_.host.c_str());
+            }
+            
+            resolver_.async_resolve(io::ip::tcp::resolver::query(url_.host, url_.port),
+                boost::bind(&sender::on_resolve, shared_from_this(), generation_,
+                    io::placeholders::error, io::placeholders::iterator) );
+        }
+        
+        void on_resolve(uint64_t gen, const boost::system::error_code& err,
+                        io::ip::tcp::resolver::iterator it)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("resolve", err);
+                return;
+            }
+            
+            io::async_connect(socket_->lowest_layer(), it,
+                boost::bind(&sender::on_connect, shared_from_this(), gen, io::placeholders::error) );
+        }
+        
+        void on_connect(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("connect", err);
+                return;
+            }
+            
+            socket_->lowest_layer().set_option(io::ip::tcp::no_delay(true));
+            
+            if(!url_.tls)
+            {
+                on_handshake(gen, err);
+                return;
+            }
+            
+            socket_->async_handshake(ssl_socket::client,
+                boost::bind(&sender::on_handshake, shared_from_this(), gen, io::placeholders::error) );
+        }
+        
+        void on_handshake(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("tls handshake", err);
+                return;
+            }
+            
+            LOG_INFO << "gcm multicast connected to " << url_.host << ":" << url_.port;
+            
+            connecting_ = false;
+            connected_ = true;
+            reused_ = false;
+            retry_ms_ = min_retry_ms;
+            
+            send_next();
+        }
+        
+        void on_write(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("write", err);
+                return;
+            }
+            
+            read_until("\r\n\r\n",
+                boost::bind(&sender::on_headers, shared_from_this(), gen, io::placeholders::error) );
+        }
+        
+        void on_headers(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("read", err);
+                return;
+            }
+            
+            std::istream in(&buf_);
+            std::string line;
+            
+            std::getline(in, line);
+            status_ = 0;
+            
+            std::vector<std::string> parts;
+            boost::split(parts, line, boost::is_any_of(" "));
+            
+            if(parts.size() >= 2)
+            {
+                status_ = std::atoi(parts[1].c_str());
+            }
+            
+            content_length_ = std::string::npos;
+            chunked_ = false;
+            keep_alive_ = true;
+            body_.clear();
+            
+            while(std::getline(in, line) && line != "\r")
+            {
+                auto colon = line.find(':');
+                if(colon == std::string::npos)
+                {
+                    continue;
+                }
+                
+                auto name = boost::to_lower_copy(line.substr(0, colon));
+                auto value = boost::to_lower_copy(boost::trim_copy(line.substr(colon + 1)));
+                
+                if(name == "content-length")
+                {
+                    content_length_ = std::strtoul(value.c_str(), NULL, 10);
+                }
+                else if(name == "transfer-encoding")
+                {
+                    chunked_ = value.find("chunked") != std::string::npos;
+                }
+                else if(name == "connection")
+                {
+                    keep_alive_ = value != "close";
+                }
+            }
+            
+            if(chunked_)
+            {
+                read_chunk(gen);
+            }
+            else if(content_length_ != std::string::npos)
+            {
+                read_at_least(content_length_,
+                    boost::bind(&sender::on_body, shared_from_this(), gen, io::placeholders::error) );
+            }
+            else
+            {
+                // body until the server closes
+                keep_alive_ = false;
+                read_at_least(std::numeric_limits<std::size_t>::max(),
+                    boost::bind(&sender::on_body, shared_from_this(), gen, io::placeholders::error) );
+            }
+        }
+        
+        void on_body(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err && !(err == io::error::eof && content_length_ == std::string::npos))
+            {
+                fail("read", err);
+                return;
+            }
+            
+            auto len = std::min(content_length_, buf_.size());
+            body_.assign(io::buffers_begin(buf_.data()), io::buffers_begin(buf_.data()) + len);
+            buf_.consume(len);
+            
+            complete();
+        }
+        
+        void read_chunk(uint64_t gen)
+        {
+            read_until("\r\n",
+                boost::bind(&sender::on_chunk_size, shared_from_this(), gen, io::placeholders::error) );
+        }
+        
+        void on_chunk_size(uint64_t gen, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("read", err);
+                return;
+            }
+            
+            std::istream in(&buf_);
+            std::string line;
+            std::getline(in, line);
+            
+            auto size = std::strtoul(line.c_str(), NULL, 16);
+            
+            // the chunk and its crlf; the last chunk is empty and followed by a crlf too
+            read_at_least(size + 2,
+                boost::bind(&sender::on_chunk, shared_from_this(), gen, size, io::placeholders::error) );
+        }
+        
+        void on_chunk(uint64_t gen, std::size_t size, const boost::system::error_code& err)
+        {
+            if(gen != generation_)
+            {
+                return;
+            }
+            
+            if(err)
+            {
+                fail("read", err);
+                return;
+            }
+            
+            body_.append(io::buffers_begin(buf_.data()), io::buffers_begin(buf_.data()) + size);
+            buf_.consume(size + 2);
+            
+            if(size)
+            {
+                read_chunk(gen);
+            }
+            else
+            {
+                complete();
+            }
+        }
+        
+        // the reply to the request in flight is in
+        void complete()
+        {
+            auto b = inflight_;
+            
+            busy_ = false;
+            reused_ = true;
+            
+            if(!keep_alive_)
+            {
+                teardown();
+            }
+            
+            report(b);
+            send_next();
+        }
+        
+        void report(const batch& b)
+        {
+            if(status_ != 200)
+            {
+                LOG_WARN << "gcm multicast request for " << b.idents.size()
+                    << " registration ids failed with http status " << status_;
+                
+                gcm_error::code c = gcm_error::protocol_error;
+                
+                if(status_ == 401)
+                {
+                    c = gcm_error::unauthorized;
+                }
+                else if(status_ == 400)
+                {
+                    c = gcm_error::bad_request;
+                }
+                else if(status_ >= 500)
+                {
+                    c = gcm_error::unavailable;
+                }
+                
+                report_all(b, gcm_error::make_error_code(c));
+                return;
+            }
+            
+            json_spirit::Value v;
+            const json_spirit::Array* results = NULL;
+            
+            if(json_spirit::read_string(body_, v) && v.type() == json_spirit::obj_type)
+            {
+                for(auto& entry : v.get_obj())
+                {
+                    if(entry.name_ == "results" && entry.value_.type() == json_spirit::array_type)
+                    {
+                        results = &entry.value_.get_array();
+                    }
+                }
+            }
+            
+            if(!results || results->size() != b.idents.size())
+            {
+                LOG_WARN << "gcm multicast reply does not match the request: '" << body_ << "'";
+                report_all(b, gcm_error::make_error_code(gcm_error::protocol_error));
+                return;
+            }
+            
+            for(std::size_t i = 0; i < b.idents.size(); ++i)
+            {
+                boost::system::error_code err;
+                auto& result = (*results)[i];
+                
+                if(result.type() == json_spirit::obj_type)
+                {
+                    for(auto& entry : result.get_obj())
+                    {
+                        if(entry.name_ == "error" && entry.value_.type() == json_spirit::str_type)
+                        {
+                            err = gcm_error::from_result(entry.value_.get_str());
+                        }
+                        else if(entry.name_ == "registration_id")
+                        {
+                            LOG_DEBUG << "gcm reports a canonical registration id for '"
+                                << b.tokens[i].get_str() << "'";
+                        }
+                    }
+                }
+                
+                config_.callback(err, b.idents[i]);
+            }
+        }
+        
+        void report_all(const batch& b, const boost::system::error_code& err)
+        {
+            for(auto ident : b.idents)
+            {
+                config_.callback(err, ident);
+            }
+        }
+        
+        // drops the connection and reconnects later
+        void fail(const std::string& what, const boost::system::error_code& err)
+        {
+            LOG_WARN << "gcm multicast " << url_.host << ":" << url_.port << " " << what
+                << " failed: " << err.message();
+            
+            bool was_busy = busy_;
+            bool stale = busy_ && reused_ && !inflight_.retried;
+            
+            teardown();
+            
+            if(stale)
+            {
+                // most likely an idle keep-alive connection closed by the server. try once more
+                inflight_.retried = true;
+                ready_.push_front(inflight_);
+                
+                send_next();
+                return;
+            }
+            
+            if(was_busy)
+            {
+                report_all(inflight_, gcm_error::make_error_code(gcm_error::connection_lost));
+            }
+            
+            if(closed_ || ready_.empty())
+            {
+                return;
+            }
+            
+            retrying_ = true;
+            
+            retry_timer_.expires_from_now(boost::posix_time::milliseconds(retry_ms_));
+            retry_timer_.async_wait(
+                boost::bind(&sender::on_retry, shared_from_this(), io::placeholders::error) );
+            
+            retry_ms_ = std::min(retry_ms_ * 2, max_retry_ms);
+        }
+        
+        void on_retry(const boost::system::error_code& err)
+        {
+            retrying_ = false;
+            
+            if(!err)
+            {
+                send_next();
+            }
+        }
+        
+        void teardown()
+        {
+            // handlers of the old socket are ignored from now on
+            ++generation_;
+            
+            connecting_ = false;
+            connected_ = false;
+            busy_ = false;
+            
+            resolver_.cancel();
+            buf_.consume(buf_.size());
+            
+            if(socket_)
+            {
+                boost::system::error_code ignored;
+                socket_->lowest_layer().close(ignored);
+            }
+        }
+        
+        /*
+         * plain or tls, depending on the url
+         */
+        template<typename Buffers, typename Handler>
+        void write(const Buffers& buffers, Handler handler)
+        {
+            if(url_.tls)
+            {
+                io::async_write(*socket_, buffers, handler);
+            }
+            else
+            {
+                io::async_write(socket_->next_layer(), buffers, handler);
+            }
+        }
+        
+        template<typename Handler>
+        void read_until(const std::string& delim, Handler handler)
+        {
+            if(url_.tls)
+            {
+                io::async_read_until(*socket_, buf_, delim, handler);
+            }
+            else
+            {
+                io::async_read_until(socket_->next_layer(), buf_, delim, handler);
+            }
+        }
+        
+        // until buf_ holds at least 'total' bytes
+        template<typename Handler>
+        void read_at_least(std::size_t total, Handler handler)
+        {
+            auto more = total > buf_.size() ? total - buf_.size() : 0;
+            
+            if(url_.tls)
+            {
+                io::async_read(*socket_, buf_, io::transfer_at_least(more), handler);
+            }
+            else
+            {
+                io::async_read(socket_->next_layer(), buf_, io::transfer_at_least(more), handler);
+            }
+        }
+        
+        io::io_service&                 io_;
+        config                          config_;
+        url_parts                       url_;
+        io::ssl::context                ctx_;
+        io::ip::tcp::resolver           resolver_;
+        boost::scoped_ptr<ssl_socket>   socket_; // a new one per connection attempt
+        io::deadline_timer              window_timer_;
+        io::deadline_timer              retry_timer_;
+        
+        std::map<std::string, batch>    open_;      // by payload without registration ids
+        std::deque<batch>               ready_;
+        batch                           inflight_;
+        
+        std::string                     request_;
+        io::streambuf                   buf_;
+        std::string                     body_;
+        int                             status_;
+        std::size_t                     content_length_;
+        bool                            chunked_;
+        
+        bool        window_armed_;
+        bool        connecting_;
+        bool        connected_;
+        bool        retrying_;
+        bool        busy_;
+        bool        reused_;
+        bool        closed_;
+        bool        keep_alive_;
+        uint32_t    retry_ms_;
+        uint64_t    generation_;
+    };
+    
+    gcm_multicast::gcm_multicast(io::io_service& io, const config& cfg)
+    : io_(io)
+    , sender_(new sender(io, cfg))
+    {
+    }
+    
+    gcm_multicast::~gcm_multicast()
+    {
+        io_.post(boost::bind(&sender::close, sender_));
+    }
+    
+    void gcm_multicast::post(const push::device& dev, const std::string& payload, uint32_t, uint32_t ident)
+    {
+        io_.post(boost::bind(&sender::add, sender_, dev.token, payload, ident));
+    }
+}
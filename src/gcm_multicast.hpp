@@ -0,0 +1,121 @@
+//
+//  gcm_multicast.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__gcm_multicast__
+#define __pushy__gcm_multicast__
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <push_service.hpp>
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * Errors reported per registration id by GCM, plus failures of the whole request.
+     */
+    namespace gcm_error
+    {
+        enum code
+        {
+            not_registered = 1,
+            invalid_registration,
+            mismatch_sender_id,
+            missing_registration,
+            message_too_big,
+            invalid_data_key,
+            invalid_ttl,
+            invalid_package_name,
+            rate_exceeded,          // DeviceMessageRateExceeded
+            unavailable,            // Unavailable or http 5xx
+            internal_server_error,
+            unauthorized,           // http 401, wrong api key
+            bad_request,            // http 400, malformed json
+            invalid_payload,        // the payload handed to post() is not a json object
+            connection_lost,        // no reply before the connection went away
+            protocol_error,         // unexpected reply
+            unknown
+        };
+        
+        const boost::system::error_category& category();
+        boost::system::error_code make_error_code(code c);
+        
+        /// maps the "error" of one entry in the results of a GCM reply
+        boost::system::error_code from_result(const std::string& error);
+        
+        /// true if GCM will never accept this registration id again
+        bool device_gone(const boost::system::error_code& err);
+    }
+}
+
+namespace boost
+{
+    namespace system
+    {
+        template<>
+        struct is_error_code_enum<pushy::gcm_error::code>
+        {
+            static const bool value = true;
+        };
+    }
+}
+
+namespace pushy
+{
+    /**
+     * GCM sender which coalesces messages with identical payloads into multicast
+     * requests of up to 'batch_size' registration ids. A batch goes out once it is full
+     * or 'window' milliseconds after its first message came in, whatever is first.
+     *
+     * Requests are sent one at a time over a single keep-alive connection. The results
+     * of a reply are in the order of the registration ids and are reported to the
+     * callback with the ident each message was posted with.
+     */
+    class gcm_multicast
+    {
+    public:
+        typedef boost::function<void(const boost::system::error_code&, const uint32_t&)> callback_type;
+        
+        struct config
+        {
+            config()
+            : url("https://android.googleapis.com/gcm/send")
+            , batch_size(1000)
+            , window(5)
+            , verify(true)
+            {
+            }
+            
+            std::string     url;        // http:// is fine for a stand-in
+            std::string     api_key;
+            uint32_t        batch_size; // registration ids per request; gcm allows 1000
+            uint32_t        window;     // milliseconds
+            bool            verify;     // verify the server certificate
+            callback_type   callback;
+        };
+        
+        gcm_multicast(io::io_service& io, const config& cfg);
+        ~gcm_multicast();
+        
+        /// same signature as the gcm plugin's post; the payload is the json the plugin would send
+        void post(const push::device& dev, const std::string& payload, uint32_t expiry, uint32_t ident);
+    
+    private:
+        class sender;
+        
+        io::io_service&             io_;
+        boost::shared_ptr<sender>   sender_;
+    };
+}
+
+#endif /* defined(__pushy__gcm_multicast__) */
@@ -0,0 +1,95 @@
+//
+//  idempotency_cache.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "idempotency_cache.hpp"
+
+using namespace boost::posix_time;
+
+namespace pushy
+{
+    idempotency_cache::idempotency_cache(std::size_t capacity, const time_duration& ttl)
+    : capacity_(capacity)
+    , ttl_(ttl)
+    , hits_(0)
+    , misses_(0)
+    {
+    }
+    
+    bool idempotency_cache::find(const std::string& key, boost::uuids::uuid& msg_uuid)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        auto it = index_.find(key);
+        if(it == index_.end())
+        {
+            ++misses_;
+            return false;
+        }
+        
+        if(it->second->expires <= microsec_clock::universal_time())
+        {
+            entries_.erase(it->second);
+            index_.erase(it);
+            
+            ++misses_;
+            return false;
+        }
+        
+        // refresh position but not the expiry; the window is fixed per key
+        entries_.splice(entries_.begin(), entries_, it->second);
+        msg_uuid = it->second->msg_uuid;
+        
+        ++hits_;
+        return true;
+    }
+    
+    void idempotency_cache::insert(const std::string& key, const boost::uuids::uuid& msg_uuid)
+    {
+        if(!capacity_)
+        {
+            return;
+        }
+        
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        auto it = index_.find(key);
+        if(it != index_.end())
+        {
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+        
+        entry e;
+        e.key = key;
+        e.msg_uuid = msg_uuid;
+        e.expires = microsec_clock::universal_time() + ttl_;
+        
+        entries_.push_front(e);
+        index_[key] = entries_.begin();
+        
+        while(entries_.size() > capacity_)
+        {
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+        }
+    }
+    
+    json_spirit::Object idempotency_cache::stats() const
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        json_spirit::Object obj;
+        
+        obj.push_back( json_spirit::Pair("size", static_cast<uint64_t>(entries_.size())) );
+        obj.push_back( json_spirit::Pair("capacity", static_cast<uint64_t>(capacity_)) );
+        obj.push_back( json_spirit::Pair("ttl", static_cast<uint64_t>(ttl_.total_seconds())) );
+        obj.push_back( json_spirit::Pair("hits", hits_) );
+        obj.push_back( json_spirit::Pair("misses", misses_) );
+        
+        return obj;
+    }
+}
@@ -0,0 +1,64 @@
+//
+//  idempotency_cache.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__idempotency_cache__
+#define __pushy__idempotency_cache__
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    /**
+     * Bounded LRU of idempotency keys seen by this node, mapped to the message uuid
+     * they produced. Entries expire after the dedup window. Redis is the authority
+     * across nodes; this only saves the round trip for retries landing on the same node.
+     */
+    class idempotency_cache
+    {
+    public:
+        idempotency_cache(std::size_t capacity, const boost::posix_time::time_duration& ttl);
+        
+        bool find(const std::string& key, boost::uuids::uuid& msg_uuid);
+        void insert(const std::string& key, const boost::uuids::uuid& msg_uuid);
+        
+        const boost::posix_time::time_duration& ttl() const
+        {
+            return ttl_;
+        }
+        
+        json_spirit::Object stats() const;
+        
+    private:
+        struct entry
+        {
+            std::string                 key;
+            boost::uuids::uuid          msg_uuid;
+            boost::posix_time::ptime    expires;
+        };
+        
+        typedef std::list<entry> entries_type;
+        
+        std::size_t                         capacity_;
+        boost::posix_time::time_duration    ttl_;
+        
+        mutable boost::mutex                                        mutex_;
+        entries_type                                                entries_; // most recent first
+        std::unordered_map<std::string, entries_type::iterator>     index_;
+        
+        uint64_t    hits_;
+        uint64_t    misses_;
+    };
+}
+
+#endif /* defined(__pushy__idempotency_cache__) */
@@ -0,0 +1,330 @@
+//
+//  ingest_protocol.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "ingest_protocol.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace pushy
+{
+    namespace ingest
+    {
+        namespace
+        {
+            // length and type
+            const std::size_t header_size = 5;
+            
+            void put8(std::string& out, uint8_t v)
+            {
+                out.push_back(static_cast<char>(v));
+            }
+            
+            void put16(std::string& out, uint16_t v)
+            {
+                out.push_back(static_cast<char>((v >> 8) & 0xff));
+                out.push_back(static_cast<char>(v & 0xff));
+            }
+            
+            void put32(std::string& out, uint32_t v)
+            {
+                out.push_back(static_cast<char>((v >> 24) & 0xff));
+                out.push_back(static_cast<char>((v >> 16) & 0xff));
+                out.push_back(static_cast<char>((v >> 8) & 0xff));
+                out.push_back(static_cast<char>(v & 0xff));
+            }
+            
+            void put64(std::string& out, uint64_t v)
+            {
+                put32(out, static_cast<uint32_t>(v >> 32));
+                put32(out, static_cast<uint32_t>(v & 0xffffffff));
+            }
+            
+            void put_string16(std::string& out, const std::string& s)
+            {
+                if(s.size() > 0xffff)
+                {
+                    throw std::length_error("ingest frame string longer than 65535 bytes");
+                }
+                
+                put16(out, static_cast<uint16_t>(s.size()));
+                out += s;
+            }
+            
+            void put_string32(std::string& out, const std::string& s)
+            {
+                put32(out, static_cast<uint32_t>(s.size()));
+                out += s;
+            }
+            
+            // writes the length of the frame starting at 'start' once it is complete
+            void finish(std::string& out, std::size_t start)
+            {
+                if(out.size() - start > max_frame)
+                {
+                    out.resize(start);
+                    throw std::length_error("ingest frame larger than the maximum frame size");
+                }
+                
+                uint32_t length = static_cast<uint32_t>(out.size() - start - 4);
+                
+                out[start] = static_cast<char>((length >> 24) & 0xff);
+                out[start + 1] = static_cast<char>((length >> 16) & 0xff);
+                out[start + 2] = static_cast<char>((length >> 8) & 0xff);
+                out[start + 3] = static_cast<char>(length & 0xff);
+            }
+            
+            /**
+             * Bounds checked reads from the body of a frame
+             */
+            class cursor
+            {
+            public:
+                cursor(const char* p, const char* end)
+                : p_(reinterpret_cast<const unsigned char*>(p))
+                , end_(reinterpret_cast<const unsigned char*>(end))
+                {
+                }
+                
+                bool get8(uint8_t& v)
+                {
+                    if(end_ - p_ < 1)
+                    {
+                        return false;
+                    }
+                    
+                    v = *p_++;
+                    return true;
+                }
+                
+                bool get16(uint16_t& v)
+                {
+                    if(end_ - p_ < 2)
+                    {
+                        return false;
+                    }
+                    
+                    v = static_cast<uint16_t>((p_[0] << 8) | p_[1]);
+                    p_ += 2;
+                    return true;
+                }
+                
+                bool get32(uint32_t& v)
+                {
+                    if(end_ - p_ < 4)
+                    {
+                        return false;
+                    }
+                    
+                    v = (static_cast<uint32_t>(p_[0]) << 24) | (static_cast<uint32_t>(p_[1]) << 16)
+                        | (static_cast<uint32_t>(p_[2]) << 8) | p_[3];
+                    p_ += 4;
+                    return true;
+                }
+                
+                bool get64(uint64_t& v)
+                {
+                    uint32_t high, low;
+                    
+                    if(!get32(high) || !get32(low))
+                    {
+                        return false;
+                    }
+                    
+                    v = (static_cast<uint64_t>(high) << 32) | low;
+                    return true;
+                }
+                
+                bool get_bytes(void* out, std::size_t size)
+                {
+                    if(static_cast<std::size_t>(end_ - p_) < size)
+                    {
+                        return false;
+                    }
+                    
+                    std::memcpy(out, p_, size);
+                    p_ += size;
+                    return true;
+                }
+                
+                bool get_string(std::string& s, std::size_t size)
+                {
+                    if(static_cast<std::size_t>(end_ - p_) < size)
+                    {
+                        return false;
+                    }
+                    
+                    s.assign(reinterpret_cast<const char*>(p_), size);
+                    p_ += size;
+                    return true;
+                }
+                
+                bool get_string16(std::string& s)
+                {
+                    uint16_t size;
+                    return get16(size) && get_string(s, size);
+                }
+                
+                bool get_string32(std::string& s)
+                {
+                    uint32_t size;
+                    return get32(size) && get_string(s, size);
+                }
+                
+                bool at_end() const
+                {
+                    return p_ == end_;
+                }
+            
+            private:
+                const unsigned char*    p_;
+                const unsigned char*    end_;
+            };
+            
+            // checks the length and type; the body is everything after the type
+            decode_result frame_body(const char* data, std::size_t& size, uint8_t type, cursor& body)
+            {
+                if(size < 4)
+                {
+                    size = 0;
+                    return incomplete;
+                }
+                
+                uint32_t length;
+                cursor(data, data + 4).get32(length);
+                
+                std::size_t total = static_cast<std::size_t>(length) + 4;
+                
+                if(length < 1 || total > max_frame)
+                {
+                    return malformed;
+                }
+                
+                if(size < total)
+                {
+                    size = total;
+                    return incomplete;
+                }
+                
+                size = total;
+                
+                if(static_cast<uint8_t>(data[4]) != type)
+                {
+                    return malformed;
+                }
+                
+                body = cursor(data + header_size, data + size);
+                return decoded;
+            }
+        }
+        
+        void encode(const send_frame& f, std::string& out)
+        {
+            std::size_t start = out.size();
+            
+            put32(out, 0);
+            put8(out, frame_send);
+            put32(out, f.id);
+            out.append(reinterpret_cast<const char*>(f.device.data), f.device.size());
+            put8(out, f.priority);
+            put64(out, static_cast<uint64_t>(f.send_at));
+            
+            try
+            {
+                put_string16(out, f.tag);
+                put_string16(out, f.idempotency_key);
+                put_string16(out, f.collapse_key);
+                put_string32(out, f.msg);
+            }
+            catch(...)
+            {
+                out.resize(start);
+                throw;
+            }
+            
+            finish(out, start);
+        }
+        
+        void encode(const ack_frame& f, std::string& out)
+        {
+            std::size_t start = out.size();
+            
+            put32(out, 0);
+            put8(out, frame_ack);
+            put32(out, f.id);
+            put8(out, f.status);
+            
+            if(f.status == status_ok)
+            {
+                out.append(reinterpret_cast<const char*>(f.uuid.data), f.uuid.size());
+            }
+            else
+            {
+                put32(out, f.retry_after);
+                
+                // errors are for humans; a very long one is cut rather than refused
+                put_string16(out, f.error.substr(0, 0xffff));
+            }
+            
+            finish(out, start);
+        }
+        
+        decode_result decode(const char* data, std::size_t& size, send_frame& f)
+        {
+            cursor body(data, data);
+            auto res = frame_body(data, size, frame_send, body);
+            
+            if(res != decoded)
+            {
+                return res;
+            }
+            
+            uint64_t send_at;
+            
+            bool ok = body.get32(f.id)
+                && body.get_bytes(f.device.data, f.device.size())
+                && body.get8(f.priority)
+                && body.get64(send_at)
+                && body.get_string16(f.tag)
+                && body.get_string16(f.idempotency_key)
+                && body.get_string16(f.collapse_key)
+                && body.get_string32(f.msg)
+                && body.at_end();
+            
+            f.send_at = static_cast<int64_t>(send_at);
+            
+            return ok ? decoded : malformed;
+        }
+        
+        decode_result decode(const char* data, std::size_t& size, ack_frame& f)
+        {
+            cursor body(data, data);
+            auto res = frame_body(data, size, frame_ack, body);
+            
+            if(res != decoded)
+            {
+                return res;
+            }
+            
+            bool ok = body.get32(f.id) && body.get8(f.status);
+            
+            if(ok && f.status == status_ok)
+            {
+                ok = body.get_bytes(f.uuid.data, f.uuid.size());
+                f.retry_after = 0;
+                f.error.clear();
+            }
+            else if(ok)
+            {
+                ok = body.get32(f.retry_after) && body.get_string16(f.error);
+            }
+            
+            return ok && body.at_end() ? decoded : malformed;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+//
+//  ingest_protocol.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__ingest_protocol__
+#define __pushy__ingest_protocol__
+
+#include <string>
+#include <cstdint>
+#include <boost/uuid/uuid.hpp>
+
+namespace pushy
+{
+    /**
+     * Frames of the binary ingest protocol. Every frame starts with its length as a
+     * big endian uint32, not counting the length itself, and a type byte. Integers
+     * are big endian, strings are length prefixed.
+     *
+     *  send (client to server)
+     *      uint32  length
+     *      uint8   type            1
+     *      uint32  id              chosen by the client, echoed in the ack
+     *      uint8   device[16]      device uuid
+     *      uint8   priority        0 high, 1 normal
+     *      int64   send_at         seconds since epoch, 0 to send right away
+     *      uint16  tag length              tag
+     *      uint16  idempotency key length  idempotency key
+     *      uint16  collapse key length     collapse key
+     *      uint32  msg length              msg
+     *
+     *  ack (server to client), one per send frame and in the same order
+     *      uint32  length
+     *      uint8   type            0x81
+     *      uint32  id
+     *      uint8   status          see ingest::status
+     *      ok:     uint8 uuid[16]  uuid of the message
+     *      else:   uint32 retry_after (seconds, throttled and busy only),
+     *              uint16 error length, error
+     *
+     * The server closes the connection after acking a malformed frame.
+     */
+    namespace ingest
+    {
+        const uint8_t frame_send = 1;
+        const uint8_t frame_ack = 0x81;
+        
+        /// largest frame either side accepts, length field included
+        const std::size_t max_frame = 1024 * 1024;
+        
+        enum status
+        {
+            status_ok = 0,
+            status_malformed = 1,   // the frame could not be read
+            status_failed = 2,      // the message was refused, see the error
+            status_throttled = 3,   // provider queues are full; retry later
+            status_busy = 4         // too much work in progress; retry later
+        };
+        
+        struct send_frame
+        {
+            send_frame()
+            : id(0)
+            , priority(1)
+            , send_at(0)
+            {
+            }
+            
+            uint32_t            id;
+            boost::uuids::uuid  device;
+            uint8_t             priority;
+            int64_t             send_at;
+            std::string         tag;
+            std::string         idempotency_key;
+            std::string         collapse_key;
+            std::string         msg;
+        };
+        
+        struct ack_frame
+        {
+            ack_frame()
+            : id(0)
+            , status(status_ok)
+            , retry_after(0)
+            {
+            }
+            
+            uint32_t            id;
+            uint8_t             status;
+            boost::uuids::uuid  uuid;           // status_ok only
+            uint32_t            retry_after;
+            std::string         error;
+        };
+        
+        enum decode_result
+        {
+            incomplete,     // more bytes are needed
+            decoded,
+            malformed
+        };
+        
+        /// appends the frame to out
+        void encode(const send_frame& f, std::string& out);
+        void encode(const ack_frame& f, std::string& out);
+        
+        /**
+         * Decodes the frame at the start of the size bytes at data. On 'decoded' size is
+         * set to the bytes the frame took; on 'incomplete' to the bytes the whole frame
+         * needs, or 0 while even its length is not in yet.
+         */
+        decode_result decode(const char* data, std::size_t& size, send_frame& f);
+        decode_result decode(const char* data, std::size_t& size, ack_frame& f);
+    }
+}
+
+#endif /* defined(__pushy__ingest_protocol__) */
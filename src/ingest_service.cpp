@@ -0,0 +1,398 @@
+//
+//  ingest_service.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "ingest_service.hpp"
+#include "ingest_protocol.hpp"
+#include "pushy_service.hpp"
+#include "logging.hpp"
+
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+namespace pushy
+{
+    namespace
+    {
+        // a connection's read buffer starts here and grows up to ingest::max_frame
+        const std::size_t initial_buffer = 64 * 1024;
+        
+        // pause after a failed accept so running out of descriptors doesn't spin
+        const long accept_backoff_ms = 100;
+    }
+    
+    /**
+     * One producer connection over tcp or a unix socket. Reads, handles every complete
+     * frame, writes the acks and only then reads again; a producer that pipelines
+     * faster than pushy keeps up is held back by the socket buffers.
+     */
+    template<typename Protocol>
+    class ingest_service::connection
+    : public boost::enable_shared_from_this<ingest_service::connection<Protocol> >
+    {
+    public:
+        connection(ingest_service& service)
+        : service_(service)
+        , socket_(service.io_)
+        , buffer_(initial_buffer)
+        , size_(0)
+        , closing_(false)
+        , started_(false)
+        {
+        }
+        
+        ~connection()
+        {
+            if(started_)
+            {
+                --service_.open_;
+            }
+        }
+        
+        typename Protocol::socket& socket()
+        {
+            return socket_;
+        }
+        
+        void start()
+        {
+            started_ = true;
+            ++service_.connections_;
+            ++service_.open_;
+            
+            read();
+        }
+    
+    private:
+        void read()
+        {
+            socket_.async_read_some(io::buffer(&buffer_[size_], buffer_.size() - size_),
+                boost::bind(&connection::on_read, this->shared_from_this(),
+                            io::placeholders::error, io::placeholders::bytes_transferred) );
+        }
+        
+        void on_read(const boost::system::error_code& err, std::size_t bytes)
+        {
+            if(err)
+            {
+                if(err != io::error::eof)
+                {
+                    LOG_DEBUG << "ingest connection lost: " << err.message();
+                }
+                
+                return;
+            }
+            
+            size_ += bytes;
+            process();
+            
+            if(acks_.empty())
+            {
+                read();
+                return;
+            }
+            
+            io::async_write(socket_, io::buffer(acks_),
+                boost::bind(&connection::on_write, this->shared_from_this(),
+                            io::placeholders::error) );
+        }
+        
+        void on_write(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                LOG_DEBUG << "ingest connection lost while writing acks: " << err.message();
+                return;
+            }
+            
+            acks_.clear();
+            
+            if(closing_)
+            {
+                boost::system::error_code ignored;
+                socket_.shutdown(Protocol::socket::shutdown_both, ignored);
+                return;
+            }
+            
+            read();
+        }
+        
+        // handles every complete frame in the buffer and keeps the partial one
+        void process()
+        {
+            std::size_t offset = 0;
+            std::size_t needed = 0;
+            
+            while(!closing_ && offset < size_)
+            {
+                std::size_t size = size_ - offset;
+                auto res = ingest::decode(&buffer_[offset], size, frame_);
+                
+                if(res == ingest::incomplete)
+                {
+                    needed = size;
+                    break;
+                }
+                
+                if(res == ingest::malformed)
+                {
+                    LOG_WARN << "malformed ingest frame; closing the connection";
+                    ++service_.malformed_;
+                    
+                    ingest::ack_frame ack;
+                    ack.status = ingest::status_malformed;
+                    ack.error = "malformed frame";
+                    
+                    ingest::encode(ack, acks_);
+                    closing_ = true;
+                    break;
+                }
+                
+                handle(frame_);
+                offset += size;
+            }
+            
+            if(offset)
+            {
+                std::memmove(&buffer_[0], &buffer_[offset], size_ - offset);
+                size_ -= offset;
+            }
+            
+            // room for the whole frame; its size was checked against max_frame
+            if(needed > buffer_.size())
+            {
+                buffer_.resize(needed);
+            }
+        }
+        
+        void handle(const ingest::send_frame& f)
+        {
+            ++service_.frames_;
+            
+            ingest::ack_frame ack;
+            ack.id = f.id;
+            
+            try
+            {
+                if(f.priority >= database::push_priority_count)
+                {
+                    throw std::runtime_error("priority must be 0 (high) or 1 (normal)");
+                }
+                
+                push_request req;
+                
+                req.dev_uuid = f.device;
+                req.msg = f.msg;
+                req.tag = f.tag;
+                req.priority = static_cast<database::push_priority>(f.priority);
+                req.idempotency_key = f.idempotency_key;
+                req.collapse_key = f.collapse_key;
+                
+                if(f.send_at)
+                {
+                    req.send_at = boost::posix_time::from_time_t(static_cast<std::time_t>(f.send_at));
+                }
+                
+                ack.uuid = service_.push_service_.push(req);
+                ++service_.accepted_;
+            }
+            catch(overload_error& e)
+            {
+                ++service_.rejected_;
+                
+                ack.status = e.reason() == overload_error::throttled
+                    ? ingest::status_throttled
+                    : ingest::status_busy;
+                ack.retry_after = e.retry_after();
+                ack.error = e.what();
+            }
+            catch(std::exception& e)
+            {
+                LOG_DEBUG << "ingest frame " << f.id << " refused: " << e.what();
+                ++service_.failed_;
+                
+                ack.status = ingest::status_failed;
+                ack.error = e.what();
+            }
+            
+            ingest::encode(ack, acks_);
+        }
+        
+        ingest_service&             service_;
+        typename Protocol::socket   socket_;
+        
+        std::vector<char>           buffer_;
+        std::size_t                 size_;      // bytes read into buffer_ and not handled yet
+        ingest::send_frame          frame_;     // reused so its strings keep their capacity
+        std::string                 acks_;
+        
+        bool                        closing_;   // after a malformed frame
+        bool                        started_;
+    };
+    
+    ingest_service::ingest_service(pushy_service& ps,
+                                   const std::string& addr, const std::string& port,
+                                   const std::string& unix_path, int threads)
+    : push_service_(ps)
+    , tcp_accept_timer_(io_)
+    , local_accept_timer_(io_)
+    , unix_path_(unix_path)
+    , stopped_(false)
+    , connections_(0)
+    , open_(0)
+    , frames_(0)
+    , accepted_(0)
+    , failed_(0)
+    , rejected_(0)
+    , malformed_(0)
+    {
+        if(port.empty() && unix_path.empty())
+        {
+            throw std::runtime_error("the ingest listener needs ingest.port or ingest.unix");
+        }
+        
+        if(threads < 1)
+        {
+            throw std::runtime_error("ingest.threads must be greater than zero");
+        }
+        
+        if(!port.empty())
+        {
+            io::ip::tcp::resolver resolver(io_);
+            io::ip::tcp::endpoint endpoint = *resolver.resolve(io::ip::tcp::resolver::query(addr, port));
+            
+            tcp_acceptor_.reset(new io::ip::tcp::acceptor(io_));
+            tcp_acceptor_->open(endpoint.protocol());
+            tcp_acceptor_->set_option(io::ip::tcp::acceptor::reuse_address(true));
+            tcp_acceptor_->bind(endpoint);
+            tcp_acceptor_->listen();
+            
+            LOG_INFO << "ingest listening on " << addr << ":" << port;
+            accept_tcp();
+        }
+        
+        if(!unix_path_.empty())
+        {
+            // a socket file left over by an earlier run
+            ::unlink(unix_path_.c_str());
+            
+            local_acceptor_.reset(new io::local::stream_protocol::acceptor(io_,
+                io::local::stream_protocol::endpoint(unix_path_)));
+            
+            LOG_INFO << "ingest listening on " << unix_path_;
+            accept_local();
+        }
+        
+        for(int i = 0; i < threads; ++i)
+        {
+            threads_.add_thread( new boost::thread( boost::bind(&io::io_service::run, &io_) ) );
+        }
+    }
+    
+    void ingest_service::stop()
+    {
+        if(stopped_)
+        {
+            return;
+        }
+        
+        stopped_ = true;
+        
+        io_.stop();
+        threads_.join_all();
+        
+        if(!unix_path_.empty())
+        {
+            ::unlink(unix_path_.c_str());
+        }
+    }
+    
+    void ingest_service::accept_tcp()
+    {
+        boost::shared_ptr<tcp_connection> c(new tcp_connection(*this));
+        
+        tcp_acceptor_->async_accept(c->socket(),
+            boost::bind(&ingest_service::on_accept_tcp, this, c, io::placeholders::error) );
+    }
+    
+    void ingest_service::on_accept_tcp(boost::shared_ptr<tcp_connection> c, const boost::system::error_code& err)
+    {
+        if(err)
+        {
+            retry_accept(tcp_accept_timer_, err, &ingest_service::accept_tcp);
+            return;
+        }
+        
+        boost::system::error_code ignored;
+        c->socket().set_option(io::ip::tcp::no_delay(true), ignored);
+        c->start();
+        
+        accept_tcp();
+    }
+    
+    void ingest_service::accept_local()
+    {
+        boost::shared_ptr<local_connection> c(new local_connection(*this));
+        
+        local_acceptor_->async_accept(c->socket(),
+            boost::bind(&ingest_service::on_accept_local, this, c, io::placeholders::error) );
+    }
+    
+    void ingest_service::on_accept_local(boost::shared_ptr<local_connection> c, const boost::system::error_code& err)
+    {
+        if(err)
+        {
+            retry_accept(local_accept_timer_, err, &ingest_service::accept_local);
+            return;
+        }
+        
+        c->start();
+        accept_local();
+    }
+    
+    void ingest_service::retry_accept(io::deadline_timer& timer, const boost::system::error_code& err,
+                                      void (ingest_service::*accept)())
+    {
+        if(err == io::error::operation_aborted)
+        {
+            return;
+        }
+        
+        LOG_WARN << "ingest accept failed: " << err.message() << ". retrying in "
+            << accept_backoff_ms << " ms.";
+        
+        timer.expires_from_now(boost::posix_time::milliseconds(accept_backoff_ms));
+        timer.async_wait(boost::bind(&ingest_service::on_accept_retry, this, accept, io::placeholders::error));
+    }
+    
+    void ingest_service::on_accept_retry(void (ingest_service::*accept)(), const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            (this->*accept)();
+        }
+    }
+    
+    json_spirit::Object ingest_service::stats() const
+    {
+        json_spirit::Object obj;
+        
+        obj.push_back( json_spirit::Pair("connections", connections_.load()) );
+        obj.push_back( json_spirit::Pair("open", open_.load()) );
+        obj.push_back( json_spirit::Pair("frames", frames_.load()) );
+        obj.push_back( json_spirit::Pair("accepted", accepted_.load()) );
+        obj.push_back( json_spirit::Pair("failed", failed_.load()) );
+        obj.push_back( json_spirit::Pair("rejected", rejected_.load()) );
+        obj.push_back( json_spirit::Pair("malformed", malformed_.load()) );
+        
+        return obj;
+    }
+}
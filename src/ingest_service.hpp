@@ -0,0 +1,90 @@
+//
+//  ingest_service.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__ingest_service__
+#define __pushy__ingest_service__
+
+#include <atomic>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    class pushy_service;
+    
+    /**
+     * Binary ingest listener for internal producers, see ingest_protocol.hpp. Serves a
+     * tcp port, a unix domain socket or both. The frames of a connection are handled
+     * in order and feed the same push path as /send; the acks of all frames that came
+     * in one read are written back in one go, so clients may pipeline freely.
+     */
+    class ingest_service
+    {
+    public:
+        /// an empty port or unix_path leaves that listener out
+        ingest_service(pushy_service& ps,
+                       const std::string& addr, const std::string& port,
+                       const std::string& unix_path, int threads);
+        
+        ~ingest_service()
+        {
+            stop();
+        }
+        
+        void stop();
+        
+        /// connections and frames for the json api
+        json_spirit::Object stats() const;
+    
+    private:
+        template<typename Protocol>
+        class connection;
+        
+        typedef connection<io::ip::tcp>                 tcp_connection;
+        typedef connection<io::local::stream_protocol>  local_connection;
+        
+        void accept_tcp();
+        void on_accept_tcp(boost::shared_ptr<tcp_connection> c, const boost::system::error_code& err);
+        
+        void accept_local();
+        void on_accept_local(boost::shared_ptr<local_connection> c, const boost::system::error_code& err);
+        
+        // waits a bit before accepting again after a failed accept, e.g. out of descriptors
+        void retry_accept(io::deadline_timer& timer, const boost::system::error_code& err,
+                          void (ingest_service::*accept)());
+        void on_accept_retry(void (ingest_service::*accept)(), const boost::system::error_code& err);
+        
+        pushy_service&      push_service_;
+        
+        io::io_service      io_;
+        boost::scoped_ptr<io::ip::tcp::acceptor>                tcp_acceptor_;
+        boost::scoped_ptr<io::local::stream_protocol::acceptor> local_acceptor_;
+        io::deadline_timer  tcp_accept_timer_;
+        io::deadline_timer  local_accept_timer_;
+        std::string         unix_path_;
+        
+        boost::thread_group threads_;
+        bool                stopped_;
+        
+        std::atomic<uint64_t>   connections_;
+        std::atomic<uint64_t>   open_;
+        std::atomic<uint64_t>   frames_;
+        std::atomic<uint64_t>   accepted_;
+        std::atomic<uint64_t>   failed_;
+        std::atomic<uint64_t>   rejected_;      // throttled or busy
+        std::atomic<uint64_t>   malformed_;
+    };
+}
+
+#endif /* defined(__pushy__ingest_service__) */
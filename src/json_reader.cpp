@@ -0,0 +1,498 @@
+//
+//  json_reader.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "json_reader.hpp"
+
+#include <cstring>
+#include <limits>
+
+namespace pushy
+{
+    namespace
+    {
+        int hex_value(char c)
+        {
+            if(c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            
+            if(c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            
+            if(c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            
+            return -1;
+        }
+        
+        void append_utf8(std::string& out, uint32_t cp)
+        {
+            if(cp < 0x80)
+            {
+                out.push_back(static_cast<char>(cp));
+            }
+            else if(cp < 0x800)
+            {
+                out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+            else if(cp < 0x10000)
+            {
+                out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+        }
+    }
+    
+    json_error::json_error(const std::string& what, std::size_t offset)
+    : std::runtime_error(what + " at offset " + std::to_string(offset))
+    , offset_(offset)
+    {
+    }
+    
+    json_reader::json_reader(boost::string_ref input)
+    : begin_(input.data())
+    , pos_(input.data())
+    , end_(input.data() + input.size())
+    , state_(state_value)
+    , current_(token_end)
+    , depth_(0)
+    {
+    }
+    
+    json_reader::token json_reader::next()
+    {
+        skip_ws();
+        
+        if(state_ == state_done)
+        {
+            if(pos_ != end_)
+            {
+                fail("unexpected data after the document");
+            }
+            
+            return current_ = token_end;
+        }
+        
+        if(pos_ == end_)
+        {
+            fail("unexpected end of input");
+        }
+        
+        char c = *pos_;
+        
+        switch(state_)
+        {
+            case state_comma_or_end:
+                if(c == ',')
+                {
+                    ++pos_;
+                    state_ = stack_[depth_ - 1] == '{' ? state_key : state_value;
+                    return next();
+                }
+                
+                return close(c);
+            
+            case state_key_or_end_object:
+                if(c == '}')
+                {
+                    return close(c);
+                }
+                
+                // fall through
+            case state_key:
+                if(c != '"')
+                {
+                    fail("expected a key");
+                }
+                
+                read_string();
+                skip_ws();
+                
+                if(pos_ == end_ || *pos_ != ':')
+                {
+                    fail("expected ':'");
+                }
+                
+                ++pos_;
+                state_ = state_value;
+                
+                return current_ = token_key;
+            
+            case state_value_or_end_array:
+                if(c == ']')
+                {
+                    return close(c);
+                }
+                
+                // fall through
+            default:
+                return current_ = read_value();
+        }
+    }
+    
+    json_reader::token json_reader::read_value()
+    {
+        switch(*pos_)
+        {
+            case '{':
+            case '[':
+                if(depth_ == max_depth)
+                {
+                    fail("nested too deeply");
+                }
+                
+                stack_[depth_++] = *pos_;
+                state_ = *pos_++ == '{' ? state_key_or_end_object : state_value_or_end_array;
+                
+                return stack_[depth_ - 1] == '{' ? token_begin_object : token_begin_array;
+            
+            case '"':
+                read_string();
+                after_value();
+                return token_string;
+            
+            case 't':
+                read_literal("true", 4);
+                after_value();
+                return token_true;
+            
+            case 'f':
+                read_literal("false", 5);
+                after_value();
+                return token_false;
+            
+            case 'n':
+                read_literal("null", 4);
+                after_value();
+                return token_null;
+            
+            default:
+                read_number();
+                after_value();
+                return token_number;
+        }
+    }
+    
+    json_reader::token json_reader::close(char c)
+    {
+        char open = stack_[depth_ - 1];
+        
+        if((c == '}' && open != '{') || (c == ']' && open != '[') || (c != '}' && c != ']'))
+        {
+            fail(open == '{' ? "expected ',' or '}'" : "expected ',' or ']'");
+        }
+        
+        ++pos_;
+        --depth_;
+        after_value();
+        
+        return current_ = (c == '}' ? token_end_object : token_end_array);
+    }
+    
+    void json_reader::read_string()
+    {
+        const char* begin = ++pos_;
+        
+        // memchr is vectorised by the c library; most strings have no escapes
+        auto quote = static_cast<const char*>(std::memchr(begin, '"', end_ - begin));
+        
+        if(!quote)
+        {
+            fail("unterminated string");
+        }
+        
+        if(std::memchr(begin, '\\', quote - begin))
+        {
+            read_string_escaped(begin);
+            return;
+        }
+        
+        text_ = boost::string_ref(begin, quote - begin);
+        pos_ = quote + 1;
+    }
+    
+    void json_reader::read_string_escaped(const char* begin)
+    {
+        buf_.clear();
+        
+        for(const char* p = begin; p < end_; )
+        {
+            char c = *p++;
+            
+            if(c == '"')
+            {
+                text_ = boost::string_ref(buf_);
+                pos_ = p;
+                return;
+            }
+            
+            if(c != '\\')
+            {
+                buf_.push_back(c);
+                continue;
+            }
+            
+            if(p == end_)
+            {
+                break;
+            }
+            
+            switch(*p++)
+            {
+                case '"':   buf_.push_back('"'); break;
+                case '\\':  buf_.push_back('\\'); break;
+                case '/':   buf_.push_back('/'); break;
+                case 'b':   buf_.push_back('\b'); break;
+                case 'f':   buf_.push_back('\f'); break;
+                case 'n':   buf_.push_back('\n'); break;
+                case 'r':   buf_.push_back('\r'); break;
+                case 't':   buf_.push_back('\t'); break;
+                
+                case 'u':
+                {
+                    uint32_t cp = 0;
+                    
+                    for(int i = 0; i < 4; ++i, ++p)
+                    {
+                        int v = p < end_ ? hex_value(*p) : -1;
+                        
+                        if(v < 0)
+                        {
+                            pos_ = p;
+                            fail("invalid \\u escape");
+                        }
+                        
+                        cp = (cp << 4) | v;
+                    }
+                    
+                    // a high surrogate is followed by the low one
+                    if(cp >= 0xd800 && cp < 0xdc00 && end_ - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        uint32_t low = 0;
+                        bool valid = true;
+                        
+                        for(int i = 2; i < 6; ++i)
+                        {
+                            int v = hex_value(p[i]);
+                            valid = valid && v >= 0;
+                            low = (low << 4) | (v < 0 ? 0 : v);
+                        }
+                        
+                        if(valid && low >= 0xdc00 && low < 0xe000)
+                        {
+                            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                            p += 6;
+                        }
+                    }
+                    
+                    append_utf8(buf_, cp);
+                    break;
+                }
+                
+                default:
+                    pos_ = p - 1;
+                    fail("invalid escape");
+            }
+        }
+        
+        pos_ = end_;
+        fail("unterminated string");
+    }
+    
+    void json_reader::read_number()
+    {
+        const char* begin = pos_;
+        const char* p = pos_;
+        
+        if(p < end_ && *p == '-')
+        {
+            ++p;
+        }
+        
+        if(p == end_ || *p < '0' || *p > '9')
+        {
+            fail("unexpected character");
+        }
+        
+        // no leading zeros
+        if(*p == '0')
+        {
+            ++p;
+        }
+        else
+        {
+            while(p < end_ && *p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+        }
+        
+        if(p < end_ && *p == '.')
+        {
+            const char* digits = ++p;
+            
+            while(p < end_ && *p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+            
+            if(p == digits)
+            {
+                pos_ = p;
+                fail("invalid number");
+            }
+        }
+        
+        if(p < end_ && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            
+            if(p < end_ && (*p == '+' || *p == '-'))
+            {
+                ++p;
+            }
+            
+            const char* digits = p;
+            
+            while(p < end_ && *p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+            
+            if(p == digits)
+            {
+                pos_ = p;
+                fail("invalid number");
+            }
+        }
+        
+        text_ = boost::string_ref(begin, p - begin);
+        pos_ = p;
+    }
+    
+    void json_reader::read_literal(const char* literal, std::size_t size)
+    {
+        if(static_cast<std::size_t>(end_ - pos_) < size || std::memcmp(pos_, literal, size) != 0)
+        {
+            fail("unexpected character");
+        }
+        
+        text_ = boost::string_ref(pos_, size);
+        pos_ += size;
+    }
+    
+    void json_reader::skip_ws()
+    {
+        while(pos_ < end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t'))
+        {
+            ++pos_;
+        }
+    }
+    
+    int64_t json_reader::get_int64() const
+    {
+        if(current_ != token_number)
+        {
+            fail("expected a number");
+        }
+        
+        bool negative = !text_.empty() && text_[0] == '-';
+        uint64_t value = 0;
+        uint64_t limit = negative
+            ? static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1
+            : static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        
+        for(std::size_t i = negative ? 1 : 0; i < text_.size(); ++i)
+        {
+            char c = text_[i];
+            
+            if(c < '0' || c > '9')
+            {
+                fail("expected an integer");
+            }
+            
+            if(value > (limit - (c - '0')) / 10)
+            {
+                fail("integer out of range");
+            }
+            
+            value = value * 10 + (c - '0');
+        }
+        
+        return negative ? static_cast<int64_t>(0 - value) : static_cast<int64_t>(value);
+    }
+    
+    void json_reader::skip()
+    {
+        if(current_ == token_key)
+        {
+            next();
+        }
+        
+        if(current_ != token_begin_object && current_ != token_begin_array)
+        {
+            return;
+        }
+        
+        std::size_t depth = depth_;
+        
+        while(depth_ >= depth)
+        {
+            next();
+        }
+    }
+    
+    void json_reader::fail(const std::string& what) const
+    {
+        throw json_error(what, pos_ - begin_);
+    }
+    
+    bool parse_canonical_uuid(boost::string_ref str, boost::uuids::uuid& uuid)
+    {
+        if(str.size() != 36 || str[8] != '-' || str[13] != '-' || str[18] != '-' || str[23] != '-')
+        {
+            return false;
+        }
+        
+        std::size_t byte = 0;
+        
+        for(std::size_t i = 0; i < 36 && byte < 16; i += 2)
+        {
+            if(str[i] == '-')
+            {
+                ++i;
+            }
+            
+            int hi = hex_value(str[i]);
+            int lo = hex_value(str[i + 1]);
+            
+            if(hi < 0 || lo < 0)
+            {
+                return false;
+            }
+            
+            uuid.data[byte++] = static_cast<uint8_t>((hi << 4) | lo);
+        }
+        
+        return byte == 16;
+    }
+}
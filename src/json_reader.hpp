@@ -0,0 +1,135 @@
+//
+//  json_reader.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__json_reader__
+#define __pushy__json_reader__
+
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+#include <boost/uuid/uuid.hpp>
+
+namespace pushy
+{
+    /**
+     * Malformed JSON input
+     */
+    class json_error : public std::runtime_error
+    {
+    public:
+        json_error(const std::string& what, std::size_t offset);
+        
+        /// byte offset of the error in the input
+        std::size_t offset() const
+        {
+            return offset_;
+        }
+    
+    private:
+        std::size_t offset_;
+    };
+    
+    /**
+     * Pull parser for API request bodies. Every next() validates and returns one
+     * token of the document; the caller copies out the values it needs and skips
+     * the rest, so no DOM is built. Strings without escapes are handed out as
+     * references into the input; escaped ones are decoded into a buffer that is
+     * reused for the next string.
+     */
+    class json_reader
+    {
+    public:
+        enum token
+        {
+            token_begin_object,
+            token_end_object,
+            token_begin_array,
+            token_end_array,
+            token_key,
+            token_string,
+            token_number,
+            token_true,
+            token_false,
+            token_null,
+            token_end       // the whole document was read
+        };
+        
+        static const std::size_t max_depth = 64;
+        
+        explicit json_reader(boost::string_ref input);
+        
+        /// reads the next token; throws json_error on malformed input
+        token next();
+        
+        token current() const
+        {
+            return current_;
+        }
+        
+        /// the current key or string, unescaped, or the text of the current number.
+        /// valid until the next call to next()
+        boost::string_ref text() const
+        {
+            return text_;
+        }
+        
+        /// the current number as an integer; throws json_error if it is not one
+        int64_t get_int64() const;
+        
+        /// skips the value starting at the current token, nested values included
+        void skip();
+    
+    private:
+        enum state
+        {
+            state_value,
+            state_value_or_end_array,
+            state_key,
+            state_key_or_end_object,
+            state_comma_or_end,
+            state_done
+        };
+        
+        token read_value();
+        token close(char c);
+        
+        void read_string();
+        void read_string_escaped(const char* begin);
+        void read_number();
+        void read_literal(const char* literal, std::size_t size);
+        void skip_ws();
+        
+        void after_value()
+        {
+            state_ = depth_ ? state_comma_or_end : state_done;
+        }
+        
+        void fail(const std::string& what) const;
+        
+        const char*         begin_;
+        const char*         pos_;
+        const char*         end_;
+        
+        state               state_;
+        token               current_;
+        boost::string_ref   text_;
+        std::string         buf_;   // decoded strings with escapes
+        
+        char                stack_[max_depth];  // '{' or '[' per open container
+        std::size_t         depth_;
+    };
+    
+    /**
+     * Decodes a uuid string value in the canonical 8-4-4-4-12 form directly.
+     * Returns false for any other form, which is left to boost's string_generator.
+     */
+    bool parse_canonical_uuid(boost::string_ref str, boost::uuids::uuid& uuid);
+}
+
+#endif /* defined(__pushy__json_reader__) */
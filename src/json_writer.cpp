@@ -0,0 +1,275 @@
+//
+//  json_writer.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "json_writer.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace pushy
+{
+    namespace
+    {
+        const char hex_digits[] = "0123456789abcdef";
+        
+        const char* month_names[] = {
+            "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+        };
+        
+        // fixed width decimal, zero padded
+        char* put_digits(char* p, uint64_t v, int width)
+        {
+            for(int i = width - 1; i >= 0; --i)
+            {
+                p[i] = '0' + v % 10;
+                v /= 10;
+            }
+            
+            return p + width;
+        }
+        
+        bool needs_escape(char c)
+        {
+            return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+        }
+    }
+    
+    json_writer& json_writer::begin_object()
+    {
+        separate();
+        out_.push_back('{');
+        comma_ = false;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::end_object()
+    {
+        out_.push_back('}');
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::begin_array()
+    {
+        separate();
+        out_.push_back('[');
+        comma_ = false;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::end_array()
+    {
+        out_.push_back(']');
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::key(boost::string_ref k)
+    {
+        separate();
+        append_escaped(k);
+        out_.push_back(':');
+        
+        // the value follows the key without a comma
+        comma_ = false;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::value(boost::string_ref s)
+    {
+        separate();
+        append_escaped(s);
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::value(bool b)
+    {
+        separate();
+        out_.append(b ? "true" : "false");
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::value(int64_t i)
+    {
+        separate();
+        
+        if(i < 0)
+        {
+            out_.push_back('-');
+            append_uint(0 - static_cast<uint64_t>(i));
+        }
+        else
+        {
+            append_uint(static_cast<uint64_t>(i));
+        }
+        
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::value(uint64_t i)
+    {
+        separate();
+        append_uint(i);
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::value(const boost::uuids::uuid& uuid)
+    {
+        char buf[38];
+        char* p = buf;
+        
+        *p++ = '"';
+        
+        for(std::size_t i = 0; i < uuid.size(); ++i)
+        {
+            if(i == 4 || i == 6 || i == 8 || i == 10)
+            {
+                *p++ = '-';
+            }
+            
+            *p++ = hex_digits[uuid.data[i] >> 4];
+            *p++ = hex_digits[uuid.data[i] & 0x0f];
+        }
+        
+        *p++ = '"';
+        
+        separate();
+        out_.append(buf, p - buf);
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::value(const boost::posix_time::ptime& time)
+    {
+        if(time.is_special())
+        {
+            return value(boost::posix_time::to_simple_string(time));
+        }
+        
+        // YYYY-Mon-DD HH:MM:SS[.ffffff]
+        char buf[32];
+        char* p = buf;
+        
+        auto date = time.date().year_month_day();
+        auto tod = time.time_of_day();
+        
+        *p++ = '"';
+        p = put_digits(p, date.year, 4);
+        *p++ = '-';
+        
+        const char* month = month_names[date.month - 1];
+        *p++ = month[0];
+        *p++ = month[1];
+        *p++ = month[2];
+        
+        *p++ = '-';
+        p = put_digits(p, date.day, 2);
+        *p++ = ' ';
+        p = put_digits(p, tod.hours(), 2);
+        *p++ = ':';
+        p = put_digits(p, tod.minutes(), 2);
+        *p++ = ':';
+        p = put_digits(p, tod.seconds(), 2);
+        
+        if(tod.fractional_seconds())
+        {
+            *p++ = '.';
+            p = put_digits(p, tod.fractional_seconds(), boost::posix_time::time_duration::num_fractional_digits());
+        }
+        
+        *p++ = '"';
+        
+        separate();
+        out_.append(buf, p - buf);
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    json_writer& json_writer::raw(boost::string_ref json)
+    {
+        separate();
+        out_.append(json.data(), json.size());
+        comma_ = true;
+        
+        return *this;
+    }
+    
+    void json_writer::append_uint(uint64_t i)
+    {
+        char buf[20];
+        char* p = buf + sizeof(buf);
+        
+        do
+        {
+            *--p = '0' + i % 10;
+            i /= 10;
+        }
+        while(i);
+        
+        out_.append(p, buf + sizeof(buf) - p);
+    }
+    
+    void json_writer::append_escaped(boost::string_ref s)
+    {
+        out_.push_back('"');
+        
+        const char* run = s.data();
+        const char* end = s.data() + s.size();
+        
+        for(const char* p = run; p != end; ++p)
+        {
+            if(!needs_escape(*p))
+            {
+                continue;
+            }
+            
+            // copy the clean run in one go
+            out_.append(run, p - run);
+            run = p + 1;
+            
+            switch(*p)
+            {
+                case '"':   out_.append("\\\""); break;
+                case '\\':  out_.append("\\\\"); break;
+                case '\b':  out_.append("\\b"); break;
+                case '\f':  out_.append("\\f"); break;
+                case '\n':  out_.append("\\n"); break;
+                case '\r':  out_.append("\\r"); break;
+                case '\t':  out_.append("\\t"); break;
+                
+                default:
+                {
+                    char esc[] = { '\\', 'u', '0', '0',
+                        hex_digits[static_cast<unsigned char>(*p) >> 4],
+                        hex_digits[*p & 0x0f] };
+                    
+                    out_.append(esc, sizeof(esc));
+                    break;
+                }
+            }
+        }
+        
+        out_.append(run, end - run);
+        out_.push_back('"');
+    }
+}
@@ -0,0 +1,95 @@
+//
+//  json_writer.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__json_writer__
+#define __pushy__json_writer__
+
+#include <string>
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace pushy
+{
+    /**
+     * Writes JSON straight into a string in one pass. Commas are placed by the
+     * writer; the caller only opens and closes containers, names keys and appends
+     * values. Strings are escaped as they are copied, utf-8 is written as is.
+     */
+    class json_writer
+    {
+    public:
+        /// appends to out; out is not cleared
+        explicit json_writer(std::string& out)
+        : out_(out)
+        , comma_(false)
+        {
+        }
+        
+        json_writer& begin_object();
+        json_writer& end_object();
+        json_writer& begin_array();
+        json_writer& end_array();
+        
+        json_writer& key(boost::string_ref k);
+        
+        json_writer& value(boost::string_ref s);
+        json_writer& value(const std::string& s)
+        {
+            return value(boost::string_ref(s));
+        }
+        
+        json_writer& value(const char* s)
+        {
+            return value(boost::string_ref(s));
+        }
+        
+        json_writer& value(bool b);
+        json_writer& value(int64_t i);
+        json_writer& value(uint64_t i);
+        
+        /// canonical 8-4-4-4-12 lower case form
+        json_writer& value(const boost::uuids::uuid& uuid);
+        
+        /// same text as boost's to_simple_string
+        json_writer& value(const boost::posix_time::ptime& time);
+        
+        /// a value that is serialized already
+        json_writer& raw(boost::string_ref json);
+        
+        template<typename T>
+        json_writer& member(boost::string_ref k, const T& v)
+        {
+            key(k);
+            return value(v);
+        }
+        
+        std::string& str()
+        {
+            return out_;
+        }
+    
+    private:
+        void separate()
+        {
+            if(comma_)
+            {
+                out_.push_back(',');
+            }
+        }
+        
+        void append_uint(uint64_t i);
+        void append_escaped(boost::string_ref s);
+        
+        std::string&    out_;
+        bool            comma_; // a value was written in the open container
+    };
+}
+
+#endif /* defined(__pushy__json_writer__) */
@@ -298,7 +298,7 @@ namespace pushy
     
     void logging::logstash_msg(const severity_level& loglevel,
                                const std::string& status,
-                               boost::uuids::uuid& uuid,
+                               const dba::msg_entry& m,
                                const std::string& msg)
     {
         auto rec = std_logger.open_record(keywords::severity = (loglevel));
@@ -307,8 +307,6 @@ namespace pushy
             logger::record_ostream strm(rec);
             json_spirit::Object obj, fields;
             
-            auto m = dba::instance().get_message(uuid);
-            
             obj.push_back( json_spirit::Pair("@timestamp", to_iso_extended_string(m.ts) ) );
             obj.push_back( json_spirit::Pair("message", msg) );
             
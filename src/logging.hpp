@@ -35,12 +35,17 @@
 #define LOG_WARN  BOOST_LOG_SEV(logging::std_logger, pushy::warning)
 #define LOG_ERROR BOOST_LOG_SEV(logging::std_logger, pushy::error)
 
-// special loggers for apns and gcm stats
-#define LOG_APNS(status, uuid, msg) logging::logstash_msg(pushy::apns, status, uuid, msg)
+// special loggers for apns and gcm stats. messages are logged from their in-process entry
+#define LOG_APNS(status, entry, msg) logging::logstash_msg(pushy::apns, status, entry, msg)
 #define LOG_APNS_DEVICE(status, uuid, time, msg) logging::logstash_dev(pushy::apns, status, uuid, time, msg)
 #define LOG_APNS_GENERIC(status, time, msg) logging::logstash(pushy::apns, status, time, msg, pushy::database::push_type_apns)
 
-#define LOG_GCM(status, uuid, msg) logging::logstash_msg(pushy::gcm, status, uuid, msg)
+#define LOG_GCM(status, entry, msg) logging::logstash_msg(pushy::gcm, status, entry, msg)
+#define LOG_GCM_DEVICE(status, uuid, time, msg) logging::logstash_dev(pushy::gcm, status, uuid, time, msg)
+
+// picks the apns or gcm stats logger by provider type
+#define LOG_PUSH(status, entry, msg) logging::logstash_msg( \
+    (entry).provider_type == pushy::database::push_type_apns ? pushy::apns : pushy::gcm, status, entry, msg)
 
 
 namespace pushy
@@ -115,7 +120,7 @@ namespace pushy
                                  const std::string& msg);
         
         static void logstash_msg(const severity_level& loglevel, const std::string& status,
-                                 boost::uuids::uuid& uuid, const std::string& msg);
+                                 const database::dba::msg_entry& m, const std::string& msg);
 
         static boost::log::sources::severity_logger< pushy::severity_level > std_logger;
     };
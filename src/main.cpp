@@ -12,8 +12,10 @@
 
 #include "logging.hpp"
 #include "api_service.hpp"
+#include "ingest_service.hpp"
 #include "pushy_service.hpp"
 #include "database.hpp"
+#include "app_config.hpp"
 
 namespace po = boost::program_options;
 
@@ -34,17 +36,47 @@ try
     // db options
     std::string redis_host;
     int         redis_port;
+    std::size_t redis_max_inflight;
     
     // automation options
     bool auto_redeliver;
     int  auto_redeliver_attempts;
     bool auto_deregister;
+    uint32_t auto_backoff_base;
+    uint32_t auto_backoff_cap;
+    uint32_t auto_interval_ms;
+    uint32_t auto_batch;
+    uint32_t auto_drain_timeout;
+    std::size_t auto_dead_filter;
+    double auto_dead_filter_fp;
+    
+    // scheduled messages
+    uint32_t schedule_interval_ms;
+    uint32_t schedule_batch;
+    
+    // dispatch options
+    dispatcher::config dispatch_cfg;
+    std::vector<std::string> dispatch_tag_limits;
     
     // api options
     std::string api_base_uri;
     std::string api_addr;
     std::string api_port;
+    std::string api_mode;
     int         api_workers;
+    int         api_io_threads;
+    std::size_t api_keep_alive;
+    std::size_t api_keep_alive_requests;
+    std::size_t api_max_inflight;
+    uint32_t    api_retry_after;
+    std::size_t api_idempotency_cache;
+    uint32_t    api_idempotency_ttl;
+    
+    // ingest options
+    std::string ingest_addr;
+    std::string ingest_port;
+    std::string ingest_unix;
+    int         ingest_threads;
     
     // apns options
     std::string apns_key; // pem
@@ -53,13 +85,33 @@ try
     std::string apns_p12_cert_key; // p12 file with both cert and key
     std::string apns_mode;
     int         apns_poolsize;
+    int         apns_poolsize_max;
+    std::string apns_protocol;
+    std::string apns_topic;
+    std::string apns_host;
+    bool        apns_verify;
+    uint32_t    apns_streams;
+    std::size_t apns_batch_bytes;
+    uint32_t    apns_batch_delay;
+    std::string apns_feedback_host;
+    uint32_t    apns_feedback_interval;
     std::string apns_logfile;
+    std::string apns_rate;
     
     // gcm options
     std::string gcm_project_id;
     std::string gcm_api_key;
     int         gcm_poolsize;
+    int         gcm_poolsize_max;
+    bool        gcm_multicast;
+    std::string gcm_url;
+    uint32_t    gcm_batch_size;
+    uint32_t    gcm_batch_window;
     std::string gcm_logfile;
+    std::string gcm_rate;
+    
+    // apps configured in [app.<id>] sections, by app id
+    std::map<std::string, app_config> apps;
     
     // a banner just for fun
     static char banner[] = "\n"
@@ -86,6 +138,8 @@ try
             "redis host")
         ("redis.port", po::value<int>(&redis_port)->default_value(6379),
             "redis port")
+        ("redis.max_inflight", po::value<std::size_t>(&redis_max_inflight)->default_value(64),
+            "max concurrent message/device writes before rejecting with 503 (0 for unbounded)")
     ;
     
     po::options_description auto_config("Automation");
@@ -96,6 +150,45 @@ try
             "times to try deliver a message before giving up (only if auto.redeliver is on)")
         ("auto.deregister,d", po::value<bool>(&auto_deregister)->default_value(true),
             "automatically deregister devices which reported as unreachable")
+        ("auto.backoff_base", po::value<uint32_t>(&auto_backoff_base)->default_value(5),
+            "seconds before the first redelivery; doubles with every failed attempt")
+        ("auto.backoff_cap", po::value<uint32_t>(&auto_backoff_cap)->default_value(3600),
+            "max seconds between redelivery attempts of a message")
+        ("auto.interval", po::value<uint32_t>(&auto_interval_ms)->default_value(1000),
+            "milliseconds between checks for messages due for redelivery")
+        ("auto.batch", po::value<uint32_t>(&auto_batch)->default_value(500),
+            "max messages per provider claimed for redelivery in one go")
+        ("auto.drain_timeout", po::value<uint32_t>(&auto_drain_timeout)->default_value(10),
+            "seconds to wait for provider acknowledgements on SIGTERM before handing the rest to redelivery")
+        ("auto.dead_filter", po::value<std::size_t>(&auto_dead_filter)->default_value(1000000),
+            "dead devices the in-memory filter is sized for; sends to them are skipped (0 to disable)")
+        ("auto.dead_filter_fp", po::value<double>(&auto_dead_filter_fp)->default_value(0.001),
+            "false positive rate of the dead device filter; hits are confirmed with redis")
+    ;
+    
+    po::options_description schedule_config("Scheduled messages");
+    schedule_config.add_options()
+        ("schedule.interval", po::value<uint32_t>(&schedule_interval_ms)->default_value(1000),
+            "milliseconds between checks for scheduled messages which are due (send_at)")
+        ("schedule.batch", po::value<uint32_t>(&schedule_batch)->default_value(500),
+            "max scheduled messages per provider fired in one go")
+    ;
+    
+    po::options_description dispatch_config("Dispatch");
+    dispatch_config.add_options()
+        ("dispatch.window", po::value<uint32_t>(&dispatch_cfg.window)->default_value(dispatch_cfg.window),
+            "max messages handed to the provider plugins of each app without a reply yet")
+        ("dispatch.high_weight", po::value<uint32_t>(&dispatch_cfg.weights[push_priority_high])
+            ->default_value(dispatch_cfg.weights[push_priority_high]),
+            "messages dispatched from the high priority lane per round")
+        ("dispatch.normal_weight", po::value<uint32_t>(&dispatch_cfg.weights[push_priority_normal])
+            ->default_value(dispatch_cfg.weights[push_priority_normal]),
+            "messages dispatched from the normal priority lane per round")
+        ("dispatch.queue_limit", po::value<std::size_t>(&dispatch_cfg.queue_limit)
+            ->default_value(dispatch_cfg.queue_limit),
+            "max messages held in memory waiting for dispatch (0 for unbounded)")
+        ("dispatch.tag_limit", po::value<std::vector<std::string> >(&dispatch_tag_limits)->composing(),
+            "rate limit for a tag as tag=rate[:burst] in messages per second (may be repeated)")
     ;
 
     po::options_description api_config("JSON API");
@@ -103,7 +196,32 @@ try
         ("api.base,b", po::value<std::string>(&api_base_uri)->default_value("/api"), "base uri")
         ("api.address,a", po::value<std::string>(&api_addr)->default_value("0.0.0.0"), "address")
         ("api.port,p", po::value<std::string>(&api_port)->default_value("7446"), "port")
+        ("api.mode", po::value<std::string>(&api_mode)->default_value("sync"),
+            "server mode ('sync' or 'async'); async serves all connections on api.io_threads and runs the apis on the workers")
         ("api.workers,w", po::value<int>(&api_workers)->default_value(1), "workers to spawn (threads)")
+        ("api.io_threads", po::value<int>(&api_io_threads)->default_value(1), "io threads of the async server")
+        ("api.keep_alive", po::value<std::size_t>(&api_keep_alive)->default_value(30),
+            "seconds a sync mode connection may idle between requests (0 closes after each response)")
+        ("api.keep_alive_requests", po::value<std::size_t>(&api_keep_alive_requests)->default_value(1000),
+            "requests answered per connection before closing it (0 for unlimited)")
+        ("api.max_inflight", po::value<std::size_t>(&api_max_inflight)->default_value(256),
+            "max requests in progress before rejecting with 503 (0 for unbounded)")
+        ("api.retry_after", po::value<uint32_t>(&api_retry_after)->default_value(1),
+            "Retry-After hint in seconds sent with 429/503 rejections")
+        ("api.idempotency_ttl", po::value<uint32_t>(&api_idempotency_ttl)->default_value(300),
+            "seconds an idempotency_key passed to /send is remembered")
+        ("api.idempotency_cache", po::value<std::size_t>(&api_idempotency_cache)->default_value(100000),
+            "idempotency keys remembered in memory in front of redis (0 to always ask redis)")
+    ;
+    
+    po::options_description ingest_config("Binary ingest");
+    ingest_config.add_options()
+        ("ingest.address", po::value<std::string>(&ingest_addr)->default_value("0.0.0.0"), "address")
+        ("ingest.port", po::value<std::string>(&ingest_port)->default_value(""),
+            "tcp port for internal producers (empty to disable)")
+        ("ingest.unix", po::value<std::string>(&ingest_unix)->default_value(""),
+            "unix domain socket path for internal producers (empty to disable)")
+        ("ingest.threads", po::value<int>(&ingest_threads)->default_value(1), "io threads of the ingest listener")
     ;
     
     po::options_description apns_config("APNS");
@@ -112,7 +230,27 @@ try
         ("apns.password", po::value<std::string>(&apns_password), "password for the key if needed")
         ("apns.mode", po::value<std::string>(&apns_mode)->default_value("sandbox"), "mode ('production' or 'sandbox')")
         ("apns.pool", po::value<int>(&apns_poolsize)->default_value(1), "pool size (connections count)")
+        ("apns.pool_max", po::value<int>(&apns_poolsize_max)->default_value(0),
+            "grow the pool up to this many connections under load (0 for a fixed apns.pool)")
+        ("apns.protocol", po::value<std::string>(&apns_protocol)->default_value("binary"),
+            "provider protocol ('binary' or 'http2')")
+        ("apns.topic", po::value<std::string>(&apns_topic), "apns-topic (bundle id) sent with http2 requests")
+        ("apns.host", po::value<std::string>(&apns_host),
+            "host[:port] to connect to instead of apple's server, e.g. pushy-mock-providers")
+        ("apns.verify", po::value<bool>(&apns_verify)->default_value(true),
+            "verify the server certificate (turn off for stand-ins with self-signed certificates)")
+        ("apns.streams", po::value<uint32_t>(&apns_streams)->default_value(1000),
+            "max concurrent http2 streams per connection")
+        ("apns.batch_bytes", po::value<std::size_t>(&apns_batch_bytes)->default_value(0),
+            "coalesce binary protocol frames into tls writes of up to this many bytes (0 to use the push_service plugin unless apns.host is set)")
+        ("apns.batch_delay", po::value<uint32_t>(&apns_batch_delay)->default_value(200),
+            "microseconds an idle connection waits for more frames before writing (with apns.batch_bytes)")
+        ("apns.feedback_host", po::value<std::string>(&apns_feedback_host),
+            "host[:port] of the feedback service to poll instead of apple's")
+        ("apns.feedback_interval", po::value<uint32_t>(&apns_feedback_interval)->default_value(3600),
+            "seconds between polls of apns.feedback_host")
         ("apns.logfile", po::value<std::string>(&apns_logfile), "logstash JSON format logfile for APNS stats")
+        ("apns.rate", po::value<std::string>(&apns_rate), "rate limit as rate[:burst] in messages per second")
     ;
 
     po::options_description gcm_config("GCM");
@@ -120,12 +258,23 @@ try
         ("gcm.project", po::value<std::string>(&gcm_project_id), "project id")
         ("gcm.key", po::value<std::string>(&gcm_api_key), "api key")
         ("gcm.pool", po::value<int>(&gcm_poolsize)->default_value(1), "pool size (connections count)")
+        ("gcm.pool_max", po::value<int>(&gcm_poolsize_max)->default_value(0),
+            "grow the pool up to this many connections under load (0 for a fixed gcm.pool)")
+        ("gcm.multicast", po::value<bool>(&gcm_multicast)->default_value(false),
+            "coalesce messages with identical payloads into multicast requests")
+        ("gcm.url", po::value<std::string>(&gcm_url),
+            "endpoint for multicast requests instead of google's, e.g. a stand-in")
+        ("gcm.batch_size", po::value<uint32_t>(&gcm_batch_size)->default_value(1000),
+            "max registration ids per multicast request (up to 1000)")
+        ("gcm.batch_window", po::value<uint32_t>(&gcm_batch_window)->default_value(5),
+            "milliseconds a multicast request waits for more messages with the same payload")
         ("gcm.logfile", po::value<std::string>(&gcm_logfile), "logstash JSON format logfile for GCM stats")
+        ("gcm.rate", po::value<std::string>(&gcm_rate), "rate limit as rate[:burst] in messages per second")
     ;
 
     po::options_description desc("Pushy server options");
     desc.add(generic_config).add(redis_config).add(auto_config)
-        .add(api_config).add(apns_config).add(gcm_config);
+        .add(schedule_config).add(dispatch_config).add(api_config).add(ingest_config).add(apns_config).add(gcm_config);
 
     // initialize logger's basic properties
     logging::init_basics();
@@ -147,8 +296,13 @@ try
         std::ifstream f(config_path.c_str());
         if(f.good())
         {
-            po::store(po::parse_config_file(f, desc, true), vm);
+            auto parsed = po::parse_config_file(f, desc, true);
+            
+            po::store(parsed, vm);
             po::notify(vm);
+            
+            // [app.<id>] sections
+            apps = app_config::parse(parsed);
         }
         else
         {
@@ -161,40 +315,127 @@ try
     
     // initialize redis database connection pool
     dba::instance().init_pool(redis_host, redis_port);
+    dba::instance().limit_writes(redis_max_inflight, api_retry_after);
+    
+    // rate limits
+    if(!apns_rate.empty())
+    {
+        dispatch_cfg.limits[push_type_apns] = token_bucket::from_spec(apns_rate);
+    }
+    
+    if(!gcm_rate.empty())
+    {
+        dispatch_cfg.limits[push_type_gcm] = token_bucket::from_spec(gcm_rate);
+    }
+    
+    dispatch_cfg.retry_after = api_retry_after;
+    
+    for(auto& spec : dispatch_tag_limits)
+    {
+        dispatch_cfg.add_tag_limit(spec);
+    }
     
     // the push service
-    pushy_service service(auto_redeliver, auto_redeliver_attempts, auto_deregister);
+    pushy_service service(auto_redeliver, auto_redeliver_attempts, auto_deregister,
+                          backoff(boost::posix_time::seconds(auto_backoff_base),
+                                  boost::posix_time::seconds(auto_backoff_cap)),
+                          auto_interval_ms, auto_batch, dispatch_cfg,
+                          api_idempotency_cache, api_idempotency_ttl,
+                          auto_dead_filter, auto_dead_filter_fp,
+                          schedule_interval_ms, schedule_batch, auto_drain_timeout);
         
-    // now check if apns, gcm, etc. are enabled
+    // the default app comes from the top level apns/gcm options
+    app_config& default_app = apps[std::string()];
+    
     if(vm.count("apns.p12"))
     {
-        if(apns_mode != "sandbox" && apns_mode != "production")
-        {
-            throw std::runtime_error("apns.mode must be either 'sandbox' or 'production'");
-        }
-        
-        LOG_DEBUG << "configuring apns with " << apns_mode << " p12=" << apns_p12_cert_key;
-        service.setup_apns(apns_mode, apns_p12_cert_key, apns_password, apns_poolsize);
-        LOG_DEBUG << "configuration of apns done";
+        default_app.apns_p12 = apns_p12_cert_key;
+        default_app.apns_password = apns_password;
+        default_app.apns_mode = apns_mode;
+        default_app.apns_pool = apns_poolsize;
+        default_app.apns_pool_max = apns_poolsize_max;
+        default_app.apns_protocol = apns_protocol;
+        default_app.apns_topic = apns_topic;
+        default_app.apns_host = apns_host;
+        default_app.apns_verify = apns_verify;
+        default_app.apns_streams = apns_streams;
+        default_app.apns_batch_bytes = apns_batch_bytes;
+        default_app.apns_batch_delay = apns_batch_delay;
+        default_app.apns_feedback_host = apns_feedback_host;
+        default_app.apns_feedback_interval = apns_feedback_interval;
     }
     
-    // gcm
     if(vm.count("gcm.project") || vm.count("gcm.key"))
     {
-        if(!vm.count("gcm.project") || !vm.count("gcm.key"))
+        default_app.gcm_project = gcm_project_id;
+        default_app.gcm_key = gcm_api_key;
+        default_app.gcm_pool = gcm_poolsize;
+        default_app.gcm_pool_max = gcm_poolsize_max;
+        default_app.gcm_multicast = gcm_multicast;
+        default_app.gcm_url = gcm_url;
+        default_app.gcm_batch_size = gcm_batch_size;
+        default_app.gcm_batch_window = gcm_batch_window;
+    }
+    
+    // now check if apns, gcm, etc. are enabled for each app
+    for(auto& entry : apps)
+    {
+        auto& app = entry.second;
+        auto name = entry.first.empty() ? std::string("default app") : "app '" + entry.first + "'";
+        
+        if(app.has_apns())
         {
-            throw std::runtime_error("both gcm.project and gcm.key must be defined in order to use GCM");
+            if(app.apns_mode != "sandbox" && app.apns_mode != "production")
+            {
+                throw std::runtime_error("apns.mode must be either 'sandbox' or 'production' for " + name);
+            }
+            
+            if(app.apns_protocol != "binary" && app.apns_protocol != "http2")
+            {
+                throw std::runtime_error("apns.protocol must be either 'binary' or 'http2' for " + name);
+            }
+            
+            LOG_DEBUG << "configuring apns for " << name << " with " << app.apns_mode
+                << " over " << app.apns_protocol << " p12=" << app.apns_p12;
+            
+            service.setup_apns(entry.first, app);
+            LOG_DEBUG << "configuration of apns done";
         }
         
-        LOG_DEBUG << "configure gcm with project_id=" << gcm_project_id << ", key=" << gcm_api_key;
-        service.setup_gcm(gcm_project_id, gcm_api_key, gcm_poolsize);
-        LOG_DEBUG << "configuration of gcm done";
+        // gcm
+        if(app.has_gcm())
+        {
+            if(app.gcm_project.empty() || app.gcm_key.empty())
+            {
+                throw std::runtime_error("both gcm.project and gcm.key must be defined in order to use GCM for " + name);
+            }
+            
+            LOG_DEBUG << "configure gcm for " << name << " with project_id=" << app.gcm_project << ", key=" << app.gcm_key;
+            service.setup_gcm(entry.first, app);
+            LOG_DEBUG << "configuration of gcm done";
+        }
+    }
+    
+    if(api_mode != "sync" && api_mode != "async")
+    {
+        throw std::runtime_error("api.mode must be either 'sync' or 'async'");
+    }
+        
+    // binary ingest for internal producers. runs on its own threads
+    boost::scoped_ptr<ingest_service> ingest;
+    
+    if(!ingest_port.empty() || !ingest_unix.empty())
+    {
+        LOG_INFO << "running binary ingest service.";
+        ingest.reset(new ingest_service(service, ingest_addr, ingest_port, ingest_unix, ingest_threads));
     }
         
     LOG_INFO << "running json api service.";
         
     // create the api service. it runs on background thread automatically
-    api_service api(service, api_addr, api_port, api_base_uri, api_workers);
+    api_service api(service, api_addr, api_port, api_base_uri, api_workers,
+                    api_max_inflight, api_retry_after, api_keep_alive, api_keep_alive_requests,
+                    api_mode == "async", api_io_threads, ingest.get());
 
     LOG_INFO << "running pushy service.";
         
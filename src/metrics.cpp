@@ -0,0 +1,96 @@
+//
+//  metrics.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "metrics.hpp"
+
+namespace pushy
+{
+    latency_histogram::latency_histogram()
+    : count_(0)
+    , sum_(0)
+    , max_(0)
+    {
+        for(std::size_t i = 0; i < buckets_count; ++i)
+        {
+            buckets_[i] = 0;
+        }
+    }
+    
+    void latency_histogram::record(const boost::posix_time::time_duration& latency)
+    {
+        auto usec = latency.total_microseconds();
+        record(static_cast<uint64_t>(usec < 0 ? 0 : usec));
+    }
+    
+    void latency_histogram::record(uint64_t usec)
+    {
+        // bucket i holds values in [2^(i-1), 2^i)
+        std::size_t idx = 0;
+        for(uint64_t v = usec; v && idx < buckets_count - 1; v >>= 1)
+        {
+            ++idx;
+        }
+        
+        ++buckets_[idx];
+        ++count_;
+        sum_ += usec;
+        
+        uint64_t cur = max_.load();
+        while(usec > cur && !max_.compare_exchange_weak(cur, usec))
+        {
+        }
+    }
+    
+    uint64_t latency_histogram::count() const
+    {
+        return count_.load();
+    }
+    
+    uint64_t latency_histogram::max() const
+    {
+        return max_.load();
+    }
+    
+    uint64_t latency_histogram::percentile(double p) const
+    {
+        uint64_t total = count_.load();
+        if(!total)
+        {
+            return 0;
+        }
+        
+        uint64_t rank = static_cast<uint64_t>(total * p / 100.0);
+        uint64_t seen = 0;
+        
+        for(std::size_t i = 0; i < buckets_count; ++i)
+        {
+            seen += buckets_[i].load();
+            if(seen > rank)
+            {
+                return std::min<uint64_t>(i ? (1ull << i) : 0, max_.load());
+            }
+        }
+        
+        return max_.load();
+    }
+    
+    json_spirit::Object latency_histogram::to_json() const
+    {
+        json_spirit::Object obj;
+        uint64_t total = count_.load();
+        
+        obj.push_back( json_spirit::Pair("count", total) );
+        obj.push_back( json_spirit::Pair("mean_us", total ? sum_.load() / total : 0) );
+        obj.push_back( json_spirit::Pair("p50_us", percentile(50)) );
+        obj.push_back( json_spirit::Pair("p90_us", percentile(90)) );
+        obj.push_back( json_spirit::Pair("p99_us", percentile(99)) );
+        obj.push_back( json_spirit::Pair("max_us", max_.load()) );
+        
+        return obj;
+    }
+}
@@ -0,0 +1,50 @@
+//
+//  metrics.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__metrics__
+#define __pushy__metrics__
+
+#include <atomic>
+#include <cstdint>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    /**
+     * Lock-free latency histogram with power-of-two microsecond buckets.
+     * Percentiles are reported as the upper bound of the matching bucket.
+     */
+    class latency_histogram
+    {
+    public:
+        static const std::size_t buckets_count = 40;
+        
+        latency_histogram();
+        
+        void record(const boost::posix_time::time_duration& latency);
+        void record(uint64_t usec);
+        
+        uint64_t count() const;
+        uint64_t max() const;
+        
+        /// upper bound (usec) of the bucket containing the given percentile (0..100)
+        uint64_t percentile(double p) const;
+        
+        /// count, mean, p50, p90, p99 and max in microseconds
+        json_spirit::Object to_json() const;
+        
+    private:
+        std::atomic<uint64_t> buckets_[buckets_count];
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+    };
+}
+
+#endif /* defined(__pushy__metrics__) */
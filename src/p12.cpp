@@ -0,0 +1,58 @@
+//
+//  p12.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "p12.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+#include <openssl/pkcs12.h>
+
+namespace pushy
+{
+    void use_p12(SSL_CTX* ctx, const std::string& file, const std::string& password)
+    {
+        FILE* fp = fopen(file.c_str(), "rb");
+        if(!fp)
+        {
+            throw std::runtime_error("can't open apns p12 file '" + file + "'");
+        }
+        
+        PKCS12* p12 = d2i_PKCS12_fp(fp, NULL);
+        fclose(fp);
+        
+        if(!p12)
+        {
+            throw std::runtime_error("can't read apns p12 file '" + file + "'");
+        }
+        
+        EVP_PKEY* key = NULL;
+        X509* cert = NULL;
+        STACK_OF(X509)* ca = NULL;
+        
+        int ok = PKCS12_parse(p12, password.c_str(), &key, &cert, &ca);
+        PKCS12_free(p12);
+        
+        if(!ok)
+        {
+            throw std::runtime_error("can't parse apns p12 file '" + file + "'. wrong password?");
+        }
+        
+        ok = SSL_CTX_use_certificate(ctx, cert) == 1
+            && SSL_CTX_use_PrivateKey(ctx, key) == 1
+            && SSL_CTX_check_private_key(ctx) == 1;
+        
+        X509_free(cert);
+        EVP_PKEY_free(key);
+        sk_X509_pop_free(ca, X509_free);
+        
+        if(!ok)
+        {
+            throw std::runtime_error("certificate or key from apns p12 file '" + file + "' is not usable");
+        }
+    }
+}
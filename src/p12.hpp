@@ -0,0 +1,21 @@
+//
+//  p12.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__p12__
+#define __pushy__p12__
+
+#include <string>
+#include <openssl/ssl.h>
+
+namespace pushy
+{
+    /// loads the certificate and key of a p12 file into the context. throws std::runtime_error
+    void use_p12(SSL_CTX* ctx, const std::string& file, const std::string& password);
+}
+
+#endif /* defined(__pushy__p12__) */
@@ -0,0 +1,284 @@
+//
+//  provider_pool.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "provider_pool.hpp"
+#include "logging.hpp"
+
+#include <cmath>
+#include <boost/bind.hpp>
+
+namespace pushy
+{
+    provider_pool::provider_pool(io::io_service& io, const std::string& name, const config& cfg,
+                                 const factory_type& factory, const depth_type& depth,
+                                 const callback_type& callback)
+    : io_(io)
+    , name_(name)
+    , config_(cfg)
+    , factory_(factory)
+    , depth_(depth)
+    , callback_(callback)
+    , timer_(io)
+    , next_id_(0)
+    , acks_(0)
+    , rate_(0)
+    , up_ticks_(0)
+    , down_ticks_(0)
+    , wanted_(cfg.min)
+    , grown_(0)
+    , shrunk_(0)
+    {
+        if(!config_.min || config_.max < config_.min)
+        {
+            throw std::runtime_error(name_ + " pool bounds must satisfy 0 < min <= max");
+        }
+        
+        if(!config_.interval || !config_.target)
+        {
+            throw std::runtime_error(name_ + " pool interval and target must be greater than zero");
+        }
+        
+        boost::mutex::scoped_lock lock(mutex_);
+        
+        for(std::size_t i = 0; i < config_.min; ++i)
+        {
+            grow();
+        }
+        
+        // a fixed size pool has nothing to decide
+        if(config_.max > config_.min)
+        {
+            reset_timer();
+        }
+    }
+    
+    void provider_pool::post(const push::device& dev, const std::string& payload, uint32_t ident)
+    {
+        post_type target;
+        
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            
+            slot* best = nullptr;
+            for(auto& entry : slots_)
+            {
+                if(!entry.second.retiring && (!best || entry.second.outstanding < best->outstanding))
+                {
+                    best = &entry.second;
+                }
+            }
+            
+            if(!best)
+            {
+                throw std::runtime_error(name_ + " pool has no connections");
+            }
+            
+            ++best->outstanding;
+            target = best->post;
+        }
+        
+        // plugins may report errors synchronously, so never call them with the lock held
+        target(dev, payload, ident);
+    }
+    
+    void provider_pool::on_reply(uint64_t id, const boost::system::error_code& err, const uint32_t& ident)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            ++acks_;
+            
+            auto it = slots_.find(id);
+            if(it != slots_.end())
+            {
+                if(it->second.outstanding)
+                {
+                    --it->second.outstanding;
+                }
+                
+                if(it->second.retiring && !it->second.outstanding)
+                {
+                    LOG_DEBUG << name_ << " pool: closing drained connection " << id;
+                    
+                    retired_.push_back(it->second.post);
+                    slots_.erase(it);
+                }
+            }
+        }
+        
+        callback_(err, ident);
+    }
+    
+    void provider_pool::reset_timer()
+    {
+        timer_.expires_from_now(boost::posix_time::milliseconds(config_.interval));
+        timer_.async_wait(
+            boost::bind(&provider_pool::on_resize, this, boost::asio::placeholders::error) );
+    }
+    
+    void provider_pool::on_resize(const boost::system::error_code& err)
+    {
+        if(err == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+        
+        auto queued = depth_();
+        std::vector<post_type> closing;
+        
+        try
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            closing.swap(retired_);
+            
+            auto n = active();
+            auto backlog = queued + outstanding();
+            double seconds = config_.interval / 1000.0;
+            
+            // only intervals with work waiting tell us what a connection can do
+            if(acks_ && n && backlog)
+            {
+                double sample = acks_ / seconds / n;
+                rate_ = rate_ > 0 ? 0.7 * rate_ + 0.3 * sample : sample;
+            }
+            
+            acks_ = 0;
+            
+            std::size_t wanted = config_.min;
+            if(rate_ > 0)
+            {
+                wanted = static_cast<std::size_t>(
+                    std::ceil(backlog / (rate_ * config_.target / 1000.0)) );
+            }
+            else if(backlog)
+            {
+                wanted = n + 1;
+            }
+            
+            wanted_ = std::min(std::max(wanted, config_.min), config_.max);
+            
+            if(wanted_ > n)
+            {
+                down_ticks_ = 0;
+                if(++up_ticks_ >= config_.grow_after)
+                {
+                    up_ticks_ = 0;
+                    grow();
+                }
+            }
+            else if(wanted_ < n)
+            {
+                up_ticks_ = 0;
+                if(++down_ticks_ >= config_.shrink_after)
+                {
+                    down_ticks_ = 0;
+                    shrink();
+                }
+            }
+            else
+            {
+                up_ticks_ = down_ticks_ = 0;
+            }
+        }
+        catch(std::exception& e)
+        {
+            LOG_ERROR << name_ << " pool: resizing failed: " << e.what();
+        }
+        
+        reset_timer();
+    }
+    
+    // must be called with mutex_ held
+    void provider_pool::grow()
+    {
+        uint64_t id = next_id_++;
+        
+        slot s;
+        s.post = factory_(boost::bind(&provider_pool::on_reply, this, id, _1, _2));
+        slots_[id] = s;
+        
+        if(id >= config_.min)
+        {
+            ++grown_;
+            LOG_INFO << name_ << " pool: grown to " << active() << " connections.";
+        }
+    }
+    
+    // must be called with mutex_ held
+    void provider_pool::shrink()
+    {
+        slot* idlest = nullptr;
+        uint64_t idlest_id = 0;
+        
+        for(auto& entry : slots_)
+        {
+            if(!entry.second.retiring && (!idlest || entry.second.outstanding < idlest->outstanding))
+            {
+                idlest = &entry.second;
+                idlest_id = entry.first;
+            }
+        }
+        
+        if(!idlest)
+        {
+            return;
+        }
+        
+        ++shrunk_;
+        idlest->retiring = true;
+        
+        if(!idlest->outstanding)
+        {
+            retired_.push_back(idlest->post);
+            slots_.erase(idlest_id);
+        }
+        
+        LOG_INFO << name_ << " pool: shrunk to " << active() << " connections.";
+    }
+    
+    // must be called with mutex_ held
+    std::size_t provider_pool::active() const
+    {
+        std::size_t res = 0;
+        for(auto& entry : slots_)
+        {
+            res += entry.second.retiring ? 0 : 1;
+        }
+        
+        return res;
+    }
+    
+    // must be called with mutex_ held
+    std::size_t provider_pool::outstanding() const
+    {
+        std::size_t res = 0;
+        for(auto& entry : slots_)
+        {
+            res += entry.second.outstanding;
+        }
+        
+        return res;
+    }
+    
+    json_spirit::Object provider_pool::stats() const
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        json_spirit::Object obj;
+        
+        obj.push_back( json_spirit::Pair("connections", static_cast<uint64_t>(active())) );
+        obj.push_back( json_spirit::Pair("closing", static_cast<uint64_t>(slots_.size() - active())) );
+        obj.push_back( json_spirit::Pair("min", static_cast<uint64_t>(config_.min)) );
+        obj.push_back( json_spirit::Pair("max", static_cast<uint64_t>(config_.max)) );
+        obj.push_back( json_spirit::Pair("wanted", static_cast<uint64_t>(wanted_)) );
+        obj.push_back( json_spirit::Pair("outstanding", static_cast<uint64_t>(outstanding())) );
+        obj.push_back( json_spirit::Pair("rate_per_connection", rate_) );
+        obj.push_back( json_spirit::Pair("grown", grown_) );
+        obj.push_back( json_spirit::Pair("shrunk", shrunk_) );
+        
+        return obj;
+    }
+}
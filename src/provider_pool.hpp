@@ -0,0 +1,125 @@
+//
+//  provider_pool.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__provider_pool__
+#define __pushy__provider_pool__
+
+#include <map>
+#include <vector>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <push_service.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    namespace io = boost::asio;
+    
+    /**
+     * A set of provider plugin instances, one connection each, which grows and shrinks
+     * between 'min' and 'max'. Every 'interval' the backlog of the provider (messages
+     * waiting for dispatch plus messages handed to a connection but not acknowledged)
+     * is compared with what the current connections get through per second.
+     *
+     * Growing needs the demand to persist for 'grow_after' intervals, shrinking for
+     * 'shrink_after' intervals. A connection picked for shrinking gets no new messages
+     * and is closed once everything it was handed is acknowledged.
+     */
+    class provider_pool
+    {
+    public:
+        typedef boost::function<void(const boost::system::error_code&, const uint32_t&)> callback_type;
+        typedef boost::function<void(const push::device&, const std::string&, uint32_t)> post_type;
+        
+        /// creates one plugin instance with a single connection reporting to the given callback
+        typedef boost::function<post_type(const callback_type&)> factory_type;
+        
+        /// messages of this provider waiting for dispatch
+        typedef boost::function<std::size_t()> depth_type;
+        
+        struct config
+        {
+            config()
+            : min(1)
+            , max(1)
+            , interval(1000)
+            , grow_after(2)
+            , shrink_after(30)
+            , target(1000)
+            {
+            }
+            
+            std::size_t min;
+            std::size_t max;
+            uint32_t    interval;       // milliseconds between sizing decisions
+            uint32_t    grow_after;     // intervals
+            uint32_t    shrink_after;   // intervals
+            uint32_t    target;         // milliseconds the backlog should take to clear
+        };
+        
+        provider_pool(io::io_service& io, const std::string& name, const config& cfg,
+                      const factory_type& factory, const depth_type& depth,
+                      const callback_type& callback);
+        
+        /// hands a message to the connection with the least unacknowledged messages
+        void post(const push::device& dev, const std::string& payload, uint32_t ident);
+        
+        json_spirit::Object stats() const;
+    
+    private:
+        struct slot
+        {
+            slot()
+            : outstanding(0)
+            , retiring(false)
+            {
+            }
+            
+            post_type   post;
+            std::size_t outstanding;
+            bool        retiring;
+        };
+        
+        void on_reply(uint64_t id, const boost::system::error_code& err, const uint32_t& ident);
+        void on_resize(const boost::system::error_code& err);
+        void reset_timer();
+        
+        // must be called with mutex_ held
+        void grow();
+        void shrink();
+        std::size_t active() const;
+        std::size_t outstanding() const;
+        
+        io::io_service&     io_;
+        std::string         name_;
+        config              config_;
+        factory_type        factory_;
+        depth_type          depth_;
+        callback_type       callback_;
+        io::deadline_timer  timer_;
+        
+        mutable boost::mutex        mutex_;
+        std::map<uint64_t, slot>    slots_;
+        uint64_t                    next_id_;
+        std::vector<post_type>      retired_; // closed outside of their own callbacks
+        
+        // sizing state
+        uint64_t    acks_;          // since the last sizing decision
+        double      rate_;          // acknowledged messages per second per connection, averaged
+        uint32_t    up_ticks_;
+        uint32_t    down_ticks_;
+        std::size_t wanted_;
+        uint64_t    grown_;
+        uint64_t    shrunk_;
+    };
+}
+
+#endif /* defined(__pushy__provider_pool__) */
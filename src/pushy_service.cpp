@@ -20,51 +20,171 @@ using namespace pushy::database;
 
 namespace pushy
 {
+    namespace
+    {
+        std::string pool_name(const std::string& provider, const std::string& app)
+        {
+            return app.empty() ? provider : provider + "/" + app;
+        }
+        
+        // host[:port] of a stand-in server; the port is left alone if not given
+        void split_host(const std::string& spec, std::string& host, std::string& port)
+        {
+            auto pos = spec.rfind(':');
+            host = spec.substr(0, pos);
+            
+            if(pos != std::string::npos)
+            {
+                port = spec.substr(pos + 1);
+            }
+        }
+        
+        // a fixed pool unless pool_max is larger than pool
+        provider_pool::config pool_config(int pool, int pool_max)
+        {
+            provider_pool::config cfg;
+            
+            cfg.min = std::max(pool, 1);
+            cfg.max = std::max(pool_max, pool);
+            
+            return cfg;
+        }
+        
+        // the in-process entry of a message which was just written
+        dba::msg_entry new_entry(const boost::uuids::uuid& msg_uuid, const boost::uuids::uuid& dev_uuid,
+                                 const dba::push_record& rec)
+        {
+            dba::msg_entry m;
+            
+            m.msg_uuid = msg_uuid;
+            m.dev_uuid = dev_uuid;
+            m.attempts = 1;
+            m.ts = rec.timestamp;
+            m.provider_type = rec.type;
+            m.priority = rec.priority;
+            m.tag = rec.tag;
+            m.app = rec.app;
+            
+            if(!rec.collapse_key.empty())
+            {
+                m.collapse = dba::collapse_key(dev_uuid, rec.collapse_key);
+            }
+            
+            return m;
+        }
+    }
+    
     /*
      * APNS handlers
      */
     void pushy_service::on_apns(const boost::system::error_code& err, const uint32_t& ident)
     {
-        // get the message uuid using this ident from local cache
-        if(!apns_cache_.count(ident))
+        // get the message using this ident from local cache
+        dba::msg_entry m;
+        if(!take_ident(push_type_apns, ident, m))
         {
             LOG_ERROR << "APNS message identifier not found in local node's cache. Fatal error which should never happen.";
             throw std::runtime_error("APNS message identifier not found in local node's cache. Fatal error which should never happen.");
         }
         
-        auto uuid = apns_cache_[ident];
+        if(!window_released(ident))
+        {
+            dispatcher_.complete(push_type_apns, m.app);
+        }
         
         if(!err)
         {
-            LOG_INFO << "message " << uuid
+            LOG_INFO << "message " << m.msg_uuid
                 << " is sent successfully thru APNS.";
             
-            LOG_APNS("sent", uuid, "sent successfully");
-            dba::instance().drop_push_record(uuid);
+            LOG_APNS("sent", m, "sent successfully");
+            dba::instance().drop_push_record(m.msg_uuid);
+        }
+        else if(http2_error::device_gone(err) || apns_error::device_gone(err))
+        {
+            // apns tells right away that the token is dead; no point in redelivering
+            LOG_WARN << "device of message " << to_string(m.msg_uuid) << " is gone: "
+                << err.message();
+            
+            LOG_APNS("device_gone", m, "device token rejected. reason: " + err.message());
+            dba::instance().drop_push_record(m.msg_uuid);
+            
+            auto now = boost::posix_time::second_clock::universal_time();
+            LOG_APNS_DEVICE("device_unsubscribed", m.dev_uuid, now, "device reported as unsubscribed");
+            retire_device(push_type_apns, m.dev_uuid, now);
         }
         else
         {
-            LOG_WARN << "error for message " << to_string(uuid) << ": "
+            LOG_WARN << "error for message " << to_string(m.msg_uuid) << ": "
                 << err.message();
             
-            auto attempts = dba::instance().mark_push_record_failed(uuid, err.message());
-            if(redeliver_ && redeliver_attempts_ <= attempts)
+            handle_failure(m, err);
+        }
+    }
+    
+    void pushy_service::retire_device(const push_type& type, boost::uuids::uuid uuid,
+                                      const boost::posix_time::ptime& time)
+    {
+        if(deregister_)
+        {
+            // automatically remove device
+            dba::instance().drop_device(uuid);
+            
+            if(type == push_type_apns)
             {
-                LOG_INFO << "message " << to_string(uuid) << " exceeded redelivery attempts. removing it completely.";
-                if(dba::instance().remove_from_failed_messages(uuid))
-                {
-                    // no other node beat us to it
-                    LOG_APNS("permanent_failure", uuid, "permanently failed. reason: " + err.message());
-                    dba::instance().drop_push_record(uuid);
-                }
+                LOG_APNS_DEVICE("device_dropped", uuid, time, "device automatically dropped from redis db");
+            }
+            else
+            {
+                LOG_GCM_DEVICE("device_dropped", uuid, time, "device automatically dropped from redis db");
+            }
+        }
+        else
+        {
+            // add device to removed devices list instead of removing
+            dba::instance().mark_device_dead(uuid, time);
+            dead_filter_.insert(uuid);
+            
+            if(type == push_type_apns)
+            {
+                LOG_APNS_DEVICE("device_marked_unsubscribed", uuid, time, "device marked as dead");
             }
             else
             {
-                LOG_APNS("redeliverable_failure", uuid, "failed. will try to redeliver. reason: " + err.message());
+                LOG_GCM_DEVICE("device_marked_unsubscribed", uuid, time, "device marked as dead");
             }
         }
     }
     
+    void pushy_service::load_dead_devices()
+    {
+        if(!dead_filter_.enabled())
+        {
+            return;
+        }
+        
+        dead_filter_.clear();
+        
+        auto dead = dba::instance().get_dead_device_uuids();
+        for(auto& uuid : dead)
+        {
+            dead_filter_.insert(uuid);
+        }
+        
+        LOG_INFO << "loaded " << dead.size() << " dead devices into the filter.";
+    }
+    
+    bool pushy_service::known_dead(const boost::uuids::uuid& dev_uuid)
+    {
+        if(!dead_filter_.maybe_contains(dev_uuid) || !dba::instance().is_device_dead(dev_uuid))
+        {
+            return false;
+        }
+        
+        ++dead_skipped_;
+        return true;
+    }
+    
     void pushy_service::on_apns_feed(const boost::system::error_code& err,
                                      const std::string& token,
                                      const boost::posix_time::ptime& time)
@@ -73,24 +193,24 @@ namespace pushy
         {
             LOG_TRACE << "feedback time: " << time << " for token " << token;
 
-            auto uuid = dba::instance().find_device_by_token64(
-                util::base64::encode(token.c_str(), token.size() ) );
-
-            LOG_APNS_DEVICE("device_unsubscribed", uuid, time, "device reported as unsubscribed");
+            auto token64 = util::base64::encode(token.c_str(), token.size());
             
-            if(deregister_)
+            // one bad token must not take the node down with the feedback run
+            try
             {
-                // automatically remove device
-                dba::instance().drop_device(uuid);
+                boost::uuids::uuid uuid;
+                if(!dba::instance().find_device_by_token64(token64, uuid))
+                {
+                    LOG_DEBUG << "feedback for unknown token " << token64 << ". skipping it.";
+                    return;
+                }
                 
-                LOG_APNS("device_dropped", uuid, "device automatically dropped from redis db");
+                LOG_APNS_DEVICE("device_unsubscribed", uuid, time, "device reported as unsubscribed");
+                retire_device(push_type_apns, uuid, time);
             }
-            else
+            catch(std::exception& e)
             {
-                // add device to removed devices list instead of removing
-                dba::instance().mark_device_dead(uuid, time);
-                
-                LOG_APNS_DEVICE("device_marked_unsubscribed", uuid, time, "device marked as dead");
+                LOG_ERROR << "failed to handle feedback for token " << token64 << ": " << e.what();
             }
         }
         else if(err == push::error::shutdown)
@@ -100,49 +220,111 @@ namespace pushy
         }
     }
 
+    // the coalescing binary sender confirms a frame only a while after writing it. the dispatch
+    // window is given back right away so that it bounds the frames queued, not those confirmed
+    void pushy_service::on_apns_written(const uint32_t& ident)
+    {
+        std::string app;
+        
+        {
+            boost::mutex::scoped_lock lock(cache_mutex_);
+            
+            auto it = apns_cache_.find(ident);
+            if(it == apns_cache_.end() || !apns_written_.insert(ident).second)
+            {
+                return;
+            }
+            
+            app = it->second.app;
+        }
+        
+        dispatcher_.complete(push_type_apns, app);
+    }
+    
+    bool pushy_service::window_released(const uint32_t& ident)
+    {
+        boost::mutex::scoped_lock lock(cache_mutex_);
+        return apns_written_.erase(ident) > 0;
+    }
+    
     /*
      * GCM handlers
      */
     void pushy_service::on_gcm(const boost::system::error_code& err, const uint32_t& ident)
     {
-        // get the message uuid using this ident from local cache
-        if(!gcm_cache_.count(ident))
+        // get the message using this ident from local cache
+        dba::msg_entry m;
+        if(!take_ident(push_type_gcm, ident, m))
         {
             LOG_ERROR << "GCM message identifier not found in local node's cache. Fatal error which should never happen.";
             throw std::runtime_error("GCM message identifier not found in local node's cache. Fatal error which should never happen.");
         }
-        
-        auto uuid = gcm_cache_[ident];
+
+        dispatcher_.complete(push_type_gcm, m.app);
 
         if(!err)
         {
-            LOG_INFO << "message " << uuid
+            LOG_INFO << "message " << m.msg_uuid
                 << " is sent successfully thru GCM.";
             
-            LOG_GCM("sent", uuid, "sent successfully");
-            dba::instance().drop_push_record(uuid);
+            LOG_GCM("sent", m, "sent successfully");
+            dba::instance().drop_push_record(m.msg_uuid);
+        }
+        else if(gcm_error::device_gone(err))
+        {
+            // multicast results tell which registration ids are dead
+            LOG_WARN << "device of message " << m.msg_uuid << " is gone: " << err.message();
+            
+            LOG_GCM("device_gone", m, "registration id rejected. reason: " + err.message());
+            dba::instance().drop_push_record(m.msg_uuid);
+            
+            auto now = boost::posix_time::second_clock::universal_time();
+            LOG_GCM_DEVICE("device_unsubscribed", m.dev_uuid, now, "device reported as unsubscribed");
+            retire_device(push_type_gcm, m.dev_uuid, now);
         }
         else
         {
-            LOG_WARN << "GCM error for message " << uuid << ": "
+            LOG_WARN << "GCM error for message " << m.msg_uuid << ": "
                 << err.message();
             
-            auto attempts = dba::instance().mark_push_record_failed(uuid, err.message());
-            if(redeliver_ && redeliver_attempts_ <= attempts)
+            handle_failure(m, err);
+        }
+    }
+    
+    void pushy_service::handle_failure(dba::msg_entry& m, const boost::system::error_code& err)
+    {
+        auto attempts = dba::instance().mark_push_record_failed(m.msg_uuid, err.message());
+        if(!attempts)
+        {
+            // superseded by a newer message with the same collapse key meanwhile
+            LOG_PUSH("superseded", m, "failed but superseded already. reason: " + err.message());
+            return;
+        }
+        
+        m.attempts = attempts;
+        
+        if(redeliver_ && redeliver_attempts_ <= attempts)
+        {
+            LOG_INFO << "message " << to_string(m.msg_uuid) << " exceeded redelivery attempts. removing it completely.";
+            if(dba::instance().remove_from_failed_messages(m.msg_uuid))
             {
-                LOG_INFO << "message " << to_string(uuid) << " exceeded redelivery attempts. removing it completely.";
-                if(dba::instance().remove_from_failed_messages(uuid))
-                {
-                    LOG_GCM("permanent_failure", uuid, "permanently failed. reason: " + err.message());
-                    
-                    // no other node beat us to it
-                    dba::instance().drop_push_record(uuid);
-                }
+                // no other node beat us to it
+                LOG_PUSH("permanent_failure", m, "permanently failed. reason: " + err.message());
+                dba::instance().drop_push_record(m.msg_uuid);
             }
-            else
+        }
+        else
+        {
+            if(redeliver_)
             {
-                LOG_GCM("redeliverable_failure", uuid, "failed. will try to redeliver. reason: " + err.message());
+                auto delay = backoff_.delay(attempts);
+                LOG_DEBUG << "message " << to_string(m.msg_uuid) << " will be redelivered in " << delay;
+                
+                dba::instance().schedule_redelivery(m.msg_uuid, m.provider_type,
+                    boost::posix_time::microsec_clock::universal_time() + delay);
             }
+            
+            LOG_PUSH("redeliverable_failure", m, "failed. will try to redeliver. reason: " + err.message());
         }
     }
 
@@ -150,65 +332,360 @@ namespace pushy
     /*
      * Setup
      */
-    void pushy_service::setup_apns(const std::string& mode, const std::string& p12_file,
-                                   const std::string& password, int poolsize)
+    void pushy_service::setup_apns(const std::string& app, const app_config& cfg)
     {
-        apns::config ap = apns::config::sandbox(p12_file);
-        ap.p12_pass = password;
-        
-        apns_feedback::config apf = apns_feedback::config::sandbox(p12_file);
-        apf.p12_pass = password;
+        auto pool = pool_config(cfg.apns_pool, cfg.apns_pool_max);
+        provider_pool::factory_type factory;
         
-        if(mode == "production")
+        if(cfg.apns_protocol == "http2")
         {
-            ap = apns::config::production(p12_file);
-            ap.p12_pass = password;
+#ifdef PUSHY_WITH_HTTP2
+            apns_http2::config ap = cfg.apns_mode == "production"
+                ? apns_http2::config::production(cfg.apns_p12)
+                : apns_http2::config::sandbox(cfg.apns_p12);
+            
+            ap.p12_pass = cfg.apns_password;
+            ap.topic = cfg.apns_topic;
+            ap.streams = cfg.apns_streams;
+            ap.verify = cfg.apns_verify;
             
-            apf = apns_feedback::config::production(p12_file);
-            apf.p12_pass = password;
+            if(!cfg.apns_host.empty())
+            {
+                split_host(cfg.apns_host, ap.host, ap.port);
+            }
+            
+            factory = boost::bind(&pushy_service::make_apns_http2, this, ap, _1);
+#else
+            throw std::runtime_error("apns.protocol 'http2' needs pushy built with nghttp2");
+#endif
+        }
+        else
+        {
+            if(cfg.apns_batch_bytes || !cfg.apns_host.empty())
+            {
+                // in-tree sender coalescing frames into large writes; the plugin can't change hosts
+                apns_binary::config ap = cfg.apns_mode == "production"
+                    ? apns_binary::config::production(cfg.apns_p12)
+                    : apns_binary::config::sandbox(cfg.apns_p12);
+                
+                ap.p12_pass = cfg.apns_password;
+                ap.batch_bytes = cfg.apns_batch_bytes;
+                ap.batch_delay = cfg.apns_batch_delay;
+                ap.verify = cfg.apns_verify;
+                ap.written = boost::bind(&pushy_service::on_apns_written, this, _1);
+                
+                if(!cfg.apns_host.empty())
+                {
+                    split_host(cfg.apns_host, ap.host, ap.port);
+                }
+                
+                factory = boost::bind(&pushy_service::make_apns_binary, this, ap, _1);
+            }
+            else
+            {
+                apns::config ap = cfg.apns_mode == "production"
+                    ? apns::config::production(cfg.apns_p12)
+                    : apns::config::sandbox(cfg.apns_p12);
+                
+                ap.p12_pass = cfg.apns_password;
+                factory = boost::bind(&pushy_service::make_apns, this, ap, _1);
+            }
+            
+            // unregistered devices are reported by the feedback service. http/2 replies tell right away
+            if(!cfg.apns_feedback_host.empty())
+            {
+                apns_feedback_poller::config apf;
+                
+                split_host(cfg.apns_feedback_host, apf.host, apf.port);
+                apf.p12 = cfg.apns_p12;
+                apf.p12_pass = cfg.apns_password;
+                apf.interval = cfg.apns_feedback_interval;
+                apf.verify = cfg.apns_verify;
+                apf.callback =
+                    boost::bind(&pushy_service::on_apns_feed, this, _1, _2, _3);
+                
+                apns_feedback_pollers_[app] = boost::shared_ptr<apns_feedback_poller>(
+                    new apns_feedback_poller(io_, apf) );
+            }
+            else
+            {
+                apns_feedback::config apf = cfg.apns_mode == "production"
+                    ? apns_feedback::config::production(cfg.apns_p12)
+                    : apns_feedback::config::sandbox(cfg.apns_p12);
+                
+                apf.p12_pass = cfg.apns_password;
+                apf.callback =
+                    boost::bind(&pushy_service::on_apns_feed, this, _1, _2, _3);
+                
+                // create the apns feedback listener
+                apns_feedback_[app] = boost::shared_ptr<apns_feedback>( new apns_feedback(ps_, apf) );
+            }
         }
         
-        ap.pool_size = poolsize;
+        // create the apns push service runners
+        apns_[app] = boost::shared_ptr<provider_pool>(
+            new provider_pool(io_, pool_name("apns", app), pool, factory,
+                boost::bind(&dispatcher::queued, &dispatcher_, push_type_apns, app),
+                boost::bind(&pushy_service::on_apns, this, _1, _2)
+            )
+        );
+    }
+
+    void pushy_service::setup_gcm(const std::string& app, const app_config& cfg)
+    {
+        provider_pool::factory_type factory;
         
-        ap.callback =
-            boost::bind(&pushy_service::on_apns, this, _1, _2);
+        if(cfg.gcm_multicast)
+        {
+            gcm_multicast::config gc;
+            
+            gc.api_key = cfg.gcm_key;
+            gc.batch_size = cfg.gcm_batch_size;
+            gc.window = cfg.gcm_batch_window;
+            
+            if(!cfg.gcm_url.empty())
+            {
+                gc.url = cfg.gcm_url;
+            }
+            
+            factory = boost::bind(&pushy_service::make_gcm_multicast, this, gc, _1);
+        }
+        else
+        {
+            factory = boost::bind(&pushy_service::make_gcm, this, cfg.gcm_project, cfg.gcm_key, _1);
+        }
         
-        // create the apns push service runner
-        apns_ = boost::shared_ptr<push::apns>( new push::apns(ps_, ap) );
+        // create the gcm push service runners
+        gcm_[app] = boost::shared_ptr<provider_pool>(
+            new provider_pool(io_, pool_name("gcm", app), pool_config(cfg.gcm_pool, cfg.gcm_pool_max), factory,
+                boost::bind(&dispatcher::queued, &dispatcher_, push_type_gcm, app),
+                boost::bind(&pushy_service::on_gcm, this, _1, _2)
+            )
+        );
+    }
+    
+    bool pushy_service::serves(const push_type& type, const std::string& app) const
+    {
+        switch(type)
+        {
+            case push_type_apns:
+                return apns_.count(app) > 0;
+            case push_type_gcm:
+                return gcm_.count(app) > 0;
+            default:
+                return false;
+        }
+    }
+    
+    provider_pool::post_type pushy_service::make_apns(apns::config cfg, const provider_pool::callback_type& cb)
+    {
+        cfg.pool_size = 1;
+        cfg.callback = cb;
         
-        apf.callback =
-            boost::bind(&pushy_service::on_apns_feed, this, _1, _2, _3);
+        boost::shared_ptr<push::apns> plugin( new push::apns(ps_, cfg) );
+        return boost::bind(&push::apns::post, plugin, _1, _2, 0, _3);
+    }
+    
+    provider_pool::post_type pushy_service::make_apns_binary(apns_binary::config cfg,
+                                                             const provider_pool::callback_type& cb)
+    {
+        cfg.callback = cb;
         
-        // create the apns feedback listener
-        apns_feedback_ = boost::shared_ptr<apns_feedback>( new apns_feedback(ps_, apf) );
+        boost::shared_ptr<apns_binary> plugin( new apns_binary(io_, cfg) );
+        return boost::bind(&apns_binary::post, plugin, _1, _2, 0, _3);
     }
-
-    void pushy_service::setup_gcm(const std::string& gcm_project_id, const std::string& gcm_api_key, int poolsize)
+    
+#ifdef PUSHY_WITH_HTTP2
+    provider_pool::post_type pushy_service::make_apns_http2(apns_http2::config cfg,
+                                                            const provider_pool::callback_type& cb)
     {
-        // create the gcm push service runner
-        gcm_ = boost::shared_ptr<push::gcm>(
-            new push::gcm(ps_,
-                gcm_project_id, gcm_api_key, poolsize,
-                    boost::bind(&pushy_service::on_gcm, this, _1, _2)
-            )
-        );
+        cfg.callback = cb;
+        
+        boost::shared_ptr<apns_http2> plugin( new apns_http2(io_, cfg) );
+        return boost::bind(&apns_http2::post, plugin, _1, _2, 0, _3);
+    }
+#endif
+    
+    provider_pool::post_type pushy_service::make_gcm(const std::string& project_id, const std::string& api_key,
+                                                     const provider_pool::callback_type& cb)
+    {
+        boost::shared_ptr<push::gcm> plugin( new push::gcm(ps_, project_id, api_key, 1, cb) );
+        return boost::bind(&push::gcm::post, plugin, _1, _2, 0, _3);
+    }
+    
+    provider_pool::post_type pushy_service::make_gcm_multicast(gcm_multicast::config cfg,
+                                                               const provider_pool::callback_type& cb)
+    {
+        cfg.callback = cb;
+        
+        boost::shared_ptr<gcm_multicast> plugin( new gcm_multicast(io_, cfg) );
+        return boost::bind(&gcm_multicast::post, plugin, _1, _2, 0, _3);
     }
     
     void pushy_service::run()
     {
-        if(apns_feedback_)
+        load_dead_devices();
+        
+        if(redeliver_)
+        {
+            // failures recorded before redelivery was scheduled per message
+            for(auto type : { push_type_apns, push_type_gcm })
+            {
+                auto adopted = dba::instance().schedule_unscheduled_failures(type);
+                if(adopted)
+                {
+                    LOG_INFO << "scheduled " << adopted << " previously failed "
+                        << dba::type_to_str(type) << " messages for redelivery.";
+                }
+            }
+        }
+        
+        for(auto& feedback : apns_feedback_)
         {
             // start getting the apns feed
-            apns_feedback_->start();
+            feedback.second->start();
+        }
+        
+        for(auto& poller : apns_feedback_pollers_)
+        {
+            poller.second->start();
         }
         
+        redelivery_thread_ = boost::thread( boost::bind(&io::io_service::run, &redelivery_io_) );
+        
+        signals_.async_wait(
+            boost::bind(&pushy_service::on_signal, this,
+                boost::asio::placeholders::error, boost::asio::placeholders::signal_number) );
+        
         // and finally run the whole service
         io_.run();
     }
     
-    void pushy_service::reset_redelivery_timer(uint32_t sec)
+    void pushy_service::on_signal(const boost::system::error_code& err, int signal_number)
+    {
+        if(!err)
+        {
+            LOG_INFO << "received signal " << signal_number << ". shutting down.";
+            drain();
+        }
+    }
+    
+    void pushy_service::drain()
+    {
+        if(draining_.exchange(true))
+        {
+            return;
+        }
+        
+        LOG_INFO << "draining: not accepting messages anymore. waiting up to " << drain_timeout_
+            << " seconds for providers to acknowledge " << unacknowledged() << " messages.";
+        
+        // no more redeliveries or scheduled sends from this node
+        redelivery_io_.stop();
+        if(redelivery_thread_.joinable())
+        {
+            redelivery_thread_.join();
+        }
+        
+        // whatever did not reach a provider yet does not need to wait for it
+        take_queued();
+        
+        drain_deadline_ = boost::posix_time::microsec_clock::universal_time()
+            + boost::posix_time::seconds(drain_timeout_);
+        
+        on_drain_tick(boost::system::error_code());
+    }
+    
+    void pushy_service::on_drain_tick(const boost::system::error_code& err)
+    {
+        if(err == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+        
+        // calls which got past the draining check before it was set still enqueue their
+        // message; it must not be written to redis and then be lost with the dispatcher
+        if(accepting_.current()
+           || (unacknowledged() && boost::posix_time::microsec_clock::universal_time() < drain_deadline_))
+        {
+            drain_timer_.expires_from_now(boost::posix_time::milliseconds(100));
+            drain_timer_.async_wait(
+                boost::bind(&pushy_service::on_drain_tick,
+                    this, boost::asio::placeholders::error) );
+            return;
+        }
+        
+        finish_drain();
+    }
+    
+    void pushy_service::finish_drain()
+    {
+        // late arrivals which were accepted just before draining started
+        take_queued();
+        
+        {
+            boost::mutex::scoped_lock lock(cache_mutex_);
+            
+            for(auto& entry : apns_cache_)
+            {
+                drained_.push_back(entry.second);
+            }
+            
+            for(auto& entry : gcm_cache_)
+            {
+                drained_.push_back(entry.second);
+            }
+            
+            apns_cache_.clear();
+            apns_written_.clear();
+            gcm_cache_.clear();
+        }
+        
+        LOG_INFO << "drained. handing " << drained_.size() << " unacknowledged messages over to redelivery.";
+        
+        try
+        {
+            dba::instance().requeue_for_redelivery(drained_);
+        }
+        catch(std::exception& e)
+        {
+            LOG_ERROR << "failed to hand unacknowledged messages over to redelivery: " << e.what();
+        }
+        
+        signals_.cancel();
+        io_.stop();
+    }
+    
+    std::size_t pushy_service::unacknowledged()
+    {
+        boost::mutex::scoped_lock lock(cache_mutex_);
+        return apns_cache_.size() + gcm_cache_.size();
+    }
+    
+    void pushy_service::take_queued()
+    {
+        for(auto& j : dispatcher_.close())
+        {
+            dba::msg_entry m;
+            if(take_ident(j.type, j.ident, m))
+            {
+                drained_.push_back(m);
+            }
+        }
+    }
+    
+    void pushy_service::reset_redelivery_timer(bool immediately)
     {
-        redelivery_timer_.expires_from_now(boost::posix_time::seconds(sec));
+        if(immediately)
+        {
+            // yield to other handlers between batches and continue right away
+            redelivery_io_.post(
+                boost::bind(&pushy_service::on_check_redelivery,
+                    this, boost::system::error_code()) );
+            return;
+        }
+        
+        redelivery_timer_.expires_from_now(boost::posix_time::milliseconds(redelivery_interval_ms_));
         redelivery_timer_.async_wait(
             boost::bind(&pushy_service::on_check_redelivery,
                 this, boost::asio::placeholders::error) );
@@ -216,118 +693,372 @@ namespace pushy
     
     void pushy_service::on_check_redelivery(const boost::system::error_code& err)
     {
-        if(err != boost::asio::error::operation_aborted)
+        if(err == boost::asio::error::operation_aborted)
         {
-            LOG_TRACE << "redelivery timer fired. check redelivery..";
+            LOG_TRACE << "redelivery timer aborted.";
+            return;
+        }
+        
+        LOG_TRACE << "redelivery tick. check redelivery..";
+        
+        auto started = boost::posix_time::microsec_clock::universal_time();
+        bool more = false;
+        
+        try
+        {
+            if(!apns_.empty())
+            {
+                more |= redeliver_batch(push_type_apns) >= redelivery_batch_;
+            }
             
-            if(apns_)
+            if(!gcm_.empty())
             {
-                auto apns_msgs = dba::instance().get_failed_messages(push_type_apns);
-
-                for(auto msg : apns_msgs)
-                {
-                    LOG_TRACE << "APNS message to redeliver: " << to_string(msg.msg_uuid);
-                    redeliver(msg.msg_uuid, msg.dev_uuid, push_type_apns);
-                }
+                more |= redeliver_batch(push_type_gcm) >= redelivery_batch_;
             }
-
-            if(gcm_)
+        }
+        catch(std::exception& e)
+        {
+            LOG_ERROR << "redelivery tick failed: " << e.what();
+            more = false;
+        }
+        
+        redelivery_tick_.record(boost::posix_time::microsec_clock::universal_time() - started);
+        ++redelivery_ticks_;
+        
+        // a full batch means there is likely more due right now
+        reset_redelivery_timer(more && dispatcher_.has_capacity());
+    }
+    
+    std::size_t pushy_service::redeliver_batch(const push_type& type)
+    {
+        auto now = boost::posix_time::microsec_clock::universal_time();
+        auto backlog = dba::instance().get_redelivery_backlog(type, now);
+        
+        {
+            boost::mutex::scoped_lock lock(redelivery_mutex_);
+            redelivery_backlog_[type] = backlog;
+        }
+        
+        if(!backlog.due)
+        {
+            return 0;
+        }
+        
+        // never claim more than the dispatcher is willing to hold
+        if(!dispatcher_.has_capacity())
+        {
+            LOG_DEBUG << "dispatch queue is full. postponing redelivery of "
+                << backlog.due << " due " << dba::type_to_str(type) << " messages.";
+            return 0;
+        }
+        
+        auto claimed = dba::instance().claim_due_messages(type, now, redelivery_batch_);
+        redelivery_claimed_ += claimed.size();
+        
+        for(auto& msg : claimed)
+        {
+            LOG_TRACE << dba::type_to_str(type) << " message to redeliver: " << to_string(msg.msg_uuid);
+            
+            if(msg.token.empty() || known_dead(msg.dev_uuid))
             {
-                auto gcm_msgs  = dba::instance().get_failed_messages(push_type_gcm);
-                
-                for(auto msg : gcm_msgs)
-                {
-                    LOG_TRACE << "GCM message to redeliver: " << to_string(msg.msg_uuid);
-                    
-                    // lets say we redeliverd it and it failed
-                    // dba::instance().mark_push_record_failed(msg.msg_uuid, "retry failure"); // for now it's here
-                    redeliver(msg.msg_uuid, msg.dev_uuid, push_type_gcm);
-                }
+                LOG_WARN << "device " << to_string(msg.dev_uuid) << " of message "
+                    << to_string(msg.msg_uuid) << " is gone. dropping the message.";
+                dba::instance().drop_push_record(msg.msg_uuid);
+                continue;
             }
             
-            // and keep going
-            reset_redelivery_timer(5); // TODO: configurable?
+            uint32_t ident = type == push_type_apns ? apns_identifier_++ : gcm_identifier_++;
+            enqueue_post(msg, dba::make_device(type, msg.token), msg.payload, ident);
         }
-        else
+        
+        // report the amount looked at so that a batch of lost races still counts as full
+        return std::min<std::size_t>(backlog.due, redelivery_batch_);
+    }
+    
+    void pushy_service::reset_schedule_timer(bool immediately)
+    {
+        if(immediately)
         {
-            LOG_TRACE << "redelivery timer aborted.";
+            redelivery_io_.post(
+                boost::bind(&pushy_service::on_check_schedule,
+                    this, boost::system::error_code()) );
+            return;
+        }
+        
+        schedule_timer_.expires_from_now(boost::posix_time::milliseconds(schedule_interval_ms_));
+        schedule_timer_.async_wait(
+            boost::bind(&pushy_service::on_check_schedule,
+                this, boost::asio::placeholders::error) );
+    }
+    
+    void pushy_service::on_check_schedule(const boost::system::error_code& err)
+    {
+        if(err == boost::asio::error::operation_aborted)
+        {
+            LOG_TRACE << "schedule timer aborted.";
+            return;
+        }
+        
+        LOG_TRACE << "schedule tick. check scheduled messages..";
+        bool more = false;
+        
+        try
+        {
+            if(!apns_.empty())
+            {
+                more |= dispatch_scheduled(push_type_apns) >= schedule_batch_;
+            }
+            
+            if(!gcm_.empty())
+            {
+                more |= dispatch_scheduled(push_type_gcm) >= schedule_batch_;
+            }
+        }
+        catch(std::exception& e)
+        {
+            LOG_ERROR << "schedule tick failed: " << e.what();
+            more = false;
         }
+        
+        reset_schedule_timer(more && dispatcher_.has_capacity());
+    }
+    
+    std::size_t pushy_service::dispatch_scheduled(const push_type& type)
+    {
+        scheduled_pending_[type] = dba::instance().get_scheduled_count(type);
+        
+        if(!scheduled_pending_[type])
+        {
+            return 0;
+        }
+        
+        // due messages stay on the schedule until there is room for them
+        if(!dispatcher_.has_capacity())
+        {
+            LOG_DEBUG << "dispatch queue is full. postponing scheduled "
+                << dba::type_to_str(type) << " messages.";
+            return 0;
+        }
+        
+        // claimed messages are locked for a minute. if this node dies before
+        // dequeueing them another node fires them after that.
+        auto fired = dba::instance().claim_scheduled_messages(type, schedule_batch_,
+                                                              boost::posix_time::minutes(1));
+        std::vector<boost::uuids::uuid> done;
+        
+        for(auto& msg : fired)
+        {
+            LOG_TRACE << dba::type_to_str(type) << " scheduled message is due: " << to_string(msg.msg_uuid);
+            done.push_back(msg.msg_uuid);
+            
+            if(msg.token.empty() || known_dead(msg.dev_uuid))
+            {
+                LOG_WARN << "device " << to_string(msg.dev_uuid) << " of scheduled message "
+                    << to_string(msg.msg_uuid) << " is gone. dropping the message.";
+                dba::instance().drop_push_record(msg.msg_uuid);
+                continue;
+            }
+            
+            uint32_t ident = type == push_type_apns ? apns_identifier_++ : gcm_identifier_++;
+            enqueue_post(msg, dba::make_device(type, msg.token), msg.payload, ident);
+        }
+        
+        dba::instance().dequeue_scheduled(type, done);
+        scheduled_fired_ += fired.size();
+        
+        return fired.size();
+    }
+    
+    void pushy_service::enqueue_post(const dba::msg_entry& m, const push::device& dev,
+                                     const std::string& payload, uint32_t ident)
+    {
+        {
+            // cache this identifier mapped to the message
+            boost::mutex::scoped_lock lock(cache_mutex_);
+            
+            if(m.provider_type == push_type_apns)
+            {
+                apns_cache_[ident] = m;
+            }
+            else
+            {
+                gcm_cache_[ident] = m;
+            }
+        }
+        
+        dispatcher_.enqueue(dispatcher::job(m.provider_type, dev, payload, ident, m.tag, m.app), m.priority);
+    }
+    
+    bool pushy_service::take_ident(const push_type& type, uint32_t ident, dba::msg_entry& m)
+    {
+        boost::mutex::scoped_lock lock(cache_mutex_);
+        
+        auto& cache = type == push_type_apns ? apns_cache_ : gcm_cache_;
+        auto it = cache.find(ident);
+        
+        if(it == cache.end())
+        {
+            return false;
+        }
+        
+        m = it->second;
+        cache.erase(it);
+        
+        return true;
     }
 
     
     /*
      * API
      */
-    // TODO: this runs on multiple threads so look carefully
-    // about usage of apns_cache_ and apns_identifier_.
-    boost::uuids::uuid pushy_service::push(boost::uuids::uuid& dev_uuid, const std::string& msg, const std::string& tag)
+    boost::uuids::uuid pushy_service::push(push_request& req)
     {
-        LOG_INFO << "trying to push message to " << to_string(dev_uuid);
+        LOG_INFO << "trying to push message to " << to_string(req.dev_uuid);
+        
+        // counted before the check so that draining waits for this call to enqueue
+        inflight_limit::guard call(accepting_);
+        
+        if(draining_)
+        {
+            throw overload_error("shutting down. try again on another node.",
+                                 overload_error::busy, retry_after_);
+        }
+        
+        boost::uuids::uuid uuid;
+        if(!req.idempotency_key.empty() && idempotency_.find(req.idempotency_key, uuid))
+        {
+            LOG_INFO << "idempotency key '" << req.idempotency_key << "' seen recently. message "
+                << to_string(uuid) << " is not sent again.";
+            return uuid;
+        }
+        
+        if(known_dead(req.dev_uuid))
+        {
+            LOG_INFO << "device " << to_string(req.dev_uuid) << " is marked dead. not sending.";
+            throw std::runtime_error("device is unreachable (reported dead by the provider). not sending.");
+        }
+        
+        // a send_at in the past simply means now
+        bool scheduled = !req.send_at.is_special()
+            && req.send_at > boost::posix_time::microsec_clock::universal_time();
+        
+        if(!scheduled)
+        {
+            // rejects with overload_error if provider queues are saturated
+            dispatcher_.admit();
+        }
+        
+        dba::push_record rec;
+        rec.tag = req.tag;
+        rec.priority = req.priority;
+        rec.idempotency_key = req.idempotency_key;
+        rec.idempotency_ttl = static_cast<uint32_t>(idempotency_.ttl().total_seconds());
+        rec.collapse_key = req.collapse_key;
+        
+        if(scheduled)
+        {
+            LOG_DEBUG << "message is scheduled to be sent at " << req.send_at;
+            rec.send_at = req.send_at;
+        }
+        
+        bool created = false;
         
         // find out if it's apns or gcm, or maybe does not exist
-        auto type = dba::instance().get_device_type(dev_uuid);
-        if(type == push_type_apns)
+        auto device = dba::instance().get_device(req.dev_uuid);
+        rec.app = device.app;
+        
+        if(device.type == push_type_apns)
         {
-            if(!apns_)
+            if(!serves(push_type_apns, device.app))
             {
-                LOG_ERROR << "APNS device detected but APNS push service is not setup properly.";
-                throw std::runtime_error("APNS is not setup properly. unable to send.");
+                LOG_ERROR << "APNS device of app '" << device.app << "' detected but APNS push service is not setup for it.";
+                throw std::runtime_error("APNS is not setup properly for app '" + device.app + "'. unable to send.");
             }
             
             LOG_DEBUG << "APNS device detected. pushing thru apns.";
             
             apns_message push_msg;
-            push_msg.alert = msg;
+            push_msg.alert = req.msg;
             
-            auto payload = push_msg.to_json();
-            auto uuid = dba::instance().write_apns_push(dev_uuid, payload, tag);
-            auto dev = dba::instance().get_apns_device(dev_uuid);
+            rec.type = push_type_apns;
+            rec.payload = push_msg.to_json();
             
-            int32_t ident = apns_identifier_++;
-
-            // cache this identifier mapped to uuid of message
-            // TODO: this is not safe in multithreaded env?
-            apns_cache_[ident] = uuid;
-            apns_->post(dev, payload, 0, ident);
-            
-            return uuid;
+            uuid = dba::instance().write_push(req.dev_uuid, rec, created);
+            if(created && !scheduled)
+            {
+                auto dev = dba::make_device(push_type_apns, device.token);
+                
+                int32_t ident = apns_identifier_++;
+                enqueue_post(new_entry(uuid, req.dev_uuid, rec), dev, rec.payload, ident);
+            }
         }
-        else if(type == push_type_gcm)
+        else if(device.type == push_type_gcm)
         {
-            if(!gcm_)
+            if(!serves(push_type_gcm, device.app))
             {
-                LOG_ERROR << "GCM device detected but GCM push service is not setup properly.";
-                throw std::runtime_error("GCM is not setup properly. unable to send.");
+                LOG_ERROR << "GCM device of app '" << device.app << "' detected but GCM push service is not setup for it.";
+                throw std::runtime_error("GCM is not setup properly for app '" + device.app + "'. unable to send.");
             }
             
             LOG_DEBUG << "GCM device detected. pushing thru gcm.";
             int32_t ident = gcm_identifier_++;
             
             gcm_message push_msg(ident);
-            push_msg.add("msg", msg);
+            push_msg.add("msg", req.msg);
             
-            auto dev = dba::instance().get_gcm_device(dev_uuid);
+            auto dev = dba::make_device(push_type_gcm, device.token);
             
             push_msg.add_reg_id(dev.token);
-            auto payload = push_msg.to_json();
-            auto uuid = dba::instance().write_gcm_push(dev_uuid, payload, tag);
             
-            // cache this identifier mapped to uuid of message
-            // TODO: this is not safe in multithreaded env?
-            gcm_cache_[ident] = uuid;
-
-            gcm_->post(dev, payload, 0, ident);
+            rec.type = push_type_gcm;
+            rec.payload = push_msg.to_json();
             
-            return uuid;
+            uuid = dba::instance().write_push(req.dev_uuid, rec, created);
+            if(created && !scheduled)
+            {
+                enqueue_post(new_entry(uuid, req.dev_uuid, rec), dev, rec.payload, ident);
+            }
+        }
+        else
+        {
+            throw std::runtime_error("requested to push for unknown device type");
         }
         
-        throw std::runtime_error("requested to push for unknown device type");
+        if(!req.idempotency_key.empty())
+        {
+            if(!created)
+            {
+                LOG_INFO << "idempotency key '" << req.idempotency_key << "' already used for message "
+                    << to_string(uuid) << ". not sending again.";
+            }
+            
+            idempotency_.insert(req.idempotency_key, uuid);
+        }
+        
+        return uuid;
     }
     
-    void pushy_service::redeliver(boost::uuids::uuid& msg_uuid,
-                                  boost::uuids::uuid& dev_uuid,
-                                  const push_type& type)
+    void pushy_service::redeliver(const dba::msg_entry& m)
     {
+        auto msg_uuid = m.msg_uuid;
+        auto dev_uuid = m.dev_uuid;
+        
+        inflight_limit::guard call(accepting_);
+        
+        if(draining_)
+        {
+            LOG_DEBUG << "shutting down. leaving " << to_string(msg_uuid) << " for redelivery by another node.";
+            throw overload_error("shutting down. try again on another node.",
+                                 overload_error::busy, retry_after_);
+        }
+        
+        // leave it in the failed set for a later round if we are saturated
+        if(!dispatcher_.has_capacity())
+        {
+            LOG_DEBUG << "dispatch queue is full. postponing redelivery of " << to_string(msg_uuid);
+            return;
+        }
+        
         // if remove_from_failed_messages returns false it means that
         // another node has taken this for redelivery, so we just skip it here.
         if(! dba::instance().remove_from_failed_messages(msg_uuid))
@@ -337,7 +1068,15 @@ namespace pushy
             return;
         }
         
-        if(type == push_type_apns)
+        if(known_dead(dev_uuid))
+        {
+            LOG_WARN << "device " << to_string(dev_uuid) << " of message "
+                << to_string(msg_uuid) << " is dead. dropping the message.";
+            dba::instance().drop_push_record(msg_uuid);
+            return;
+        }
+        
+        if(m.provider_type == push_type_apns)
         {
             LOG_DEBUG << "APNS message. pushing thru apns.";
             
@@ -345,13 +1084,9 @@ namespace pushy
             auto payload = dba::instance().get_message_payload(msg_uuid);
 
             int32_t ident = apns_identifier_++;
-            
-            // cache this identifier mapped to uuid of message
-            // TODO: this is not safe in multithreaded env?
-            apns_cache_[ident] = msg_uuid;
-            apns_->post(dev, payload, 0, ident);
+            enqueue_post(m, dev, payload, ident);
         }
-        else if(type == push_type_gcm)
+        else if(m.provider_type == push_type_gcm)
         {
             LOG_DEBUG << "GCM message. pushing thru gcm.";
 
@@ -359,11 +1094,125 @@ namespace pushy
             auto payload = dba::instance().get_message_payload(msg_uuid);
             
             int32_t ident = gcm_identifier_++;
+            enqueue_post(m, dev, payload, ident);
+        }
+    }
+    
+    void pushy_service::send(const dispatcher::job& j)
+    {
+        if(superseded(j))
+        {
+            dispatcher_.complete(j.type, j.app);
+            return;
+        }
+        
+        auto& pools = j.type == push_type_apns ? apns_ : gcm_;
+        
+        auto it = pools.find(j.app);
+        if(it == pools.end())
+        {
+            throw std::runtime_error(dba::type_to_str(j.type) + " is not setup for app '" + j.app + "'");
+        }
+        
+        it->second->post(j.dev, j.payload, j.ident);
+    }
+    
+    bool pushy_service::superseded(const dispatcher::job& j)
+    {
+        dba::msg_entry m;
+        
+        {
+            boost::mutex::scoped_lock lock(cache_mutex_);
+            
+            auto& cache = j.type == push_type_apns ? apns_cache_ : gcm_cache_;
+            auto it = cache.find(j.ident);
+            
+            // only messages with a collapse key can be superseded
+            if(it == cache.end() || it->second.collapse.empty())
+            {
+                return false;
+            }
             
-            // cache this identifier mapped to uuid of message
-            // TODO: this is not safe in multithreaded env?
-            gcm_cache_[ident] = msg_uuid;
-            gcm_->post(dev, payload, 0, ident);
+            m = it->second;
         }
+        
+        // a throttled backlog may hold a message for a long time after a newer one came in
+        if(!dba::instance().is_superseded(m) || !take_ident(j.type, j.ident, m))
+        {
+            return false;
+        }
+        
+        LOG_PUSH("superseded", m, "superseded while queued. not sending.");
+        return true;
+    }
+    
+    json_spirit::Object pushy_service::stats() const
+    {
+        json_spirit::Object obj;
+        
+        obj.push_back( json_spirit::Pair("draining", draining_.load()) );
+        obj.push_back( json_spirit::Pair("dispatch", dispatcher_.stats()) );
+        
+        json_spirit::Object pools;
+        
+        for(auto type : { push_type_apns, push_type_gcm })
+        {
+            json_spirit::Object apps;
+            
+            for(auto& entry : type == push_type_apns ? apns_ : gcm_)
+            {
+                apps.push_back( json_spirit::Pair(entry.first.empty() ? "default" : entry.first,
+                                                  entry.second->stats()) );
+            }
+            
+            pools.push_back( json_spirit::Pair(dba::type_to_str(type), apps) );
+        }
+        
+        obj.push_back( json_spirit::Pair("pools", pools) );
+        
+        json_spirit::Object redelivery, backlog;
+        
+        redelivery.push_back( json_spirit::Pair("enabled", redeliver_) );
+        redelivery.push_back( json_spirit::Pair("batch", static_cast<uint64_t>(redelivery_batch_)) );
+        redelivery.push_back( json_spirit::Pair("ticks", redelivery_ticks_.load()) );
+        redelivery.push_back( json_spirit::Pair("claimed", redelivery_claimed_.load()) );
+        redelivery.push_back( json_spirit::Pair("tick_duration", redelivery_tick_.to_json()) );
+        
+        {
+            boost::mutex::scoped_lock lock(redelivery_mutex_);
+            
+            for(auto type : { push_type_apns, push_type_gcm })
+            {
+                json_spirit::Object b;
+                
+                b.push_back( json_spirit::Pair("scheduled", redelivery_backlog_[type].scheduled) );
+                b.push_back( json_spirit::Pair("due", redelivery_backlog_[type].due) );
+                
+                backlog.push_back( json_spirit::Pair(dba::type_to_str(type), b) );
+            }
+        }
+        
+        redelivery.push_back( json_spirit::Pair("backlog", backlog) );
+        obj.push_back( json_spirit::Pair("redelivery", redelivery) );
+        obj.push_back( json_spirit::Pair("idempotency", idempotency_.stats()) );
+        
+        json_spirit::Object dead = dead_filter_.stats();
+        dead.push_back( json_spirit::Pair("skipped", dead_skipped_.load()) );
+        obj.push_back( json_spirit::Pair("dead_devices", dead) );
+        
+        json_spirit::Object schedule, pending;
+        
+        schedule.push_back( json_spirit::Pair("batch", static_cast<uint64_t>(schedule_batch_)) );
+        schedule.push_back( json_spirit::Pair("fired", scheduled_fired_.load()) );
+        
+        for(auto type : { push_type_apns, push_type_gcm })
+        {
+            pending.push_back( json_spirit::Pair(dba::type_to_str(type), scheduled_pending_[type].load()) );
+        }
+        
+        schedule.push_back( json_spirit::Pair("pending", pending) );
+        obj.push_back( json_spirit::Pair("schedule", schedule) );
+        
+        return obj;
     }
 }
@@ -9,86 +9,274 @@
 #ifndef pushy_pushy_service_hpp
 #define pushy_pushy_service_hpp
 
+#include <set>
+
 #include <boost/asio.hpp>
+#include <boost/thread.hpp>
 #include <boost/uuid/uuid.hpp>
 
 #include <push_service.hpp>
+#include <json_spirit/json_spirit_value.h>
+
 #include "database.hpp"
+#include "dispatcher.hpp"
+#include "backoff.hpp"
+#include "idempotency_cache.hpp"
+#include "dead_device_filter.hpp"
+#include "provider_pool.hpp"
+#include "apns_binary.hpp"
+#include "apns_feedback_poller.hpp"
+#include "apns_http2.hpp"
+#include "gcm_multicast.hpp"
+#include "app_config.hpp"
 
 namespace pushy
 {
     namespace io = boost::asio;
 
+    /**
+     * A message to push as received from the api
+     */
+    struct push_request
+    {
+        push_request()
+        : priority(database::push_priority_normal)
+        {
+        }
+        
+        boost::uuids::uuid          dev_uuid;
+        std::string                 msg;
+        std::string                 tag;
+        database::push_priority     priority;
+        std::string                 idempotency_key;
+        boost::posix_time::ptime    send_at; // not_a_date_time to send right away
+        std::string                 collapse_key;
+    };
+    
     /**
      * Pushy service
      */
     class pushy_service
     {
     public:
-        pushy_service(bool auto_redeliver, uint32_t auto_redeliver_attempts, bool auto_deregister)
+        pushy_service(bool auto_redeliver, uint32_t auto_redeliver_attempts, bool auto_deregister,
+                      const backoff& redelivery_backoff, uint32_t redelivery_interval_ms,
+                      uint32_t redelivery_batch, const dispatcher::config& dispatch_cfg,
+                      std::size_t idempotency_capacity, uint32_t idempotency_ttl,
+                      std::size_t dead_filter_capacity, double dead_filter_fp,
+                      uint32_t schedule_interval_ms, uint32_t schedule_batch,
+                      uint32_t drain_timeout)
         : ps_(io_)
         , work_(io_)
+        , dispatcher_(io_, dispatch_cfg, boost::bind(&pushy_service::send, this, _1))
         , apns_identifier_(0)
         , gcm_identifier_(0)
-        , redelivery_timer_(io_) 
         , redeliver_(auto_redeliver)
         , redeliver_attempts_(auto_redeliver_attempts)
         , deregister_(auto_deregister)
+        , backoff_(redelivery_backoff)
+        , redelivery_interval_ms_(redelivery_interval_ms)
+        , redelivery_batch_(redelivery_batch)
+        , redelivery_work_(redelivery_io_)
+        , redelivery_timer_(redelivery_io_)
+        , redelivery_ticks_(0)
+        , redelivery_claimed_(0)
+        , idempotency_(idempotency_capacity, boost::posix_time::seconds(idempotency_ttl))
+        , dead_filter_(dead_filter_capacity, dead_filter_fp)
+        , dead_skipped_(0)
+        , schedule_interval_ms_(schedule_interval_ms)
+        , schedule_batch_(schedule_batch)
+        , schedule_timer_(redelivery_io_)
+        , scheduled_fired_(0)
+        , drain_timeout_(drain_timeout)
+        , retry_after_(dispatch_cfg.retry_after)
+        , draining_(false)
+        , accepting_("accepting")
+        , signals_(io_, SIGINT, SIGTERM)
+        , drain_timer_(io_)
         {
+            if(!redelivery_batch_)
+            {
+                throw std::runtime_error("auto.batch must be greater than zero");
+            }
+            
+            if(!schedule_batch_)
+            {
+                throw std::runtime_error("schedule.batch must be greater than zero");
+            }
+            
+            for(auto& b : redelivery_backlog_)
+            {
+                b.scheduled = b.due = 0;
+            }
+            
+            for(auto& p : scheduled_pending_)
+            {
+                p = 0;
+            }
+            
             if(redeliver_)
             {
-                reset_redelivery_timer(5); // TODO: configurable?
+                reset_redelivery_timer();
             }
+            
+            reset_schedule_timer();
         }
         
-        void setup_apns(const std::string& mode,
-                        const std::string& p12_file,
-                        const std::string& password,
-                        int poolsize);
+        /// the default app is set up with an empty app id
+        void setup_apns(const std::string& app, const app_config& cfg);
+        void setup_gcm(const std::string& app, const app_config& cfg);
         
-        void setup_gcm(const std::string& gcm_project_id,
-                       const std::string& gcm_api_key,
-                       int poolsize);
+        /// true if the provider is set up for the given app
+        bool serves(const database::push_type& type, const std::string& app) const;
         
-        boost::uuids::uuid push(boost::uuids::uuid& dev_uuid, const std::string& msg, const std::string& tag);
-        void redeliver(boost::uuids::uuid& msg_uuid, boost::uuids::uuid& dev_uuid, const database::push_type& type);
+        /// returns the uuid of the new message, or of the original one for a repeated idempotency key
+        boost::uuids::uuid push(push_request& req);
+        
+        /// throws overload_error(busy) while draining so the caller retries on another node
+        void redeliver(const database::dba::msg_entry& m);
         
         void run();
         
+        /**
+         * Stops accepting messages, waits up to the drain timeout for the providers to
+         * acknowledge what was handed to them and hands everything left over to redelivery.
+         * run() returns afterwards. Triggered by SIGINT/SIGTERM.
+         */
+        void drain();
+        
+        /// runtime statistics for the json api
+        json_spirit::Object stats() const;
+        
     private:
         
+        // hands a dispatched job over to the provider plugin
+        void send(const dispatcher::job& j);
+        
+        // true (and the job is settled) if a newer message took over the job's collapse key while it was queued
+        bool superseded(const dispatcher::job& j);
+        
+        // create one single connection plugin instance for the provider pools
+        provider_pool::post_type make_apns(push::apns::config cfg, const provider_pool::callback_type& cb);
+        provider_pool::post_type make_apns_binary(apns_binary::config cfg, const provider_pool::callback_type& cb);
+#ifdef PUSHY_WITH_HTTP2
+        provider_pool::post_type make_apns_http2(apns_http2::config cfg, const provider_pool::callback_type& cb);
+#endif
+        provider_pool::post_type make_gcm(const std::string& project_id, const std::string& api_key,
+                                          const provider_pool::callback_type& cb);
+        provider_pool::post_type make_gcm_multicast(gcm_multicast::config cfg, const provider_pool::callback_type& cb);
+        
         // APNS handlers
         void on_apns(const boost::system::error_code& err, const uint32_t& ident);
+        void on_apns_written(const uint32_t& ident);
+        bool window_released(const uint32_t& ident);
         void on_apns_feed(const boost::system::error_code& err,
                           const std::string& token,
                           const boost::posix_time::ptime& time);
         
+        // drops the device or marks it dead, depending on auto.deregister
+        void retire_device(const database::push_type& type, boost::uuids::uuid uuid,
+                           const boost::posix_time::ptime& time);
+        
+        // fills the dead device filter from redis
+        void load_dead_devices();
+        
+        // true if the device is marked dead; redis is only asked for filter hits
+        bool known_dead(const boost::uuids::uuid& dev_uuid);
+        
         // GCM handlers
         void on_gcm(const boost::system::error_code& err, const uint32_t& ident);
         
-        void reset_redelivery_timer(uint32_t sec);
+        // records the failure and either schedules a retry or gives up on the message
+        void handle_failure(database::dba::msg_entry& m, const boost::system::error_code& err);
+        
+        // keeps the message entry under its ident until the provider reports back and queues it for dispatch
+        void enqueue_post(const database::dba::msg_entry& m, const push::device& dev,
+                          const std::string& payload, uint32_t ident);
+        bool take_ident(const database::push_type& type, uint32_t ident, database::dba::msg_entry& m);
+        
+        // redelivery runs on its own thread so it never stalls the delivery callbacks
+        void reset_redelivery_timer(bool immediately = false);
         void on_check_redelivery(const boost::system::error_code& err);
+        std::size_t redeliver_batch(const database::push_type& type);
+        
+        // scheduled messages are fired from the redelivery thread as well
+        void reset_schedule_timer(bool immediately = false);
+        void on_check_schedule(const boost::system::error_code& err);
+        std::size_t dispatch_scheduled(const database::push_type& type);
+        
+        // graceful shutdown
+        void on_signal(const boost::system::error_code& err, int signal_number);
+        void on_drain_tick(const boost::system::error_code& err);
+        void finish_drain();
+        std::size_t unacknowledged();
+        void take_queued();
         
         io::io_service          io_;
         push::push_service      ps_;
         io::io_service::work    work_;
+        dispatcher              dispatcher_;
+        
+        // plugins per app
+        typedef std::map<std::string, boost::shared_ptr<provider_pool> > pool_map;
         
-        // plugins
-        boost::shared_ptr<push::apns>           apns_;
-        boost::shared_ptr<push::apns_feedback>  apns_feedback_;
+        pool_map                                apns_;
+        std::map<std::string, boost::shared_ptr<push::apns_feedback> > apns_feedback_;
+        std::map<std::string, boost::shared_ptr<apns_feedback_poller> > apns_feedback_pollers_;
         std::atomic_int_fast32_t                apns_identifier_;
-        std::map<uint32_t, boost::uuids::uuid>  apns_cache_;
+        std::map<uint32_t, database::dba::msg_entry>    apns_cache_;
+        std::set<uint32_t>                      apns_written_;  // gave their dispatch window back on write
         
-        boost::shared_ptr<push::gcm>            gcm_;
+        pool_map                                gcm_;
         std::atomic_int_fast32_t                gcm_identifier_;
-        std::map<uint32_t, boost::uuids::uuid>  gcm_cache_;
+        std::map<uint32_t, database::dba::msg_entry>    gcm_cache_;
+        
+        // guards the ident caches which are used from api, redelivery and io threads
+        boost::mutex                            cache_mutex_;
         
         // automation
         bool        redeliver_;
         uint32_t    redeliver_attempts_;
         bool        deregister_;
+        backoff     backoff_;
+        uint32_t    redelivery_interval_ms_;
+        uint32_t    redelivery_batch_;
+        
+        io::io_service          redelivery_io_;
+        io::io_service::work    redelivery_work_;
+        io::deadline_timer      redelivery_timer_;
+        boost::thread           redelivery_thread_;
+        
+        // redelivery statistics
+        latency_histogram                   redelivery_tick_;
+        std::atomic<uint64_t>               redelivery_ticks_;
+        std::atomic<uint64_t>               redelivery_claimed_;
+        database::dba::redelivery_backlog   redelivery_backlog_[2]; // indexed by push_type
+        mutable boost::mutex                redelivery_mutex_;
+        
+        // recently seen idempotency keys
+        idempotency_cache                   idempotency_;
+        
+        // devices marked dead, so sends to them can be skipped
+        dead_device_filter                  dead_filter_;
+        std::atomic<uint64_t>               dead_skipped_;
+        
+        // scheduled (send_at) messages
+        uint32_t                            schedule_interval_ms_;
+        uint32_t                            schedule_batch_;
+        io::deadline_timer                  schedule_timer_;
+        std::atomic<uint64_t>               scheduled_fired_;
+        std::atomic<uint64_t>               scheduled_pending_[2]; // indexed by push_type
         
-        io::deadline_timer redelivery_timer_;
+        // graceful shutdown
+        uint32_t                                drain_timeout_;
+        uint32_t                                retry_after_;
+        std::atomic<bool>                       draining_;
+        inflight_limit                          accepting_;     // push and redeliver calls in progress
+        io::signal_set                          signals_;
+        io::deadline_timer                      drain_timer_;
+        boost::posix_time::ptime                drain_deadline_;
+        std::vector<database::dba::msg_entry>   drained_;
     };
 }
 
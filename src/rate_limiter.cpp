@@ -0,0 +1,143 @@
+//
+//  rate_limiter.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <boost/lexical_cast.hpp>
+
+using namespace boost::posix_time;
+
+namespace pushy
+{
+    token_bucket::token_bucket(double rate, double burst)
+    : rate_(rate)
+    , burst_(burst > 0 ? burst : std::max(rate, 1.0))
+    , tokens_(burst_)
+    , last_(microsec_clock::universal_time())
+    , granted_(0)
+    , throttled_(0)
+    {
+    }
+    
+    void token_bucket::refill(const ptime& now)
+    {
+        if(now <= last_)
+        {
+            return;
+        }
+        
+        double elapsed = (now - last_).total_microseconds() / 1000000.0;
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+        last_ = now;
+    }
+    
+    bool token_bucket::try_take(const ptime& now)
+    {
+        if(unlimited())
+        {
+            ++granted_;
+            return true;
+        }
+        
+        refill(now);
+        
+        if(tokens_ >= 1.0)
+        {
+            tokens_ -= 1.0;
+            ++granted_;
+            return true;
+        }
+        
+        ++throttled_;
+        return false;
+    }
+    
+    time_duration token_bucket::wait_time(const ptime& now)
+    {
+        if(unlimited())
+        {
+            return time_duration(0, 0, 0, 0);
+        }
+        
+        refill(now);
+        
+        if(tokens_ >= 1.0)
+        {
+            return time_duration(0, 0, 0, 0);
+        }
+        
+        return microseconds( static_cast<int64_t>( std::ceil((1.0 - tokens_) / rate_ * 1000000.0) ) );
+    }
+    
+    json_spirit::Object token_bucket::stats(const ptime& now) const
+    {
+        json_spirit::Object obj;
+        
+        if(unlimited())
+        {
+            obj.push_back( json_spirit::Pair("rate", "unlimited") );
+        }
+        else
+        {
+            double tokens = tokens_;
+            if(now > last_)
+            {
+                tokens = std::min(burst_, tokens + (now - last_).total_microseconds() / 1000000.0 * rate_);
+            }
+            
+            obj.push_back( json_spirit::Pair("rate", rate_) );
+            obj.push_back( json_spirit::Pair("burst", burst_) );
+            obj.push_back( json_spirit::Pair("tokens", tokens) );
+        }
+        
+        obj.push_back( json_spirit::Pair("granted", granted_) );
+        obj.push_back( json_spirit::Pair("throttled", throttled_) );
+        
+        return obj;
+    }
+    
+    token_bucket token_bucket::from_spec(const std::string& spec)
+    {
+        const std::string error = "invalid rate limit '" + spec + "'. expected rate[:burst]";
+        
+        auto pos = spec.find(':');
+        double rate = 0;
+        double burst = 1.0;
+        
+        try
+        {
+            rate = boost::lexical_cast<double>(spec.substr(0, pos));
+            
+            if(pos != std::string::npos)
+            {
+                burst = boost::lexical_cast<double>(spec.substr(pos + 1));
+            }
+        }
+        catch(boost::bad_lexical_cast&)
+        {
+            throw std::runtime_error(error);
+        }
+        
+        // a negative rate would read as unlimited, and a bucket holding
+        // less than one token would never grant anything
+        if(!(rate >= 0.0) || !(burst >= 1.0))
+        {
+            throw std::runtime_error(error);
+        }
+        
+        if(pos == std::string::npos)
+        {
+            return token_bucket(rate);
+        }
+        
+        return token_bucket(rate, burst);
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  rate_limiter.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__rate_limiter__
+#define __pushy__rate_limiter__
+
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+namespace pushy
+{
+    /**
+     * Classic token bucket. Tokens are refilled at 'rate' per second up to 'burst'.
+     * A rate of zero means unlimited. Not thread-safe; callers hold their own lock.
+     */
+    class token_bucket
+    {
+    public:
+        token_bucket(double rate = 0, double burst = 0);
+        
+        bool unlimited() const
+        {
+            return rate_ <= 0;
+        }
+        
+        /// takes one token if available
+        bool try_take(const boost::posix_time::ptime& now);
+        
+        /// time until the next token becomes available
+        boost::posix_time::time_duration wait_time(const boost::posix_time::ptime& now);
+        
+        /// counts a request held back after checking wait_time instead of try_take
+        void throttle()
+        {
+            ++throttled_;
+        }
+        
+        json_spirit::Object stats(const boost::posix_time::ptime& now) const;
+        
+        /**
+         * Parses "rate[:burst]". Burst defaults to one second worth of tokens.
+         */
+        static token_bucket from_spec(const std::string& spec);
+        
+    private:
+        void refill(const boost::posix_time::ptime& now);
+        
+        double                      rate_;
+        double                      burst_;
+        double                      tokens_;
+        boost::posix_time::ptime    last_;
+        uint64_t                    granted_;
+        uint64_t                    throttled_;
+    };
+}
+
+#endif /* defined(__pushy__rate_limiter__) */
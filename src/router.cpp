@@ -0,0 +1,165 @@
+//
+//  router.cpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "router.hpp"
+
+#include <stdexcept>
+
+namespace pushy
+{
+    namespace
+    {
+        // next non-empty segment of the path at or after pos; empty at the end
+        boost::string_ref next_segment(boost::string_ref path, std::size_t& pos)
+        {
+            while(pos < path.size() && path[pos] == '/')
+            {
+                ++pos;
+            }
+            
+            auto end = pos;
+            
+            while(end < path.size() && path[end] != '/')
+            {
+                ++end;
+            }
+            
+            auto segment = path.substr(pos, end - pos);
+            pos = end;
+            
+            return segment;
+        }
+    }
+    
+    router::router()
+    {
+    }
+    
+    void router::add(const std::string& method, const std::string& pattern, int id)
+    {
+        node* n = &root_;
+        std::size_t pos = 0;
+        
+        for(auto segment = next_segment(pattern, pos); !segment.empty(); segment = next_segment(pattern, pos))
+        {
+            if(segment.front() == '{' && segment.back() == '}')
+            {
+                if(!n->param)
+                {
+                    n->param.reset(new node);
+                }
+                
+                n = n->param.get();
+                continue;
+            }
+            
+            node* child = nullptr;
+            
+            for(auto& entry : n->children)
+            {
+                if(segment == entry.first)
+                {
+                    child = entry.second.get();
+                    break;
+                }
+            }
+            
+            if(!child)
+            {
+                n->children.push_back(std::make_pair(segment.to_string(), std::unique_ptr<node>(new node)));
+                child = n->children.back().second.get();
+            }
+            
+            n = child;
+        }
+        
+        for(auto r : n->routes)
+        {
+            if(r->method == method)
+            {
+                throw std::runtime_error("route '" + method + " " + pattern + "' is defined twice");
+            }
+        }
+        
+        routes_.push_back(std::unique_ptr<route>(new route(method, pattern, id)));
+        n->routes.push_back(routes_.back().get());
+    }
+    
+    router::result router::match(const std::string& method, boost::string_ref path,
+                                 route*& found, params& p) const
+    {
+        auto query = path.find('?');
+        
+        if(query != boost::string_ref::npos)
+        {
+            path = path.substr(0, query);
+        }
+        
+        const node* n = &root_;
+        std::size_t pos = 0;
+        
+        for(auto segment = next_segment(path, pos); !segment.empty(); segment = next_segment(path, pos))
+        {
+            const node* child = nullptr;
+            
+            // literal segments win over parameters
+            for(auto& entry : n->children)
+            {
+                if(segment == entry.first)
+                {
+                    child = entry.second.get();
+                    break;
+                }
+            }
+            
+            if(!child && n->param && p.count < max_params)
+            {
+                p.values[p.count++] = segment;
+                child = n->param.get();
+            }
+            
+            if(!child)
+            {
+                return not_found;
+            }
+            
+            n = child;
+        }
+        
+        if(n->routes.empty())
+        {
+            return not_found;
+        }
+        
+        for(auto r : n->routes)
+        {
+            if(r->method == method)
+            {
+                found = r;
+                return matched;
+            }
+        }
+        
+        return method_not_allowed;
+    }
+    
+    json_spirit::Object router::stats() const
+    {
+        json_spirit::Object obj;
+        
+        for(auto& r : routes_)
+        {
+            auto route_obj = r->latency.to_json();
+            route_obj.push_back( json_spirit::Pair("errors", r->errors.load()) );
+            
+            obj.push_back( json_spirit::Pair(r->name, route_obj) );
+        }
+        
+        return obj;
+    }
+}
@@ -0,0 +1,100 @@
+//
+//  router.hpp
+//  pushy
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy__router__
+#define __pushy__router__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include <json_spirit/json_spirit_value.h>
+
+#include "metrics.hpp"
+
+namespace pushy
+{
+    /**
+     * Route table of the JSON API. Routes are added at startup as a method and a
+     * pattern such as "/message/{uuid}" and kept in a trie of path segments.
+     * Matching walks the trie without allocating; path parameters refer into the
+     * matched path.
+     */
+    class router
+    {
+    public:
+        static const std::size_t max_params = 4;
+        
+        struct route
+        {
+            route(const std::string& m, const std::string& pattern, int i)
+            : method(m)
+            , name(m + " " + pattern)
+            , id(i)
+            , errors(0)
+            {
+            }
+            
+            std::string             method;
+            std::string             name;   // "POST /send"
+            int                     id;
+            
+            latency_histogram       latency;
+            std::atomic<uint64_t>   errors;
+        };
+        
+        struct params
+        {
+            params()
+            : count(0)
+            {
+            }
+            
+            std::string str(std::size_t i) const
+            {
+                return i < count ? values[i].to_string() : std::string();
+            }
+            
+            boost::string_ref   values[max_params];
+            std::size_t         count;
+        };
+        
+        enum result
+        {
+            matched,
+            not_found,
+            method_not_allowed
+        };
+        
+        router();
+        
+        /// throws if the method and pattern are routed already
+        void add(const std::string& method, const std::string& pattern, int id);
+        
+        /// finds the route of the method and path; a query string is ignored
+        result match(const std::string& method, boost::string_ref path,
+                     route*& found, params& p) const;
+        
+        /// latency and errors of every route
+        json_spirit::Object stats() const;
+    
+    private:
+        struct node
+        {
+            std::vector<std::pair<std::string, std::unique_ptr<node> > >    children;
+            std::unique_ptr<node>   param;  // any segment, captured
+            std::vector<route*>     routes; // one per method
+        };
+        
+        node                                    root_;
+        std::vector<std::unique_ptr<route> >    routes_;
+    };
+}
+
+#endif /* defined(__pushy__router__) */
@@ -0,0 +1,560 @@
+//
+//  main.cpp
+//  apns-http2-standin
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+//  Local stand-in for the APNS HTTP/2 provider api. Accepts any client, answers every
+//  request after a configurable latency with 200 or one of the errors apple sends.
+//  Point pushy at it with apns.protocol=http2, apns.host=127.0.0.1:<port>
+//  and apns.verify=false.
+//
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/program_options.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <openssl/ssl.h>
+#include <nghttp2/nghttp2.h>
+
+namespace po = boost::program_options;
+namespace io = boost::asio;
+
+typedef io::ssl::stream<io::ip::tcp::socket> ssl_socket;
+
+struct settings
+{
+    uint32_t    streams;
+    uint32_t    latency_ms;
+    double      unregistered;   // share of requests answered 410 Unregistered
+    double      bad_token;      // share of requests answered 400 BadDeviceToken
+    double      failures;       // share of requests answered 500
+};
+
+struct counters
+{
+    counters()
+    : requests(0)
+    , ok(0)
+    , errors(0)
+    {
+    }
+    
+    uint64_t requests;
+    uint64_t ok;
+    uint64_t errors;
+};
+
+class session
+: public boost::enable_shared_from_this<session>
+{
+public:
+    session(io::io_service& io, io::ssl::context& ctx, const settings& cfg, counters& stats)
+    : io_(io)
+    , socket_(io, ctx)
+    , cfg_(cfg)
+    , stats_(stats)
+    , session_(NULL)
+    , writing_(false)
+    , rng_(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)))
+    {
+    }
+    
+    ~session()
+    {
+        if(session_)
+        {
+            nghttp2_session_del(session_);
+        }
+    }
+    
+    ssl_socket& socket()
+    {
+        return socket_;
+    }
+    
+    void start()
+    {
+        socket_.async_handshake(ssl_socket::server,
+            boost::bind(&session::on_handshake, shared_from_this(), io::placeholders::error) );
+    }
+    
+private:
+    struct stream
+    {
+        stream()
+        : offset(0)
+        {
+        }
+        
+        std::string method;
+        std::string path;
+        std::string status;
+        std::string apns_id;
+        std::string body;
+        std::size_t offset;
+        boost::shared_ptr<io::deadline_timer> timer;
+    };
+    
+    typedef boost::shared_ptr<stream> stream_ptr;
+    
+    void on_handshake(const boost::system::error_code& err)
+    {
+        if(err)
+        {
+            std::cerr << "tls handshake failed: " << err.message() << "\n";
+            return;
+        }
+        
+        nghttp2_session_callbacks* callbacks;
+        nghttp2_session_callbacks_new(&callbacks);
+        nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &session::on_begin_headers);
+        nghttp2_session_callbacks_set_on_header_callback(callbacks, &session::on_header);
+        nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &session::on_frame_recv);
+        nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &session::on_stream_close);
+        
+        nghttp2_session_server_new(&session_, callbacks, this);
+        nghttp2_session_callbacks_del(callbacks);
+        
+        nghttp2_settings_entry settings[] = {
+            { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, cfg_.streams }
+        };
+        nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, settings, 1);
+        
+        read();
+        flush();
+    }
+    
+    void read()
+    {
+        socket_.async_read_some(io::buffer(read_buf_),
+            boost::bind(&session::on_read, shared_from_this(),
+                io::placeholders::error, io::placeholders::bytes_transferred) );
+    }
+    
+    void on_read(const boost::system::error_code& err, std::size_t bytes)
+    {
+        if(err)
+        {
+            close();
+            return;
+        }
+        
+        if(nghttp2_session_mem_recv(session_, read_buf_.data(), bytes) < 0)
+        {
+            close();
+            return;
+        }
+        
+        flush();
+        read();
+    }
+    
+    void flush()
+    {
+        if(writing_ || !session_)
+        {
+            return;
+        }
+        
+        write_buf_.clear();
+        
+        for(;;)
+        {
+            const uint8_t* data = NULL;
+            auto len = nghttp2_session_mem_send(session_, &data);
+            
+            if(len <= 0)
+            {
+                break;
+            }
+            
+            write_buf_.insert(write_buf_.end(), data, data + len);
+        }
+        
+        if(write_buf_.empty())
+        {
+            return;
+        }
+        
+        writing_ = true;
+        io::async_write(socket_, io::buffer(write_buf_),
+            boost::bind(&session::on_write, shared_from_this(), io::placeholders::error) );
+    }
+    
+    void on_write(const boost::system::error_code& err)
+    {
+        writing_ = false;
+        
+        if(err)
+        {
+            close();
+            return;
+        }
+        
+        flush();
+    }
+    
+    void close()
+    {
+        boost::system::error_code ignored;
+        socket_.lowest_layer().close(ignored);
+        
+        for(auto& entry : streams_)
+        {
+            if(entry.second->timer)
+            {
+                entry.second->timer->cancel();
+            }
+        }
+    }
+    
+    // picks the reply for a complete request
+    void decide(stream& s)
+    {
+        ++stats_.requests;
+        s.apns_id = "00000000-0000-0000-0000-" + std::to_string(100000000000ULL + stats_.requests);
+        
+        static const std::string prefix("/3/device/");
+        auto token = s.path.substr(0, prefix.size()) == prefix ? s.path.substr(prefix.size()) : std::string();
+        auto dice = dist_(rng_);
+        
+        if(s.method != "POST")
+        {
+            reply_error(s, "405", "MethodNotAllowed");
+        }
+        else if(token.size() != 64 || token.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+        {
+            reply_error(s, "400", "BadDeviceToken");
+        }
+        else if(dice < cfg_.unregistered)
+        {
+            reply_error(s, "410", "Unregistered");
+        }
+        else if(dice < cfg_.unregistered + cfg_.bad_token)
+        {
+            reply_error(s, "400", "BadDeviceToken");
+        }
+        else if(dice < cfg_.unregistered + cfg_.bad_token + cfg_.failures)
+        {
+            reply_error(s, "500", "InternalServerError");
+        }
+        else
+        {
+            ++stats_.ok;
+            s.status = "200";
+        }
+    }
+    
+    void reply_error(stream& s, const std::string& status, const std::string& reason)
+    {
+        ++stats_.errors;
+        s.status = status;
+        s.body = "{\"reason\":\"" + reason + "\"}";
+    }
+    
+    void respond(int32_t stream_id)
+    {
+        auto it = streams_.find(stream_id);
+        if(it == streams_.end() || !session_)
+        {
+            return;
+        }
+        
+        auto& s = *it->second;
+        
+        static const std::string status(":status"), apns_id("apns-id");
+        nghttp2_nv headers[] = {
+            nv(status, s.status),
+            nv(apns_id, s.apns_id)
+        };
+        
+        nghttp2_data_provider body;
+        body.source.ptr = &s;
+        body.read_callback = &session::read_body;
+        
+        nghttp2_submit_response(session_, stream_id, headers, 2, s.body.empty() ? NULL : &body);
+    }
+    
+    void on_latency(int32_t stream_id, const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            respond(stream_id);
+            flush();
+        }
+    }
+    
+    static nghttp2_nv nv(const std::string& name, const std::string& value)
+    {
+        nghttp2_nv res;
+        
+        res.name = (uint8_t*)name.data();
+        res.namelen = name.size();
+        res.value = (uint8_t*)value.data();
+        res.valuelen = value.size();
+        res.flags = NGHTTP2_NV_FLAG_NONE;
+        
+        return res;
+    }
+    
+    /*
+     * nghttp2 callbacks
+     */
+    static ssize_t read_body(nghttp2_session*, int32_t, uint8_t* buf, size_t length,
+                             uint32_t* data_flags, nghttp2_data_source* source, void*)
+    {
+        auto s = static_cast<stream*>(source->ptr);
+        auto len = std::min(length, s->body.size() - s->offset);
+        
+        std::memcpy(buf, s->body.data() + s->offset, len);
+        s->offset += len;
+        
+        if(s->offset == s->body.size())
+        {
+            *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+        
+        return len;
+    }
+    
+    static int on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+    {
+        if(frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST)
+        {
+            auto self = static_cast<session*>(user_data);
+            self->streams_[frame->hd.stream_id] = stream_ptr(new stream);
+        }
+        
+        return 0;
+    }
+    
+    static int on_header(nghttp2_session*, const nghttp2_frame* frame,
+                         const uint8_t* name, size_t namelen,
+                         const uint8_t* value, size_t valuelen, uint8_t, void* user_data)
+    {
+        auto self = static_cast<session*>(user_data);
+        auto it = self->streams_.find(frame->hd.stream_id);
+        
+        if(it == self->streams_.end())
+        {
+            return 0;
+        }
+        
+        std::string key((const char*)name, namelen);
+        
+        if(key == ":method")
+        {
+            it->second->method.assign((const char*)value, valuelen);
+        }
+        else if(key == ":path")
+        {
+            it->second->path.assign((const char*)value, valuelen);
+        }
+        
+        return 0;
+    }
+    
+    static int on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+    {
+        if((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA)
+           || !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM))
+        {
+            return 0;
+        }
+        
+        // the whole request is in
+        auto self = static_cast<session*>(user_data);
+        auto it = self->streams_.find(frame->hd.stream_id);
+        
+        if(it == self->streams_.end())
+        {
+            return 0;
+        }
+        
+        self->decide(*it->second);
+        
+        if(!self->cfg_.latency_ms)
+        {
+            self->respond(frame->hd.stream_id);
+            return 0;
+        }
+        
+        it->second->timer.reset(new io::deadline_timer(self->io_));
+        it->second->timer->expires_from_now(boost::posix_time::milliseconds(self->cfg_.latency_ms));
+        it->second->timer->async_wait(
+            boost::bind(&session::on_latency, self->shared_from_this(), frame->hd.stream_id,
+                io::placeholders::error) );
+        
+        return 0;
+    }
+    
+    static int on_stream_close(nghttp2_session*, int32_t stream_id, uint32_t, void* user_data)
+    {
+        auto self = static_cast<session*>(user_data);
+        self->streams_.erase(stream_id);
+        
+        return 0;
+    }
+    
+    io::io_service&                 io_;
+    ssl_socket                      socket_;
+    const settings&                 cfg_;
+    counters&                       stats_;
+    nghttp2_session*                session_;
+    
+    std::map<int32_t, stream_ptr>   streams_;
+    std::vector<uint8_t>            write_buf_;
+    boost::array<uint8_t, 16384>    read_buf_;
+    bool                            writing_;
+    
+    boost::random::mt19937                      rng_;
+    boost::random::uniform_real_distribution<>  dist_;
+};
+
+class server
+{
+public:
+    server(io::io_service& io, const std::string& port, io::ssl::context& ctx, const settings& cfg)
+    : io_(io)
+    , ctx_(ctx)
+    , cfg_(cfg)
+    , acceptor_(io, io::ip::tcp::endpoint(io::ip::tcp::v4(), std::stoi(port)))
+    , timer_(io)
+    , last_(0)
+    {
+        accept();
+        report();
+    }
+    
+private:
+    void accept()
+    {
+        boost::shared_ptr<session> s(new session(io_, ctx_, cfg_, stats_));
+        
+        acceptor_.async_accept(s->socket().lowest_layer(),
+            boost::bind(&server::on_accept, this, s, io::placeholders::error) );
+    }
+    
+    void on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            s->socket().lowest_layer().set_option(io::ip::tcp::no_delay(true));
+            s->start();
+        }
+        
+        accept();
+    }
+    
+    // requests per second, once a second while there is traffic
+    void report()
+    {
+        if(stats_.requests != last_)
+        {
+            std::cout << (stats_.requests - last_) << " req/s, total " << stats_.requests
+                << " (" << stats_.ok << " ok, " << stats_.errors << " errors)" << std::endl;
+            
+            last_ = stats_.requests;
+        }
+        
+        timer_.expires_from_now(boost::posix_time::seconds(1));
+        timer_.async_wait(boost::bind(&server::report, this));
+    }
+    
+    io::io_service&             io_;
+    io::ssl::context&           ctx_;
+    const settings&             cfg_;
+    io::ip::tcp::acceptor       acceptor_;
+    io::deadline_timer          timer_;
+    counters                    stats_;
+    uint64_t                    last_;
+};
+
+// only clients offering h2 are served
+static int select_h2(SSL*, const unsigned char** out, unsigned char* outlen,
+                     const unsigned char* in, unsigned int inlen, void*)
+{
+    for(unsigned int i = 0; i < inlen; i += in[i] + 1)
+    {
+        if(in[i] == 2 && i + 2 < inlen && std::memcmp(in + i + 1, "h2", 2) == 0)
+        {
+            *out = in + i + 1;
+            *outlen = 2;
+            
+            return SSL_TLSEXT_ERR_OK;
+        }
+    }
+    
+    return SSL_TLSEXT_ERR_NOACK;
+}
+
+int main(int ac, char **av)
+try
+{
+    std::string port;
+    std::string cert;
+    std::string key;
+    settings cfg;
+    
+    po::options_description desc("APNS HTTP/2 stand-in options");
+    desc.add_options()
+        ("help,h", "produce help message")
+        ("port,p", po::value<std::string>(&port)->default_value("2197"), "port to listen on")
+        ("cert", po::value<std::string>(&cert)->required(), "server certificate chain (PEM)")
+        ("key", po::value<std::string>(&key)->required(), "server private key (PEM)")
+        ("streams", po::value<uint32_t>(&cfg.streams)->default_value(1000),
+            "max concurrent streams per connection announced to clients")
+        ("latency", po::value<uint32_t>(&cfg.latency_ms)->default_value(0),
+            "milliseconds before each reply")
+        ("unregistered", po::value<double>(&cfg.unregistered)->default_value(0),
+            "share of requests answered with 410 Unregistered (0..1)")
+        ("bad_token", po::value<double>(&cfg.bad_token)->default_value(0),
+            "share of requests answered with 400 BadDeviceToken (0..1)")
+        ("failures", po::value<double>(&cfg.failures)->default_value(0),
+            "share of requests answered with 500 (0..1)")
+    ;
+    
+    po::variables_map vm;
+    po::store(po::parse_command_line(ac, av, desc), vm);
+    
+    if(vm.count("help"))
+    {
+        std::cout << desc << "\n";
+        return 1;
+    }
+    
+    po::notify(vm);
+    
+    io::io_service io;
+    io::ssl::context ctx(io::ssl::context::sslv23_server);
+    
+    ctx.set_options(io::ssl::context::default_workarounds
+        | io::ssl::context::no_sslv2 | io::ssl::context::no_sslv3);
+    ctx.use_certificate_chain_file(cert);
+    ctx.use_private_key_file(key, io::ssl::context::pem);
+    
+    SSL_CTX_set_alpn_select_cb(ctx.native_handle(), &select_h2, NULL);
+    
+    server srv(io, port, ctx, cfg);
+    
+    std::cout << "apns http/2 stand-in listening on port " << port << "\n";
+    io.run();
+}
+catch(std::exception& e)
+{
+    std::cerr << "fatal: " << e.what() << "\n";
+    return 1;
+}
@@ -0,0 +1,148 @@
+//
+//  main.cpp
+//  pushy-ingest-bench
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+//  Pushes messages through pushy's binary ingest listener with a number of
+//  producer threads, each on its own connection, and reports the messages acked
+//  per second and how many of them pushy refused.
+//
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/string_generator.hpp>
+
+#include "ingest_client.hpp"
+
+namespace po = boost::program_options;
+using pushy::ingest_client;
+namespace ingest = pushy::ingest;
+
+namespace
+{
+    struct bench_config
+    {
+        std::string         host;
+        std::string         port;
+        std::string         unix_path;
+        uint32_t            messages;
+        uint32_t            window;
+        boost::uuids::uuid  device;
+        std::string         msg;
+    };
+    
+    std::atomic<uint64_t> acked(0);
+    std::atomic<uint64_t> refused(0);
+    
+    void producer(const bench_config& cfg, uint32_t messages)
+    try
+    {
+        boost::scoped_ptr<ingest_client> client(cfg.unix_path.empty()
+            ? new ingest_client(cfg.host, cfg.port)
+            : new ingest_client(cfg.unix_path));
+        
+        std::vector<ingest::send_frame> frames(std::min(messages, cfg.window));
+        std::vector<ingest::ack_frame> acks;
+        
+        for(auto& f : frames)
+        {
+            f.device = cfg.device;
+            f.msg = cfg.msg;
+            f.tag = "ingest-bench";
+        }
+        
+        for(uint32_t sent = 0; sent < messages; )
+        {
+            frames.resize(std::min<std::size_t>(frames.size(), messages - sent));
+            
+            for(auto& f : frames)
+            {
+                f.id = sent++;
+            }
+            
+            client->send(frames, acks, cfg.window);
+            
+            for(auto& ack : acks)
+            {
+                ++(ack.status == ingest::status_ok ? acked : refused);
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "producer failed: " << e.what() << std::endl;
+    }
+}
+
+int main(int ac, const char* av[])
+try
+{
+    bench_config cfg;
+    std::string device;
+    uint32_t producers;
+    
+    po::options_description desc("pushy-ingest-bench");
+    desc.add_options()
+        ("help,h", "show help")
+        ("host", po::value<std::string>(&cfg.host)->default_value("127.0.0.1"), "ingest host")
+        ("port,p", po::value<std::string>(&cfg.port)->default_value("7447"), "ingest tcp port")
+        ("unix,u", po::value<std::string>(&cfg.unix_path)->default_value(""), "ingest unix socket (instead of tcp)")
+        ("device,d", po::value<std::string>(&device), "uuid of a registered device to push to")
+        ("messages,n", po::value<uint32_t>(&cfg.messages)->default_value(100000), "messages to send in total")
+        ("producers,c", po::value<uint32_t>(&producers)->default_value(4), "producer threads, one connection each")
+        ("window,w", po::value<uint32_t>(&cfg.window)->default_value(512), "frames sent before reading their acks")
+        ("msg,m", po::value<std::string>(&cfg.msg)->default_value("{\"aps\":{\"alert\":\"ingest bench\"}}"), "payload")
+    ;
+    
+    po::variables_map vm;
+    po::store(po::parse_command_line(ac, av, desc), vm);
+    po::notify(vm);
+    
+    if(vm.count("help") || device.empty())
+    {
+        std::cout << desc << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+    
+    cfg.device = boost::uuids::string_generator()(device);
+    cfg.window = std::max(1u, cfg.window);
+    producers = std::max(1u, producers);
+    
+    auto start = boost::posix_time::microsec_clock::universal_time();
+    
+    boost::thread_group threads;
+    
+    for(uint32_t i = 0; i < producers; ++i)
+    {
+        uint32_t share = cfg.messages / producers + (i < cfg.messages % producers ? 1 : 0);
+        threads.add_thread( new boost::thread( boost::bind(&producer, boost::cref(cfg), share) ) );
+    }
+    
+    threads.join_all();
+    
+    auto usec = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+    double secs = std::max<int64_t>(usec, 1) / 1e6;
+    
+    std::cout << std::fixed << std::setprecision(1)
+        << acked << " acked, " << refused << " refused in " << secs << " s: "
+        << (acked + refused) / secs << " msgs/s" << std::endl;
+    
+    return 0;
+}
+catch(std::exception& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,345 @@
+//
+//  main.cpp
+//  pushy-json-bench
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+//  Compares json_spirit with pushy's json_reader on API request bodies: a /send
+//  object and /redeliver style uuid arrays. Both sides extract the same fields the
+//  api handler needs; the results are checked to match before timing. Replies of
+//  /list are written with both json_spirit and json_writer the same way.
+//
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/string_generator.hpp>
+
+#include <json_spirit/json_spirit_reader_template.h>
+#include <json_spirit/json_spirit_writer_template.h>
+
+#include "json_reader.hpp"
+#include "json_writer.hpp"
+
+namespace po = boost::program_options;
+using pushy::json_reader;
+using pushy::json_writer;
+
+namespace
+{
+    struct send_fields
+    {
+        boost::uuids::uuid  uuid;
+        std::string         msg;
+        std::string         tag;
+        std::string         priority;
+        int64_t             send_at;
+    };
+    
+    void spirit_send(const std::string& body, send_fields& out)
+    {
+        json_spirit::Value input;
+        
+        if(!json_spirit::read_string(body, input) || input.type() != json_spirit::obj_type)
+        {
+            throw std::runtime_error("json_spirit failed on the send body");
+        }
+        
+        boost::uuids::string_generator str_gen;
+        
+        // the way api_service read /send bodies
+        for(auto entry : input.get_obj())
+        {
+            if(entry.name_ == "uuid")
+            {
+                out.uuid = str_gen(entry.value_.get_str());
+            }
+            else if(entry.name_ == "msg")
+            {
+                out.msg = entry.value_.get_str();
+            }
+            else if(entry.name_ == "tag")
+            {
+                out.tag = entry.value_.get_str();
+            }
+            else if(entry.name_ == "priority")
+            {
+                out.priority = entry.value_.get_str();
+            }
+            else if(entry.name_ == "send_at")
+            {
+                out.send_at = entry.value_.get_int64();
+            }
+        }
+    }
+    
+    void reader_send(const std::string& body, send_fields& out)
+    {
+        json_reader reader(body);
+        boost::uuids::string_generator str_gen;
+        
+        reader.next();
+        
+        while(reader.next() == json_reader::token_key)
+        {
+            auto key = reader.text();
+            
+            if(key == "uuid")
+            {
+                reader.next();
+                out.uuid = str_gen(reader.text().begin(), reader.text().end());
+            }
+            else if(key == "msg")
+            {
+                reader.next();
+                out.msg = reader.text().to_string();
+            }
+            else if(key == "tag")
+            {
+                reader.next();
+                out.tag = reader.text().to_string();
+            }
+            else if(key == "priority")
+            {
+                reader.next();
+                out.priority = reader.text().to_string();
+            }
+            else if(key == "send_at")
+            {
+                reader.next();
+                out.send_at = reader.get_int64();
+            }
+            else
+            {
+                reader.skip();
+            }
+        }
+        
+        reader.next();
+    }
+    
+    void spirit_uuids(const std::string& body, std::vector<boost::uuids::uuid>& out)
+    {
+        json_spirit::Value input;
+        
+        if(!json_spirit::read_string(body, input) || input.type() != json_spirit::array_type)
+        {
+            throw std::runtime_error("json_spirit failed on the uuid array");
+        }
+        
+        boost::uuids::string_generator str_gen;
+        
+        for(auto entry : input.get_array())
+        {
+            out.push_back( str_gen(entry.get_str()) );
+        }
+    }
+    
+    void reader_uuids(const std::string& body, std::vector<boost::uuids::uuid>& out)
+    {
+        json_reader reader(body);
+        boost::uuids::string_generator str_gen;
+        
+        reader.next();
+        
+        while(reader.next() == json_reader::token_string)
+        {
+            out.push_back( str_gen(reader.text().begin(), reader.text().end()) );
+        }
+        
+        reader.next();
+    }
+    
+    struct failed_row
+    {
+        boost::uuids::uuid  msg_uuid;
+        boost::uuids::uuid  dev_uuid;
+        std::string         reason;
+    };
+    
+    void spirit_list(const std::vector<failed_row>& rows, std::string& out)
+    {
+        json_spirit::Array arr;
+        
+        for(auto& row : rows)
+        {
+            json_spirit::Object obj;
+            
+            obj.push_back( json_spirit::Pair("uuid", to_string(row.msg_uuid)) );
+            obj.push_back( json_spirit::Pair("device", to_string(row.dev_uuid)) );
+            obj.push_back( json_spirit::Pair("msg", row.reason) );
+            
+            arr.push_back(obj);
+        }
+        
+        out = json_spirit::write_string( json_spirit::Value(arr), false );
+    }
+    
+    void writer_list(const std::vector<failed_row>& rows, std::string& out)
+    {
+        out.clear();
+        json_writer w(out);
+        
+        w.begin_array();
+        
+        for(auto& row : rows)
+        {
+            w.begin_object()
+                .member("uuid", row.msg_uuid)
+                .member("device", row.dev_uuid)
+                .member("msg", row.reason)
+                .end_object();
+        }
+        
+        w.end_array();
+    }
+    
+    typedef void (*list_writer)(const std::vector<failed_row>&, std::string&);
+    
+    void run_list(list_writer write, const std::vector<failed_row>& rows, std::string& out)
+    {
+        write(rows, out);
+    }
+    
+    typedef void (*send_parser)(const std::string&, send_fields&);
+    typedef void (*uuids_parser)(const std::string&, std::vector<boost::uuids::uuid>&);
+    
+    void run_send(send_parser parse, const std::string& body)
+    {
+        send_fields fields;
+        parse(body, fields);
+    }
+    
+    void run_uuids(uuids_parser parse, const std::string& body)
+    {
+        std::vector<boost::uuids::uuid> uuids;
+        parse(body, uuids);
+    }
+    
+    void measure(const std::string& name, const std::string& body, uint32_t rounds, boost::function<void()> f)
+    {
+        auto start = boost::posix_time::microsec_clock::universal_time();
+        
+        for(uint32_t i = 0; i < rounds; ++i)
+        {
+            f();
+        }
+        
+        auto usec = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+        double secs = usec / 1e6;
+        
+        std::cout << "  " << std::left << std::setw(12) << name << std::right
+            << std::setw(10) << std::fixed << std::setprecision(2) << double(usec) / rounds << " us/body "
+            << std::setw(10) << std::setprecision(1) << (body.size() * double(rounds) / secs / (1024 * 1024)) << " MB/s"
+            << std::endl;
+    }
+}
+
+int main(int ac, const char* av[])
+try
+{
+    uint32_t rounds;
+    uint32_t array_size;
+    
+    po::options_description desc("pushy-json-bench");
+    desc.add_options()
+        ("help,h", "show help")
+        ("rounds,r", po::value<uint32_t>(&rounds)->default_value(100000), "bodies parsed per measurement")
+        ("array,a", po::value<uint32_t>(&array_size)->default_value(1000), "uuids in the array body")
+    ;
+    
+    po::variables_map vm;
+    po::store(po::parse_command_line(ac, av, desc), vm);
+    po::notify(vm);
+    
+    if(vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    
+    boost::uuids::random_generator gen;
+    
+    std::string send_body = "{\"uuid\": \"" + to_string(gen()) + "\", "
+        "\"msg\": \"{\\\"aps\\\":{\\\"alert\\\":\\\"Your order has shipped\\\",\\\"badge\\\":1}}\", "
+        "\"tag\": \"campaign-2026-10\", \"priority\": \"high\", \"send_at\": 1792396800, "
+        "\"extra\": {\"ignored\": [1, 2.5, true, null]}}";
+    
+    std::string array_body = "[";
+    
+    for(uint32_t i = 0; i < array_size; ++i)
+    {
+        array_body += (i ? ", \"" : "\"") + to_string(gen()) + "\"";
+    }
+    
+    array_body += "]";
+    
+    // both must read the same values
+    send_fields a, b;
+    spirit_send(send_body, a);
+    reader_send(send_body, b);
+    
+    std::vector<boost::uuids::uuid> ua, ub;
+    spirit_uuids(array_body, ua);
+    reader_uuids(array_body, ub);
+    
+    if(a.uuid != b.uuid || a.msg != b.msg || a.tag != b.tag || a.priority != b.priority
+       || a.send_at != b.send_at || ua != ub)
+    {
+        std::cerr << "parsers disagree" << std::endl;
+        return 1;
+    }
+    
+    uint32_t array_rounds = std::max(1u, rounds / std::max(1u, array_size / 10));
+    
+    std::cout << "/send body, " << send_body.size() << " bytes:" << std::endl;
+    measure("json_spirit", send_body, rounds, boost::bind(&run_send, &spirit_send, boost::cref(send_body)));
+    measure("json_reader", send_body, rounds, boost::bind(&run_send, &reader_send, boost::cref(send_body)));
+    
+    std::vector<failed_row> rows(array_size);
+    
+    for(auto& row : rows)
+    {
+        row.msg_uuid = gen();
+        row.dev_uuid = gen();
+        row.reason = "BadDeviceToken";
+    }
+    
+    std::string spirit_out, writer_out;
+    spirit_list(rows, spirit_out);
+    writer_list(rows, writer_out);
+    
+    if(spirit_out != writer_out)
+    {
+        std::cerr << "writers disagree" << std::endl;
+        return 1;
+    }
+    
+    std::cout << "uuid array of " << array_size << ", " << array_body.size() << " bytes:" << std::endl;
+    measure("json_spirit", array_body, array_rounds, boost::bind(&run_uuids, &spirit_uuids, boost::cref(array_body)));
+    measure("json_reader", array_body, array_rounds, boost::bind(&run_uuids, &reader_uuids, boost::cref(array_body)));
+    
+    // the output buffer is reused between rounds like a worker's reply buffer
+    std::cout << "/list reply of " << array_size << " rows, " << writer_out.size() << " bytes:" << std::endl;
+    measure("json_spirit", writer_out, array_rounds,
+            boost::bind(&run_list, &spirit_list, boost::cref(rows), boost::ref(spirit_out)));
+    measure("json_writer", writer_out, array_rounds,
+            boost::bind(&run_list, &writer_list, boost::cref(rows), boost::ref(writer_out)));
+    
+    return 0;
+}
+catch(std::exception& e)
+{
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+}
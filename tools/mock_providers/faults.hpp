@@ -0,0 +1,197 @@
+//
+//  faults.hpp
+//  pushy-mock-providers
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy_mock__faults__
+#define __pushy_mock__faults__
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/random.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace mock
+{
+    typedef boost::random::mt19937 rng_type;
+    
+    /**
+     * Latency distribution given as a spec string, all values in milliseconds:
+     *   "5" or "fixed:5", "uniform:2:10", "normal:10:3" (mean, stddev),
+     *   "exp:5" (mean) and "pareto:2:1.5" (minimum, shape) for a long tail.
+     */
+    class latency
+    {
+    public:
+        enum kind
+        {
+            fixed,
+            uniform,
+            normal,
+            exponential,
+            pareto
+        };
+        
+        latency()
+        : kind_(fixed)
+        , a_(0)
+        , b_(0)
+        {
+        }
+        
+        static latency parse(const std::string& spec)
+        {
+            std::vector<std::string> parts;
+            boost::split(parts, spec, boost::is_any_of(":"));
+            
+            latency l;
+            
+            try
+            {
+                if(parts.size() == 1)
+                {
+                    l.a_ = boost::lexical_cast<double>(parts[0]);
+                }
+                else if(parts[0] == "fixed" && parts.size() == 2)
+                {
+                    l.a_ = boost::lexical_cast<double>(parts[1]);
+                }
+                else if(parts.size() == 3 && (parts[0] == "uniform" || parts[0] == "normal" || parts[0] == "pareto"))
+                {
+                    l.kind_ = parts[0] == "uniform" ? uniform : parts[0] == "normal" ? normal : pareto;
+                    l.a_ = boost::lexical_cast<double>(parts[1]);
+                    l.b_ = boost::lexical_cast<double>(parts[2]);
+                }
+                else if(parts[0] == "exp" && parts.size() == 2)
+                {
+                    l.kind_ = exponential;
+                    l.a_ = boost::lexical_cast<double>(parts[1]);
+                }
+                else
+                {
+                    throw std::runtime_error("unknown latency distribution");
+                }
+            }
+            catch(boost::bad_lexical_cast&)
+            {
+                throw std::runtime_error("bad latency spec '" + spec + "'");
+            }
+            
+            if(l.a_ < 0 || l.b_ < 0 || (l.kind_ == uniform && l.b_ < l.a_) || (l.kind_ == pareto && l.b_ <= 0))
+            {
+                throw std::runtime_error("bad latency spec '" + spec + "'");
+            }
+            
+            return l;
+        }
+        
+        /// one draw in milliseconds; never negative
+        double sample(rng_type& rng) const
+        {
+            double ms = a_;
+            
+            switch(kind_)
+            {
+                case fixed:
+                    break;
+                case uniform:
+                    ms = boost::random::uniform_real_distribution<>(a_, b_)(rng);
+                    break;
+                case normal:
+                    ms = boost::random::normal_distribution<>(a_, b_)(rng);
+                    break;
+                case exponential:
+                    ms = a_ > 0 ? boost::random::exponential_distribution<>(1.0 / a_)(rng) : 0;
+                    break;
+                case pareto:
+                    ms = a_ / std::pow(1.0 - boost::random::uniform_real_distribution<>()(rng), 1.0 / b_);
+                    break;
+            }
+            
+            return ms > 0 ? ms : 0;
+        }
+        
+        bool zero() const
+        {
+            return kind_ == fixed && a_ == 0;
+        }
+    
+    private:
+        kind    kind_;
+        double  a_;
+        double  b_;
+    };
+    
+    /**
+     * Token bucket allowing 'rate' units per second with a burst of one second's worth.
+     * A rate of 0 never throttles.
+     */
+    class throttle
+    {
+    public:
+        explicit throttle(uint32_t rate = 0)
+        : rate_(rate)
+        , tokens_(rate)
+        , last_(boost::posix_time::microsec_clock::universal_time())
+        {
+        }
+        
+        /// takes n units if available. more than a second's worth runs the bucket into debt
+        bool take(uint32_t n = 1)
+        {
+            if(!rate_)
+            {
+                return true;
+            }
+            
+            refill();
+            
+            if(tokens_ < std::min(n, rate_))
+            {
+                return false;
+            }
+            
+            tokens_ -= n;
+            return true;
+        }
+        
+        /// time until n units are available
+        boost::posix_time::time_duration wait(uint32_t n = 1)
+        {
+            refill();
+            
+            double missing = std::min(n, rate_) - tokens_;
+            if(missing < 0)
+            {
+                missing = 0;
+            }
+            
+            return boost::posix_time::microseconds(static_cast<int64_t>(missing * 1000000 / rate_) + 1);
+        }
+    
+    private:
+        void refill()
+        {
+            auto now = boost::posix_time::microsec_clock::universal_time();
+            
+            tokens_ += (now - last_).total_microseconds() * rate_ / 1000000.0;
+            tokens_ = std::min(tokens_, static_cast<double>(rate_));
+            last_ = now;
+        }
+        
+        uint32_t                    rate_;
+        double                      tokens_;
+        boost::posix_time::ptime    last_;
+    };
+}
+
+#endif /* defined(__pushy_mock__faults__) */
@@ -0,0 +1,223 @@
+//
+//  main.cpp
+//  pushy-mock-providers
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+//  Local APNS (binary gateway and feedback service) and GCM endpoints for load and
+//  fault testing without apple or google. Point pushy at it with
+//      apns.host = 127.0.0.1:2195
+//      apns.feedback_host = 127.0.0.1:2196
+//      apns.verify = false
+//      gcm.multicast = true
+//      gcm.url = http://127.0.0.1:8080/gcm/send
+//
+
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/program_options.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "mock_apns.hpp"
+#include "mock_gcm.hpp"
+
+namespace po = boost::program_options;
+namespace io = boost::asio;
+
+/**
+ * Prints what each endpoint did in the last second, once a second while there is traffic.
+ */
+class reporter
+{
+public:
+    reporter(io::io_service& io, const mock::apns_counters& apns, const mock::gcm_counters& gcm)
+    : timer_(io)
+    , apns_(apns)
+    , gcm_(gcm)
+    {
+        report();
+    }
+
+private:
+    void report()
+    {
+        if(apns_.frames != last_apns_.frames || apns_.feedback != last_apns_.feedback)
+        {
+            std::cout << "apns: " << (apns_.frames - last_apns_.frames) << " frames/s, total "
+                << apns_.frames << " frames, " << apns_.connections << " connections, "
+                << apns_.errors << " error responses, " << apns_.drops << " dropped, "
+                << apns_.feedback << " fed back" << std::endl;
+            
+            last_apns_ = apns_;
+        }
+        
+        if(gcm_.requests != last_gcm_.requests)
+        {
+            std::cout << "gcm: " << (gcm_.requests - last_gcm_.requests) << " req/s, "
+                << (gcm_.ids - last_gcm_.ids) << " ids/s, total " << gcm_.requests
+                << " requests, " << gcm_.ids << " ids, " << gcm_.errors << " failed, "
+                << gcm_.throttled << " throttled" << std::endl;
+            
+            last_gcm_ = gcm_;
+        }
+        
+        timer_.expires_from_now(boost::posix_time::seconds(1));
+        timer_.async_wait(boost::bind(&reporter::report, this));
+    }
+    
+    io::deadline_timer          timer_;
+    const mock::apns_counters&  apns_;
+    const mock::gcm_counters&   gcm_;
+    mock::apns_counters         last_apns_;
+    mock::gcm_counters          last_gcm_;
+};
+
+int main(int ac, char **av)
+try
+{
+    std::string config_file;
+    std::string cert;
+    std::string key;
+    unsigned short apns_port;
+    unsigned short feedback_port;
+    unsigned short gcm_port;
+    std::string apns_latency;
+    std::string gcm_latency;
+    std::string feedback_tokens;
+    
+    mock::apns_settings apns;
+    mock::gcm_settings gcm;
+    
+    po::options_description generic("Generic options");
+    generic.add_options()
+        ("help,h", "produce help message")
+        ("config,c", po::value<std::string>(&config_file), "config file with any of the options below")
+    ;
+    
+    po::options_description config("Mock provider options");
+    config.add_options()
+        ("cert", po::value<std::string>(&cert)->default_value("cert.pem"),
+            "pem certificate chain for the tls endpoints")
+        ("key", po::value<std::string>(&key)->default_value("key.pem"), "pem private key of the certificate")
+        
+        ("apns.port", po::value<unsigned short>(&apns_port)->default_value(2195),
+            "binary gateway port (0 to disable)")
+        ("apns.latency", po::value<std::string>(&apns_latency)->default_value("0"),
+            "ms before data read from a connection is processed: N, uniform:A:B, normal:MEAN:SD, exp:MEAN or pareto:MIN:SHAPE")
+        ("apns.rate", po::value<uint32_t>(&apns.rate)->default_value(0),
+            "frames per second per connection; reading stalls beyond it (0 for no limit)")
+        ("apns.invalid_token", po::value<double>(&apns.invalid_token)->default_value(0),
+            "share of frames answered with invalid token (0..1); the token is fed back and stays invalid")
+        ("apns.processing_error", po::value<double>(&apns.processing_error)->default_value(0),
+            "share of frames answered with processing error (0..1)")
+        ("apns.drop", po::value<double>(&apns.drop)->default_value(0),
+            "share of frames after which the connection is cut without an error response (0..1)")
+        
+        ("feedback.port", po::value<unsigned short>(&feedback_port)->default_value(2196),
+            "feedback service port (0 to disable)")
+        ("feedback.tokens", po::value<std::string>(&feedback_tokens),
+            "file with hex device tokens, one per line, reported by the first feedback connection")
+        ("feedback.retire", po::value<double>(&apns.retire)->default_value(0),
+            "share of delivered tokens reported by the feedback service afterwards (0..1)")
+        
+        ("gcm.port", po::value<unsigned short>(&gcm_port)->default_value(8080),
+            "gcm endpoint port (0 to disable)")
+        ("gcm.latency", po::value<std::string>(&gcm_latency)->default_value("0"),
+            "ms before each reply, same distributions as apns.latency")
+        ("gcm.rate", po::value<uint32_t>(&gcm.rate)->default_value(0),
+            "registration ids per second; requests beyond are answered with http 503 (0 for no limit)")
+        ("gcm.api_key", po::value<std::string>(&gcm.api_key), "reject requests without this api key")
+        ("gcm.not_registered", po::value<double>(&gcm.not_registered)->default_value(0),
+            "share of registration ids answered with NotRegistered (0..1); the id stays unregistered")
+        ("gcm.unavailable", po::value<double>(&gcm.unavailable)->default_value(0),
+            "share of registration ids answered with Unavailable (0..1)")
+        ("gcm.failures", po::value<double>(&gcm.failures)->default_value(0),
+            "share of requests answered with http 500 (0..1)")
+    ;
+    
+    po::options_description cmdline;
+    cmdline.add(generic).add(config);
+    
+    po::variables_map vm;
+    po::store(po::parse_command_line(ac, av, cmdline), vm);
+    po::notify(vm);
+    
+    if(vm.count("help"))
+    {
+        std::cout << cmdline << "\n";
+        return 1;
+    }
+    
+    if(!config_file.empty())
+    {
+        std::ifstream ifs(config_file.c_str());
+        if(!ifs)
+        {
+            std::cerr << "can't open config file: " << config_file << "\n";
+            return 1;
+        }
+        
+        // the command line wins over the file
+        po::store(po::parse_config_file(ifs, config), vm);
+        po::notify(vm);
+    }
+    
+    apns.delay = mock::latency::parse(apns_latency);
+    gcm.delay = mock::latency::parse(gcm_latency);
+    
+    io::io_service io;
+    
+    mock::feedback_store store;
+    mock::apns_counters apns_stats;
+    mock::gcm_counters gcm_stats;
+    
+    if(!feedback_tokens.empty())
+    {
+        std::cout << "injected " << store.inject(feedback_tokens) << " feedback tokens\n";
+    }
+    
+    io::ssl::context ctx(io::ssl::context::sslv23_server);
+    boost::scoped_ptr<mock::apns_server> apns_srv;
+    boost::scoped_ptr<mock::feedback_server> feedback_srv;
+    boost::scoped_ptr<mock::gcm_server> gcm_srv;
+    
+    if(apns_port || feedback_port)
+    {
+        ctx.set_options(io::ssl::context::default_workarounds
+            | io::ssl::context::no_sslv2 | io::ssl::context::no_sslv3);
+        ctx.use_certificate_chain_file(cert);
+        ctx.use_private_key_file(key, io::ssl::context::pem);
+    }
+    
+    if(apns_port)
+    {
+        apns_srv.reset(new mock::apns_server(io, apns_port, ctx, apns, store, apns_stats));
+        std::cout << "apns gateway listening on port " << apns_port << "\n";
+    }
+    
+    if(feedback_port)
+    {
+        feedback_srv.reset(new mock::feedback_server(io, feedback_port, ctx, store, apns_stats));
+        std::cout << "apns feedback listening on port " << feedback_port << "\n";
+    }
+    
+    if(gcm_port)
+    {
+        gcm_srv.reset(new mock::gcm_server(io, gcm_port, gcm, gcm_stats));
+        std::cout << "gcm listening on port " << gcm_port << "\n";
+    }
+    
+    reporter stats(io, apns_stats, gcm_stats);
+    io.run();
+}
+catch(std::exception& e)
+{
+    std::cerr << "fatal: " << e.what() << "\n";
+    return 1;
+}
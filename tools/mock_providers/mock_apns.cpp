@@ -0,0 +1,611 @@
+//
+//  mock_apns.cpp
+//  pushy-mock-providers
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "mock_apns.hpp"
+
+#include <ctime>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+namespace mock
+{
+    namespace
+    {
+        typedef io::ssl::stream<io::ip::tcp::socket> ssl_socket;
+        
+        const std::size_t token_size = 32;
+        const std::size_t max_payload = 2048;
+        
+        uint32_t get32(const std::string& s, std::size_t at)
+        {
+            return (uint32_t(uint8_t(s[at])) << 24) | (uint32_t(uint8_t(s[at + 1])) << 16)
+                | (uint32_t(uint8_t(s[at + 2])) << 8) | uint32_t(uint8_t(s[at + 3]));
+        }
+        
+        uint16_t get16(const std::string& s, std::size_t at)
+        {
+            return static_cast<uint16_t>((uint8_t(s[at]) << 8) | uint8_t(s[at + 1]));
+        }
+        
+        void put32(std::string& out, uint32_t v)
+        {
+            out.push_back(static_cast<char>((v >> 24) & 0xff));
+            out.push_back(static_cast<char>((v >> 16) & 0xff));
+            out.push_back(static_cast<char>((v >> 8) & 0xff));
+            out.push_back(static_cast<char>(v & 0xff));
+        }
+        
+        int unhex(char c)
+        {
+            if(c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            
+            c = static_cast<char>(std::tolower(c));
+            if(c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            
+            return -1;
+        }
+        
+        /**
+         * One notification as found on the wire. Frames of command 2 carry items, the
+         * older commands 0 and 1 fixed fields.
+         */
+        struct notification
+        {
+            notification()
+            : command(0)
+            , ident(0)
+            , payload_size(0)
+            {
+            }
+            
+            uint8_t     command;
+            uint32_t    ident;
+            std::string token;
+            std::size_t payload_size;
+        };
+        
+        enum parse_result
+        {
+            parse_incomplete,
+            parse_ok,
+            parse_bad_command
+        };
+        
+        parse_result parse(const std::string& buf, std::size_t& at, notification& n)
+        {
+            auto left = buf.size() - at;
+            if(!left)
+            {
+                return parse_incomplete;
+            }
+            
+            n = notification();
+            n.command = static_cast<uint8_t>(buf[at]);
+            
+            if(n.command == 2)
+            {
+                if(left < 5 || left < 5 + get32(buf, at + 1))
+                {
+                    return parse_incomplete;
+                }
+                
+                auto end = at + 5 + get32(buf, at + 1);
+                auto item = at + 5;
+                
+                while(item + 3 <= end)
+                {
+                    auto id = static_cast<uint8_t>(buf[item]);
+                    auto length = get16(buf, item + 1);
+                    auto data = item + 3;
+                    
+                    if(data + length > end)
+                    {
+                        break;
+                    }
+                    
+                    if(id == 1)
+                    {
+                        n.token = buf.substr(data, length);
+                    }
+                    else if(id == 2)
+                    {
+                        n.payload_size = length;
+                    }
+                    else if(id == 3 && length == 4)
+                    {
+                        n.ident = get32(buf, data);
+                    }
+                    
+                    item = data + length;
+                }
+                
+                at = end;
+                return parse_ok;
+            }
+            
+            if(n.command == 0 || n.command == 1)
+            {
+                // [1 ident expiry] token length, token, payload length, payload
+                std::size_t head = n.command == 1 ? 9 : 1;
+                
+                if(left < head + 2 || left < head + 2 + get16(buf, at + head) + 2)
+                {
+                    return parse_incomplete;
+                }
+                
+                auto token_length = get16(buf, at + head);
+                auto payload_at = at + head + 2 + token_length;
+                auto payload_length = get16(buf, payload_at);
+                
+                if(left < head + 2 + token_length + 2 + payload_length)
+                {
+                    return parse_incomplete;
+                }
+                
+                n.ident = n.command == 1 ? get32(buf, at + 1) : 0;
+                n.token = buf.substr(at + head + 2, token_length);
+                n.payload_size = payload_length;
+                
+                at = payload_at + 2 + payload_length;
+                return parse_ok;
+            }
+            
+            return parse_bad_command;
+        }
+    }
+    
+    void feedback_store::retire(const std::string& token)
+    {
+        entry e;
+        
+        e.time = static_cast<uint32_t>(std::time(NULL));
+        e.token = token;
+        
+        pending.push_back(e);
+    }
+    
+    std::size_t feedback_store::inject(const std::string& file)
+    {
+        std::ifstream in(file.c_str());
+        if(!in)
+        {
+            throw std::runtime_error("can't open feedback token file '" + file + "'");
+        }
+        
+        std::size_t count = 0;
+        std::string line;
+        
+        while(std::getline(in, line))
+        {
+            boost::trim(line);
+            if(line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            
+            if(line.size() % 2)
+            {
+                throw std::runtime_error("bad hex token '" + line + "' in " + file);
+            }
+            
+            std::string token;
+            for(std::size_t i = 0; i < line.size(); i += 2)
+            {
+                auto hi = unhex(line[i]);
+                auto lo = unhex(line[i + 1]);
+                
+                if(hi < 0 || lo < 0)
+                {
+                    throw std::runtime_error("bad hex token '" + line + "' in " + file);
+                }
+                
+                token.push_back(static_cast<char>(hi * 16 + lo));
+            }
+            
+            retire(token);
+            ++count;
+        }
+        
+        return count;
+    }
+    
+    /**
+     * One gateway connection. Frames are processed in the order they came in; a
+     * throttled or delayed connection stops reading, which backs the client up.
+     */
+    class apns_server::session
+    : public boost::enable_shared_from_this<apns_server::session>
+    {
+    public:
+        session(io::io_service& io, io::ssl::context& ctx, const apns_settings& cfg,
+                feedback_store& store, apns_counters& stats)
+        : socket_(io, ctx)
+        , timer_(io)
+        , linger_(io)
+        , cfg_(cfg)
+        , store_(store)
+        , stats_(stats)
+        , throttle_(cfg.rate)
+        , failed_(false)
+        , rng_(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)))
+        {
+        }
+        
+        ssl_socket::lowest_layer_type& socket()
+        {
+            return socket_.lowest_layer();
+        }
+        
+        void start()
+        {
+            socket_.async_handshake(ssl_socket::server,
+                boost::bind(&session::on_handshake, shared_from_this(), io::placeholders::error) );
+        }
+    
+    private:
+        void on_handshake(const boost::system::error_code& err)
+        {
+            if(!err)
+            {
+                read();
+            }
+        }
+        
+        void read()
+        {
+            socket_.async_read_some(io::buffer(read_buf_),
+                boost::bind(&session::on_read, shared_from_this(),
+                    io::placeholders::error, io::placeholders::bytes_transferred) );
+        }
+        
+        void on_read(const boost::system::error_code& err, std::size_t bytes)
+        {
+            if(err)
+            {
+                close();
+                return;
+            }
+            
+            if(failed_)
+            {
+                // apple ignores everything after an error response
+                read();
+                return;
+            }
+            
+            pending_.append(read_buf_.data(), bytes);
+            
+            if(cfg_.delay.zero())
+            {
+                process();
+                return;
+            }
+            
+            timer_.expires_from_now(boost::posix_time::microseconds(
+                static_cast<int64_t>(cfg_.delay.sample(rng_) * 1000)));
+            timer_.async_wait(
+                boost::bind(&session::on_timer, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_timer(const boost::system::error_code& err)
+        {
+            if(!err)
+            {
+                process();
+            }
+        }
+        
+        void process()
+        {
+            std::size_t at = 0;
+            notification n;
+            
+            while(true)
+            {
+                auto next = at;
+                auto result = parse(pending_, next, n);
+                
+                if(result == parse_incomplete)
+                {
+                    break;
+                }
+                
+                if(result == parse_bad_command)
+                {
+                    reject(1, 0);
+                    return;
+                }
+                
+                if(!throttle_.take())
+                {
+                    // carry on with this frame once the bucket refilled
+                    pending_.erase(0, at);
+                    
+                    timer_.expires_from_now(throttle_.wait());
+                    timer_.async_wait(
+                        boost::bind(&session::on_timer, shared_from_this(), io::placeholders::error) );
+                    return;
+                }
+                
+                at = next;
+                ++stats_.frames;
+                
+                auto status = verdict(n);
+                if(status)
+                {
+                    reject(status, n.ident);
+                    return;
+                }
+                
+                if(dice_(rng_) < cfg_.drop)
+                {
+                    ++stats_.drops;
+                    close();
+                    return;
+                }
+            }
+            
+            pending_.erase(0, at);
+            read();
+        }
+        
+        // status of the error response for the notification, 0 if it goes through
+        uint8_t verdict(const notification& n)
+        {
+            if(n.token.empty())
+            {
+                return 2;
+            }
+            
+            if(n.token.size() != token_size)
+            {
+                return 5;
+            }
+            
+            if(!n.payload_size)
+            {
+                return 4;
+            }
+            
+            if(n.payload_size > max_payload)
+            {
+                return 7;
+            }
+            
+            if(store_.dead.count(n.token))
+            {
+                return 8;
+            }
+            
+            auto dice = dice_(rng_);
+            
+            if(dice < cfg_.invalid_token)
+            {
+                store_.dead.insert(n.token);
+                store_.retire(n.token);
+                
+                return 8;
+            }
+            
+            if(dice < cfg_.invalid_token + cfg_.processing_error)
+            {
+                return 1;
+            }
+            
+            if(dice_(rng_) < cfg_.retire)
+            {
+                store_.retire(n.token);
+            }
+            
+            return 0;
+        }
+        
+        void reject(uint8_t status, uint32_t ident)
+        {
+            ++stats_.errors;
+            failed_ = true;
+            pending_.clear();
+            
+            reply_.assign(1, 8);
+            reply_.push_back(static_cast<char>(status));
+            put32(reply_, ident);
+            
+            io::async_write(socket_, io::buffer(reply_),
+                boost::bind(&session::on_reject, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_reject(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                close();
+                return;
+            }
+            
+            // half close so the client sees the response and then eof; drain whatever it
+            // still writes so the close doesn't turn into a reset that eats the response
+            boost::system::error_code ignored;
+            socket_.lowest_layer().shutdown(io::ip::tcp::socket::shutdown_send, ignored);
+            
+            linger_.expires_from_now(boost::posix_time::seconds(2));
+            linger_.async_wait(boost::bind(&session::close, shared_from_this()));
+            
+            read();
+        }
+        
+        void close()
+        {
+            boost::system::error_code ignored;
+            
+            timer_.cancel(ignored);
+            linger_.cancel(ignored);
+            socket_.lowest_layer().close(ignored);
+        }
+        
+        ssl_socket                  socket_;
+        io::deadline_timer          timer_;
+        io::deadline_timer          linger_;
+        const apns_settings&        cfg_;
+        feedback_store&             store_;
+        apns_counters&              stats_;
+        throttle                    throttle_;
+        bool                        failed_;
+        
+        boost::array<char, 65536>   read_buf_;
+        std::string                 pending_;
+        std::string                 reply_;
+        
+        rng_type                                    rng_;
+        boost::random::uniform_real_distribution<>  dice_;
+    };
+    
+    apns_server::apns_server(io::io_service& io, unsigned short port, io::ssl::context& ctx,
+                             const apns_settings& cfg, feedback_store& store, apns_counters& stats)
+    : io_(io)
+    , ctx_(ctx)
+    , cfg_(cfg)
+    , store_(store)
+    , stats_(stats)
+    , acceptor_(io, io::ip::tcp::endpoint(io::ip::tcp::v4(), port))
+    {
+        accept();
+    }
+    
+    void apns_server::accept()
+    {
+        boost::shared_ptr<session> s(new session(io_, ctx_, cfg_, store_, stats_));
+        
+        acceptor_.async_accept(s->socket(),
+            boost::bind(&apns_server::on_accept, this, s, io::placeholders::error) );
+    }
+    
+    void apns_server::on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            ++stats_.connections;
+            
+            s->socket().set_option(io::ip::tcp::no_delay(true));
+            s->start();
+        }
+        
+        accept();
+    }
+    
+    /**
+     * One feedback connection: everything pending is written out, then it's closed.
+     */
+    class feedback_server::session
+    : public boost::enable_shared_from_this<feedback_server::session>
+    {
+    public:
+        session(io::io_service& io, io::ssl::context& ctx, feedback_store& store, apns_counters& stats)
+        : socket_(io, ctx)
+        , store_(store)
+        , stats_(stats)
+        {
+        }
+        
+        ssl_socket::lowest_layer_type& socket()
+        {
+            return socket_.lowest_layer();
+        }
+        
+        void start()
+        {
+            socket_.async_handshake(ssl_socket::server,
+                boost::bind(&session::on_handshake, shared_from_this(), io::placeholders::error) );
+        }
+    
+    private:
+        void on_handshake(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                return;
+            }
+            
+            // tokens taken now are gone even if the write fails, as with apple
+            for(auto& e : store_.pending)
+            {
+                put32(buf_, e.time);
+                buf_.push_back(static_cast<char>((e.token.size() >> 8) & 0xff));
+                buf_.push_back(static_cast<char>(e.token.size() & 0xff));
+                buf_ += e.token;
+            }
+            
+            stats_.feedback += store_.pending.size();
+            store_.pending.clear();
+            
+            io::async_write(socket_, io::buffer(buf_),
+                boost::bind(&session::on_write, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_write(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                return;
+            }
+            
+            socket_.async_shutdown(
+                boost::bind(&session::on_shutdown, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_shutdown(const boost::system::error_code&)
+        {
+            boost::system::error_code ignored;
+            socket_.lowest_layer().close(ignored);
+        }
+        
+        ssl_socket          socket_;
+        feedback_store&     store_;
+        apns_counters&      stats_;
+        std::string         buf_;
+    };
+    
+    feedback_server::feedback_server(io::io_service& io, unsigned short port, io::ssl::context& ctx,
+                                     feedback_store& store, apns_counters& stats)
+    : io_(io)
+    , ctx_(ctx)
+    , store_(store)
+    , stats_(stats)
+    , acceptor_(io, io::ip::tcp::endpoint(io::ip::tcp::v4(), port))
+    {
+        accept();
+    }
+    
+    void feedback_server::accept()
+    {
+        boost::shared_ptr<session> s(new session(io_, ctx_, store_, stats_));
+        
+        acceptor_.async_accept(s->socket(),
+            boost::bind(&feedback_server::on_accept, this, s, io::placeholders::error) );
+    }
+    
+    void feedback_server::on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            s->start();
+        }
+        
+        accept();
+    }
+}
@@ -0,0 +1,134 @@
+//
+//  mock_apns.hpp
+//  pushy-mock-providers
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy_mock__mock_apns__
+#define __pushy_mock__mock_apns__
+
+#include <set>
+#include <deque>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "faults.hpp"
+
+namespace mock
+{
+    namespace io = boost::asio;
+    
+    struct apns_settings
+    {
+        apns_settings()
+        : rate(0)
+        , invalid_token(0)
+        , processing_error(0)
+        , drop(0)
+        , retire(0)
+        {
+        }
+        
+        latency     delay;              // before each chunk read from a connection is processed
+        uint32_t    rate;               // frames per second per connection; reading stalls beyond it
+        double      invalid_token;      // share of frames answered with status 8; the token turns dead
+        double      processing_error;   // share of frames answered with status 1
+        double      drop;               // share of frames after which the connection is cut silently
+        double      retire;             // share of delivered tokens reported by the feedback service later
+    };
+    
+    /**
+     * Tokens for the feedback service and the tokens apns considers dead. Shared by
+     * the gateway and the feedback server; both run on the same io service thread.
+     */
+    struct feedback_store
+    {
+        struct entry
+        {
+            uint32_t    time;
+            std::string token;
+        };
+        
+        /// queues the token for the next feedback connection
+        void retire(const std::string& token);
+        
+        /// loads hex tokens, one per line; returns how many were queued
+        std::size_t inject(const std::string& file);
+        
+        std::deque<entry>       pending;
+        std::set<std::string>   dead;       // answered invalid_token from now on
+    };
+    
+    struct apns_counters
+    {
+        apns_counters()
+        : connections(0)
+        , frames(0)
+        , errors(0)
+        , drops(0)
+        , feedback(0)
+        {
+        }
+        
+        uint64_t connections;
+        uint64_t frames;
+        uint64_t errors;    // error responses sent
+        uint64_t drops;     // connections cut on purpose
+        uint64_t feedback;  // tokens handed out by the feedback service
+    };
+    
+    /**
+     * Binary protocol gateway (commands 1 and 2) over TLS. Successful frames get no
+     * answer, as with apple; a failing one gets an error response after which the
+     * connection is closed once the client stops writing.
+     */
+    class apns_server
+    {
+    public:
+        apns_server(io::io_service& io, unsigned short port, io::ssl::context& ctx,
+                    const apns_settings& cfg, feedback_store& store, apns_counters& stats);
+    
+    private:
+        class session;
+        
+        void accept();
+        void on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err);
+        
+        io::io_service&         io_;
+        io::ssl::context&       ctx_;
+        const apns_settings&    cfg_;
+        feedback_store&         store_;
+        apns_counters&          stats_;
+        io::ip::tcp::acceptor   acceptor_;
+    };
+    
+    /**
+     * Feedback service over TLS: writes every pending (time, token) tuple to whoever
+     * connects and closes the connection.
+     */
+    class feedback_server
+    {
+    public:
+        feedback_server(io::io_service& io, unsigned short port, io::ssl::context& ctx,
+                        feedback_store& store, apns_counters& stats);
+    
+    private:
+        class session;
+        
+        void accept();
+        void on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err);
+        
+        io::io_service&         io_;
+        io::ssl::context&       ctx_;
+        feedback_store&         store_;
+        apns_counters&          stats_;
+        io::ip::tcp::acceptor   acceptor_;
+    };
+}
+
+#endif /* defined(__pushy_mock__mock_apns__) */
@@ -0,0 +1,274 @@
+//
+//  mock_gcm.cpp
+//  pushy-mock-providers
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#include "mock_gcm.hpp"
+
+#include <istream>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <json_spirit/json_spirit_reader_template.h>
+#include <json_spirit/json_spirit_writer_template.h>
+
+namespace mock
+{
+    class gcm_server::session
+    : public boost::enable_shared_from_this<gcm_server::session>
+    {
+    public:
+        session(io::io_service& io, const gcm_settings& cfg, gcm_counters& stats,
+                throttle& limit, std::set<std::string>& gone)
+        : socket_(io)
+        , timer_(io)
+        , cfg_(cfg)
+        , stats_(stats)
+        , throttle_(limit)
+        , gone_(gone)
+        , rng_(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)))
+        {
+        }
+        
+        io::ip::tcp::socket& socket()
+        {
+            return socket_;
+        }
+        
+        void start()
+        {
+            io::async_read_until(socket_, buf_, "\r\n\r\n",
+                boost::bind(&session::on_headers, shared_from_this(), io::placeholders::error) );
+        }
+    
+    private:
+        void on_headers(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                return;
+            }
+            
+            std::istream in(&buf_);
+            std::string line;
+            std::getline(in, line);
+            
+            std::size_t length = 0;
+            authorization_.clear();
+            
+            while(std::getline(in, line) && line != "\r")
+            {
+                auto colon = line.find(':');
+                if(colon == std::string::npos)
+                {
+                    continue;
+                }
+                
+                auto name = boost::to_lower_copy(line.substr(0, colon));
+                auto value = boost::trim_copy(line.substr(colon + 1));
+                
+                if(name == "content-length")
+                {
+                    length = boost::lexical_cast<std::size_t>(value);
+                }
+                else if(name == "authorization")
+                {
+                    authorization_ = value;
+                }
+            }
+            
+            auto more = length > buf_.size() ? length - buf_.size() : 0;
+            
+            io::async_read(socket_, buf_, io::transfer_at_least(more),
+                boost::bind(&session::on_body, shared_from_this(), length, io::placeholders::error) );
+        }
+        
+        void on_body(std::size_t length, const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                return;
+            }
+            
+            std::string body(io::buffers_begin(buf_.data()), io::buffers_begin(buf_.data()) + length);
+            buf_.consume(length);
+            
+            reply_ = answer(body);
+            
+            if(cfg_.delay.zero())
+            {
+                on_delay(boost::system::error_code());
+                return;
+            }
+            
+            timer_.expires_from_now(boost::posix_time::microseconds(
+                static_cast<int64_t>(cfg_.delay.sample(rng_) * 1000)));
+            timer_.async_wait(
+                boost::bind(&session::on_delay, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_delay(const boost::system::error_code& err)
+        {
+            if(err)
+            {
+                return;
+            }
+            
+            io::async_write(socket_, io::buffer(reply_),
+                boost::bind(&session::on_write, shared_from_this(), io::placeholders::error) );
+        }
+        
+        void on_write(const boost::system::error_code& err)
+        {
+            if(!err)
+            {
+                // keep-alive; wait for the next request
+                start();
+            }
+        }
+        
+        std::string answer(const std::string& body)
+        {
+            ++stats_.requests;
+            
+            if(!cfg_.api_key.empty() && authorization_ != "key=" + cfg_.api_key)
+            {
+                ++stats_.errors;
+                return response("401 Unauthorized", "Unauthorized");
+            }
+            
+            json_spirit::Value v;
+            const json_spirit::Array* ids = NULL;
+            
+            if(json_spirit::read_string(body, v) && v.type() == json_spirit::obj_type)
+            {
+                for(auto& entry : v.get_obj())
+                {
+                    if(entry.name_ == "registration_ids" && entry.value_.type() == json_spirit::array_type)
+                    {
+                        ids = &entry.value_.get_array();
+                    }
+                }
+            }
+            
+            if(!ids || ids->empty() || ids->size() > 1000)
+            {
+                ++stats_.errors;
+                return response("400 Bad Request", "bad registration_ids");
+            }
+            
+            if(!throttle_.take(static_cast<uint32_t>(ids->size())))
+            {
+                ++stats_.throttled;
+                return response("503 Service Unavailable", "Unavailable", "text/plain", "Retry-After: 1\r\n");
+            }
+            
+            if(dice_(rng_) < cfg_.failures)
+            {
+                ++stats_.errors;
+                return response("500 Internal Server Error", "Internal Server Error");
+            }
+            
+            json_spirit::Array results;
+            uint64_t success = 0;
+            uint64_t failure = 0;
+            
+            for(std::size_t i = 0; i < ids->size(); ++i)
+            {
+                json_spirit::Object result;
+                
+                auto id = (*ids)[i].type() == json_spirit::str_type ? (*ids)[i].get_str() : std::string();
+                auto dice = dice_(rng_);
+                
+                if(gone_.count(id) || dice < cfg_.not_registered)
+                {
+                    gone_.insert(id);
+                    
+                    result.push_back( json_spirit::Pair("error", "NotRegistered") );
+                    ++failure;
+                }
+                else if(dice < cfg_.not_registered + cfg_.unavailable)
+                {
+                    result.push_back( json_spirit::Pair("error", "Unavailable") );
+                    ++failure;
+                }
+                else
+                {
+                    result.push_back( json_spirit::Pair("message_id",
+                        "0:" + boost::lexical_cast<std::string>(stats_.ids + i)) );
+                    ++success;
+                }
+                
+                results.push_back(result);
+            }
+            
+            stats_.ids += ids->size();
+            
+            json_spirit::Object obj;
+            obj.push_back( json_spirit::Pair("multicast_id", stats_.requests) );
+            obj.push_back( json_spirit::Pair("success", success) );
+            obj.push_back( json_spirit::Pair("failure", failure) );
+            obj.push_back( json_spirit::Pair("canonical_ids", 0) );
+            obj.push_back( json_spirit::Pair("results", results) );
+            
+            return response("200 OK", json_spirit::write_string(json_spirit::Value(obj), false),
+                            "application/json");
+        }
+        
+        static std::string response(const std::string& status, const std::string& body,
+                                    const std::string& type = "text/plain",
+                                    const std::string& headers = std::string())
+        {
+            return "HTTP/1.1 " + status + "\r\n"
+                "Content-Type: " + type + "\r\n"
+                "Content-Length: " + boost::lexical_cast<std::string>(body.size()) + "\r\n"
+                + headers + "\r\n" + body;
+        }
+        
+        io::ip::tcp::socket     socket_;
+        io::deadline_timer      timer_;
+        const gcm_settings&     cfg_;
+        gcm_counters&           stats_;
+        throttle&               throttle_;
+        std::set<std::string>&  gone_;
+        io::streambuf           buf_;
+        std::string             authorization_;
+        std::string             reply_;
+        
+        rng_type                                    rng_;
+        boost::random::uniform_real_distribution<>  dice_;
+    };
+    
+    gcm_server::gcm_server(io::io_service& io, unsigned short port, const gcm_settings& cfg, gcm_counters& stats)
+    : io_(io)
+    , cfg_(cfg)
+    , stats_(stats)
+    , throttle_(cfg.rate)
+    , acceptor_(io, io::ip::tcp::endpoint(io::ip::tcp::v4(), port))
+    {
+        accept();
+    }
+    
+    void gcm_server::accept()
+    {
+        boost::shared_ptr<session> s(new session(io_, cfg_, stats_, throttle_, gone_));
+        
+        acceptor_.async_accept(s->socket(),
+            boost::bind(&gcm_server::on_accept, this, s, io::placeholders::error) );
+    }
+    
+    void gcm_server::on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            s->socket().set_option(io::ip::tcp::no_delay(true));
+            s->start();
+        }
+        
+        accept();
+    }
+}
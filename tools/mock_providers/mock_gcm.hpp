@@ -0,0 +1,82 @@
+//
+//  mock_gcm.hpp
+//  pushy-mock-providers
+//
+//  Created by godexsoft on 19/10/2026.
+//  Copyright (c) 2026 godexsoft. All rights reserved.
+//
+
+#ifndef __pushy_mock__mock_gcm__
+#define __pushy_mock__mock_gcm__
+
+#include <set>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/asio.hpp>
+
+#include "faults.hpp"
+
+namespace mock
+{
+    namespace io = boost::asio;
+    
+    struct gcm_settings
+    {
+        gcm_settings()
+        : rate(0)
+        , not_registered(0)
+        , unavailable(0)
+        , failures(0)
+        {
+        }
+        
+        latency     delay;          // before each reply
+        uint32_t    rate;           // registration ids per second; requests beyond get http 503
+        std::string api_key;        // required in the Authorization header if set
+        double      not_registered; // share of registration ids answered NotRegistered; the id stays gone
+        double      unavailable;    // share of registration ids answered Unavailable
+        double      failures;       // share of requests answered with http 500
+    };
+    
+    struct gcm_counters
+    {
+        gcm_counters()
+        : requests(0)
+        , ids(0)
+        , errors(0)
+        , throttled(0)
+        {
+        }
+        
+        uint64_t requests;
+        uint64_t ids;
+        uint64_t errors;    // requests failed as a whole
+        uint64_t throttled; // requests answered 503 by the rate limit
+    };
+    
+    /**
+     * Plain HTTP stand-in for the GCM send endpoint. Answers every request, single or
+     * multicast, with one result per registration id over a keep-alive connection.
+     */
+    class gcm_server
+    {
+    public:
+        gcm_server(io::io_service& io, unsigned short port, const gcm_settings& cfg, gcm_counters& stats);
+    
+    private:
+        class session;
+        
+        void accept();
+        void on_accept(boost::shared_ptr<session> s, const boost::system::error_code& err);
+        
+        io::io_service&         io_;
+        const gcm_settings&     cfg_;
+        gcm_counters&           stats_;
+        throttle                throttle_;  // shared by all connections
+        std::set<std::string>   gone_;      // answered NotRegistered from now on
+        io::ip::tcp::acceptor   acceptor_;
+    };
+}
+
+#endif /* defined(__pushy_mock__mock_gcm__) */